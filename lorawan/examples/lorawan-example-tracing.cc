@@ -858,9 +858,8 @@ LoRaWANExampleTracing::CalculateDataRateIndexPER (Ptr<Application> endDeviceApp)
   }
 
 
-  LoRaWANSpectrumValueHelper psdHelper;
   const uint32_t freq = LoRaWAN::m_supportedChannels [0].m_fc;
-  Ptr<const SpectrumValue> noise = psdHelper.CreateNoisePowerSpectralDensity (freq);
+  Ptr<const SpectrumValue> noise = LoRaWANSpectrumValueHelper::GetNoisePowerSpectralDensity (0);
 
   double maxRxPowerLinear = pow (10.0, maxRxPowerdBm / 10.0) / 1000.0; // in Watts
   const double noisePowerLinear = LoRaWANSpectrumValueHelper::TotalAvgPower (noise, freq); // in Watts
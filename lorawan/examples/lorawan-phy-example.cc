@@ -27,6 +27,7 @@
 #include <ns3/simulator.h>
 #include <ns3/single-model-spectrum-channel.h>
 #include <ns3/constant-position-mobility-model.h>
+#include <ns3/boolean.h>
 
 using namespace ns3;
 
@@ -42,14 +43,17 @@ ReceivePdDataIndication (uint32_t psduLength,
                          uint8_t lqi,
                          uint8_t channelIndex,
                          uint8_t dataRateIndex,
-                         uint8_t codeRate)
+                         uint8_t codeRate,
+                         LoRaWANRxMetadata rxMetadata)
 {
   NS_LOG_UNCOND ("At: " << Simulator::Now ()
                         << " Received frame size: " << psduLength
                         << " LQI: " << (uint16_t) lqi
                         << " channelIndex: " << (uint16_t) channelIndex
                         << " dataRateIndex: " << (uint16_t) dataRateIndex
-                        << " codeRate: " << (uint16_t) codeRate);
+                        << " codeRate: " << (uint16_t) codeRate
+                        << " RSSI: " << rxMetadata.m_rssi << "dBm"
+                        << " SNR: " << rxMetadata.m_snr << "dB");
 }
 
 void SendOnePacket (Ptr<LoRaWANPhy> sender, Ptr<LoRaWANPhy> receiver)
@@ -74,6 +78,7 @@ int main (int argc, char *argv[])
 
   Ptr<LoRaWANPhy> sender = CreateObject<LoRaWANPhy> ();
   Ptr<LoRaWANPhy> receiver = CreateObject<LoRaWANPhy> ();
+  receiver->SetAttribute ("InvertedIq", BooleanValue (true)); // the receiver is a gateway
 
   Ptr<SingleModelSpectrumChannel> channel = CreateObject<SingleModelSpectrumChannel> ();
   sender->SetChannel (channel);
@@ -20,6 +20,8 @@
 
 #include "lorawan-helper.h"
 #include <ns3/lorawan-net-device.h>
+#include <ns3/lorawan-spectrum-channel.h>
+#include <ns3/lorawan-collision-channel.h>
 #include <ns3/simulator.h>
 #include <ns3/mobility-model.h>
 #include <ns3/single-model-spectrum-channel.h>
@@ -33,18 +35,20 @@ namespace ns3 {
 NS_LOG_COMPONENT_DEFINE ("LoRaWANHelper");
 
 /* ... */
-LoRaWANHelper::LoRaWANHelper (void) : m_deviceType (LORAWAN_DT_END_DEVICE)
+LoRaWANHelper::LoRaWANHelper (void) : m_deviceType (LORAWAN_DT_END_DEVICE), m_gatewayDemodulators (0), m_collisionModel (false)
 {
-  m_channel = CreateObject<SingleModelSpectrumChannel> ();
+  Ptr<LoRaWANSpectrumChannel> channel = CreateObject<LoRaWANSpectrumChannel> ();
 
   Ptr<LogDistancePropagationLossModel> lossModel = CreateObject<LogDistancePropagationLossModel> ();
-  m_channel->AddPropagationLossModel (lossModel);
+  channel->AddPropagationLossModel (lossModel);
 
   Ptr<ConstantSpeedPropagationDelayModel> delayModel = CreateObject<ConstantSpeedPropagationDelayModel> ();
-  m_channel->SetPropagationDelayModel (delayModel);
+  channel->SetPropagationDelayModel (delayModel);
+
+  m_channel = channel;
 }
 
-LoRaWANHelper::LoRaWANHelper (bool useMultiModelSpectrumChannel) : m_deviceType (LORAWAN_DT_END_DEVICE)
+LoRaWANHelper::LoRaWANHelper (bool useMultiModelSpectrumChannel) : m_deviceType (LORAWAN_DT_END_DEVICE), m_gatewayDemodulators (0), m_collisionModel (false)
 {
   if (useMultiModelSpectrumChannel)
     {
@@ -85,6 +89,27 @@ LoRaWANHelper::SetNbRep (uint8_t nbRep)
   m_nbRep = nbRep;
 }
 
+void
+LoRaWANHelper::SetGatewayDemodulators (uint32_t nDemodulators)
+{
+  m_gatewayDemodulators = nDemodulators;
+}
+
+void
+LoRaWANHelper::UseCollisionModel (void)
+{
+  Ptr<LoRaWANCollisionChannel> channel = CreateObject<LoRaWANCollisionChannel> ();
+
+  Ptr<LogDistancePropagationLossModel> lossModel = CreateObject<LogDistancePropagationLossModel> ();
+  channel->AddPropagationLossModel (lossModel);
+
+  Ptr<ConstantSpeedPropagationDelayModel> delayModel = CreateObject<ConstantSpeedPropagationDelayModel> ();
+  channel->SetPropagationDelayModel (delayModel);
+
+  m_channel = channel;
+  m_collisionModel = true;
+}
+
 void
 LoRaWANHelper::EnableLogComponents (enum LogLevel level)
 {
@@ -94,13 +119,19 @@ LoRaWANHelper::EnableLogComponents (enum LogLevel level)
 
   LogComponentEnable ("LoRaWANSpectrumValueHelper", level);
   LogComponentEnable ("LoRaWANPhy", level);
+  LogComponentEnable ("LoRaWANGatewayPhy", level);
+  LogComponentEnable ("LoRaWANCollisionPhy", level);
   LogComponentEnable ("LoRaWANGatewayApplication", level);
   LogComponentEnable ("LoRaWANErrorModel", level);
   LogComponentEnable ("LoRaWANMac", level);
   LogComponentEnable ("LoRaWANNetDevice", level);
+  LogComponentEnable ("LoRaWANRadioArbiter", level);
   LogComponentEnable ("LoRaWANInterferenceHelper", level);
   LogComponentEnable ("LoRaWANSpectrumSignalParameters", level);
+  LogComponentEnable ("LoRaWANSpectrumChannel", level);
+  LogComponentEnable ("LoRaWANCollisionChannel", level);
   LogComponentEnable ("LoRaWANEndDeviceApplication", level);
+  LogComponentEnable ("LoRaWANClassBPingOffsetCalculator", level);
   LogComponentEnable ("LoRaWANFrameHeader", level);
 }
 
@@ -113,7 +144,7 @@ LoRaWANHelper::Install (NodeContainer c)
     {
       Ptr<Node> node = *i;
 
-      Ptr<LoRaWANNetDevice> netDevice = CreateObject<LoRaWANNetDevice> (m_deviceType);
+      Ptr<LoRaWANNetDevice> netDevice = CreateObject<LoRaWANNetDevice> (m_deviceType, m_gatewayDemodulators, m_collisionModel);
 
       netDevice->SetChannel (m_channel); // will also set channel on underlying phy(s)
       netDevice->SetNode (node);
@@ -41,8 +41,10 @@ class LoRaWANHelper {
 public:
   /**
    * \brief Create a LoRaWAN helper in an empty state.  By default, a
-   * SingleModelSpectrumChannel is created, with a 
+   * LoRaWANSpectrumChannel is created, with a
    * LogDistancePropagationLossModel and a ConstantSpeedPropagationDelayModel.
+   * The LoRaWANSpectrumChannel only delivers transmissions to the PHYs that
+   * are tuned to the channel of the transmission.
    *
    * To change the channel type, loss model, or delay model, the Get/Set
    * Channel methods may be used.
@@ -96,6 +98,28 @@ public:
    */
   void SetNbRep (uint8_t rep);
 
+  /**
+   * \brief Set the number of demodulators of the gateways created by this helper.
+   *
+   * When set to a value larger than zero, gateways use a single
+   * LoRaWANGatewayPhy with the given number of demodulators and a single MAC,
+   * instead of a LoRaWANPhy and LoRaWANMac per channel and data rate (the
+   * default, 0).
+   */
+  void SetGatewayDemodulators (uint32_t nDemodulators);
+
+  /**
+   * \brief Use the collision model for the devices created by this helper.
+   *
+   * The channel of the helper is replaced by a LoRaWANCollisionChannel, with
+   * a LogDistancePropagationLossModel and a ConstantSpeedPropagationDelayModel,
+   * and devices are created with LoRaWANCollisionPhy objects. The collision
+   * model decides on receptions from overlapping frames, their received power
+   * and a capture threshold, which is much faster than the SINR based
+   * LoRaWANPhy for very large networks.
+   */
+  void UseCollisionModel (void);
+
   /**
    * \brief Install a LoRaWANNetDevice and the associated structures (e.g., channel) in the nodes.
    * \param c a set of nodes
@@ -133,6 +157,8 @@ private:
   Ptr<SpectrumChannel> m_channel; //!< channel to be used for the devices
   LoRaWANDeviceType m_deviceType; //!< the device type to use when creating new LoRaWANNetDevice objects
   uint8_t m_nbRep; //!< number of repetitions for unconfirmed us data (only for end devices)
+  uint32_t m_gatewayDemodulators; //!< number of demodulators of a gateway, 0 for a PHY per channel and data rate
+  bool m_collisionModel; //!< create LoRaWANCollisionPhy objects instead of LoRaWANPhy objects
 };
 
 }
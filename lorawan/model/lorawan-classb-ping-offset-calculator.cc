@@ -0,0 +1,156 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include "lorawan-classb-ping-offset-calculator.h"
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "ns3/singleton.h"
+#include <cstring>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LoRaWANClassBPingOffsetCalculator");
+
+static const uint32_t BEACON_PERIOD_SECONDS = 128;
+
+LoRaWANClassBPingOffsetCalculator::LoRaWANClassBPingOffsetCalculator (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+LoRaWANClassBPingOffsetCalculator*
+LoRaWANClassBPingOffsetCalculator::Get (void)
+{
+  return Singleton<LoRaWANClassBPingOffsetCalculator>::Get ();
+}
+
+uint16_t
+LoRaWANClassBPingOffsetCalculator::GetPingOffset (Time beaconTime, Ipv4Address devAddr, uint8_t pingSlots, const uint8_t key[16])
+{
+  NS_LOG_FUNCTION (this << beaconTime << devAddr << (uint32_t)pingSlots);
+
+  const uint32_t beaconSecs = (uint32_t) beaconTime.GetSeconds ();
+  KeyState &state = GetKeyState (key, beaconSecs);
+  BeaconPeriodCache &cache = state.periods[beaconSecs];
+
+  BeaconPeriodCache::const_iterator it = cache.find (devAddr.Get ());
+  if (it != cache.end ())
+    return ToPingOffset (it->second, pingSlots);
+
+  uint8_t block[16];
+  FillBlock (block, beaconSecs, devAddr);
+  state.aes.Encrypt (block, 16);
+
+  const uint16_t rand = block[0] + block[1]*256;
+  cache[devAddr.Get ()] = rand;
+  return ToPingOffset (rand, pingSlots);
+}
+
+void
+LoRaWANClassBPingOffsetCalculator::GetPingOffsets (Time beaconTime, const std::vector<Ipv4Address> &devAddrs, const std::vector<uint8_t> &pingSlots, const uint8_t key[16], std::vector<uint16_t> &offsets)
+{
+  NS_LOG_FUNCTION (this << beaconTime << devAddrs.size ());
+  NS_ASSERT (devAddrs.size () == pingSlots.size ());
+
+  const uint32_t beaconSecs = (uint32_t) beaconTime.GetSeconds ();
+  KeyState &state = GetKeyState (key, beaconSecs);
+  BeaconPeriodCache &cache = state.periods[beaconSecs];
+
+  // Collect the blocks of the devices that are not known yet, a device that is listed twice is encrypted once
+  std::vector<uint32_t> missing;
+  m_blocks.clear ();
+  for (uint32_t i = 0; i < devAddrs.size (); i++)
+    {
+      if (cache.insert (std::make_pair (devAddrs[i].Get (), 0)).second)
+        {
+          missing.push_back (i);
+          m_blocks.resize (m_blocks.size () + 16);
+          FillBlock (&m_blocks[m_blocks.size () - 16], beaconSecs, devAddrs[i]);
+        }
+    }
+
+  if (!missing.empty ())
+    {
+      NS_LOG_DEBUG ("Encrypting " << missing.size () << " blocks for beacon time " << beaconSecs);
+      state.aes.Encrypt (&m_blocks[0], m_blocks.size ());
+      for (uint32_t j = 0; j < missing.size (); j++)
+        {
+          const uint8_t *block = &m_blocks[16*j];
+          cache[devAddrs[missing[j]].Get ()] = block[0] + block[1]*256;
+        }
+    }
+
+  offsets.resize (devAddrs.size ());
+  for (uint32_t i = 0; i < devAddrs.size (); i++)
+    {
+      offsets[i] = ToPingOffset (cache[devAddrs[i].Get ()], pingSlots[i]);
+    }
+}
+
+void
+LoRaWANClassBPingOffsetCalculator::Clear (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_keys.clear ();
+  m_blocks.clear ();
+}
+
+LoRaWANClassBPingOffsetCalculator::KeyState&
+LoRaWANClassBPingOffsetCalculator::GetKeyState (const uint8_t key[16], uint32_t beaconSecs)
+{
+  Key k;
+  std::memcpy (k.data (), key, 16);
+
+  std::map<Key, KeyState>::iterator it = m_keys.find (k);
+  if (it == m_keys.end ())
+    {
+      NS_LOG_DEBUG ("Expanding a new key");
+      it = m_keys.insert (std::make_pair (k, KeyState ())).first;
+      Key copy = k; // SetKey takes a non-const key
+      it->second.aes.SetKey (copy.data (), 16);
+    }
+
+  // Forget the beacon periods that ended before beaconSecs
+  std::map<uint32_t, BeaconPeriodCache> &periods = it->second.periods;
+  while (!periods.empty () && periods.begin ()->first + BEACON_PERIOD_SECONDS <= beaconSecs)
+    {
+      periods.erase (periods.begin ());
+    }
+
+  return it->second;
+}
+
+void
+LoRaWANClassBPingOffsetCalculator::FillBlock (uint8_t *block, uint32_t beaconSecs, Ipv4Address devAddr)
+{
+  // Time | DevAddr | pad16, the time is copied in host byte order like the beacon timestamp
+  std::memcpy (block, &beaconSecs, 4);
+  devAddr.Serialize (block + 4);
+  std::memset (block + 8, 0, 8);
+}
+
+uint16_t
+LoRaWANClassBPingOffsetCalculator::ToPingOffset (uint16_t rand, uint8_t pingSlots)
+{
+  NS_ASSERT (pingSlots > 0);
+  const uint32_t period = 4096 / pingSlots;
+  return rand % period;
+}
+
+} // namespace ns3
@@ -0,0 +1,122 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#ifndef LORAWAN_CLASSB_PING_OFFSET_CALCULATOR_H
+#define LORAWAN_CLASSB_PING_OFFSET_CALCULATOR_H
+
+#include "ns3/aes.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/nstime.h"
+#include <array>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup lorawan
+ *
+ * \brief Calculates the Class B ping offsets of end devices.
+ *
+ * The ping offset of a device in a beacon period is derived from
+ * R = AES_128_enc(key, Time | DevAddr | pad16) as
+ * O = (R[0] + R[1] * 256) % period, with period = 2^12 / pingSlots.
+ *
+ * The network server and the end devices use the shared instance returned by
+ * Get, so both sides always calculate the same offsets. The calculator keeps
+ * an AES instance with an expanded key schedule per key and remembers
+ * R[0] + R[1] * 256 per (beacon time, DevAddr). Results of beacon periods
+ * that ended are forgotten as soon as a later beacon time is requested.
+ */
+class LoRaWANClassBPingOffsetCalculator
+{
+public:
+  LoRaWANClassBPingOffsetCalculator (void);
+
+  /**
+   * \return the calculator shared by the network server and the end devices
+   */
+  static LoRaWANClassBPingOffsetCalculator* Get (void);
+
+  /**
+   * Calculate the ping offset of one device.
+   *
+   * \param beaconTime the timestamp of the beacon, only whole seconds are used
+   * \param devAddr the address of the device
+   * \param pingSlots the number of ping slots of the device per beacon period
+   * \param key the 16 byte key
+   * \return the ping offset, in slots
+   */
+  uint16_t GetPingOffset (Time beaconTime, Ipv4Address devAddr, uint8_t pingSlots, const uint8_t key[16]);
+
+  /**
+   * Calculate the ping offsets of a list of devices for the same beacon.
+   * The blocks of all devices that are not remembered yet are encrypted in
+   * a single pass.
+   *
+   * \param beaconTime the timestamp of the beacon, only whole seconds are used
+   * \param devAddrs the addresses of the devices
+   * \param pingSlots the number of ping slots per beacon period of every device
+   * \param key the 16 byte key
+   * \param offsets the ping offsets, in the order of devAddrs
+   */
+  void GetPingOffsets (Time beaconTime, const std::vector<Ipv4Address> &devAddrs, const std::vector<uint8_t> &pingSlots, const uint8_t key[16], std::vector<uint16_t> &offsets);
+
+  /**
+   * Forget all key schedules and remembered offsets.
+   */
+  void Clear (void);
+
+private:
+  typedef std::array<uint8_t, 16> Key;
+  typedef std::unordered_map<uint32_t, uint16_t> BeaconPeriodCache; //!< DevAddr -> R[0] + R[1] * 256
+
+  /**
+   * State kept per key.
+   */
+  struct KeyState
+  {
+    AES aes;                                          //!< AES instance with the expanded key schedule of the key
+    std::map<uint32_t, BeaconPeriodCache> periods;    //!< Remembered values per beacon time (in s)
+  };
+
+  /**
+   * Look up the state of a key, expanding the key the first time it is used,
+   * and drop the values of beacon periods that ended before beaconSecs.
+   */
+  KeyState& GetKeyState (const uint8_t key[16], uint32_t beaconSecs);
+
+  /**
+   * Fill a 16 byte block with Time | DevAddr | pad16.
+   */
+  static void FillBlock (uint8_t *block, uint32_t beaconSecs, Ipv4Address devAddr);
+
+  /**
+   * \return R[0] + R[1] * 256 modulo the ping period of pingSlots
+   */
+  static uint16_t ToPingOffset (uint16_t rand, uint8_t pingSlots);
+
+  std::map<Key, KeyState> m_keys;
+  std::vector<uint8_t> m_blocks; //!< Scratch buffer for GetPingOffsets
+};
+
+} // namespace ns3
+
+#endif /* LORAWAN_CLASSB_PING_OFFSET_CALCULATOR_H */
@@ -0,0 +1,145 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include "lorawan-collision-channel.h"
+#include "lorawan-collision-phy.h"
+#include "lorawan-spectrum-signal-parameters.h"
+#include "lorawan-spectrum-value-helper.h"
+#include <ns3/log.h>
+#include <ns3/boolean.h>
+#include <ns3/mobility-model.h>
+#include <ns3/propagation-loss-model.h>
+#include <ns3/propagation-delay-model.h>
+
+#include <cmath>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LoRaWANCollisionChannel");
+
+NS_OBJECT_ENSURE_REGISTERED (LoRaWANCollisionChannel);
+
+TypeId
+LoRaWANCollisionChannel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LoRaWANCollisionChannel")
+    .SetParent<LoRaWANSpectrumChannel> ()
+    .SetGroupName ("LoRaWAN")
+    .AddConstructor<LoRaWANCollisionChannel> ()
+    .AddAttribute ("SkipTrxOffReceivers",
+                   "Do not deliver transmissions to LoRaWANCollisionPhy "
+                   "receivers that have their transceiver switched off when "
+                   "the transmission starts. Such receivers then do not trace "
+                   "the transmission as dropped and do not count it as "
+                   "interference when they switch to RX before it ends.",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&LoRaWANCollisionChannel::m_skipTrxOffReceivers),
+                   MakeBooleanChecker ())
+  ;
+  return tid;
+}
+
+LoRaWANCollisionChannel::LoRaWANCollisionChannel (void)
+  : m_txPowerDbm (0),
+    m_skipTrxOffReceivers (true)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+LoRaWANCollisionChannel::~LoRaWANCollisionChannel (void)
+{
+}
+
+void
+LoRaWANCollisionChannel::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_txParams = 0;
+  LoRaWANSpectrumChannel::DoDispose ();
+}
+
+void
+LoRaWANCollisionChannel::StartTx (Ptr<SpectrumSignalParameters> txParams)
+{
+  NS_LOG_FUNCTION (this << txParams);
+
+  m_txParams = DynamicCast<LoRaWANSpectrumSignalParameters> (txParams);
+  if (m_txParams)
+    {
+      const double txPower = LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (txParams->psd, m_txParams->channelIndex);
+      m_txPowerDbm = 10.0 * std::log10 (txPower) + 30;
+    }
+
+  LoRaWANSpectrumChannel::StartTx (txParams);
+  m_txParams = 0;
+}
+
+void
+LoRaWANCollisionChannel::DeliverToRx (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility, Ptr<SpectrumPhy> receiver)
+{
+  Ptr<LoRaWANCollisionPhy> collisionPhy = DynamicCast<LoRaWANCollisionPhy> (receiver);
+  if (m_txParams == 0 || collisionPhy == 0)
+    {
+      LoRaWANSpectrumChannel::DeliverToRx (txParams, senderMobility, receiver);
+      return;
+    }
+
+  if (receiver == txParams->txPhy || (m_skipTrxOffReceivers && collisionPhy->IsTrxOff ()))
+    {
+      return;
+    }
+
+  double rxPowerDbm = m_txPowerDbm;
+  Time delay = MicroSeconds (0);
+
+  Ptr<MobilityModel> receiverMobility = receiver->GetMobility ();
+  if (senderMobility && receiverMobility)
+    {
+      if (m_propagationLoss)
+        {
+          rxPowerDbm += GetPropagationGain (senderMobility, receiverMobility);
+        }
+
+      if (m_propagationDelay)
+        {
+          delay = m_propagationDelay->GetDelay (senderMobility, receiverMobility);
+        }
+    }
+
+  if (std::isinf (rxPowerDbm) || rxPowerDbm < GetMinRxPower ())
+    {
+      return;
+    }
+
+  AddReception (receiver, txParams, delay, std::pow (10.0, (rxPowerDbm - 30) / 10.0));
+}
+
+void
+LoRaWANCollisionChannel::StartReception (const Reception &reception)
+{
+  if (reception.rxPower < 0)
+    {
+      LoRaWANSpectrumChannel::StartReception (reception);
+      return;
+    }
+
+  StaticCast<LoRaWANCollisionPhy> (reception.receiver)->StartRx (StaticCast<LoRaWANSpectrumSignalParameters> (reception.rxParams), reception.rxPower);
+}
+
+} // namespace ns3
@@ -0,0 +1,92 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#ifndef LORAWAN_COLLISION_CHANNEL_H
+#define LORAWAN_COLLISION_CHANNEL_H
+
+#include "lorawan-spectrum-channel.h"
+
+namespace ns3 {
+
+struct LoRaWANSpectrumSignalParameters;
+
+/**
+ * \ingroup lorawan
+ *
+ * A LoRaWANSpectrumChannel for LoRaWANCollisionPhy receivers.
+ *
+ * LoRaWAN transmissions are delivered to LoRaWANCollisionPhy receivers as a
+ * received power in W, calculated from the transmission power and the
+ * PropagationLossModel only (antennas and SpectrumPropagationLossModels are
+ * ignored). All receivers share the signal parameters of the transmission,
+ * no SpectrumValue is copied. Receivers that would receive the transmission
+ * below MinRxPower are skipped. Receivers that have their transceiver
+ * switched off when the transmission starts are skipped as well, unless
+ * SkipTrxOffReceivers is false: such receivers neither trace the transmission
+ * as dropped, nor count it as interference to frames they start receiving
+ * before it ends. Disable SkipTrxOffReceivers to get the same traces as with
+ * every transmission delivered.
+ *
+ * Other receivers, e.g. a LoRaWANGatewayPhy, are handled like in the
+ * LoRaWANSpectrumChannel.
+ */
+class LoRaWANCollisionChannel : public LoRaWANSpectrumChannel
+{
+public:
+  /**
+   * Get the type ID.
+   *
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+
+  LoRaWANCollisionChannel (void);
+  virtual ~LoRaWANCollisionChannel (void);
+
+  // inherited from SpectrumChannel
+  virtual void StartTx (Ptr<SpectrumSignalParameters> params);
+
+protected:
+  // Inherited from Object.
+  virtual void DoDispose (void);
+
+  // Inherited from LoRaWANSpectrumChannel.
+  virtual void DeliverToRx (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility, Ptr<SpectrumPhy> receiver);
+  virtual void StartReception (const Reception &reception);
+
+private:
+  /**
+   * The LoRaWAN transmission that is being delivered by StartTx, or 0.
+   */
+  Ptr<LoRaWANSpectrumSignalParameters> m_txParams;
+
+  /**
+   * The transmission power of m_txParams in dBm.
+   */
+  double m_txPowerDbm;
+
+  /**
+   * Do not deliver transmissions to receivers that are switched off.
+   */
+  bool m_skipTrxOffReceivers;
+};
+
+} // namespace ns3
+
+#endif /* LORAWAN_COLLISION_CHANNEL_H */
@@ -0,0 +1,221 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include "lorawan-collision-phy.h"
+#include "lorawan-spectrum-signal-parameters.h"
+#include "lorawan-spectrum-value-helper.h"
+#include "lorawan-error-model.h"
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/packet.h>
+#include <ns3/double.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LoRaWANCollisionPhy");
+
+NS_OBJECT_ENSURE_REGISTERED (LoRaWANCollisionPhy);
+
+TypeId
+LoRaWANCollisionPhy::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LoRaWANCollisionPhy")
+    .SetParent<LoRaWANPhy> ()
+    .SetGroupName ("LoRaWAN")
+    .AddConstructor<LoRaWANCollisionPhy> ()
+    .AddAttribute ("CaptureThreshold",
+                   "The power (in dB) by which a frame has to exceed the "
+                   "strongest overlapping frame with the same spreading "
+                   "factor in order to be received.",
+                   DoubleValue (6.0),
+                   MakeDoubleAccessor (&LoRaWANCollisionPhy::m_captureThreshold),
+                   MakeDoubleChecker<double> ())
+  ;
+  return tid;
+}
+
+LoRaWANCollisionPhy::LoRaWANCollisionPhy (void)
+  : LoRaWANPhy (0),
+    m_rxInterference (0),
+    m_captureThreshold (6.0)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+LoRaWANCollisionPhy::LoRaWANCollisionPhy (uint8_t index)
+  : LoRaWANPhy (index),
+    m_rxInterference (0),
+    m_captureThreshold (6.0)
+{
+  NS_LOG_FUNCTION (this << index);
+}
+
+LoRaWANCollisionPhy::~LoRaWANCollisionPhy (void)
+{
+}
+
+void
+LoRaWANCollisionPhy::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  m_signals.clear ();
+
+  LoRaWANPhy::DoDispose ();
+}
+
+bool
+LoRaWANCollisionPhy::IsTrxOff (void) const
+{
+  return m_trxState == LORAWAN_PHY_TRX_OFF;
+}
+
+void
+LoRaWANCollisionPhy::StartRx (Ptr<SpectrumSignalParameters> spectrumRxParams)
+{
+  Ptr<LoRaWANSpectrumSignalParameters> loraWanRxParams = DynamicCast<LoRaWANSpectrumSignalParameters> (spectrumRxParams);
+  if (loraWanRxParams == 0)
+    {
+      return; // only LoRaWAN transmissions are modelled
+    }
+
+  StartRx (loraWanRxParams, GetRxPower (loraWanRxParams));
+}
+
+void
+LoRaWANCollisionPhy::StartRx (Ptr<LoRaWANSpectrumSignalParameters> params, double rxPower)
+{
+  NS_LOG_FUNCTION (this << params << rxPower);
+
+  if (params->channelIndex != m_currentChannelIndex)
+    {
+      return; // just do nothing
+    }
+
+  Ptr<Packet> p = params->packet;
+  NS_ASSERT (p != 0);
+
+  const LoRaSpreadingFactor sf = LoRaWAN::m_supportedDataRates [params->dataRateIndex].spreadingFactor;
+  const double noise = LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (m_noise, m_currentChannelIndex);
+
+  if (m_trxState == LORAWAN_PHY_BUSY_RX)
+    {
+      Ptr<LoRaWANSpectrumSignalParameters> currentRxParams = m_currentRxPacket.first;
+      NS_ASSERT (currentRxParams);
+      if (LoRaWAN::m_supportedDataRates [currentRxParams->dataRateIndex].spreadingFactor == sf)
+        {
+          m_rxInterference = std::max (m_rxInterference, rxPower);
+        }
+
+      if (params->dataRateIndex == m_currentDataRateIndex && IsRxPolarity (params))
+        {
+          NS_LOG_DEBUG (this << " packet collision");
+          m_phyRxDropTrace (p, LORAWAN_RX_DROP_PHY_BUSY_RX);
+        }
+    }
+  else if (params->dataRateIndex == m_currentDataRateIndex && IsRxPolarity (params))
+    {
+      if (m_trxState == LORAWAN_PHY_RX_ON && !m_skippedRxWindow && !m_setTRXState.IsRunning () && !IsRadioTransmitting ())
+        {
+          const uint32_t bw = LoRaWAN::m_supportedChannels [m_currentChannelIndex].m_bw;
+          const double snr_db = 10.0 * log10 (rxPower / noise);
+          const double snr_cutoff_db = m_errorModel->getSNRCutoffForRX (bw, sf, params->codeRate);
+
+          if (snr_db > snr_cutoff_db)
+            {
+              // Frames with the same spreading factor that are already on air interfere
+              double interference = 0;
+              for (std::vector<Signal>::const_iterator it = m_signals.begin (); it != m_signals.end (); ++it)
+                {
+                  if (LoRaWAN::m_supportedDataRates [it->params->dataRateIndex].spreadingFactor == sf)
+                    interference = std::max (interference, it->rxPower);
+                }
+
+              ChangeTrxState (LORAWAN_PHY_BUSY_RX);
+              m_currentRxPacket = std::make_pair (params, LoRaWANPhyRxStatus (false, false));
+              m_rxInterference = interference;
+              InitRxRecord (m_rxRecord, rxPower, rxPower / (interference + noise));
+              m_phyRxBeginTrace (p);
+            }
+          else
+            {
+              m_phyRxDropTrace (p, LORAWAN_RX_DROP_SINR_TOO_LOW);
+            }
+        }
+      else
+        {
+          NS_LOG_DEBUG (this << " transceiver not in RX state (state = " << m_trxState << ")");
+          m_phyRxDropTrace (p, LORAWAN_RX_DROP_NOT_IN_RX_STATE);
+        }
+    }
+
+  Signal signal;
+  signal.params = params;
+  signal.rxPower = rxPower;
+  m_signals.push_back (signal);
+
+  ScheduleEndRx (params);
+}
+
+void
+LoRaWANCollisionPhy::EndRx (Ptr<SpectrumSignalParameters> par)
+{
+  NS_LOG_FUNCTION (this);
+
+  for (uint32_t i = 0; i < m_signals.size (); i++)
+    {
+      if (m_signals[i].params == par)
+        {
+          m_signals[i] = m_signals.back ();
+          m_signals.pop_back ();
+          break;
+        }
+    }
+
+  if (m_currentRxPacket.first != par)
+    {
+      return;
+    }
+
+  // The frame survives the overlapping frames if it is strong enough to be captured
+  const double noise = LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (m_noise, m_currentChannelIndex);
+  const double rxPower = pow (10.0, (m_rxRecord.rssi - 30) / 10.0);
+  bool captured = true;
+  if (m_rxInterference > 0)
+    {
+      captured = 10.0 * log10 (rxPower / m_rxInterference) >= m_captureThreshold;
+    }
+  NS_LOG_LOGIC (this << " strongest interferer " << 10.0 * log10 (m_rxInterference) + 30 << "dBm, captured = " << captured);
+
+  m_rxRecord.sinr = rxPower / (m_rxInterference + noise);
+  m_rxRecord.successRate = captured ? 1.0 : 0.0;
+  m_rxRecord.lqi = captured ? std::numeric_limits<uint8_t>::max () : 0;
+  if (!captured)
+    {
+      m_currentRxPacket.second.destroyed = true;
+    }
+  m_rxInterference = 0;
+
+  FinishRx ();
+}
+
+} // namespace ns3
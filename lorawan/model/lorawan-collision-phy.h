@@ -0,0 +1,120 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#ifndef LORAWAN_COLLISION_PHY_H
+#define LORAWAN_COLLISION_PHY_H
+
+#include "lorawan-phy.h"
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup lorawan
+ *
+ * Phy layer for LoRaWAN that decides on receptions with a collision model
+ * instead of the SINR based error model, for simulations with a very large
+ * number of devices.
+ *
+ * The PHY keeps the received power of the transmissions on its channel. A
+ * frame is received when its SNR is above the cut-off of the
+ * LoRaWANErrorModel for its spreading factor and, if it overlaps with other
+ * frames of the same spreading factor, when it is at least CaptureThreshold
+ * dB stronger than the strongest of them. Frames with a different spreading
+ * factor are considered orthogonal. Signals that are not LoRaWAN
+ * transmissions are ignored.
+ *
+ * The PHY behaves like a LoRaWANPhy towards the MAC and fires the same trace
+ * sources. The LQI of a received frame is either 255 or 0. Used with a
+ * LoRaWANCollisionChannel, the received power is passed as a number and the
+ * PSD of a transmission is never copied. That channel does not deliver
+ * transmissions to a PHY whose transceiver is switched off or that receives
+ * them below MinRxPower, so these are not traced as dropped with reason
+ * LORAWAN_RX_DROP_NOT_IN_RX_STATE or LORAWAN_RX_DROP_SINR_TOO_LOW.
+ */
+class LoRaWANCollisionPhy : public LoRaWANPhy
+{
+
+public:
+  /**
+   * Get the type ID.
+   *
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+
+  LoRaWANCollisionPhy (void);
+  LoRaWANCollisionPhy (uint8_t index);
+  virtual ~LoRaWANCollisionPhy (void);
+
+  // inherited from LoRaWANPhy
+  virtual void StartRx (Ptr<SpectrumSignalParameters> params);
+
+  /**
+   * Notify the PHY of an incoming LoRaWAN transmission.
+   *
+   * \param params the parameters of the transmission, may be shared with
+   *        other receivers
+   * \param rxPower the received power in W
+   */
+  void StartRx (Ptr<LoRaWANSpectrumSignalParameters> params, double rxPower);
+
+  /**
+   * \return true if the transceiver is switched off
+   */
+  bool IsTrxOff (void) const;
+
+private:
+  // Inherited from Object.
+  virtual void DoDispose (void);
+
+  // Inherited from LoRaWANPhy.
+  virtual void EndRx (Ptr<SpectrumSignalParameters> params);
+
+  /**
+   * A transmission on the channel of the PHY.
+   */
+  struct Signal
+  {
+    Ptr<LoRaWANSpectrumSignalParameters> params; //!< the transmission
+    double rxPower;                              //!< the received power in W
+  };
+
+  /**
+   * The transmissions on the channel of the PHY that did not end yet.
+   */
+  std::vector<Signal> m_signals;
+
+  /**
+   * The power in W of the strongest frame with the same spreading factor that
+   * overlapped with the frame currently received.
+   */
+  double m_rxInterference;
+
+  /**
+   * The power in dB by which a frame has to exceed overlapping frames with
+   * the same spreading factor.
+   */
+  double m_captureThreshold;
+
+}; // class LoRaWANCollisionPhy
+
+} // namespace ns3
+
+#endif /* LORAWAN_COLLISION_PHY_H */
@@ -42,6 +42,7 @@
 #include "lorawan.h"
 #include "lorawan-net-device.h"
 #include "lorawan-enddevice-application.h"
+#include "lorawan-classb-ping-offset-calculator.h"
 #include "lorawan-frame-header-uplink.h"
 #include "lorawan-frame-header-downlink.h"
 #include "ns3/udp-socket-factory.h"
@@ -144,7 +145,9 @@ LoRaWANEndDeviceApplication::LoRaWANEndDeviceApplication ()
     m_fcntRX2(0),
     m_attemptedThroughput(0),
     m_timestamp(0),
-    m_missedBeaconsCounter(0)
+    m_missedBeaconsCounter(0),
+    m_ClassBPingOffset(0),
+    m_ClassBNextPingSlot(0)
 
 {
   NS_LOG_FUNCTION (this);
@@ -321,6 +324,7 @@ void LoRaWANEndDeviceApplication::CancelEvents ()
 
   Simulator::Cancel (m_txEvent);
   Simulator::Cancel (m_sendEvent);
+  Simulator::Cancel (m_pingSlotEvent);
 }
 
 
@@ -608,6 +612,7 @@ LoRaWANEndDeviceApplication::ClassBSchedulePingSlots ()
         m_isClassB = false; // this setting gets passed as a bit in the next uplink frame, telling the NS to stop scheduling pings for this device.
 
         //and don't attempt to calculate ping slots
+        Simulator::Cancel (m_pingSlotEvent);
         return;
       }
     } else {
@@ -621,59 +626,39 @@ LoRaWANEndDeviceApplication::ClassBSchedulePingSlots ()
 
     NS_LOG_DEBUG("ed: timestamp is: " << m_timestamp.GetSeconds() );
 
-    uint64_t period = std::pow(2.0, 12) / m_ClassBPingSlots;;   
     uint8_t key[16] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }; // the key. Encryption of packets isn't fully supported right now so assuming a key of all 0s.
-    uint8_t buf[16] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-
-    // add time from beacon frame to buffer
-    double secs = m_timestamp.GetSeconds(); // convert to a 4 byte buffer
-    uint32_t secsTruncated = (uint32_t) secs;
-
-    uint8_t *sp = (uint8_t *)&secsTruncated;
-    buf[0] = sp[0];
-    buf[1] = sp[1];
-    buf[2] = sp[2];
-    buf[3] = sp[3];
-    
-    // add own node address to buffer
-    Ipv4Address devAddr = Ipv4Address::ConvertFrom (GetNode ()->GetDevice (0)->GetAddress ());
-    NS_LOG_DEBUG("ed: device address is: " << devAddr );    
-    uint8_t addr[4];
-    devAddr.Serialize(addr);
-    buf[4] = addr[0];
-    buf[5] = addr[1];
-    buf[6] = addr[2];
-    buf[7] = addr[3];
-    
-    //pad16 is to ensure the buffer is 16 bytes long
-    //the rest of the buffer (the other 8 bytes) is just 0s.
-    for(uint i=8; i<16;i++){
-      buf[i] = 0;
-    }
-
-    AES aes;
-    aes.SetKey(key, 16);
-    aes.Encrypt(buf, 16);
-
-    uint64_t O = (buf[0] + buf[1]*256) % period;
 
-    uint32_t beacon_reserved = 2120; // ms 
-    uint32_t slotLength = 30; // ms
-    uint32_t dAddr = (uint32_t) devAddr.Get ();
-
-    //calculate and schedule ping slots for this device
-
-    //on the end device pingTime factors in the time in between the given timestamp and now
-    Time offset = Simulator::Now() - m_timestamp;
+    // the offset is calculated from the time in the beacon frame and the own node address, like on the NS
+    Ipv4Address devAddr = Ipv4Address::ConvertFrom (GetNode ()->GetDevice (0)->GetAddress ());
+    NS_LOG_DEBUG("ed: device address is: " << devAddr );
+    uint64_t O = LoRaWANClassBPingOffsetCalculator::Get ()->GetPingOffset (m_timestamp, devAddr, m_ClassBPingSlots, key);
 
+    //only the first ping slot of this beacon period is scheduled, each ping slot schedules the next one
     NS_LOG_DEBUG("Scheduling ping slots for device" << devAddr.Get ());
-    for(uint i=0;i< m_ClassBPingSlots; i++){
-      uint64_t pingTime = beacon_reserved + (O + period*i) * slotLength; // Ping slot time is beacon_reserved + (pingOffset + N*pingPeriod) * slotLength
-      Time ping = MilliSeconds(pingTime);
-      ping -= offset; 
-      NS_LOG_DEBUG(this << "ed : ping slot for device " << dAddr << " is at " << Simulator::Now() + ping);
-      Simulator::Schedule (ping, &LoRaWANEndDeviceApplication::ClassBPingSlot, this);
+    m_ClassBPingOffset = O;
+    m_ClassBNextPingSlot = 0;
+    m_ClassBPingSlotsStart = m_timestamp;
+    Simulator::Cancel (m_pingSlotEvent);
+    ClassBScheduleNextPingSlot ();
+}
+
+void
+LoRaWANEndDeviceApplication::ClassBScheduleNextPingSlot ()
+{
+  uint64_t period = std::pow(2.0, 12) / m_ClassBPingSlots;
+  uint32_t beacon_reserved = 2120; // ms 
+  uint32_t slotLength = 30; // ms
+
+  //on the end device the ping slots are relative to the timestamp of the beacon
+  for(; m_ClassBNextPingSlot < m_ClassBPingSlots; m_ClassBNextPingSlot++){
+    uint64_t pingTime = beacon_reserved + (m_ClassBPingOffset + period*m_ClassBNextPingSlot) * slotLength; // Ping slot time is beacon_reserved + (pingOffset + N*pingPeriod) * slotLength
+    Time ping = m_ClassBPingSlotsStart + MilliSeconds(pingTime) - Simulator::Now ();
+    if (ping.IsPositive ()) {
+      NS_LOG_DEBUG(this << "ed : ping slot for device " << m_devAddr << " is at " << Simulator::Now() + ping);
+      m_pingSlotEvent = Simulator::Schedule (ping, &LoRaWANEndDeviceApplication::ClassBPingSlot, this);
+      return;
     }
+  }
 }
 
 void
@@ -683,6 +668,9 @@ LoRaWANEndDeviceApplication::ClassBPingSlot ()
   //attempt to receive a packet from the NS
   NS_LOG_DEBUG("Start of a ping slot");
 
+  m_ClassBNextPingSlot++;
+  ClassBScheduleNextPingSlot ();
+
   Ptr<LoRaWANNetDevice> netDevice = DynamicCast<LoRaWANNetDevice> (GetNode ()->GetDevice (0));
   netDevice->StartReceivingClassBPacket(m_ClassBChannelIndex, m_ClassBDataRateIndex, m_ClassBCodeRateIndex);
 }
@@ -143,6 +143,11 @@ private:
 
   void ClassBSchedulePingSlots ();
   void ClassBReceiveBeacon ();
+  /**
+   * Schedule m_pingSlotEvent for the first ping slot from m_ClassBNextPingSlot
+   * on that has not started yet. Only one ping slot is scheduled at a time.
+   */
+  void ClassBScheduleNextPingSlot ();
   void ClassBPingSlot ();
 
   
@@ -164,6 +169,11 @@ private:
   Time        m_timestamp;
   uint8_t     m_missedBeaconsCounter;
 
+  EventId     m_pingSlotEvent;        //!< The next ping slot
+  uint16_t    m_ClassBPingOffset;     //!< Ping offset in the current beacon period
+  uint8_t     m_ClassBNextPingSlot;   //!< Index of the next ping slot in the current beacon period
+  Time        m_ClassBPingSlotsStart; //!< Timestamp of the beacon of the current beacon period
+
 
 
   /// Traced Callback: transmitted packets.
@@ -20,6 +20,7 @@
 #include "lorawan-error-model.h"
 #include <ns3/log.h>
 
+#include <algorithm>
 #include <cmath>
 
 namespace ns3 {
@@ -39,99 +40,110 @@ LoRaWANErrorModel::GetTypeId (void)
   return tid;
 }
 
-LoRaWANErrorModel::LoRaWANErrorModel (void)
-{
-  /**
-  * Coefficients from exp1_log_model_curvefit_truncated_output.txt
-  */
-
-  // SF7, CR1
-  m_aCoefficients[0] = -30.25798896;
-  m_bCoefficients[0] = 0.28570229;
-
-  // SF7, CR3
-  m_aCoefficients[1] = -105.19660816;
-  m_bCoefficients[1] = 0.37455655;
-
-  // SF8, CR1
-  m_aCoefficients[2] =-77.10020378;
-  m_bCoefficients[2] = 0.29933678;
-
-  // SF8, CR3
-  m_aCoefficients[3] = -289.81333927;
-  m_bCoefficients[3] = 0.37560498;
-
-  // SF9, CR1
-  m_aCoefficients[4] = -244.64237268;
-  m_bCoefficients[4] = 0.32227064;
-
-  // SF9, CR3
-  m_aCoefficients[5] = -1114.33115567;
-  m_bCoefficients[5] = 0.39694465;
-
-  // SF10, CR1
-  m_aCoefficients[6] = -725.95557882;
-  m_bCoefficients[6] = 0.33393115;
-
-  // SF10, CR3
-  m_aCoefficients[7] = -4285.44400727;
-  m_bCoefficients[7] = 0.41164155;
+/**
+ * Coefficients from exp1_log_model_curvefit_truncated_output.txt, the index
+ * of a SF and CR combination is (SF-7)*2 for CR1 and (SF-7)*2+1 for CR3
+ */
+static const double g_LoRaWANErrorModelACoefficients[LORAWAN_ERROR_MODEL_NR_COEFF] = {
+  -30.25798896,     // SF7, CR1
+  -105.19660816,    // SF7, CR3
+  -77.10020378,     // SF8, CR1
+  -289.81333927,    // SF8, CR3
+  -244.64237268,    // SF9, CR1
+  -1114.33115567,   // SF9, CR3
+  -725.95557882,    // SF10, CR1
+  -4285.44400727,   // SF10, CR3
+  -2109.80642246,   // SF11, CR1
+  -20771.69446082,  // SF11, CR3
+  -4452.36530463,   // SF12, CR1
+  -98658.11656301,  // SF12, CR3
+};
+
+static const double g_LoRaWANErrorModelBCoefficients[LORAWAN_ERROR_MODEL_NR_COEFF] = {
+  0.28570229,  // SF7, CR1
+  0.37455655,  // SF7, CR3
+  0.29933678,  // SF8, CR1
+  0.37560498,  // SF8, CR3
+  0.32227064,  // SF9, CR1
+  0.39694465,  // SF9, CR3
+  0.33393115,  // SF10, CR1
+  0.41164155,  // SF10, CR3
+  0.34073142,  // SF11, CR1
+  0.43318930,  // SF11, CR3
+  0.33174696,  // SF12, CR1
+  0.44852713,  // SF12, CR3
+};
+
+/**
+ * We checked the BER curves between snr_min and 0dB (where snr_min depends
+ * on the SF) and all curves are monotonically decreasing functions between
+ * these bounds (for increasing SNR_DB). Indexed by SF-7.
+ */
+static const double g_LoRaWANErrorModelMinSnr[6] = { -20, -20, -20, -20, -23, -26 };
 
-  // SF11, CR1
-  m_aCoefficients[8] = -2109.80642246;
-  m_bCoefficients[8] = 0.34073142;
+/**
+ * ln(-ln(1-BER)) for every SF and CR combination, sampled every
+ * LORAWAN_ERROR_MODEL_TABLE_SNR_STEP dB starting from
+ * LORAWAN_ERROR_MODEL_TABLE_SNR_MIN
+ */
+static double g_LoRaWANErrorModelTable[LORAWAN_ERROR_MODEL_NR_COEFF][LORAWAN_ERROR_MODEL_TABLE_SIZE];
 
-  // SF11, CR3
-  m_aCoefficients[9] = -20771.69446082;
-  m_bCoefficients[9] = 0.43318930;
+/**
+ * \ingroup lorawan
+ * \brief Helper class used to automatically fill g_LoRaWANErrorModelTable
+ */
+class LoRaWANErrorModelTableInitializer
+{
+public:
+  LoRaWANErrorModelTableInitializer (void)
+  {
+    for (uint8_t i = 0; i < LORAWAN_ERROR_MODEL_NR_COEFF; i++)
+      {
+        for (uint32_t j = 0; j < LORAWAN_ERROR_MODEL_TABLE_SIZE; j++)
+          {
+            const double snr_db = LORAWAN_ERROR_MODEL_TABLE_SNR_MIN + j * LORAWAN_ERROR_MODEL_TABLE_SNR_STEP;
+            const double log_ber = g_LoRaWANErrorModelACoefficients[i] * exp (g_LoRaWANErrorModelBCoefficients[i] * snr_db);
+            const double ber = pow (10.0, log_ber);
+            if (ber > 1.0e-12)
+              g_LoRaWANErrorModelTable[i][j] = log (-log1p (-ber));
+            else // -ln(1-BER) equals BER for all practical purposes, do not let the BER underflow
+              g_LoRaWANErrorModelTable[i][j] = log_ber * M_LN10;
+          }
+      }
+  }
+} g_LoRaWANErrorModelTableInitializerInstance; //!< Global object used to initialize g_LoRaWANErrorModelTable
 
-  // SF12, CR1
-  m_aCoefficients[10] = -4452.36530463;
-  m_bCoefficients[10] = 0.33174696;
+LoRaWANErrorModel::LoRaWANErrorModel (void)
+{
+  for (uint8_t i = 0; i < LORAWAN_ERROR_MODEL_NR_COEFF; i++)
+    {
+      m_aCoefficients[i] = g_LoRaWANErrorModelACoefficients[i];
+      m_bCoefficients[i] = g_LoRaWANErrorModelBCoefficients[i];
+    }
+}
 
-  // SF12, CR3
-  m_aCoefficients[11] = -98658.11656301;
-  m_bCoefficients[11] = 0.44852713;
+uint8_t
+LoRaWANErrorModel::GetCoefficientIndex (LoRaSpreadingFactor spreadingFactor, uint8_t codeRate)
+{
+  NS_ASSERT( spreadingFactor >= LORAWAN_SF7 && spreadingFactor <= LORAWAN_SF12 && (codeRate == 1 || codeRate == 3) );
+  return (spreadingFactor - 7) * 2 + (codeRate == 3 ? 1 : 0);
 }
 
 double
 LoRaWANErrorModel::getBER (double snr_db, uint32_t bandWidth, LoRaSpreadingFactor spreadingFactor, uint8_t codeRate) const
 {
   NS_ASSERT( bandWidth == 125e3 );
-  NS_ASSERT( spreadingFactor == LORAWAN_SF7 || spreadingFactor == LORAWAN_SF8 || spreadingFactor == LORAWAN_SF9 || spreadingFactor == LORAWAN_SF10 || spreadingFactor == LORAWAN_SF11 || spreadingFactor == LORAWAN_SF12);
-  NS_ASSERT( codeRate == 1 || codeRate == 3 );
   // Note only bandwidth 125kHz is supported
 
-  double snr_db_rounded = snr_db;
-
-  // We checked the BER curves between snr_min and 0dB (where snr_min depends
-  // on the SF) and all curves are monotonically decreasing functions between
-  // these bounds (for increasing SNR_DB)
-  if (spreadingFactor == LORAWAN_SF7 || spreadingFactor == LORAWAN_SF8 || spreadingFactor == LORAWAN_SF9 || spreadingFactor == LORAWAN_SF10) {
-    if (snr_db < -20)
-      snr_db_rounded = -20;
-    if (snr_db > 0)
-      snr_db_rounded = 0;
-  } else if (spreadingFactor == LORAWAN_SF11) {
-    if (snr_db < -23)
-      snr_db_rounded = -23;
-    if (snr_db > 0)
-      snr_db_rounded = 0;
-  } else if (spreadingFactor == LORAWAN_SF12) {
-    if (snr_db < -26)
-      snr_db_rounded = -26;
-    if (snr_db > 0)
-      snr_db_rounded = 0;
-  }
-
   // Get index for coeffients in arrays:
-  uint8_t coefIndex = (spreadingFactor-7)*2;
-  if (codeRate == 3)
-    coefIndex+=1;
+  const uint8_t coefIndex = GetCoefficientIndex (spreadingFactor, codeRate);
+  const double snr_db_min = g_LoRaWANErrorModelMinSnr[spreadingFactor - 7];
 
-  if (coefIndex >= LORAWAN_ERROR_MODEL_NR_COEFF) {
-    NS_FATAL_ERROR (this << "invalid coef index");
-  }
+  double snr_db_rounded = snr_db;
+  if (snr_db < snr_db_min)
+    snr_db_rounded = snr_db_min;
+  if (snr_db > 0)
+    snr_db_rounded = 0;
 
   // log10(BER) = a*exp(b*x) + c*exp(d*x) where x is the SNR in dB
   double log_ber = m_aCoefficients[coefIndex]*exp (m_bCoefficients[coefIndex]*snr_db_rounded);
@@ -143,25 +155,43 @@ LoRaWANErrorModel::getBER (double snr_db, uint32_t bandWidth, LoRaSpreadingFacto
 }
 
 double
-LoRaWANErrorModel::GetChunkSuccessRate (double snr_db, uint32_t nbits, uint32_t bandWidth, LoRaSpreadingFactor spreadingFactor, uint8_t codeRate) const
+LoRaWANErrorModel::GetLogBitSuccessRate (double snr_db, uint8_t coefIndex)
 {
-  NS_ASSERT( bandWidth == 125e3 );
-  NS_ASSERT( spreadingFactor == LORAWAN_SF7 || spreadingFactor == LORAWAN_SF8 || spreadingFactor == LORAWAN_SF9 || spreadingFactor == LORAWAN_SF10 || spreadingFactor == LORAWAN_SF11 || spreadingFactor == LORAWAN_SF12);
-  NS_ASSERT( codeRate == 1 || codeRate == 3 );
+  // Clamp to the range of the curve fit, a NaN SNR is treated as the lowest SNR
+  const double snr_db_min = g_LoRaWANErrorModelMinSnr[coefIndex / 2];
+  const double snr_db_rounded = snr_db > 0.0 ? 0.0 : (snr_db > snr_db_min ? snr_db : snr_db_min);
 
-  double ber = getBER (snr_db, bandWidth, spreadingFactor, codeRate);
+  const double position = (snr_db_rounded - LORAWAN_ERROR_MODEL_TABLE_SNR_MIN) / LORAWAN_ERROR_MODEL_TABLE_SNR_STEP;
+  const uint32_t i = std::min (static_cast<uint32_t> (position), static_cast<uint32_t> (LORAWAN_ERROR_MODEL_TABLE_SIZE - 2));
+  const double fraction = position - i;
 
-  if (ber > 1.0)
-    NS_FATAL_ERROR (this << "BER is great than 1.0");
+  const double *row = g_LoRaWANErrorModelTable[coefIndex];
+  return -exp (row[i] + (row[i + 1] - row[i]) * fraction);
+}
+
+double
+LoRaWANErrorModel::GetChunkSuccessRate (double snr_db, uint32_t nbits, uint32_t bandWidth, LoRaSpreadingFactor spreadingFactor, uint8_t codeRate) const
+{
+  NS_ASSERT( bandWidth == 125e3 );
 
-  ber = std::min (ber, 1.0);
-  double retval = pow (1.0 - ber, nbits);
+  double retval = exp (nbits * GetLogBitSuccessRate (snr_db, GetCoefficientIndex (spreadingFactor, codeRate)));
 
   NS_LOG_LOGIC (this << " snr_db = " << snr_db << ", nbits = " << nbits << ", spreadingFactor = " << static_cast<uint32_t>(spreadingFactor) << ", codeRate = " << static_cast<uint32_t>(codeRate) << ". ChunkSuccesRate = " << retval);
 
   return retval;
 }
 
+void
+LoRaWANErrorModel::GetChunkSuccessRates (uint32_t n, const double *snr_db, const uint32_t *nbits, const LoRaSpreadingFactor *spreadingFactors, const uint8_t *codeRates, double *successRates) const
+{
+  NS_LOG_FUNCTION (this << n);
+
+  for (uint32_t i = 0; i < n; i++)
+    {
+      successRates[i] = exp (nbits[i] * GetLogBitSuccessRate (snr_db[i], GetCoefficientIndex (spreadingFactors[i], codeRates[i])));
+    }
+}
+
 double
 LoRaWANErrorModel::getSNRCutoffForRX (uint32_t bandWidth, LoRaSpreadingFactor spreadingFactor, uint8_t codeRate) const
 {
@@ -46,8 +46,20 @@ namespace ns3 {
  *
  * Note that spreading factors 7, 8, 9, 10, 11 and 12 and CR=1 and CR=3 were
  * part of the baseband simulation.
+ *
+ * GetChunkSuccessRate does not evaluate the curve fits directly. At startup
+ * ln(-ln(1-BER)) is tabulated for every SF and CR on a grid of
+ * LORAWAN_ERROR_MODEL_TABLE_SNR_STEP dB between
+ * LORAWAN_ERROR_MODEL_TABLE_SNR_MIN and 0 dB. This function is smooth in the
+ * SNR, so it is linearly interpolated and the chunk success rate is obtained
+ * as exp(nbits * ln(1-BER)). Compared to (1-BER)^nbits with the BER from
+ * getBER, the absolute error of the chunk success rate stays below 5E-4 for
+ * chunks of up to 20000 bits (see lorawan-error-model-test).
  */
 #define LORAWAN_ERROR_MODEL_NR_COEFF 2*6
+#define LORAWAN_ERROR_MODEL_TABLE_SNR_MIN -26.0 // lowest SNR of all curves (SF12), in dB
+#define LORAWAN_ERROR_MODEL_TABLE_SNR_STEP 0.05 // in dB
+#define LORAWAN_ERROR_MODEL_TABLE_SIZE 521 // -LORAWAN_ERROR_MODEL_TABLE_SNR_MIN/LORAWAN_ERROR_MODEL_TABLE_SNR_STEP + 1
 
 class LoRaWANErrorModel : public Object
 {
@@ -70,6 +82,20 @@ public:
    */
   double GetChunkSuccessRate (double snr_db, uint32_t nbits, uint32_t bandwidth, LoRaSpreadingFactor spreadingFactor, uint8_t codeRate) const;
 
+  /**
+   * Return the chunk success rates for a batch of receptions at once, element
+   * i of every array describes one reception. Only a bandwidth of 125kHz is
+   * supported.
+   *
+   * \param n number of receptions in the batch
+   * \param snr_db SNRs expressed in dB
+   * \param nbits number of bits in the chunks
+   * \param spreadingFactors spreading factors of the receptions
+   * \param codeRates code rates of the receptions
+   * \param successRates output array for the chunk success rates
+   */
+  void GetChunkSuccessRates (uint32_t n, const double *snr_db, const uint32_t *nbits, const LoRaSpreadingFactor *spreadingFactors, const uint8_t *codeRates, double *successRates) const;
+
   double getBER(double snr_db, uint32_t bandwidth, LoRaSpreadingFactor spreadingFactor, uint8_t codeRate) const;
 
   /**
@@ -80,6 +106,21 @@ public:
    */
   double getSNRCutoffForRX (uint32_t bandwidth, LoRaSpreadingFactor spreadingFactor, uint8_t codeRate) const;
 private:
+  /**
+   * Look up the natural logarithm of the probability that a single bit is
+   * received correctly.
+   *
+   * \param snr_db SNR expressed in dB
+   * \param coefIndex index of the SF and CR combination, see GetCoefficientIndex
+   * \return ln(1 - BER)
+   */
+  static double GetLogBitSuccessRate (double snr_db, uint8_t coefIndex);
+
+  /**
+   * \return the index of the curve fitting coefficients for a SF and CR
+   */
+  static uint8_t GetCoefficientIndex (LoRaSpreadingFactor spreadingFactor, uint8_t codeRate);
+
   /**
    * Array of precalculated curve fitting coefficients.
    */
@@ -36,6 +36,7 @@
 #include "lorawan.h"
 #include "lorawan-net-device.h"
 #include "lorawan-gateway-application.h"
+#include "lorawan-classb-ping-offset-calculator.h"
 #include "lorawan-frame-header-uplink.h"
 #include "lorawan-frame-header-downlink.h"
 #include "ns3/udp-socket-factory.h"
@@ -50,8 +51,291 @@ namespace ns3 {
 
   Ptr<LoRaWANNetworkServer> LoRaWANNetworkServer::m_ptr = NULL;
 
+void
+LoRaWANNSDSQueue::PushBack (LoRaWANNSDSQueueElement* element)
+{
+  element->m_next = nullptr;
+  if (m_tail)
+    m_tail->m_next = element;
+  else
+    m_head = element;
+  m_tail = element;
+  m_size++;
+}
+
+LoRaWANNSDSQueueElement*
+LoRaWANNSDSQueue::PopFront (void)
+{
+  NS_ASSERT (m_head);
+  LoRaWANNSDSQueueElement* element = m_head;
+  m_head = element->m_next;
+  if (!m_head)
+    m_tail = nullptr;
+  element->m_next = nullptr;
+  m_size--;
+  return element;
+}
+
+void
+LoRaWANNSDSQueue::Clear (void)
+{
+  while (!IsEmpty ())
+    delete PopFront ();
+}
+
+const uint32_t LoRaWANEndDeviceRegistryNS::INVALID_INDEX;
+const uint16_t LoRaWANEndDeviceRegistryNS::NO_PING_OFFSET;
+
+LoRaWANEndDeviceRegistryNS::LoRaWANEndDeviceRegistryNS ()
+{
+}
+
+LoRaWANEndDeviceRegistryNS::~LoRaWANEndDeviceRegistryNS ()
+{
+  Clear ();
+}
+
+uint32_t
+LoRaWANEndDeviceRegistryNS::Add (Ipv4Address deviceAddress)
+{
+  uint32_t index = Find (deviceAddress.Get ());
+  if (index == INVALID_INDEX) {
+    index = m_deviceAddress.size ();
+    m_indices[deviceAddress.Get ()] = index;
+
+    m_deviceAddress.push_back (deviceAddress);
+    m_fCntUp.push_back (0);
+    m_fCntDown.push_back (0);
+    m_lastSeen.push_back (Seconds (0));
+    m_rx1DROffset.push_back (0);
+    m_lastDataRateIndex.push_back (0);
+    m_lastChannelIndex.push_back (0);
+    m_lastCodeRate.push_back (0);
+    m_framePending.push_back (false);
+    m_setAck.push_back (false);
+    m_isClassB.push_back (false);
+    m_lastGWs.push_back (std::vector< Ptr<LoRaWANGatewayApplication> > ());
+    m_rw1Timer.push_back (EventId ());
+    m_rw2Timer.push_back (EventId ());
+    m_downstreamQueue.push_back (LoRaWANNSDSQueue ());
+    m_ClassBdownstreamQueue.push_back (LoRaWANNSDSQueue ());
+    m_ClassBPingSlots.push_back (0);
+    m_ClassBPingPeriodicity.push_back (6);
+    m_ClassBChannelIndex.push_back (7);
+    m_ClassBDataRateIndex.push_back (0);
+    m_ClassBCodeRateIndex.push_back (1);
+    m_ClassBPingOffset.push_back (NO_PING_OFFSET);
+    m_ClassBPingSlotTimer.push_back (EventId ());
+    m_lastDSGW.push_back (nullptr);
+    m_lastRxMetadata.push_back (LoRaWANRxMetadata ());
+    m_downstreamTimer.push_back (EventId ());
+    m_ClassBdownstreamTimer.push_back (EventId ());
+    m_ClassBdownstreamTimerSchedule.push_back (EventId ());
+    m_stats.push_back (LoRaWANEndDeviceStatsNS ());
+    m_classBPosition.push_back (INVALID_INDEX);
+    return index;
+  }
+
+  // Known device: reset all fields, keeping the pending downstream frames
+  // around would leak them so they are deleted
+  SetClassB (index, false);
+  m_fCntUp[index] = 0;
+  m_fCntDown[index] = 0;
+  m_lastSeen[index] = Seconds (0);
+  m_rx1DROffset[index] = 0;
+  m_lastDataRateIndex[index] = 0;
+  m_lastChannelIndex[index] = 0;
+  m_lastCodeRate[index] = 0;
+  m_framePending[index] = false;
+  m_setAck[index] = false;
+  m_lastGWs[index].clear ();
+  m_rw1Timer[index] = EventId ();
+  m_rw2Timer[index] = EventId ();
+  m_downstreamQueue[index].Clear ();
+  m_ClassBdownstreamQueue[index].Clear ();
+  m_ClassBPingSlots[index] = 0;
+  m_ClassBPingPeriodicity[index] = 6;
+  m_ClassBChannelIndex[index] = 7;
+  m_ClassBDataRateIndex[index] = 0;
+  m_ClassBCodeRateIndex[index] = 1;
+  m_ClassBPingOffset[index] = NO_PING_OFFSET;
+  m_ClassBPingSlotTimer[index].Cancel ();
+  m_lastDSGW[index] = nullptr;
+  m_lastRxMetadata[index] = LoRaWANRxMetadata ();
+  m_downstreamTimer[index] = EventId ();
+  m_ClassBdownstreamTimer[index] = EventId ();
+  m_ClassBdownstreamTimerSchedule[index] = EventId ();
+  m_stats[index] = LoRaWANEndDeviceStatsNS ();
+  return index;
+}
+
+uint32_t
+LoRaWANEndDeviceRegistryNS::Find (uint32_t deviceAddr) const
+{
+  auto it = m_indices.find (deviceAddr);
+  if (it == m_indices.end ())
+    return INVALID_INDEX;
+  return it->second;
+}
+
+uint32_t
+LoRaWANEndDeviceRegistryNS::GetSize (void) const
+{
+  return m_deviceAddress.size ();
+}
+
+void
+LoRaWANEndDeviceRegistryNS::SetClassB (uint32_t index, bool isClassB)
+{
+  NS_ASSERT (index < GetSize ());
+  if (m_isClassB[index] == isClassB)
+    return;
+
+  m_isClassB[index] = isClassB;
+  if (isClassB) {
+    m_classBPosition[index] = m_classBDevices.size ();
+    m_classBDevices.push_back (index);
+  } else { // move the last Class B device into the position of this device
+    const uint32_t position = m_classBPosition[index];
+    const uint32_t last = m_classBDevices.back ();
+    m_classBDevices[position] = last;
+    m_classBPosition[last] = position;
+    m_classBDevices.pop_back ();
+    m_classBPosition[index] = INVALID_INDEX;
+  }
+}
+
+const std::vector<uint32_t>&
+LoRaWANEndDeviceRegistryNS::GetClassBDevices (void) const
+{
+  return m_classBDevices;
+}
+
+void
+LoRaWANEndDeviceRegistryNS::Clear (void)
+{
+  for (auto it = m_downstreamQueue.begin (); it != m_downstreamQueue.end (); it++)
+    it->Clear ();
+  for (auto it = m_ClassBdownstreamQueue.begin (); it != m_ClassBdownstreamQueue.end (); it++)
+    it->Clear ();
+
+  m_indices.clear ();
+  m_classBDevices.clear ();
+  m_classBPosition.clear ();
+  m_deviceAddress.clear ();
+  m_fCntUp.clear ();
+  m_fCntDown.clear ();
+  m_lastSeen.clear ();
+  m_rx1DROffset.clear ();
+  m_lastDataRateIndex.clear ();
+  m_lastChannelIndex.clear ();
+  m_lastCodeRate.clear ();
+  m_framePending.clear ();
+  m_setAck.clear ();
+  m_isClassB.clear ();
+  m_lastGWs.clear ();
+  m_rw1Timer.clear ();
+  m_rw2Timer.clear ();
+  m_downstreamQueue.clear ();
+  m_ClassBdownstreamQueue.clear ();
+  m_ClassBPingSlots.clear ();
+  m_ClassBPingPeriodicity.clear ();
+  m_ClassBChannelIndex.clear ();
+  m_ClassBDataRateIndex.clear ();
+  m_ClassBCodeRateIndex.clear ();
+  m_ClassBPingOffset.clear ();
+  m_ClassBPingSlotTimer.clear ();
+  m_lastDSGW.clear ();
+  m_lastRxMetadata.clear ();
+  m_downstreamTimer.clear ();
+  m_ClassBdownstreamTimer.clear ();
+  m_ClassBdownstreamTimerSchedule.clear ();
+  m_stats.clear ();
+}
+
+const uint32_t LoRaWANPingSlotTable::NUM_SLOTS;
+
+LoRaWANPingSlotTable::LoRaWANPingSlotTable ()
+  : m_index (16, 0),
+    m_epoch (0)
+{
+}
+
+void
+LoRaWANPingSlotTable::NewEpoch (void)
+{
+  m_epoch++;
+}
+
+LoRaWANPingSlotTable::Entry&
+LoRaWANPingSlotTable::Get (uint64_t slot)
+{
+  NS_ASSERT (slot < NUM_SLOTS);
+
+  uint32_t pos = Probe (slot);
+  if (m_index[pos] == 0)
+    {
+      // keep the load factor of the hash table at most 1/2
+      if ((m_entries.size () + 1) * 2 > m_index.size ())
+        {
+          Grow ();
+          pos = Probe (slot);
+        }
+
+      Entry entry;
+      entry.m_slot = slot;
+      entry.m_epoch = m_epoch;
+      entry.m_allocated = 0;
+      entry.m_used = 0;
+      entry.m_failedToUseCollision = 0;
+      entry.m_failedToUseDutyCycle = 0;
+      m_entries.push_back (entry);
+      m_index[pos] = m_entries.size ();
+    }
+
+  Entry &entry = m_entries[m_index[pos] - 1];
+  if (entry.m_epoch != m_epoch)
+    {
+      entry.m_reservations.clear (); // reserved in an earlier epoch
+      entry.m_epoch = m_epoch;
+    }
+  return entry;
+}
+
+const std::vector<LoRaWANPingSlotTable::Entry>&
+LoRaWANPingSlotTable::GetEntries (void) const
+{
+  return m_entries;
+}
+
+void
+LoRaWANPingSlotTable::Clear (void)
+{
+  m_entries.clear ();
+  m_index.assign (16, 0);
+}
+
+uint32_t
+LoRaWANPingSlotTable::Probe (uint16_t slot) const
+{
+  // slots of one device are a multiple of the ping period apart, so scramble the bits before masking
+  const uint32_t mask = m_index.size () - 1;
+  uint32_t pos = ((slot * 2654435761u) >> 16) & mask;
+  while (m_index[pos] != 0 && m_entries[m_index[pos] - 1].m_slot != slot)
+    pos = (pos + 1) & mask;
+  return pos;
+}
+
+void
+LoRaWANPingSlotTable::Grow (void)
+{
+  m_index.assign (m_index.size () * 2, 0);
+  for (uint32_t i = 0; i < m_entries.size (); i++)
+    m_index[Probe (m_entries[i].m_slot)] = i + 1;
+}
+
   //set m_generateDataDown and m_generateClassBDataDown to generate Class A dl data and Class B dl data w/ beacons respectively
-  LoRaWANNetworkServer::LoRaWANNetworkServer () : m_endDevices(), m_pktSize(0), m_generateDataDown(false), m_confirmedData(false), m_endDevicesPopulated(false), m_downstreamIATRandomVariable(nullptr), m_nrRW1Sent(0), m_nrRW2Sent(0), m_nrRW1Missed(0), m_nrRW2Missed(0), m_ClassBpktSize(21), m_ClassBdownstreamIATRandomVariable(nullptr), m_ClassBdownstreamRandomVariable(nullptr), m_beaconTimer(), m_gateways(), m_generateClassBDataDown(true), m_ClassBBeaconChannelIndex(7), m_ClassBBeaconDataRateIndex(3), m_numberOfBeacons(0) {}
+  LoRaWANNetworkServer::LoRaWANNetworkServer () : m_endDevices(), m_pktSize(0), m_generateDataDown(false), m_confirmedData(false), m_endDevicesPopulated(false), m_downstreamIATRandomVariable(nullptr), m_nrRW1Sent(0), m_nrRW2Sent(0), m_nrRW1Missed(0), m_nrRW2Missed(0), m_ClassBpktSize(21), m_ClassBdownstreamIATRandomVariable(nullptr), m_ClassBdownstreamRandomVariable(nullptr), m_beaconTimer(), m_gateways(), m_generateClassBDataDown(true), m_ClassBBeaconChannelIndex(7), m_ClassBBeaconDataRateIndex(3), m_numberOfBeacons(0), m_lastBeaconTime(Seconds (0)) {}
 
   TypeId
   LoRaWANNetworkServer::GetTypeId (void)
@@ -160,12 +444,7 @@ namespace ns3 {
         continue;
       }
 
-      // Construct LoRaWANEndDeviceInfoNS object
-      LoRaWANEndDeviceInfoNS info = InitEndDeviceInfo (ipv4DevAddr);
-
-      uint32_t key = ipv4DevAddr.Get (); 
-
-      m_endDevices[key] = info; // store object
+      AddEndDevice (ipv4DevAddr);
     } else {
       NS_LOG_ERROR (this << " Unable to allocate device address");
       continue;
@@ -179,28 +458,25 @@ LoRaWANNetworkServer::DoDispose (void)
 {
   NS_LOG_FUNCTION (this);
   PrintFinalDetails();
+  m_endDevices.Clear ();
+  LoRaWANClassBPingOffsetCalculator::Get ()->Clear ();
 
   Object::DoDispose ();
 }
 
-LoRaWANEndDeviceInfoNS
-LoRaWANNetworkServer::InitEndDeviceInfo (Ipv4Address ipv4DevAddr)
+uint32_t
+LoRaWANNetworkServer::AddEndDevice (Ipv4Address ipv4DevAddr)
 {
-  uint32_t key = ipv4DevAddr.Get ();
-
-  // Construct LoRaWANEndDeviceInfoNS object
-  LoRaWANEndDeviceInfoNS info;
-  info.m_deviceAddress = ipv4DevAddr;
-  info.m_rx1DROffset = 0; // default
-  info.m_setAck = false;
+  // (Re)initialize the fields of the end device
+  uint32_t index = m_endDevices.Add (ipv4DevAddr);
 
   if (m_generateDataDown) {
     Time t = Seconds (this->m_downstreamIATRandomVariable->GetValue ());
-    info.m_downstreamTimer = Simulator::Schedule (t, &LoRaWANNetworkServer::DSTimerExpired, this, key);
+    m_endDevices.m_downstreamTimer[index] = Simulator::Schedule (t, &LoRaWANNetworkServer::DSTimerExpired, this, index);
     NS_LOG_DEBUG (this << " DS Traffic Timer for node " << ipv4DevAddr << " scheduled at " << t);
   }
 
-  return info;
+  return index;
 }
 
 Ptr<LoRaWANNetworkServer>
@@ -236,57 +512,62 @@ LoRaWANNetworkServer::HandleUSPacket (Ptr<LoRaWANGatewayApplication> lastGW, Add
   Ipv4Address deviceAddr = frmHdr.getDevAddr ();
   //NS_LOG_INFO(this << "Received packet from device addr = " << deviceAddr);
   uint32_t key = deviceAddr.Get ();
-  auto it = m_endDevices.find (key);
-  if (it == m_endDevices.end ()) { // not found, so create a new struct and insert it (note this should have already happened in DoInitialize()):
+  uint32_t index = m_endDevices.Find (key);
+  if (index == LoRaWANEndDeviceRegistryNS::INVALID_INDEX) { // not found, so add the end device (note this should have already happened in PopulateEndDevices()):
     NS_LOG_WARN (this << " end device with address = " << deviceAddr << " not found in m_endDevices, allocating");
 
-    LoRaWANEndDeviceInfoNS info = InitEndDeviceInfo (deviceAddr);
-    m_endDevices[key] = info;
-    it = m_endDevices.find (key);
+    index = AddEndDevice (deviceAddr);
   }
 
   // Always update number of received upstream packets:
-  it->second.m_nUSPackets += 1;
+  m_endDevices.m_stats[index].m_nUSPackets += 1;
 
   // Always update last seen GWs:
-  if ((Simulator::Now () - it->second.m_lastSeen) > Seconds(1.0)) { // assume a new upstream transmission, so clear the vector of seenGWs
-    it->second.m_lastGWs.clear ();
+  if ((Simulator::Now () - m_endDevices.m_lastSeen[index]) > Seconds(1.0)) { // assume a new upstream transmission, so clear the vector of seenGWs
+    m_endDevices.m_lastGWs[index].clear ();
+  }
+  m_endDevices.m_lastGWs[index].push_back (lastGW);
+
+  // Keep the reception metadata of the gateway that received the transmission best:
+  LoRaWANPhyParamsTag phyParamsTag;
+  if (packet->PeekPacketTag (phyParamsTag)) {
+    LoRaWANRxMetadata rxMetadata = phyParamsTag.GetRxMetadata ();
+    if (m_endDevices.m_lastGWs[index].size () == 1 || rxMetadata.m_rssi > m_endDevices.m_lastRxMetadata[index].m_rssi)
+      m_endDevices.m_lastRxMetadata[index] = rxMetadata;
   }
-  it->second.m_lastGWs.push_back (lastGW);
 
   // Check for duplicate.
   // Depending on the frame counter and received time, we can classify the US Packet as:
   // i) The first time the NS sees the US Packet: i.e. new frame counter up value
   // ii) Retransmission of a previously transmitted US Packet (then the NS has to reply with an Ack): i.e. frame counter up already seen, seen longer than 1 second ago
   // iii) The same transmission received by a second Gateway (in this case we can drop the packet): i.e. frame counter up already seen, seen shorter than 1 second ago
-  bool firstRX = it->second.m_nUSPackets == 0;
+  bool firstRX = m_endDevices.m_stats[index].m_nUSPackets == 0;
   bool processMACAck = true;
-  if (frmHdr.getFrameCounter () <= it->second.m_fCntUp && !firstRX) {
-    Time t = Simulator::Now () - it->second.m_lastSeen;
+  if (frmHdr.getFrameCounter () <= m_endDevices.m_fCntUp[index] && !firstRX) {
+    Time t = Simulator::Now () - m_endDevices.m_lastSeen[index];
     if (t <= Seconds (1.0)) { // assume US packet is really a duplicate received by a second gateway
       // Duplicate, drop packet
-      it->second.m_nUSDuplicates += 1;
-      NS_LOG_INFO (this << " Duplicate detected: " << frmHdr.getFrameCounter () << " <= " << it->second.m_fCntUp << " &&  t = " << t << " < 1 second => dropping packet");
+      m_endDevices.m_stats[index].m_nUSDuplicates += 1;
+      NS_LOG_INFO (this << " Duplicate detected: " << frmHdr.getFrameCounter () << " <= " << m_endDevices.m_fCntUp[index] << " &&  t = " << t << " < 1 second => dropping packet");
       // TODO: add trace for dropping duplicate packets?
       return;
     } else { // assume US packet is a retransmission
-      it->second.m_nUSRetransmission += 1;
+      m_endDevices.m_stats[index].m_nUSRetransmission += 1;
       processMACAck = false; // as we have already receive this US packet is a retransmission, we should not process the Ack flag set in the MAC header (but we should still open a RW or reply with an Ack if necessary)
     }
   } else { // new US frame counter value -> update number of unique packets received and US frame counter
-    it->second.m_nUniqueUSPackets += 1;
-    it->second.m_fCntUp = frmHdr.getFrameCounter (); // update US frame counter
+    m_endDevices.m_stats[index].m_nUniqueUSPackets += 1;
+    m_endDevices.m_fCntUp[index] = frmHdr.getFrameCounter (); // update US frame counter
   }
 
-  // Update fields in LoRaWANEndDeviceInfoNS:
-  it->second.m_lastSeen = Simulator::Now ();
+  // Update fields in m_endDevices:
+  m_endDevices.m_lastSeen[index] = Simulator::Now ();
 
   // Parse PhyRx Packet Tag
-  LoRaWANPhyParamsTag phyParamsTag;
   if (packet->RemovePacketTag (phyParamsTag)) {
-    it->second.m_lastChannelIndex = phyParamsTag.GetChannelIndex ();
-    it->second.m_lastDataRateIndex = phyParamsTag.GetDataRateIndex ();
-    it->second.m_lastCodeRate = phyParamsTag.GetCodeRate ();
+    m_endDevices.m_lastChannelIndex[index] = phyParamsTag.GetChannelIndex ();
+    m_endDevices.m_lastDataRateIndex[index] = phyParamsTag.GetDataRateIndex ();
+    m_endDevices.m_lastCodeRate[index] = phyParamsTag.GetCodeRate ();
   } else {
     NS_LOG_WARN (this << " LoRaWANPhyParamsTag not found on packet.");
   }
@@ -297,7 +578,7 @@ LoRaWANNetworkServer::HandleUSPacket (Ptr<LoRaWANGatewayApplication> lastGW, Add
     LoRaWANMsgType msgType = msgTypeTag.GetMsgType();
 
     if (msgType == LORAWAN_CONFIRMED_DATA_UP) {
-      it->second.m_setAck = true; // Set ack bit in next DS msg
+      m_endDevices.m_setAck[index] = true; // Set ack bit in next DS msg
       NS_LOG_DEBUG (this << " Received Confirmed Data UP. Next DS Packet will have Ack bit set");
     }
   } else {
@@ -309,20 +590,20 @@ LoRaWANNetworkServer::HandleUSPacket (Ptr<LoRaWANGatewayApplication> lastGW, Add
 
   // Parse Ack flag:
   if (processMACAck && frmHdr.getAck ()) {
-    it->second.m_nUSAcks += 1;
+    m_endDevices.m_stats[index].m_nUSAcks += 1;
 
-    if (!it->second.m_downstreamQueue.empty ()) { // there is a DS message in the queue
-      if (it->second.m_downstreamQueue.front()->m_downstreamMsgType == LORAWAN_CONFIRMED_DATA_DOWN) { // End device confirmed reception of DS packet, so we can remove it:
-        LoRaWANNSDSQueueElement* ptr = it->second.m_downstreamQueue.front();
+    if (!m_endDevices.m_downstreamQueue[index].IsEmpty ()) { // there is a DS message in the queue
+      if (m_endDevices.m_downstreamQueue[index].Front ()->m_downstreamMsgType == LORAWAN_CONFIRMED_DATA_DOWN) { // End device confirmed reception of DS packet, so we can remove it:
+        LoRaWANNSDSQueueElement* ptr = m_endDevices.m_downstreamQueue[index].Front ();
 
         // LOG that network server received an Acknowledgment for a DS packet
         m_dsMsgAckdTrace (key, ptr->m_downstreamTransmissionsRemaining, ptr->m_downstreamMsgType, ptr->m_downstreamPacket);
 
-        this->DeleteFirstDSQueueElement (key);
+        this->DeleteFirstDSQueueElement (index);
 
         NS_LOG_DEBUG (this << " Received Ack for Confirmed DS packet, removing packet from DS queue for end device " << deviceAddr);
       } else {
-        NS_LOG_ERROR (this << " Upstream frame has Ack bit set, but downstream frame msg type is not Confirmed (msgType = " << it->second.m_downstreamQueue.front()->m_downstreamMsgType << ")");
+        NS_LOG_ERROR (this << " Upstream frame has Ack bit set, but downstream frame msg type is not Confirmed (msgType = " << m_endDevices.m_downstreamQueue[index].Front ()->m_downstreamMsgType << ")");
       }
     } else {
       // One occurence of this condition is when the NS receives a retransmission that re-acknowledges a previously send DS confirmed packet
@@ -334,67 +615,57 @@ LoRaWANNetworkServer::HandleUSPacket (Ptr<LoRaWANGatewayApplication> lastGW, Add
 
   // Parse Class B flag
 
-  if (frmHdr.getClassB () && !(it->second.m_isClassB) && m_generateClassBDataDown) {
+  if (frmHdr.getClassB () && !(m_endDevices.m_isClassB[index]) && m_generateClassBDataDown) {
     //turning on Class B mode
     NS_LOG_DEBUG("Turning on Class B mode");
-    it->second.m_isClassB = true;
+    m_endDevices.SetClassB (index, true);
 
-    it->second.m_ClassBPingSlots = std::pow(2.0, 7 - it->second.m_ClassBPingPeriodicity); // number of ping slots is based on ping periodicity, and is always a power of two.
-    it->second.m_ClassBDataRateIndex = m_defaultClassBDataRateIndex;
+    m_endDevices.m_ClassBPingSlots[index] = std::pow(2.0, 7 - m_endDevices.m_ClassBPingPeriodicity[index]); // number of ping slots is based on ping periodicity, and is always a power of two.
+    m_endDevices.m_ClassBDataRateIndex[index] = m_defaultClassBDataRateIndex;
 
     //start the downlink data generation
-    uint32_t key = it->second.m_deviceAddress.Get (); 
     Time t = Seconds (this->m_ClassBdownstreamRandomVariable->GetValue ());
-    it->second.m_ClassBdownstreamTimer = Simulator::Schedule (t, &LoRaWANNetworkServer::ClassBDSTimerExpired, this, key);
-    NS_LOG_DEBUG (this << " Class B DS Traffic Timer for node " << it->second.m_deviceAddress << " scheduled at " << t);
+    m_endDevices.m_ClassBdownstreamTimer[index] = Simulator::Schedule (t, &LoRaWANNetworkServer::ClassBDSTimerExpired, this, index);
+    NS_LOG_DEBUG (this << " Class B DS Traffic Timer for node " << m_endDevices.m_deviceAddress[index] << " scheduled at " << t);
 
     Time t2 = Seconds (this->m_ClassBdownstreamIATRandomVariable->GetValue ());
-    it->second.m_ClassBdownstreamTimerSchedule = Simulator::Schedule (t2, &LoRaWANNetworkServer::ClassBScheduleExpiry, this, key);
+    m_endDevices.m_ClassBdownstreamTimerSchedule[index] = Simulator::Schedule (t2, &LoRaWANNetworkServer::ClassBScheduleExpiry, this, index);
     
-  } else if (!(frmHdr.getClassB ()) && it->second.m_isClassB && m_generateClassBDataDown) {
+  } else if (!(frmHdr.getClassB ()) && m_endDevices.m_isClassB[index] && m_generateClassBDataDown) {
     //turning off Class B mode
     NS_LOG_DEBUG("Turning off Class B mode");
-    it->second.m_isClassB = false;
-
-    //stop the downlink data generation
-    it->second.m_ClassBdownstreamTimer = EventId();
-    it->second.m_ClassBdownstreamTimerSchedule = EventId();
+    ClassBStop (index);
   }
 
   // We should always schedule a timer, even when m_downstreamPacket is NULL as a new DS packet might be generated between now and RW1
-  if (it->second.m_rw1Timer.IsRunning()) {
-    NS_LOG_ERROR (this << " Scheduling RW1 timer while RW1 timer was already scheduled for " << it->second.m_rw1Timer.GetTs ());
+  if (m_endDevices.m_rw1Timer[index].IsRunning()) {
+    NS_LOG_ERROR (this << " Scheduling RW1 timer while RW1 timer was already scheduled for " << m_endDevices.m_rw1Timer[index].GetTs ());
   }
   Time receiveDelay = MicroSeconds (RECEIVE_DELAY1);
-  it->second.m_rw1Timer = Simulator::Schedule (receiveDelay, &LoRaWANNetworkServer::RW1TimerExpired, this, key);
+  m_endDevices.m_rw1Timer[index] = Simulator::Schedule (receiveDelay, &LoRaWANNetworkServer::RW1TimerExpired, this, index);
 }
 
 bool
-LoRaWANNetworkServer::HaveSomethingToSendToEndDevice (uint32_t deviceAddr)
+LoRaWANNetworkServer::HaveSomethingToSendToEndDevice (uint32_t index)
 {
-  uint32_t key = deviceAddr;
-  auto it_ed = m_endDevices.find (key);
-
-  return it_ed->second.m_downstreamQueue.size() > 0 || it_ed->second.m_setAck;
+  return !m_endDevices.m_downstreamQueue[index].IsEmpty () || m_endDevices.m_setAck[index];
 }
 
 void
-LoRaWANNetworkServer::RW1TimerExpired (uint32_t deviceAddr)
+LoRaWANNetworkServer::RW1TimerExpired (uint32_t index)
 {
-  NS_LOG_FUNCTION (this << deviceAddr);
-
-  uint32_t key = deviceAddr;
-  auto it_ed = m_endDevices.find (key);
+  NS_LOG_FUNCTION (this << index);
 
   // Check whether any GW in lastGWs can send a downstream transmission immediately (i.e. right now) in RW1
   bool foundGW = false;
-  // The RW1 LoRa channel and data rate are the same as used in the last US transmission
-  const uint8_t dsChannelIndex = it_ed->second.m_lastChannelIndex;
-  const uint8_t dsDataRateIndex = it_ed->second.m_lastDataRateIndex;
-  for (auto it_gw = it_ed->second.m_lastGWs.cbegin(); it_gw != it_ed->second.m_lastGWs.cend(); it_gw++) {
-    if ((*it_gw)->CanSendImmediatelyOnChannel (dsChannelIndex, dsDataRateIndex)) {
+  // The RW1 LoRa channel is the same as used in the last US transmission, the data rate depends on the RX1DROffset (see SendDSPacket)
+  const uint8_t dsChannelIndex = m_endDevices.m_lastChannelIndex[index];
+  const uint8_t dsDataRateIndex = LoRaWAN::GetRX1DataRateIndex (m_endDevices.m_lastDataRateIndex[index], m_endDevices.m_rx1DROffset[index]);
+  const Time airTime = GetNextDSAirTime (index, dsChannelIndex, dsDataRateIndex);
+  for (auto it_gw = m_endDevices.m_lastGWs[index].cbegin(); it_gw != m_endDevices.m_lastGWs[index].cend(); it_gw++) {
+    if ((*it_gw)->CanSendImmediatelyOnChannel (dsChannelIndex, dsDataRateIndex, airTime)) {
       foundGW = true;
-      this->SendDSPacket (deviceAddr, *it_gw, true, false);
+      this->SendDSPacket (index, *it_gw, true, false);
       break;
     }
   }
@@ -403,80 +674,101 @@ LoRaWANNetworkServer::RW1TimerExpired (uint32_t deviceAddr)
     NS_LOG_DEBUG (this << " No gateway available for transmission in RW1, scheduling timer for DS transmission in RW2");
 
     // Increment m_nrRW1Missed only if there is something to send:
-    if (HaveSomethingToSendToEndDevice (deviceAddr)) {
+    if (HaveSomethingToSendToEndDevice (index)) {
       m_nrRW1Missed++;
     }
 
-    if (it_ed->second.m_rw2Timer.IsRunning()) {
-      NS_LOG_ERROR (this << " Scheduling RW2 timer while RW2 timer was already scheduled for " << it_ed->second.m_rw2Timer.GetTs ());
+    if (m_endDevices.m_rw2Timer[index].IsRunning()) {
+      NS_LOG_ERROR (this << " Scheduling RW2 timer while RW2 timer was already scheduled for " << m_endDevices.m_rw2Timer[index].GetTs ());
     }
 
     // Time receiveDelay = MicroSeconds (RECEIVE_DELAY2);
-    Time receiveDelay = (it_ed->second.m_lastSeen + MicroSeconds (RECEIVE_DELAY2)) - Simulator::Now ();
+    Time receiveDelay = (m_endDevices.m_lastSeen[index] + MicroSeconds (RECEIVE_DELAY2)) - Simulator::Now ();
     NS_ASSERT (receiveDelay > 0);
-    it_ed->second.m_rw2Timer = Simulator::Schedule (receiveDelay, &LoRaWANNetworkServer::RW2TimerExpired, this, key);
+    m_endDevices.m_rw2Timer[index] = Simulator::Schedule (receiveDelay, &LoRaWANNetworkServer::RW2TimerExpired, this, index);
   }
 }
 
 void
-LoRaWANNetworkServer::RW2TimerExpired (uint32_t deviceAddr)
+LoRaWANNetworkServer::RW2TimerExpired (uint32_t index)
 {
-  NS_LOG_FUNCTION (this << deviceAddr);
-
-  uint32_t key = deviceAddr;
-  auto it_ed = m_endDevices.find (key);
+  NS_LOG_FUNCTION (this << index);
 
   // Check whether any GW in lastGWs can send a downstream transmission immediately (i.e. right now) in RW2
   // The RW2 LoRa channel is a fixed channel depending on the region, for EU this is the high power 869.525 MHz channel
   const uint8_t dsChannelIndex = LoRaWAN::m_RW2ChannelIndex;
   const uint8_t dsDataRateIndex = LoRaWAN::m_RW2DataRateIndex;
+  const Time airTime = GetNextDSAirTime (index, dsChannelIndex, dsDataRateIndex);
   bool foundGW = false;
-  for (auto it_gw = it_ed->second.m_lastGWs.cbegin(); it_gw != it_ed->second.m_lastGWs.cend(); it_gw++) {
-    if ((*it_gw)->CanSendImmediatelyOnChannel (dsChannelIndex, dsDataRateIndex)) {
+  for (auto it_gw = m_endDevices.m_lastGWs[index].cbegin(); it_gw != m_endDevices.m_lastGWs[index].cend(); it_gw++) {
+    if ((*it_gw)->CanSendImmediatelyOnChannel (dsChannelIndex, dsDataRateIndex, airTime)) {
       foundGW = true;
-      this->SendDSPacket (deviceAddr, *it_gw, false, true);
+      this->SendDSPacket (index, *it_gw, false, true);
       break;
     }
   }
 
   if (!foundGW) {
     // Increment m_nrRW2Missed only if there is something to send:
-    if (HaveSomethingToSendToEndDevice (deviceAddr)) {
+    if (HaveSomethingToSendToEndDevice (index)) {
       m_nrRW2Missed++;
-      NS_LOG_INFO (this << " Unable to send DS transmission to device addr " << deviceAddr << " in RW1 and RW2, no gateway was available.");
+      NS_LOG_INFO (this << " Unable to send DS transmission to device addr " << m_endDevices.m_deviceAddress[index] << " in RW1 and RW2, no gateway was available.");
     }
   }
 }
 
-void
-LoRaWANNetworkServer::SendDSPacket (uint32_t deviceAddr, Ptr<LoRaWANGatewayApplication> gatewayPtr, bool RW1, bool RW2)
+Time
+LoRaWANNetworkServer::GetDSAirTime (Ptr<const Packet> payload, uint8_t framePort, uint8_t channelIndex, uint8_t dataRateIndex, uint8_t codeRate) const
 {
-  // Search device in m_endDevices:
-  auto it = m_endDevices.find (deviceAddr);
-  if (it == m_endDevices.end ()) { // end device not found
-    NS_LOG_ERROR (this << " Could not find device info struct in m_endDevices for dev addr " << deviceAddr << ". Aborting DS Transmission");
-    return;
+  LoRaWANFrameHeaderDownlink fhdr;
+  if (framePort > 0)
+    fhdr.setFramePort (framePort);
+
+  // The MAC of the gateway adds the MAC header (1B) and the MIC (4B), see LoRaWANMac::constructPhyPayload
+  const uint32_t phyPayloadSize = 1 + fhdr.GetSerializedSize () + payload->GetSize () + 4;
+  const LoRaSpreadingFactor sf = LoRaWAN::m_supportedDataRates [dataRateIndex].spreadingFactor;
+  const uint32_t bandwidth = LoRaWAN::m_supportedChannels [channelIndex].m_bw;
+  return LoRaWAN::GetTimeOnAir (sf, bandwidth, codeRate, 8, true, false, phyPayloadSize);
+}
+
+Time
+LoRaWANNetworkServer::GetNextDSAirTime (uint32_t index, uint8_t channelIndex, uint8_t dataRateIndex) const
+{
+  NS_ASSERT (index < m_endDevices.GetSize ());
+
+  // Same frame as SendDSPacket would send: the first pending DS packet or an empty Ack
+  if (!m_endDevices.m_downstreamQueue[index].IsEmpty ()) {
+    const LoRaWANNSDSQueueElement* element = m_endDevices.m_downstreamQueue[index].Front ();
+    return GetDSAirTime (element->m_downstreamPacket, element->m_downstreamFramePort, channelIndex, dataRateIndex, m_endDevices.m_lastCodeRate[index]);
   }
+  return GetDSAirTime (Create<Packet> (0), 0, channelIndex, dataRateIndex, m_endDevices.m_lastCodeRate[index]);
+}
+
+void
+LoRaWANNetworkServer::SendDSPacket (uint32_t index, Ptr<LoRaWANGatewayApplication> gatewayPtr, bool RW1, bool RW2)
+{
+  NS_ASSERT (index < m_endDevices.GetSize ());
+  const uint32_t deviceAddr = m_endDevices.m_deviceAddress[index].Get ();
 
   // Check if we have a last known GW for the device:
-  // bool haveGW = it->second.m_lastGWs.size () > 0;
+  // bool haveGW = m_endDevices.m_lastGWs[index].size () > 0;
   // if (!haveGW) {
   //   NS_LOG_ERROR (this << " lastGW is not set for dev addr " << deviceAddr << ". Aborting DS Transmission");
   //   return;
   // }
-  // Ptr <LoRaWANGatewayApplication> lastGW = *it->second.m_lastGWs.begin ();
+  // Ptr <LoRaWANGatewayApplication> lastGW = *m_endDevices.m_lastGWs[index].begin ();
 
   // Figure out which DS packet to send
   LoRaWANNSDSQueueElement elementToSend;
   bool deleteQueueElement = false;
-  if (it->second.m_downstreamQueue.size() > 0) {
-    LoRaWANNSDSQueueElement* element = it->second.m_downstreamQueue.front ();
+  if (!m_endDevices.m_downstreamQueue[index].IsEmpty ()) {
+    LoRaWANNSDSQueueElement* element = m_endDevices.m_downstreamQueue[index].Front ();
 
     // Bookkeeping for Confirmed packets:
     if (element->m_downstreamMsgType == LORAWAN_CONFIRMED_DATA_DOWN) {
       // Count number of retransmissions:
       if (element->m_isRetransmission) {
-        it->second.m_nDSRetransmission++;
+        m_endDevices.m_stats[index].m_nDSRetransmission++;
       }
 
       // Update for next transmission:
@@ -501,7 +793,7 @@ LoRaWANNetworkServer::SendDSPacket (uint32_t deviceAddr, Ptr<LoRaWANGatewayAppli
     elementToSend.m_downstreamFramePort = element->m_downstreamFramePort;
     elementToSend.m_downstreamTransmissionsRemaining = element->m_downstreamTransmissionsRemaining;
   } else {
-    if (!it->second.m_setAck) {
+    if (!m_endDevices.m_setAck[index]) {
       // Not really a warning as there is just no need to send a DS packet (i.e. no data and no Ack)
       NS_LOG_INFO (this << " No downstream packet found nor is ack bit set for dev addr " << deviceAddr << ". Aborting DS transmission");
       return;
@@ -529,9 +821,9 @@ LoRaWANNetworkServer::SendDSPacket (uint32_t deviceAddr, Ptr<LoRaWANGatewayAppli
   //LoRaWANFrameHeader fhdr;
   LoRaWANFrameHeaderDownlink fhdr;
   fhdr.setDevAddr (Ipv4Address (deviceAddr));
-  fhdr.setAck (it->second.m_setAck);
-  fhdr.setFramePending (it->second.m_framePending);
-  fhdr.setFrameCounter (++it->second.m_fCntDown);
+  fhdr.setAck (m_endDevices.m_setAck[index]);
+  fhdr.setFramePending (m_endDevices.m_framePending[index]);
+  fhdr.setFrameCounter (++m_endDevices.m_fCntDown[index]);
   if (elementToSend.m_downstreamFramePort > 0)
     fhdr.setFramePort (elementToSend.m_downstreamFramePort);
 
@@ -541,8 +833,8 @@ LoRaWANNetworkServer::SendDSPacket (uint32_t deviceAddr, Ptr<LoRaWANGatewayAppli
   uint8_t dsChannelIndex;
   uint8_t dsDataRateIndex;
   if (RW1) {
-    dsChannelIndex = it->second.m_lastChannelIndex;
-    dsDataRateIndex = LoRaWAN::GetRX1DataRateIndex (it->second.m_lastDataRateIndex, it->second.m_rx1DROffset);
+    dsChannelIndex = m_endDevices.m_lastChannelIndex[index];
+    dsDataRateIndex = LoRaWAN::GetRX1DataRateIndex (m_endDevices.m_lastDataRateIndex[index], m_endDevices.m_rx1DROffset[index]);
   } else if (RW2) {
     dsChannelIndex = LoRaWAN::m_RW2ChannelIndex;
     dsDataRateIndex = LoRaWAN::m_RW2DataRateIndex;
@@ -554,7 +846,7 @@ LoRaWANNetworkServer::SendDSPacket (uint32_t deviceAddr, Ptr<LoRaWANGatewayAppli
   LoRaWANPhyParamsTag phyParamsTag;
   phyParamsTag.SetChannelIndex (dsChannelIndex);
   phyParamsTag.SetDataRateIndex (dsDataRateIndex);
-  phyParamsTag.SetCodeRate (it->second.m_lastCodeRate);
+  phyParamsTag.SetCodeRate (m_endDevices.m_lastCodeRate[index]);
   phyParamsTag.SetPreambleLength (8);
   p->AddPacketTag (phyParamsTag);
 
@@ -564,46 +856,43 @@ LoRaWANNetworkServer::SendDSPacket (uint32_t deviceAddr, Ptr<LoRaWANGatewayAppli
   p->AddPacketTag (msgTypeTag);
 
   // Update DS Packet counters:
-  it->second.m_nDSPacketsSent += 1;
+  m_endDevices.m_stats[index].m_nDSPacketsSent += 1;
   if (RW1) {
     m_nrRW1Sent++;
-    it->second.m_nDSPacketsSentRW1 += 1;
+    m_endDevices.m_stats[index].m_nDSPacketsSentRW1 += 1;
   } else if (RW2) {
-    it->second.m_nDSPacketsSentRW2 += 1;
+    m_endDevices.m_stats[index].m_nDSPacketsSentRW2 += 1;
     m_nrRW2Sent++;
   }
-  if (it->second.m_setAck)
-    it->second.m_nDSAcks += 1;
+  if (m_endDevices.m_setAck[index])
+    m_endDevices.m_stats[index].m_nDSAcks += 1;
 
   // Store gatewayPtr as last DS GW:
-  it->second.m_lastDSGW = gatewayPtr;
+  m_endDevices.m_lastDSGW[index] = gatewayPtr;
 
   // Ask gateway application on lastseenGW to send the DS packet:
   gatewayPtr->SendDSPacket (p);
   NS_LOG_DEBUG (this << " Sent DS Packet to device addr " << deviceAddr << " via GW #" << gatewayPtr->GetNode()->GetId() << " in RW" << (RW1 ? "1" : "2"));
 
   // Reset data structures
-  it->second.m_setAck = false; // we only sent an Ack once, see Note on page 75 of LoRaWAN std
+  m_endDevices.m_setAck[index] = false; // we only sent an Ack once, see Note on page 75 of LoRaWAN std
 
   // For some cases (see deleteQueueElement bool), remove the pending DS packet here
   if (deleteQueueElement) {
-    this->DeleteFirstDSQueueElement (deviceAddr);
+    this->DeleteFirstDSQueueElement (index);
   }
 }
 
 void
-LoRaWANNetworkServer::DSTimerExpired (uint32_t deviceAddr)
+LoRaWANNetworkServer::DSTimerExpired (uint32_t index)
 {
-  NS_LOG_FUNCTION (this << deviceAddr);
+  NS_LOG_FUNCTION (this << index);
 
-  auto it = m_endDevices.find (deviceAddr);
-  if (it == m_endDevices.end ()) { // end device not found
-    NS_LOG_ERROR (this << " Could not find device info struct in m_endDevices for dev addr " << deviceAddr);
-    return;
-  }
+  NS_ASSERT (index < m_endDevices.GetSize ());
+  const uint32_t deviceAddr = m_endDevices.m_deviceAddress[index].Get ();
 
   // Generate a Downstream packet
-  if (it->second.m_downstreamQueue.size () > 0)
+  if (!m_endDevices.m_downstreamQueue[index].IsEmpty ())
     NS_LOG_INFO(this << " DS queue for end device " << Ipv4Address(deviceAddr) << " is not empty");
 
   NS_ASSERT (m_pktSize >= 8 + 1 + 4); // should be able to send at least frame header, MAC header and MAC MIC
@@ -643,31 +932,24 @@ LoRaWANNetworkServer::DSTimerExpired (uint32_t deviceAddr)
       element->m_downstreamTransmissionsRemaining = 1;
     }
     element->m_isRetransmission = false;
-    it->second.m_downstreamQueue.push_back (element);
-    it->second.m_nDSPacketsGenerated += 1;
+    m_endDevices.m_downstreamQueue[index].PushBack (element);
+    m_endDevices.m_stats[index].m_nDSPacketsGenerated += 1;
 
     m_dsMsgGeneratedTrace (deviceAddr, element->m_downstreamTransmissionsRemaining, element->m_downstreamMsgType, element->m_downstreamPacket);
-    NS_LOG_DEBUG (this << " Added downstream packet with size " << m_pktSize  << " to DS queue for end device " << Ipv4Address(deviceAddr) << ". queue size = " << it->second.m_downstreamQueue.size());
+    NS_LOG_DEBUG (this << " Added downstream packet with size " << m_pktSize  << " to DS queue for end device " << Ipv4Address(deviceAddr) << ". queue size = " << m_endDevices.m_downstreamQueue[index].GetSize ());
   }
 
   // Reschedule timer:
   Time t = Seconds (this->m_downstreamIATRandomVariable->GetValue ());
-  it->second.m_downstreamTimer = Simulator::Schedule (t, &LoRaWANNetworkServer::DSTimerExpired, this, deviceAddr);
-  NS_LOG_DEBUG (this << " DS Traffic Timer for end device " << it->second.m_deviceAddress << " scheduled at " << t);
+  m_endDevices.m_downstreamTimer[index] = Simulator::Schedule (t, &LoRaWANNetworkServer::DSTimerExpired, this, index);
+  NS_LOG_DEBUG (this << " DS Traffic Timer for end device " << m_endDevices.m_deviceAddress[index] << " scheduled at " << t);
 }
 
 void
-LoRaWANNetworkServer::DeleteFirstDSQueueElement (uint32_t deviceAddr)
+LoRaWANNetworkServer::DeleteFirstDSQueueElement (uint32_t index)
 {
-  auto it = m_endDevices.find (deviceAddr);
-  if (it == m_endDevices.end ()) { // end device not found
-    NS_LOG_ERROR (this << " Could not find device info struct in m_endDevices for dev addr " << deviceAddr << ". Unable to delete DS queue element.");
-    return;
-  }
-
-  LoRaWANNSDSQueueElement* ptr = it->second.m_downstreamQueue.front ();
-  delete ptr;
-  it->second.m_downstreamQueue.pop_front ();
+  NS_ASSERT (index < m_endDevices.GetSize ());
+  delete m_endDevices.m_downstreamQueue[index].PopFront ();
 }
 
 int64_t
@@ -695,39 +977,32 @@ LoRaWANNetworkServer::GetConfirmedDataDown (void) const
 
 
 void
-LoRaWANNetworkServer::ClassBScheduleExpiry(uint32_t deviceAddr)
+LoRaWANNetworkServer::ClassBScheduleExpiry(uint32_t index)
 {
-    auto it = m_endDevices.find (deviceAddr);
-    if (it == m_endDevices.end ()) { // end device not found
-      NS_LOG_ERROR (this << " Could not find device info struct in m_endDevices for dev addr " << deviceAddr);
-      return;
-    }
+    NS_ASSERT (index < m_endDevices.GetSize ());
 
     //Schedule a call to TimerExpired to a random time in the next 900 seconds
     Time t = Seconds (this->m_ClassBdownstreamRandomVariable->GetValue ());
-    it->second.m_ClassBdownstreamTimer = Simulator::Schedule (t, &LoRaWANNetworkServer::ClassBDSTimerExpired, this, deviceAddr);
-    NS_LOG_DEBUG (this << " Class B DS Traffic Timer for node " << deviceAddr << " scheduled at " << t);
+    m_endDevices.m_ClassBdownstreamTimer[index] = Simulator::Schedule (t, &LoRaWANNetworkServer::ClassBDSTimerExpired, this, index);
+    NS_LOG_DEBUG (this << " Class B DS Traffic Timer for node " << m_endDevices.m_deviceAddress[index] << " scheduled at " << t);
 
     //Schedule this function to be called again in (900) seconds
     Time t2 = Seconds (this->m_ClassBdownstreamIATRandomVariable->GetValue ());
-    it->second.m_ClassBdownstreamTimerSchedule = Simulator::Schedule (t2, &LoRaWANNetworkServer::ClassBScheduleExpiry, this, deviceAddr);
+    m_endDevices.m_ClassBdownstreamTimerSchedule[index] = Simulator::Schedule (t2, &LoRaWANNetworkServer::ClassBScheduleExpiry, this, index);
   }
 
 // adding a stream of data specifically to be sent as Class B downlink traffic.
 // based on DSTimerExpired 
 void
-LoRaWANNetworkServer::ClassBDSTimerExpired (uint32_t deviceAddr)
+LoRaWANNetworkServer::ClassBDSTimerExpired (uint32_t index)
 {
-    NS_LOG_FUNCTION (this << deviceAddr);
+    NS_LOG_FUNCTION (this << index);
 
-    auto it = m_endDevices.find (deviceAddr);
-  if (it == m_endDevices.end ()) { // end device not found
-    NS_LOG_ERROR (this << " Could not find device info struct in m_endDevices for dev addr " << deviceAddr);
-    return;
-  }
+  NS_ASSERT (index < m_endDevices.GetSize ());
+  const uint32_t deviceAddr = m_endDevices.m_deviceAddress[index].Get ();
 
   // Generate a Downstream packet
-  if (it->second.m_ClassBdownstreamQueue.size () > 0)
+  if (!m_endDevices.m_ClassBdownstreamQueue[index].IsEmpty ())
     NS_LOG_INFO(this << " Class B DS queue for end device " << Ipv4Address(deviceAddr) << " is not empty");
 
   NS_ASSERT (m_ClassBpktSize >= 8 + 1 + 4); // should be able to send at least frame header, MAC header and MAC MIC
@@ -763,12 +1038,15 @@ LoRaWANNetworkServer::ClassBDSTimerExpired (uint32_t deviceAddr)
     element->m_downstreamTransmissionsRemaining = 1;
 
     element->m_isRetransmission = false;
-    it->second.m_ClassBdownstreamQueue.push_back (element);
-    it->second.m_nClassBPacketsGenerated += 1;
+    m_endDevices.m_ClassBdownstreamQueue[index].PushBack (element);
+    m_endDevices.m_stats[index].m_nClassBPacketsGenerated += 1;
+
+    // make sure the next ping slot of the device is scheduled
+    ClassBScheduleNextPingSlot (index);
 
 
     m_dsMsgGeneratedTrace (deviceAddr, element->m_downstreamTransmissionsRemaining, element->m_downstreamMsgType, element->m_downstreamPacket);
-    NS_LOG_DEBUG (this << " Added downstream packet with size " << m_pktSize  << " to DS queue for end device " << Ipv4Address(deviceAddr) << ". queue size = " << it->second.m_downstreamQueue.size());
+    NS_LOG_DEBUG (this << " Added downstream packet with size " << m_pktSize  << " to DS queue for end device " << Ipv4Address(deviceAddr) << ". queue size = " << m_endDevices.m_downstreamQueue[index].GetSize ());
   }
 }
 
@@ -806,6 +1084,7 @@ LoRaWANNetworkServer::ClassBSendBeacon (){
 
   Time timestamp = Simulator::Now();
   Time nextBeacon = Seconds (128);
+  m_lastBeaconTime = timestamp;
 
   m_numberOfBeacons++;
 
@@ -851,9 +1130,13 @@ LoRaWANNetworkServer::ClassBSendBeacon (){
   //add the tags to the packet
   //note that there is no LoRa PHY or MAC headers in beacons
 
+  // Beacons are sent with CR 4/5, a 10 symbol preamble, an implicit header and without CRC (see LoRaWANGatewayApplication::SendBeacon)
+  const LoRaSpreadingFactor beaconSf = LoRaWAN::m_supportedDataRates [m_ClassBBeaconDataRateIndex].spreadingFactor;
+  const Time beaconAirTime = LoRaWAN::GetTimeOnAir (beaconSf, LoRaWAN::m_supportedChannels [m_ClassBBeaconChannelIndex].m_bw, 1, 10, false, true, 17);
+
   //indicate to gateways to send a beacon at exact right time
   for (auto gw = m_gateways.cbegin(); gw != m_gateways.cend(); gw++) {
-    if ((*gw)->CanSendImmediatelyOnChannel (m_ClassBBeaconChannelIndex, m_ClassBBeaconDataRateIndex)) {
+    if ((*gw)->CanSendImmediatelyOnChannel (m_ClassBBeaconChannelIndex, m_ClassBBeaconDataRateIndex, beaconAirTime)) {
         (*gw)->SendBeacon(p);
     }
     else{
@@ -861,75 +1144,48 @@ LoRaWANNetworkServer::ClassBSendBeacon (){
     }
   }
 
-  //schedule ping slots for all devices
-  for (auto d = m_endDevices.cbegin(); d != m_endDevices.cend(); d++) {
-
-    /*
-    period  = (2^32)/slots
-    R = AES_128_enc(16x 0x00, Time | DevAddr | pad16)
-    O = (R[0] + R[1] * 256) % period
-
-    then timings = {O + x*period | x < slots, x element of N}
+  //calculate the ping offsets of all Class B devices in one pass
+  /*
+  period  = (2^12)/slots
+  R = AES_128_enc(16x 0x00, Time | DevAddr | pad16)
+  O = (R[0] + R[1] * 256) % period
 
-    schedule the NS to call a sendDownlink function at each of those times, with the devAddr as parameter.
-    then the DL works similarly to the current DL function here, but with a set DR and channel. Closest GW is chosen.
-    Calculate all slots first, then schedule them - that way conflicting slots (same time and gw) can be handled.
-    */
+  then timings = {O + x*period | x < slots, x element of N}
 
-
-    if(d->second.m_isClassB) {
-
-      uint64_t period = std::pow(2.0, 12) / d->second.m_ClassBPingSlots;
-      uint8_t key[16] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }; // crypto not implemented across layers yet, assuming key of all 0s.   
-      uint8_t buf[16] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
-
-      double secs = timestamp.GetSeconds(); // convert to a 4 byte buffer
-      uint32_t secsTruncated = (uint32_t) secs;
-
-      uint8_t *sp = (uint8_t *)&secsTruncated;
-      buf[0] = sp[0];
-      buf[1] = sp[1];
-      buf[2] = sp[2];
-      buf[3] = sp[3];
-
-      Ipv4Address devAddr = d->second.m_deviceAddress;
-
-      uint8_t addr[4];
-      devAddr.Serialize(addr);
-      buf[4] = addr[0];
-      buf[5] = addr[1];
-      buf[6] = addr[2];
-      buf[7] = addr[3];
-
-      //pad16 is to ensure the buffer is 16 bytes long
-      //the rest of the buffer (the other 8 bytes) is just 0s.
-      for(uint i=8; i<16;i++){
-        buf[i] = 0;
-      }
-
-      AES aes;
-      aes.SetKey(key, 16);
-      aes.Encrypt(buf, 16);
-
-      uint64_t O = (buf[0] + buf[1]*256) % period;
-
-      Ipv4Address deviceAddr = d->second.m_deviceAddress;
-      uint32_t beacon_reserved = 2120; // ms 
-      uint32_t slotLength = 30; // ms
-      uint32_t dAddr = (uint32_t) deviceAddr.Get ();
-
-      //calculate and schedule ping slots for this device
-      NS_LOG_DEBUG("Scheduling ping slots for device" << deviceAddr.Get ());
-      for(uint i=0;i< d->second.m_ClassBPingSlots; i++){
-        uint64_t pingTime = beacon_reserved + (O + period*i) * slotLength; // Ping slot time is beacon_reserved + (pingOffset + N*pingPeriod) * slotLength
-        auto gw = d->second.m_lastGWs.cbegin(); // TODO: should loop through these in case the first one fails
-        (*gw)->RequestPingSlot(O + period*i, dAddr); 
-        Time ping = MilliSeconds(pingTime); 
-        NS_LOG_DEBUG("gw : ping slot for device " << dAddr << "is at " << Simulator::Now() + ping);
-        Simulator::Schedule (ping, &LoRaWANNetworkServer::ClassBPingSlot, this, dAddr, O + period*i);
-      }
+  the first ping slot of a device with pending traffic is scheduled, that ping slot schedules the next one.
+  the ping slots are reserved at the gateway first - that way conflicting slots (same time and gw) can be handled.
+  */
+  const std::vector<uint32_t> &classBDevices = m_endDevices.GetClassBDevices ();
+  uint8_t key[16] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }; // crypto not implemented across layers yet, assuming key of all 0s.
+  std::vector<Ipv4Address> devAddrs;
+  std::vector<uint8_t> pingSlots;
+  std::vector<uint16_t> offsets;
+  devAddrs.reserve (classBDevices.size ());
+  pingSlots.reserve (classBDevices.size ());
+  for (auto d = classBDevices.cbegin(); d != classBDevices.cend(); d++) {
+    devAddrs.push_back (m_endDevices.m_deviceAddress[*d]);
+    pingSlots.push_back (m_endDevices.m_ClassBPingSlots[*d]);
+  }
+  LoRaWANClassBPingOffsetCalculator::Get ()->GetPingOffsets (timestamp, devAddrs, pingSlots, key, offsets);
+
+  //schedule ping slots for all Class B devices
+  for (uint32_t d = 0; d < classBDevices.size (); d++) {
+    const uint32_t index = classBDevices[d];
+    const Ipv4Address devAddr = devAddrs[d];
+
+    uint64_t period = std::pow(2.0, 12) / m_endDevices.m_ClassBPingSlots[index];
+    uint64_t O = offsets[d];
+    m_endDevices.m_ClassBPingOffset[index] = O;
+
+    //reserve the ping slots of this device at its gateway
+    NS_LOG_DEBUG("Reserving ping slots for device" << devAddr.Get ());
+    auto gw = m_endDevices.m_lastGWs[index].cbegin(); // TODO: should loop through these in case the first one fails
+    for(uint i=0;i< m_endDevices.m_ClassBPingSlots[index]; i++){
+      (*gw)->RequestPingSlot(O + period*i, index); 
     }
 
+    //only the first usable ping slot is scheduled, and only when there is something to send
+    ClassBScheduleNextPingSlot (index);
   }
 
   //schedule next beacon
@@ -938,22 +1194,49 @@ LoRaWANNetworkServer::ClassBSendBeacon (){
 }
 
 void
-LoRaWANNetworkServer::ClassBPingSlot(uint32_t devAddr, uint64_t pingTime)
+LoRaWANNetworkServer::ClassBScheduleNextPingSlot (uint32_t index)
 {
-  //get device to send downlink to
-  auto it = m_endDevices.find (devAddr);
-  if (it == m_endDevices.end ()) { // end device not found
-    NS_LOG_ERROR (this << " Could not find device info struct in m_endDevices for dev addr " << devAddr);
+  NS_LOG_FUNCTION (this << index);
+
+  // Only Class B devices with a ping offset for the current beacon period and pending traffic need a ping slot
+  if (!m_endDevices.m_isClassB[index] || m_endDevices.m_ClassBPingOffset[index] == LoRaWANEndDeviceRegistryNS::NO_PING_OFFSET)
     return;
+  if (m_endDevices.m_ClassBdownstreamQueue[index].IsEmpty () || m_endDevices.m_ClassBPingSlotTimer[index].IsRunning ())
+    return;
+
+  const uint32_t beacon_reserved = 2120; // ms
+  const uint32_t slotLength = 30; // ms
+  const uint64_t period = std::pow(2.0, 12) / m_endDevices.m_ClassBPingSlots[index];
+  const uint64_t O = m_endDevices.m_ClassBPingOffset[index];
+  const Time elapsed = Simulator::Now () - m_lastBeaconTime;
+
+  for(uint i=0;i< m_endDevices.m_ClassBPingSlots[index]; i++){
+    Time ping = MilliSeconds (beacon_reserved + (O + period*i) * slotLength); // Ping slot time is beacon_reserved + (pingOffset + N*pingPeriod) * slotLength
+    if (ping > elapsed) {
+      NS_LOG_DEBUG("next ping slot for device " << m_endDevices.m_deviceAddress[index] << " is at " << m_lastBeaconTime + ping);
+      m_endDevices.m_ClassBPingSlotTimer[index] = Simulator::Schedule (ping - elapsed, &LoRaWANNetworkServer::ClassBPingSlot, this, index, O + period*i);
+      return;
+    }
   }
 
-  auto gw = it->second.m_lastGWs.cbegin(); 
+  // No ping slot left in this beacon period, the next beacon schedules one
+  NS_LOG_DEBUG("no ping slot left for device " << m_endDevices.m_deviceAddress[index] << " in this beacon period");
+}
+
+void
+LoRaWANNetworkServer::ClassBPingSlot(uint32_t index, uint64_t pingTime)
+{
+  //get device to send downlink to
+  NS_ASSERT (index < m_endDevices.GetSize ());
+  const uint32_t devAddr = m_endDevices.m_deviceAddress[index].Get ();
+
+  auto gw = m_endDevices.m_lastGWs[index].cbegin(); 
 
   // Figure out which DS packet to send
   LoRaWANNSDSQueueElement elementToSend;
-  if (it->second.m_ClassBdownstreamQueue.size() > 0) 
+  if (!m_endDevices.m_ClassBdownstreamQueue[index].IsEmpty ()) 
   {
-      LoRaWANNSDSQueueElement* element = it->second.m_ClassBdownstreamQueue.front ();
+      LoRaWANNSDSQueueElement* element = m_endDevices.m_ClassBdownstreamQueue[index].Front ();
 
       m_dsMsgDroppedTrace (devAddr, 0, element->m_downstreamMsgType, element->m_downstreamPacket);
 
@@ -967,19 +1250,21 @@ LoRaWANNetworkServer::ClassBPingSlot(uint32_t devAddr, uint64_t pingTime)
       return;
   } 
 
-  if((*gw)->IsTopOfPingSlotQueue(pingTime, devAddr))
+  if((*gw)->IsTopOfPingSlotQueue(pingTime, index))
   {   
       // Add Phy Packet tag to specify channel, data rate and code rate:
-      uint8_t dsChannelIndex = it->second.m_ClassBChannelIndex; 
-      uint8_t dsDataRateIndex = it->second.m_ClassBDataRateIndex;
-      uint8_t dsCodeRate = it->second.m_ClassBCodeRateIndex;
+      uint8_t dsChannelIndex = m_endDevices.m_ClassBChannelIndex[index]; 
+      uint8_t dsDataRateIndex = m_endDevices.m_ClassBDataRateIndex[index];
+      uint8_t dsCodeRate = m_endDevices.m_ClassBCodeRateIndex[index];
 
       //check if the packet can actually be sent right now
-      if( !(*gw)->CanSendImmediatelyOnChannel (dsChannelIndex, dsDataRateIndex) )
+      const Time airTime = GetDSAirTime (elementToSend.m_downstreamPacket, elementToSend.m_downstreamFramePort, dsChannelIndex, dsDataRateIndex, dsCodeRate);
+      if( !(*gw)->CanSendImmediatelyOnChannel (dsChannelIndex, dsDataRateIndex, airTime) )
       {
           //log err
           NS_LOG_INFO (this << " Ping slot can't be used because of duty cycle limits. Potential packet to " << devAddr << " not sent. Aborting DS transmission");
-          (*gw)->m_pingSlotFailedToUseDutyCycle[pingTime]++;
+          (*gw)->m_pingSlots.Get (pingTime).m_failedToUseDutyCycle++;
+          ClassBScheduleNextPingSlot (index);
           return;
       }
 
@@ -988,9 +1273,9 @@ LoRaWANNetworkServer::ClassBPingSlot(uint32_t devAddr, uint64_t pingTime)
       // Construct Frame Header:
       LoRaWANFrameHeaderDownlink fhdr;
       fhdr.setDevAddr (Ipv4Address (devAddr));
-      fhdr.setAck (it->second.m_setAck);
-      fhdr.setFramePending (it->second.m_framePending);
-      fhdr.setFrameCounter (++it->second.m_fCntDown);
+      fhdr.setAck (m_endDevices.m_setAck[index]);
+      fhdr.setFramePending (m_endDevices.m_framePending[index]);
+      fhdr.setFrameCounter (++m_endDevices.m_fCntDown[index]);
       if (elementToSend.m_downstreamFramePort > 0)
         fhdr.setFramePort (elementToSend.m_downstreamFramePort);
 
@@ -1010,23 +1295,40 @@ LoRaWANNetworkServer::ClassBPingSlot(uint32_t devAddr, uint64_t pingTime)
       p->AddPacketTag (msgTypeTag);
 
       // Update DS Packet counters:
-      it->second.m_nClassBPacketsSent += 1; 
+      m_endDevices.m_stats[index].m_nClassBPacketsSent += 1; 
 
       // Ask gateway application to send the DS packet:
       NS_LOG_DEBUG("Sending a downlink ping, from " << (*gw)->GetNode ()->GetDevice (0)->GetAddress () << " to " << Ipv4Address (devAddr) << "at time " << Simulator::Now() );
-      (*gw)->m_pingSlotUsed[pingTime]++;
+      (*gw)->m_pingSlots.Get (pingTime).m_used++;
       (*gw)->SendDSPacket (p);
 
-      LoRaWANNSDSQueueElement* ptr = it->second.m_ClassBdownstreamQueue.front ();
-      delete ptr;
-      it->second.m_ClassBdownstreamQueue.pop_front ();
+      delete m_endDevices.m_ClassBdownstreamQueue[index].PopFront ();
   }
   else
   {
       //log err
       NS_LOG_INFO (this << " Ping slot overlap. Potential packet to " << devAddr << " not sent. Aborting DS transmission");
-      return;
   }
+
+  // Chain to the next ping slot if there is more to send
+  ClassBScheduleNextPingSlot (index);
+}
+
+void
+LoRaWANNetworkServer::ClassBStop (uint32_t index)
+{
+  NS_LOG_FUNCTION (this << index);
+  NS_ASSERT (index < m_endDevices.GetSize ());
+
+  m_endDevices.SetClassB (index, false);
+
+  //stop the downlink data generation
+  m_endDevices.m_ClassBdownstreamTimer[index].Cancel ();
+  m_endDevices.m_ClassBdownstreamTimerSchedule[index].Cancel ();
+
+  //the device no longer listens in its ping slots
+  m_endDevices.m_ClassBPingSlotTimer[index].Cancel ();
+  m_endDevices.m_ClassBPingOffset[index] = LoRaWANEndDeviceRegistryNS::NO_PING_OFFSET;
 }
 
 void
@@ -1049,10 +1351,12 @@ LoRaWANNetworkServer::AssignInitialGateway(Ptr<LoRaWANGatewayApplication> gw)
         continue;
       }
 
-      // Construct LoRaWANEndDeviceInfoNS object
-      uint32_t key = ipv4DevAddr.Get ();
-      if(m_endDevices[key].m_lastGWs.size() == 0){
-        m_endDevices[key].m_lastGWs.push_back(gw);  
+      uint32_t index = m_endDevices.Find (ipv4DevAddr.Get ());
+      if (index == LoRaWANEndDeviceRegistryNS::INVALID_INDEX) {
+        index = m_endDevices.Add (ipv4DevAddr);
+      }
+      if(m_endDevices.m_lastGWs[index].size() == 0){
+        m_endDevices.m_lastGWs[index].push_back(gw);  
       }
     }
   }
@@ -1061,11 +1365,11 @@ LoRaWANNetworkServer::AssignInitialGateway(Ptr<LoRaWANGatewayApplication> gw)
 void
 LoRaWANNetworkServer::PrintFinalDetails ()
 {
-  for (auto d = m_endDevices.cbegin(); d != m_endDevices.cend(); d++) {
-    std::cout << d->second.m_deviceAddress.Get() << "\t" <<  d->second.m_nDSPacketsGenerated <<  
-    "\t" << d->second.m_nDSPacketsSent << "\t" << d->second.m_nDSPacketsSentRW1 << "\t" << d->second.m_nDSPacketsSentRW2 << 
-    "\t" << d->second.m_nDSRetransmission << "\t" << d->second.m_nDSAcks << "\t" << m_numberOfBeacons << 
-    "\t" << d->second.m_nClassBPacketsGenerated << "\t" << d->second.m_nClassBPacketsSent << "\t" << d->second.m_nUSPackets << std::endl;
+  for (uint32_t index = 0; index < m_endDevices.GetSize (); index++) {
+    std::cout << m_endDevices.m_deviceAddress[index].Get() << "\t" <<  m_endDevices.m_stats[index].m_nDSPacketsGenerated <<  
+    "\t" << m_endDevices.m_stats[index].m_nDSPacketsSent << "\t" << m_endDevices.m_stats[index].m_nDSPacketsSentRW1 << "\t" << m_endDevices.m_stats[index].m_nDSPacketsSentRW2 << 
+    "\t" << m_endDevices.m_stats[index].m_nDSRetransmission << "\t" << m_endDevices.m_stats[index].m_nDSAcks << "\t" << m_numberOfBeacons << 
+    "\t" << m_endDevices.m_stats[index].m_nClassBPacketsGenerated << "\t" << m_endDevices.m_stats[index].m_nClassBPacketsSent << "\t" << m_endDevices.m_stats[index].m_nUSPackets << std::endl;
   }
   
 }
@@ -1119,6 +1423,7 @@ LoRaWANGatewayApplication::DoDispose (void)
   NS_LOG_FUNCTION (this);
 
   PrintFinalDetails();
+  m_pingSlots.Clear ();
   m_socket = 0;
   this->m_lorawanNSPtr = nullptr;
   // clear ref count in static member, as to destroy the LoRaWANNetworkServer object.
@@ -1154,9 +1459,9 @@ LoRaWANGatewayApplication::AssignStreams (int64_t stream)
 }
 
 bool
-LoRaWANGatewayApplication::CanSendImmediatelyOnChannel (uint8_t channelIndex, uint8_t dataRateIndex)
+LoRaWANGatewayApplication::CanSendImmediatelyOnChannel (uint8_t channelIndex, uint8_t dataRateIndex, Time airTime)
 {
-  NS_LOG_FUNCTION (this << (unsigned)channelIndex << (unsigned)dataRateIndex);
+  NS_LOG_FUNCTION (this << (unsigned)channelIndex << (unsigned)dataRateIndex << airTime);
 
   Ptr<LoRaWANNetDevice> device = DynamicCast<LoRaWANNetDevice> (GetNode ()->GetDevice (0));
 
@@ -1164,7 +1469,7 @@ LoRaWANGatewayApplication::CanSendImmediatelyOnChannel (uint8_t channelIndex, ui
     NS_LOG_ERROR (this << " Cannot get LoRaWANNetDevice pointer belonging to this gateway");
     return false;
   } else {
-    return device->CanSendImmediatelyOnChannel (channelIndex, dataRateIndex);
+    return device->CanSendImmediatelyOnChannel (channelIndex, dataRateIndex, airTime);
   }
 }
 
@@ -1340,19 +1645,17 @@ LoRaWANGatewayApplication::SendBeacon (Ptr<Packet> packet)
 
 
 void
-LoRaWANGatewayApplication::RequestPingSlot (uint64_t slot, uint32_t devAddr)
+LoRaWANGatewayApplication::RequestPingSlot (uint64_t slot, uint32_t deviceIndex)
 {
-  m_pingSlotAllocated[slot]++;
-  m_pingSlots[slot].push_back(devAddr);
+  LoRaWANPingSlotTable::Entry &entry = m_pingSlots.Get (slot);
+  entry.m_allocated++;
+  entry.m_reservations.push_back(deviceIndex);
 }
 
 void
 LoRaWANGatewayApplication::ClearPingSlotQueues ()
 {
-  for(uint i=0; i<4096; i++){
-    m_pingSlots[i].clear();  
-  }
-  
+  m_pingSlots.NewEpoch ();
 }
 
 
@@ -1360,21 +1663,22 @@ LoRaWANGatewayApplication::ClearPingSlotQueues ()
 return true if there's nothing in the queue of any of the devices listed ahead of this one
 */
 bool
-LoRaWANGatewayApplication::IsTopOfPingSlotQueue (uint64_t slot, uint32_t devAddr)
+LoRaWANGatewayApplication::IsTopOfPingSlotQueue (uint64_t slot, uint32_t deviceIndex)
 {
   bool ret = true;
-  for(uint i=0; i < m_pingSlots[slot].size(); i++){
-    if(m_pingSlots[slot].at(i) == devAddr)
+  LoRaWANPingSlotTable::Entry &entry = m_pingSlots.Get (slot);
+  for(uint i=0; i < entry.m_reservations.size(); i++){
+    if(entry.m_reservations[i] == deviceIndex)
     {
       ret = true;
       break;
     } 
     else 
     {
-      uint32_t addr = m_pingSlots[slot].at(i);
-      if (this->m_lorawanNSPtr->m_endDevices.find (addr)->second.m_ClassBdownstreamQueue.size() > 0)
+      uint32_t index = entry.m_reservations[i];
+      if (!this->m_lorawanNSPtr->m_endDevices.m_ClassBdownstreamQueue[index].IsEmpty ())
       {
-        m_pingSlotFailedToUseCollision[slot]++;
+        entry.m_failedToUseCollision++;
         ret = false;
         break;
       }
@@ -1387,8 +1691,9 @@ void
 LoRaWANGatewayApplication::PrintFinalDetails()
 {
   /*std::cout << "GW" << std::endl;
-   for(uint32_t i=0; i<4096; i++) {
-    std::cout << m_pingSlotAllocated[i] << "\t" << m_pingSlotUsed[i] << "\t" << m_pingSlotFailedToUseCollision[i] << "\t" << m_pingSlotFailedToUseDutyCycle[i] << std::endl;
+   const std::vector<LoRaWANPingSlotTable::Entry> &entries = m_pingSlots.GetEntries ();
+   for(uint32_t i=0; i<entries.size (); i++) {
+    std::cout << entries[i].m_slot << "\t" << entries[i].m_allocated << "\t" << entries[i].m_used << "\t" << entries[i].m_failedToUseCollision << "\t" << entries[i].m_failedToUseDutyCycle << std::endl;
    }*/
 }
 
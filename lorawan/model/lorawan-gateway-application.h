@@ -79,30 +79,52 @@ typedef struct LoRaWANNSDSQueueElement {
   LoRaWANMsgType  m_downstreamMsgType;
   uint8_t     m_downstreamTransmissionsRemaining;
   bool      m_isRetransmission;
+  LoRaWANNSDSQueueElement* m_next; //!< Next element in the LoRaWANNSDSQueue
 } LoRaWANNSDSQueueElement;
 
-typedef struct LoRaWANEndDeviceInfoNS {
-  LoRaWANEndDeviceInfoNS () : m_deviceAddress(), m_rx1DROffset(0), m_lastDSGW(nullptr), m_lastGWs(),
-  m_lastDataRateIndex(0), m_lastChannelIndex(0), m_lastCodeRate(0), m_lastSeen(0),
-  m_framePending(false),m_setAck(false), m_fCntUp(0), m_fCntDown(0),
-  m_nUSPackets(0), m_nUniqueUSPackets(0), m_nUSRetransmission(0), m_nUSDuplicates(0), m_nUSAcks(0),
+/**
+ * \ingroup lorawan
+ *
+ * A FIFO of pending downstream frames for one end device, linked through the
+ * m_next pointer of the elements. An empty queue is three words and does not
+ * allocate memory. The queue owns its elements.
+ */
+struct LoRaWANNSDSQueue {
+  LoRaWANNSDSQueue () : m_head (nullptr), m_tail (nullptr), m_size (0) {}
+
+  bool IsEmpty (void) const { return m_head == nullptr; }
+  uint32_t GetSize (void) const { return m_size; }
+  LoRaWANNSDSQueueElement* Front (void) const { return m_head; }
+
+  /**
+   * Append an element, the queue takes ownership of it.
+   */
+  void PushBack (LoRaWANNSDSQueueElement* element);
+  /**
+   * Remove the first element and hand ownership back to the caller.
+   */
+  LoRaWANNSDSQueueElement* PopFront (void);
+  /**
+   * Delete all elements.
+   */
+  void Clear (void);
+
+  LoRaWANNSDSQueueElement* m_head;
+  LoRaWANNSDSQueueElement* m_tail;
+  uint32_t m_size;
+};
+
+/**
+ * \ingroup lorawan
+ *
+ * Statistics kept by the network server per end device. These are only
+ * updated and printed, so they are kept apart from the fields used to handle
+ * frames.
+ */
+typedef struct LoRaWANEndDeviceStatsNS {
+  LoRaWANEndDeviceStatsNS () : m_nUSPackets(0), m_nUniqueUSPackets(0), m_nUSRetransmission(0), m_nUSDuplicates(0), m_nUSAcks(0),
   m_nDSPacketsGenerated(0), m_nDSPacketsSent(0), m_nDSPacketsSentRW1(0), m_nDSPacketsSentRW2(0), m_nDSRetransmission(0), m_nDSAcks(0),
-  m_rw1Timer(), m_rw2Timer(), m_isClassB(false), m_downstreamQueue(), m_ClassBdownstreamQueue(), m_nClassBPacketsGenerated(0), m_nClassBPacketsSent(0), 
-  m_ClassBdownstreamTimer(), m_ClassBdownstreamTimerSchedule(), m_ClassBPingPeriodicity(6), m_ClassBChannelIndex(7), m_ClassBDataRateIndex(0), m_ClassBCodeRateIndex(1), m_downstreamTimer() {}
-
-  Ipv4Address     m_deviceAddress;
-  uint8_t     m_rx1DROffset;
-  Ptr<LoRaWANGatewayApplication> m_lastDSGW;
-  std::vector< Ptr<LoRaWANGatewayApplication> > m_lastGWs;
-  uint8_t         m_lastDataRateIndex;
-  uint8_t         m_lastChannelIndex;
-  uint8_t         m_lastCodeRate;
-  Time            m_lastSeen;
-
-  bool            m_framePending;
-  bool            m_setAck;
-  uint32_t        m_fCntUp;       //!< Uplink frame counter
-  uint32_t        m_fCntDown;     //!< Downlink frame counter
+  m_nClassBPacketsGenerated(0), m_nClassBPacketsSent(0) {}
 
   uint32_t    m_nUSPackets;   //!< The total number of received US packets
   uint32_t    m_nUniqueUSPackets;   //!< Number of received unique US packets (i.e. with a new US frame counter)
@@ -117,28 +139,187 @@ typedef struct LoRaWANEndDeviceInfoNS {
   uint32_t    m_nDSRetransmission;   //!< Number of retransmissions sent for of DS packets
   uint32_t        m_nDSAcks;  //!< Number of downstream acks sent
 
-  EventId   m_rw1Timer;
-  EventId   m_rw2Timer;
+  uint32_t    m_nClassBPacketsGenerated;   //!< The total number of generated Class B DS packets
+  uint32_t    m_nClassBPacketsSent;   //!< The total number of sent Class B DS packets
+} LoRaWANEndDeviceStatsNS;
+
+/**
+ * \ingroup lorawan
+ *
+ * The end devices known by the LoRaWANNetworkServer, stored as a structure of
+ * arrays. Every device gets a dense index when it is added and keeps it for
+ * the rest of the simulation. The fields that are used to handle upstream and
+ * downstream frames are stored in one array per field, indexed by the device
+ * index; statistics and rarely used fields are stored separately. The device
+ * address is only looked up (Find) when a frame arrives at the network
+ * server, all events of the network server carry the device index.
+ *
+ * The indices of the Class B devices are kept in a separate list, so that the
+ * beacon handling does not have to walk all devices.
+ */
+class LoRaWANEndDeviceRegistryNS
+{
+public:
+  static const uint32_t INVALID_INDEX = 0xffffffff;
+  static const uint16_t NO_PING_OFFSET = 0xffff; //!< No ping offset for the current beacon period
+
+  LoRaWANEndDeviceRegistryNS ();
+  ~LoRaWANEndDeviceRegistryNS ();
+
+  /**
+   * Add an end device. A device that is already known keeps its index but all
+   * its fields are reset.
+   *
+   * \param deviceAddress the address of the device
+   * \return the index of the device
+   */
+  uint32_t Add (Ipv4Address deviceAddress);
+
+  /**
+   * \param deviceAddr the address of a device
+   * \return the index of the device, or INVALID_INDEX for an unknown device
+   */
+  uint32_t Find (uint32_t deviceAddr) const;
+
+  /**
+   * \return the number of devices
+   */
+  uint32_t GetSize (void) const;
+
+  /**
+   * Set or clear the Class B flag of a device.
+   *
+   * \param index the index of the device
+   * \param isClassB true if the device operates in Class B
+   */
+  void SetClassB (uint32_t index, bool isClassB);
+
+  /**
+   * \return the indices of the devices that operate in Class B, in no
+   *         particular order
+   */
+  const std::vector<uint32_t>& GetClassBDevices (void) const;
 
+  /**
+   * Remove all devices and delete their pending downstream frames.
+   */
+  void Clear (void);
+
+  // Fields used to handle frames, indexed by device index
+  std::vector<Ipv4Address> m_deviceAddress;
+  std::vector<uint32_t>    m_fCntUp;       //!< Uplink frame counter
+  std::vector<uint32_t>    m_fCntDown;     //!< Downlink frame counter
+  std::vector<Time>        m_lastSeen;
+  std::vector<uint8_t>     m_rx1DROffset;
+  std::vector<uint8_t>     m_lastDataRateIndex;
+  std::vector<uint8_t>     m_lastChannelIndex;
+  std::vector<uint8_t>     m_lastCodeRate;
+  std::vector<uint8_t>     m_framePending;
+  std::vector<uint8_t>     m_setAck;
+  std::vector<uint8_t>     m_isClassB;
+  std::vector< std::vector< Ptr<LoRaWANGatewayApplication> > > m_lastGWs;
+  std::vector<EventId>     m_rw1Timer;
+  std::vector<EventId>     m_rw2Timer;
 
   // Pending downstream traffic
+  std::vector<LoRaWANNSDSQueue> m_downstreamQueue;
+  std::vector<LoRaWANNSDSQueue> m_ClassBdownstreamQueue;
+  std::vector<uint8_t>     m_ClassBPingSlots;
+  std::vector<uint8_t>     m_ClassBPingPeriodicity;
+  std::vector<uint8_t>     m_ClassBChannelIndex;
+  std::vector<uint8_t>     m_ClassBDataRateIndex;
+  std::vector<uint8_t>     m_ClassBCodeRateIndex;
+  std::vector<uint16_t>    m_ClassBPingOffset;     //!< Ping offset in the current beacon period
+  std::vector<EventId>     m_ClassBPingSlotTimer;  //!< The next ping slot in which the NS will send
+
+  // Rarely used fields and statistics, indexed by device index
+  std::vector< Ptr<LoRaWANGatewayApplication> > m_lastDSGW;
+  std::vector<LoRaWANRxMetadata> m_lastRxMetadata; //!< Metadata of the strongest reception of the last upstream transmission
+  std::vector<EventId>     m_downstreamTimer; // DS traffic generator timer
+  std::vector<EventId>     m_ClassBdownstreamTimer; // DS traffic generator timer
+  std::vector<EventId>     m_ClassBdownstreamTimerSchedule;
+  std::vector<LoRaWANEndDeviceStatsNS> m_stats;
+
+private:
+  std::unordered_map<uint32_t, uint32_t> m_indices; //!< device address to device index
+  std::vector<uint32_t> m_classBDevices;  //!< indices of the Class B devices
+  std::vector<uint32_t> m_classBPosition; //!< position of a device in m_classBDevices
+};
+
+/**
+ * \ingroup lorawan
+ *
+ * The ping slot reservations of a LoRaWANGatewayApplication, together with
+ * per slot statistics. Only slots that were reserved or used at least once
+ * have an entry. The entries are stored densely and are found through an open
+ * addressing hash table keyed by slot.
+ *
+ * Reservations are only valid in the epoch (beacon period) in which they were
+ * made: NewEpoch invalidates all reservations in O(1), the reservation list of
+ * an entry is emptied the next time the entry is accessed. The statistics of
+ * an entry are kept for the whole simulation.
+ */
+class LoRaWANPingSlotTable
+{
+public:
+  static const uint32_t NUM_SLOTS = 4096; //!< Number of ping slots in a beacon period
+
+  /**
+   * A slot in the table.
+   */
+  struct Entry
+  {
+    uint16_t m_slot;
+    uint32_t m_epoch;                  //!< Epoch of m_reservations
+    std::vector<uint32_t> m_reservations; //!< Indices of the devices that reserved the slot, in order of reservation
+    uint32_t m_allocated;
+    uint32_t m_used;
+    uint32_t m_failedToUseCollision;
+    uint32_t m_failedToUseDutyCycle;
+  };
+
+  LoRaWANPingSlotTable ();
 
-  bool m_isClassB;
-  std::deque<LoRaWANNSDSQueueElement* > m_downstreamQueue;
+  /**
+   * Invalidate the reservations of all slots.
+   */
+  void NewEpoch (void);
 
-  std::deque<LoRaWANNSDSQueueElement* > m_ClassBdownstreamQueue;
-  uint32_t    m_nClassBPacketsGenerated;   //!< The total number of generated DS packets
-  uint32_t    m_nClassBPacketsSent;   //!< The total number of sent DS packets
-  EventId     m_ClassBdownstreamTimer; // DS traffic generator timer
-  EventId     m_ClassBdownstreamTimerSchedule;
-  uint8_t     m_ClassBPingSlots; 
-  uint8_t     m_ClassBPingPeriodicity;
-  uint8_t     m_ClassBChannelIndex;
-  uint8_t     m_ClassBDataRateIndex;  
-  uint8_t     m_ClassBCodeRateIndex;
+  /**
+   * Get the entry of a slot, adding it if the slot has no entry yet. The
+   * reservations of the entry belong to the current epoch.
+   *
+   * \param slot the slot, smaller than NUM_SLOTS
+   * \return the entry of the slot
+   */
+  Entry& Get (uint64_t slot);
 
-  EventId     m_downstreamTimer; // DS traffic generator timer
-} LoRaWANEndDeviceInfoNS;
+  /**
+   * \return the entries of all slots that have one, in order of creation
+   */
+  const std::vector<Entry>& GetEntries (void) const;
+
+  /**
+   * Remove all entries.
+   */
+  void Clear (void);
+
+private:
+  /**
+   * \return the position of slot in m_index, or of the empty position where
+   *         it would be inserted
+   */
+  uint32_t Probe (uint16_t slot) const;
+
+  /**
+   * Double the size of m_index.
+   */
+  void Grow (void);
+
+  std::vector<Entry>    m_entries;
+  std::vector<uint16_t> m_index;  //!< Hash table of entry index + 1, 0 for an empty position
+  uint32_t              m_epoch;
+};
 
 //class LoRaWANNetworkServer : public SimpleRefCount<LoRaWANNetworkServer>
 class LoRaWANNetworkServer : public Object
@@ -151,7 +332,7 @@ public:
   virtual void DoDispose (void);
 
   void PopulateEndDevices (void);
-  LoRaWANEndDeviceInfoNS InitEndDeviceInfo (Ipv4Address);
+  uint32_t AddEndDevice (Ipv4Address);
 
   static void clearLoRaWANNetworkServerPointer () { LoRaWANNetworkServer::m_ptr = nullptr; }
   static bool haveLoRaWANNetworkServerObject () { return LoRaWANNetworkServer::m_ptr != NULL; }
@@ -161,19 +342,54 @@ public:
   bool GetConfirmedDataDown (void) const;
 
   void HandleUSPacket (Ptr<LoRaWANGatewayApplication>, Address from, Ptr<Packet> packet);
-  void RW1TimerExpired (uint32_t deviceAddr);
-  void RW2TimerExpired (uint32_t deviceAddr);
-  void SendDSPacket (uint32_t deviceAddr, Ptr<LoRaWANGatewayApplication> gatewayPtr, bool RW1, bool RW2);
-  bool HaveSomethingToSendToEndDevice (uint32_t deviceAddr);
-  void DSTimerExpired (uint32_t deviceAddr);
-  void DeleteFirstDSQueueElement (uint32_t deviceAddr);
+  // The following methods take the index of the device in m_endDevices
+  void RW1TimerExpired (uint32_t deviceIndex);
+  void RW2TimerExpired (uint32_t deviceIndex);
+  void SendDSPacket (uint32_t deviceIndex, Ptr<LoRaWANGatewayApplication> gatewayPtr, bool RW1, bool RW2);
+  bool HaveSomethingToSendToEndDevice (uint32_t deviceIndex);
+  /**
+   * Calculate the airtime of a downstream frame as it will be sent by a gateway.
+   *
+   * \param payload the payload of the frame, without frame header
+   * \param framePort the frame port, zero if the frame has no frame port
+   * \param channelIndex the channel of the transmission
+   * \param dataRateIndex the data rate of the transmission
+   * \param codeRate the code rate of the transmission
+   * \return the airtime of the frame
+   */
+  Time GetDSAirTime (Ptr<const Packet> payload, uint8_t framePort, uint8_t channelIndex, uint8_t dataRateIndex, uint8_t codeRate) const;
+  /**
+   * Calculate the airtime of the frame that SendDSPacket would send to a
+   * device: its first pending downstream packet or an empty Ack.
+   *
+   * \param deviceIndex the index of the device in m_endDevices
+   * \param channelIndex the channel of the transmission
+   * \param dataRateIndex the data rate of the transmission
+   * \return the airtime of the frame
+   */
+  Time GetNextDSAirTime (uint32_t deviceIndex, uint8_t channelIndex, uint8_t dataRateIndex) const;
+  void DSTimerExpired (uint32_t deviceIndex);
+  void DeleteFirstDSQueueElement (uint32_t deviceIndex);
 
   int64_t AssignStreams (int64_t stream);
 
-  void ClassBDSTimerExpired (uint32_t deviceAddr); //generates downlink packets for Class B. May be removed to a seperate data generator class later.
-  void ClassBScheduleExpiry(uint32_t deviceAddr);
+  void ClassBDSTimerExpired (uint32_t deviceIndex); //generates downlink packets for Class B. May be removed to a seperate data generator class later.
+  void ClassBScheduleExpiry(uint32_t deviceIndex);
   void ClassBSendBeacon ();
-  void ClassBPingSlot(uint32_t devAddr, uint64_t pingTime);
+  /**
+   * Schedule the next ping slot of a Class B device in the current beacon
+   * period, if the device has pending Class B traffic and no ping slot is
+   * scheduled yet. Ping slots are scheduled one at a time: ClassBPingSlot
+   * chains to the next one as long as there is something to send.
+   */
+  void ClassBScheduleNextPingSlot (uint32_t deviceIndex);
+  void ClassBPingSlot(uint32_t deviceIndex, uint64_t pingTime);
+  /**
+   * Turn off Class B for a device: stop its Class B DS traffic generation and
+   * cancel its scheduled ping slot, as the device no longer listens in its
+   * ping slots.
+   */
+  void ClassBStop (uint32_t deviceIndex);
 
   void AssignInitialGateway(Ptr<LoRaWANGatewayApplication> gw);
 
@@ -182,7 +398,7 @@ public:
 
   uint8_t m_defaultClassBDataRateIndex;
 
-  std::unordered_map <uint32_t, LoRaWANEndDeviceInfoNS> m_endDevices;
+  LoRaWANEndDeviceRegistryNS m_endDevices;
 
 private:
   static Ptr<LoRaWANNetworkServer> m_ptr;
@@ -215,6 +431,7 @@ private:
     uint64_t    m_simulationStartTime;
 
     uint32_t  m_numberOfBeacons;
+    Time      m_lastBeaconTime; //!< Start of the current beacon period
 
 
 };
@@ -272,27 +489,32 @@ public:
    */
   void HandleRead (Ptr<Socket> socket);
 
-  bool CanSendImmediatelyOnChannel (uint8_t channelIndex, uint8_t dataRateIndex);
+  /**
+   * \param channelIndex the channel of the transmission
+   * \param dataRateIndex the data rate of the transmission
+   * \param airTime the airtime of the frame
+   * \return true if the gateway can send the frame right now
+   * \see LoRaWANNetDevice::CanSendImmediatelyOnChannel
+   */
+  bool CanSendImmediatelyOnChannel (uint8_t channelIndex, uint8_t dataRateIndex, Time airTime);
   void SendDSPacket (Ptr<Packet> p);
 
 
   void SendBeacon (Ptr<Packet> packet);
 
-  void RequestPingSlot (uint64_t slot, uint32_t devAddr); 
+  // deviceIndex is the index of the device in LoRaWANNetworkServer::m_endDevices
+  void RequestPingSlot (uint64_t slot, uint32_t deviceIndex); 
 
   void ClearPingSlotQueues();
 
-  bool IsTopOfPingSlotQueue (uint64_t slot, uint32_t devAddr);
+  bool IsTopOfPingSlotQueue (uint64_t slot, uint32_t deviceIndex);
 
   void PrintFinalDetails();
 
   uint8_t GetDefaultClassBDataRateIndex (void) const;
   void SetDefaultClassBDataRateIndex (uint8_t index);
 
-  uint32_t        m_pingSlotAllocated[4096];
-  uint32_t        m_pingSlotUsed[4096];
-  uint32_t        m_pingSlotFailedToUseCollision[4096];
-  uint32_t        m_pingSlotFailedToUseDutyCycle[4096];
+  LoRaWANPingSlotTable m_pingSlots; //!< Ping slot reservations of the current beacon period and ping slot statistics
 
 protected:
   virtual void DoInitialize (void);
@@ -322,7 +544,6 @@ private:
   uint32_t        m_fCntDown;     //!< Downlink frame counter
   bool            m_setAck;      //!< Set the Ack bit in the next transmission
 
-  std::vector<uint32_t> m_pingSlots[4096]; //An array of vectors. The NS adds to each vector in the initial allocation, then the first request is sent in the ping slot. The others are not.  
   
   
 
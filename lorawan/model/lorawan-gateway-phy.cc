@@ -0,0 +1,332 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include "lorawan-gateway-phy.h"
+#include "lorawan-spectrum-signal-parameters.h"
+#include "lorawan-error-model.h"
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/packet.h>
+#include <ns3/random-variable-stream.h>
+#include <ns3/uinteger.h>
+
+#include <limits>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LoRaWANGatewayPhy");
+
+NS_OBJECT_ENSURE_REGISTERED (LoRaWANGatewayPhy);
+
+TypeId
+LoRaWANGatewayPhy::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LoRaWANGatewayPhy")
+    .SetParent<LoRaWANPhy> ()
+    .SetGroupName ("LoRaWAN")
+    .AddConstructor<LoRaWANGatewayPhy> ()
+    .AddAttribute ("Demodulators",
+                   "The number of frames the gateway can receive at the same "
+                   "time, over all channels and data rates.",
+                   UintegerValue (8), // SX1301
+                   MakeUintegerAccessor (&LoRaWANGatewayPhy::m_nDemodulators),
+                   MakeUintegerChecker<uint32_t> (1))
+  ;
+  return tid;
+}
+
+LoRaWANGatewayPhy::LoRaWANGatewayPhy (void)
+  : LoRaWANPhy (0),
+    m_nDemodulators (8)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+LoRaWANGatewayPhy::~LoRaWANGatewayPhy (void)
+{
+}
+
+void
+LoRaWANGatewayPhy::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  m_demodulators.clear ();
+
+  LoRaWANPhy::DoDispose ();
+}
+
+bool
+LoRaWANGatewayPhy::ReceivesOnAllChannels (void) const
+{
+  return true;
+}
+
+uint32_t
+LoRaWANGatewayPhy::GetNBusyDemodulators (void) const
+{
+  return m_demodulators.size ();
+}
+
+void
+LoRaWANGatewayPhy::ChangeTrxState (LoRaWANPhyEnumeration newState)
+{
+  if (newState == LORAWAN_PHY_RX_ON && !m_demodulators.empty ())
+    {
+      // The demodulators keep receiving, EndDemodulation switches back to RX_ON
+      newState = LORAWAN_PHY_BUSY_RX;
+    }
+  else if (newState != LORAWAN_PHY_RX_ON && newState != LORAWAN_PHY_BUSY_RX)
+    {
+      // The front end can either receive or transmit, leaving the RX states
+      // aborts all ongoing receptions.
+      for (std::vector<Demodulator>::iterator it = m_demodulators.begin (); it != m_demodulators.end (); ++it)
+        {
+          it->status.aborted = true;
+        }
+    }
+
+  LoRaWANPhy::ChangeTrxState (newState);
+}
+
+void
+LoRaWANGatewayPhy::AbortRx (void)
+{
+  NS_LOG_FUNCTION (this << m_demodulators.size ());
+
+  while (!m_demodulators.empty ())
+    {
+      m_demodulators.back ().status.aborted = true;
+      EndDemodulation (m_demodulators.size () - 1);
+    }
+}
+
+void
+LoRaWANGatewayPhy::StartRx (Ptr<SpectrumSignalParameters> spectrumRxParams)
+{
+  NS_LOG_FUNCTION (this << spectrumRxParams);
+
+  Ptr<LoRaWANSpectrumSignalParameters> loraWanRxParams = DynamicCast<LoRaWANSpectrumSignalParameters> (spectrumRxParams);
+  if (loraWanRxParams == 0)
+    {
+      // reception is not a LoRaWAN packet, count it as noise on all channels
+      CheckInterference ();
+      m_signal->AddSignal (spectrumRxParams->psd);
+      ScheduleEndRx (spectrumRxParams);
+      return;
+    }
+
+  Ptr<Packet> p = loraWanRxParams->packet;
+  NS_ASSERT (p != 0);
+
+  const uint8_t channelIndex = loraWanRxParams->channelIndex;
+  const double rxPower = GetRxPower (loraWanRxParams);
+
+  NS_LOG_DEBUG (this << " channel index = " << static_cast<uint16_t>(channelIndex));
+  NS_LOG_DEBUG (this << " receiving packet with power: " << 10 * log10 (rxPower) + 30 << "dBm");
+
+  // Record the SINR of the ongoing receptions on the channel before adding the
+  // new signal to the interference.
+  CheckInterference (channelIndex);
+  m_signal->AddPower (channelIndex, rxPower);
+
+  if (!IsRxPolarity (loraWanRxParams))
+    {
+      // demodulators do not lock onto a preamble with the wrong IQ polarity
+      NS_LOG_DEBUG (this << " ignoring transmission with inverted IQ = " << loraWanRxParams->invertedIq);
+    }
+  else if ((m_trxState == LORAWAN_PHY_RX_ON || m_trxState == LORAWAN_PHY_BUSY_RX) && !m_setTRXState.IsRunning () && !IsRadioTransmitting ())
+    {
+      const uint32_t bw = LoRaWAN::m_supportedChannels [channelIndex].m_bw;
+      const LoRaSpreadingFactor sf = LoRaWAN::m_supportedDataRates [loraWanRxParams->dataRateIndex].spreadingFactor;
+
+      const double sinr = CalculateSinr (rxPower, channelIndex);
+      double sinr_db = 10.0 * log10 (sinr);
+      double sinr_cutoff_db = m_errorModel->getSNRCutoffForRX (bw, sf, loraWanRxParams->codeRate);
+
+      if (sinr_db <= sinr_cutoff_db)
+        {
+          m_phyRxDropTrace (p, LORAWAN_RX_DROP_SINR_TOO_LOW);
+        }
+      else if (m_demodulators.size () >= m_nDemodulators)
+        {
+          NS_LOG_DEBUG (this << " all " << m_nDemodulators << " demodulators are busy");
+          m_phyRxDropTrace (p, LORAWAN_RX_DROP_NO_DEMODULATOR);
+        }
+      else
+        {
+          // Lock a free demodulator onto the preamble
+          Demodulator demodulator;
+          demodulator.params = loraWanRxParams;
+          demodulator.rxPower = rxPower;
+          demodulator.status = LoRaWANPhyRxStatus (false, false);
+          InitRxRecord (demodulator.record, rxPower, sinr);
+          demodulator.lastUpdate = Simulator::Now ();
+          m_demodulators.push_back (demodulator);
+          m_phyRxBeginTrace (p);
+
+          if (m_trxState == LORAWAN_PHY_RX_ON)
+            ChangeTrxState (LORAWAN_PHY_BUSY_RX);
+        }
+    }
+  else
+    {
+      NS_LOG_DEBUG (this << " transceiver not in RX state (state = " << m_trxState << ")");
+      m_phyRxDropTrace (p, LORAWAN_RX_DROP_NOT_IN_RX_STATE);
+    }
+
+  ScheduleEndRx (spectrumRxParams);
+}
+
+void
+LoRaWANGatewayPhy::CheckInterference (uint8_t channelIndex)
+{
+  for (std::vector<Demodulator>::iterator it = m_demodulators.begin (); it != m_demodulators.end (); ++it)
+    {
+      if (it->params->channelIndex == channelIndex)
+        AddSinrSegment (*it);
+    }
+}
+
+void
+LoRaWANGatewayPhy::CheckInterference (void)
+{
+  for (std::vector<Demodulator>::iterator it = m_demodulators.begin (); it != m_demodulators.end (); ++it)
+    {
+      AddSinrSegment (*it);
+    }
+}
+
+void
+LoRaWANGatewayPhy::AddSinrSegment (Demodulator &demodulator)
+{
+  const Time duration = Simulator::Now () - demodulator.lastUpdate;
+  demodulator.lastUpdate = Simulator::Now ();
+  if (demodulator.status.aborted)
+    {
+      return;
+    }
+
+  const double sinr = CalculateSinr (demodulator.rxPower, demodulator.params->channelIndex);
+  demodulator.record.sinr = sinr;
+  if (!demodulator.sinrSegments.empty () && demodulator.sinrSegments.back ().sinr == sinr)
+    {
+      demodulator.sinrSegments.back ().duration += duration;
+    }
+  else if (duration.IsStrictlyPositive ())
+    {
+      SinrSegment segment;
+      segment.sinr = sinr;
+      segment.duration = duration;
+      demodulator.sinrSegments.push_back (segment);
+    }
+}
+
+void
+LoRaWANGatewayPhy::EndRx (Ptr<SpectrumSignalParameters> par)
+{
+  NS_LOG_FUNCTION (this);
+
+  Ptr<LoRaWANSpectrumSignalParameters> params = DynamicCast<LoRaWANSpectrumSignalParameters> (par);
+  if (params == 0)
+    {
+      CheckInterference ();
+      m_signal->RemoveSignal (par->psd);
+      return;
+    }
+
+  // Record the last SINR segment of all receptions on the channel, including
+  // the one of this signal, before removing the signal from the interference.
+  CheckInterference (params->channelIndex);
+  m_signal->RemovePower (params->channelIndex, GetRxPower (params));
+
+  for (uint32_t i = 0; i < m_demodulators.size (); i++)
+    {
+      if (m_demodulators[i].params == params)
+        {
+          EndDemodulation (i);
+          return;
+        }
+    }
+}
+
+void
+LoRaWANGatewayPhy::EndDemodulation (uint32_t index)
+{
+  NS_ASSERT (index < m_demodulators.size ());
+
+  Ptr<LoRaWANSpectrumSignalParameters> params = m_demodulators[index].params;
+  LoRaWANPhyRxStatus status = m_demodulators[index].status;
+  RxRecord &record = m_demodulators[index].record;
+  Ptr<Packet> packet = params->packet;
+
+  if (m_errorModel == 0)
+    {
+      NS_LOG_WARN ("Missing ErrorModel");
+    }
+  else if (!status.aborted)
+    {
+      const double successRate = GetRxSuccessRate (m_demodulators[index].sinrSegments, params);
+      NS_LOG_LOGIC (this << " " << m_demodulators[index].sinrSegments.size () << " SINR segments, success rate = " << successRate);
+
+      // The LQI is the total packet success rate scaled to 0-255.
+      record.successRate = successRate;
+      record.lqi = static_cast<uint8_t> (std::numeric_limits<uint8_t>::max () * successRate);
+
+      if (m_random->GetValue () < 1.0 - successRate)
+        {
+          status.destroyed = true;
+        }
+    }
+
+  // Release the demodulator before informing the MAC, which might change the
+  // state of the transceiver.
+  const RxRecord rxRecord = record;
+  m_demodulators[index] = m_demodulators.back ();
+  m_demodulators.pop_back ();
+  if (m_demodulators.empty () && m_trxState == LORAWAN_PHY_BUSY_RX)
+    ChangeTrxState (LORAWAN_PHY_RX_ON);
+
+  // If there is no error model attached to the PHY, we always report the maximum LQI value.
+  m_phyRxEndTrace (packet, rxRecord.lqi);
+
+  if (!status.destroyed && !status.aborted)
+    {
+      // The packet was successfully received, push it up the stack.
+      if (!m_pdDataIndicationCallback.IsNull ())
+        {
+          Ptr<Packet> rxPacket = GetRxPacket (packet, rxRecord);
+          m_pdDataIndicationCallback (rxPacket->GetSize (), rxPacket, rxRecord.lqi, params->channelIndex, params->dataRateIndex, params->codeRate, GetRxMetadata (params, rxRecord));
+        }
+    }
+  else if (status.destroyed)
+    {
+      m_phyRxDropTrace (packet, LORAWAN_RX_DROP_PACKET_DESTOYED);
+      if (!m_pdDataDestroyedCallback.IsNull ())
+        {
+          m_pdDataDestroyedCallback ();
+        }
+    }
+  else
+    {
+      m_phyRxDropTrace (packet, LORAWAN_RX_DROP_PACKET_ABORTED);
+    }
+}
+
+} // namespace ns3
@@ -0,0 +1,138 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#ifndef LORAWAN_GATEWAY_PHY_H
+#define LORAWAN_GATEWAY_PHY_H
+
+#include "lorawan-phy.h"
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup lorawan
+ *
+ * Phy layer for a multi-channel LoRaWAN gateway (e.g. SX1301 based), with a
+ * single front end and a pool of demodulators.
+ *
+ * Instead of one LoRaWANPhy per channel and data rate, the gateway PHY
+ * receives on all channels at once and keeps the interference of every
+ * channel in a single LoRaWANInterferenceHelper. When a preamble is detected
+ * on any channel and data rate, the PHY locks a free demodulator onto the
+ * frame. A frame that arrives while all demodulators are busy is dropped with
+ * reason LORAWAN_RX_DROP_NO_DEMODULATOR, but still counts as interference.
+ *
+ * Transmissions use the channel and data rate set via SetTxConf, just like
+ * LoRaWANPhy. Switching the transceiver out of the RX states aborts all
+ * ongoing receptions. The outcome of a reception is always drawn once at the
+ * end of the frame, the PerChunkRxOutcome attribute is ignored.
+ */
+class LoRaWANGatewayPhy : public LoRaWANPhy
+{
+
+public:
+  /**
+   * Get the type ID.
+   *
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+
+  LoRaWANGatewayPhy (void);
+  virtual ~LoRaWANGatewayPhy (void);
+
+  /**
+   * Get the number of demodulators that are currently receiving a frame.
+   *
+   * \return the number of busy demodulators
+   */
+  uint32_t GetNBusyDemodulators (void) const;
+
+  // inherited from LoRaWANPhy
+  virtual void StartRx (Ptr<SpectrumSignalParameters> params);
+  virtual bool ReceivesOnAllChannels (void) const;
+  virtual void AbortRx (void);
+
+private:
+  // Inherited from Object.
+  virtual void DoDispose (void);
+
+  // Inherited from LoRaWANPhy.
+  virtual void ChangeTrxState (LoRaWANPhyEnumeration newState);
+  virtual void EndRx (Ptr<SpectrumSignalParameters> params);
+
+  /**
+   * A demodulation path that is locked onto a frame.
+   */
+  struct Demodulator
+  {
+    Ptr<LoRaWANSpectrumSignalParameters> params; //!< the frame being received
+    double rxPower;                              //!< received power of the frame in W
+    LoRaWANPhyRxStatus status;                   //!< reception status of the frame
+    RxRecord record;                             //!< reception record of the frame
+    Time lastUpdate;                             //!< end of the last SINR segment
+    std::vector<SinrSegment> sinrSegments;       //!< SINR timeline of the frame
+  };
+
+  /**
+   * Record the SINR of the frames received on the given channel since the
+   * last change in interference on that channel. Called before the
+   * interference of the channel changes.
+   *
+   * \param channelIndex the channel of which the interference changes
+   */
+  void CheckInterference (uint8_t channelIndex);
+
+  /**
+   * Record the SINR of the frames received on all channels, for signals that
+   * are not LoRaWAN transmissions.
+   */
+  void CheckInterference (void);
+
+  /**
+   * Record the SINR of a demodulated frame since its last update.
+   *
+   * \param demodulator the demodulator receiving the frame
+   */
+  void AddSinrSegment (Demodulator &demodulator);
+
+  /**
+   * Finish the reception of the frame by a demodulator and release the
+   * demodulator.
+   *
+   * \param index the index of the demodulator in m_demodulators
+   */
+  void EndDemodulation (uint32_t index);
+
+  /**
+   * The maximum number of frames that can be received at the same time.
+   */
+  uint32_t m_nDemodulators;
+
+  /**
+   * The demodulators that are currently receiving a frame, at most
+   * m_nDemodulators.
+   */
+  std::vector<Demodulator> m_demodulators;
+
+}; // class LoRaWANGatewayPhy
+
+} // namespace ns3
+
+#endif /* LORAWAN_GATEWAY_PHY_H */
@@ -22,24 +22,61 @@
 #include <ns3/spectrum-model.h>
 #include <ns3/log.h>
 
+#include <algorithm>
+
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("LoRaWANInterferenceHelper");
 
 LoRaWANInterferenceHelper::LoRaWANInterferenceHelper (Ptr<const SpectrumModel> spectrumModel)
   : m_spectrumModel (spectrumModel),
-    m_dirty (false)
+    m_power (spectrumModel->GetNumBands (), 0.0),
+    m_nSignals (spectrumModel->GetNumBands (), 0)
 {
-  m_signal = Create<SpectrumValue> (m_spectrumModel);
 }
 
 LoRaWANInterferenceHelper::~LoRaWANInterferenceHelper (void)
 {
   m_spectrumModel = 0;
-  m_signal = 0;
   m_signals.clear ();
 }
 
+void
+LoRaWANInterferenceHelper::AddPower (uint8_t channelIndex, double power)
+{
+  NS_LOG_FUNCTION (this << static_cast<uint16_t> (channelIndex) << power);
+  NS_ASSERT (channelIndex < m_power.size ());
+
+  m_power[channelIndex] += power;
+  m_nSignals[channelIndex]++;
+}
+
+void
+LoRaWANInterferenceHelper::RemovePower (uint8_t channelIndex, double power)
+{
+  NS_LOG_FUNCTION (this << static_cast<uint16_t> (channelIndex) << power);
+  NS_ASSERT (channelIndex < m_power.size ());
+  NS_ASSERT (m_nSignals[channelIndex] > 0);
+
+  m_nSignals[channelIndex]--;
+  if (m_nSignals[channelIndex] == 0)
+    {
+      // Do not let rounding errors of subsequent additions and subtractions accumulate
+      m_power[channelIndex] = 0.0;
+    }
+  else
+    {
+      m_power[channelIndex] = std::max (m_power[channelIndex] - power, 0.0);
+    }
+}
+
+double
+LoRaWANInterferenceHelper::GetPower (uint8_t channelIndex) const
+{
+  NS_ASSERT (channelIndex < m_power.size ());
+  return m_power[channelIndex];
+}
+
 bool
 LoRaWANInterferenceHelper::AddSignal (Ptr<const SpectrumValue> signal)
 {
@@ -50,9 +87,17 @@ LoRaWANInterferenceHelper::AddSignal (Ptr<const SpectrumValue> signal)
   if (signal->GetSpectrumModel () == m_spectrumModel)
     {
       result = m_signals.insert (signal).second;
-      if (result && !m_dirty)
+      if (result)
         {
-          *m_signal += *signal;
+          Bands::const_iterator band = m_spectrumModel->Begin ();
+          Values::const_iterator value = signal->ConstValuesBegin ();
+          for (uint8_t i = 0; band != m_spectrumModel->End (); ++band, ++value, ++i)
+            {
+              if (*value > 0.0)
+                {
+                  AddPower (i, *value * (band->fh - band->fl));
+                }
+            }
         }
     }
   return result;
@@ -70,7 +115,15 @@ LoRaWANInterferenceHelper::RemoveSignal (Ptr<const SpectrumValue> signal)
       result = (m_signals.erase (signal) == 1);
       if (result)
         {
-          m_dirty = true;
+          Bands::const_iterator band = m_spectrumModel->Begin ();
+          Values::const_iterator value = signal->ConstValuesBegin ();
+          for (uint8_t i = 0; band != m_spectrumModel->End (); ++band, ++value, ++i)
+            {
+              if (*value > 0.0)
+                {
+                  RemovePower (i, *value * (band->fh - band->fl));
+                }
+            }
         }
     }
   return result;
@@ -82,7 +135,8 @@ LoRaWANInterferenceHelper::ClearSignals (void)
   NS_LOG_FUNCTION (this);
 
   m_signals.clear ();
-  m_dirty = true;
+  std::fill (m_power.begin (), m_power.end (), 0.0);
+  std::fill (m_nSignals.begin (), m_nSignals.end (), 0);
 }
 
 Ptr<SpectrumValue>
@@ -90,19 +144,23 @@ LoRaWANInterferenceHelper::GetSignalPsd (void) const
 {
   NS_LOG_FUNCTION (this);
 
-  if (m_dirty)
+  Ptr<SpectrumValue> signal = Create<SpectrumValue> (m_spectrumModel);
+  Bands::const_iterator band = m_spectrumModel->Begin ();
+  Values::iterator value = signal->ValuesBegin ();
+  for (uint8_t i = 0; band != m_spectrumModel->End (); ++band, ++value, ++i)
     {
-      // Sum up the current interference PSD.
-      std::set<Ptr<const SpectrumValue> >::const_iterator it;
-      m_signal = Create<SpectrumValue> (m_spectrumModel);
-      for (it = m_signals.begin (); it != m_signals.end (); ++it)
-        {
-          *m_signal += *(*it);
-        }
-      m_dirty = false;
+      *value = m_power[i] / (band->fh - band->fl);
     }
 
-  return m_signal->Copy ();
+  return signal;
+}
+
+Ptr<const SpectrumModel>
+LoRaWANInterferenceHelper::GetSpectrumModel (void) const
+{
+  NS_LOG_FUNCTION (this);
+
+  return m_spectrumModel;
 }
 
 }
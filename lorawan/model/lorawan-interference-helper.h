@@ -23,6 +23,7 @@
 #include <ns3/simple-ref-count.h>
 #include <ns3/ptr.h>
 #include <set>
+#include <vector>
 
 namespace ns3 {
 
@@ -33,6 +34,13 @@ class SpectrumModel;
  * \ingroup lorawan
  *
  * \brief This class provides helper functions for LoRaWAN interference handling.
+ *
+ * LoRaWAN transmissions only occupy the band of a single channel, so the
+ * accumulated received power is tracked as a plain double (in W) per channel
+ * index, i.e. per band of the SpectrumModel. Adding or removing the power of a
+ * LoRaWAN signal is a constant time operation and querying it does not
+ * allocate. The SpectrumValue based methods are kept for signals that may
+ * cover multiple bands, they update the power of every band of the signal.
  */
 class LoRaWANInterferenceHelper : public SimpleRefCount<LoRaWANInterferenceHelper>
 {
@@ -46,6 +54,32 @@ public:
 
   ~LoRaWANInterferenceHelper (void);
 
+  /**
+   * Add the received power of a signal on the given channel. The same power
+   * has to be removed again via RemovePower when the signal ends.
+   *
+   * \param channelIndex the index of the channel (i.e. band) of the signal
+   * \param power the received power of the signal in W
+   */
+  void AddPower (uint8_t channelIndex, double power);
+
+  /**
+   * Remove the received power of a signal on the given channel that was
+   * previously added via AddPower.
+   *
+   * \param channelIndex the index of the channel (i.e. band) of the signal
+   * \param power the received power of the signal in W
+   */
+  void RemovePower (uint8_t channelIndex, double power);
+
+  /**
+   * Get the sum of the received power of all signals on the given channel.
+   *
+   * \param channelIndex the index of the channel (i.e. band)
+   * \return the accumulated received power in W
+   */
+  double GetPower (uint8_t channelIndex) const;
+
   /**
    * Add the given signal to the set of accumulated signals. Never add the same
    * signal more than once. The SpectrumModels of the signal and the one used
@@ -72,7 +106,9 @@ public:
   void ClearSignals (void);
 
   /**
-   * Get the sum of all accumulated signals.
+   * Get the sum of all accumulated signals, including the power added via
+   * AddPower. This creates a new SpectrumValue on every call, use GetPower
+   * where possible.
    *
    * \return the sum of the signals
    */
@@ -101,20 +137,19 @@ private:
   Ptr<const SpectrumModel> m_spectrumModel;
 
   /**
-   * The set of accumulated signals.
+   * The set of signals that were added via AddSignal.
    */
   std::set<Ptr<const SpectrumValue> > m_signals;
 
   /**
-   * The precomputed sum of all accumulated signals.
+   * The accumulated received power in W, per channel index.
    */
-  mutable Ptr<SpectrumValue> m_signal;
+  std::vector<double> m_power;
 
   /**
-   * Mark m_signal as dirty, whenever a signal is added or removed. m_signal has
-   * to be recomputed before next use.
+   * The number of signals that contribute to m_power, per channel index.
    */
-  mutable bool m_dirty;
+  std::vector<uint32_t> m_nSignals;
 };
 
 }
@@ -0,0 +1,272 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#ifndef LORAWAN_MAC_TX_QUEUE_H
+#define LORAWAN_MAC_TX_QUEUE_H
+
+#include <ns3/assert.h>
+#include <stdint.h>
+#include <vector>
+
+namespace ns3 {
+
+/**
+ * \ingroup lorawan
+ *
+ * \brief Transmit queue of the LoRaWANMac.
+ *
+ * The queue has two FIFO lanes: items in the priority lane (e.g. beacons,
+ * which have to go out at the start of the beacon period) are dequeued before
+ * the items in the normal lane. The queue is intrusive:
+ * every item is stored in a node that links to the next node of its lane.
+ * Nodes are allocated in blocks and are recycled through a free list, so
+ * enqueueing and dequeueing do not allocate once the queue has reached its
+ * largest size.
+ *
+ * The item returned by Front stays at the front until it is removed by
+ * PopFront, even if items are added to the priority lane in the mean time,
+ * so a frame that is being (re)transmitted is never overtaken. Use Peek to
+ * look at the next item without fixing it at the front.
+ */
+template <typename Item>
+class LoRaWANMacTxQueue
+{
+public:
+  LoRaWANMacTxQueue (void);
+  ~LoRaWANMacTxQueue (void);
+
+  /**
+   * Add an item at the back of one of the lanes.
+   *
+   * \param priority true to add the item to the priority lane
+   * \return the new item, to be filled in by the caller
+   */
+  Item& Enqueue (bool priority);
+
+  /**
+   * \return the item at the front of the queue, the queue must not be empty
+   */
+  Item& Front (void);
+
+  /**
+   * \return the item that Front would return, without fixing it at the front
+   *         of the queue, the queue must not be empty
+   */
+  Item& Peek (void);
+
+  /**
+   * Remove the item at the front of the queue.
+   */
+  void PopFront (void);
+
+  /**
+   * \return true if the queue is empty
+   */
+  bool IsEmpty (void) const;
+
+  /**
+   * \return the number of items in both lanes
+   */
+  uint32_t GetSize (void) const;
+
+  /**
+   * Remove all items.
+   */
+  void Clear (void);
+
+private:
+  /**
+   * A node of a lane.
+   */
+  struct Node
+  {
+    Item item;  //!< the queued item
+    Node *next; //!< the next node of the lane (or of the free list)
+  };
+
+  /**
+   * A FIFO list of nodes.
+   */
+  struct Lane
+  {
+    Node *head; //!< first node, or 0
+    Node *tail; //!< last node, or 0
+  };
+
+  /**
+   * The number of nodes allocated at once.
+   */
+  static const uint32_t BLOCK_SIZE = 8;
+
+  /**
+   * \return a node from the free list, allocating a new block if needed
+   */
+  Node* AllocateNode (void);
+
+  /**
+   * Reset the item of the node and return the node to the free list.
+   *
+   * \param node the node
+   */
+  void FreeNode (Node *node);
+
+  // Not copyable, the nodes are owned by the queue.
+  LoRaWANMacTxQueue (const LoRaWANMacTxQueue&);
+  LoRaWANMacTxQueue& operator= (const LoRaWANMacTxQueue&);
+
+  Lane m_priority;              //!< the priority lane
+  Lane m_normal;                //!< the normal lane
+  Node *m_front;                //!< the item returned by Front, or 0
+  uint32_t m_size;              //!< number of queued items, including m_front
+  Node *m_free;                 //!< list of unused nodes
+  std::vector<Node*> m_blocks;  //!< all allocated blocks of nodes
+};
+
+template <typename Item>
+LoRaWANMacTxQueue<Item>::LoRaWANMacTxQueue (void)
+  : m_front (0),
+    m_size (0),
+    m_free (0)
+{
+  m_priority.head = m_priority.tail = 0;
+  m_normal.head = m_normal.tail = 0;
+}
+
+template <typename Item>
+LoRaWANMacTxQueue<Item>::~LoRaWANMacTxQueue (void)
+{
+  for (typename std::vector<Node*>::iterator it = m_blocks.begin (); it != m_blocks.end (); ++it)
+    {
+      delete [] *it;
+    }
+}
+
+template <typename Item>
+Item&
+LoRaWANMacTxQueue<Item>::Enqueue (bool priority)
+{
+  Node *node = AllocateNode ();
+  node->next = 0;
+
+  Lane &lane = priority ? m_priority : m_normal;
+  if (lane.tail)
+    lane.tail->next = node;
+  else
+    lane.head = node;
+  lane.tail = node;
+
+  m_size++;
+  return node->item;
+}
+
+template <typename Item>
+Item&
+LoRaWANMacTxQueue<Item>::Front (void)
+{
+  NS_ASSERT (m_size > 0);
+
+  if (m_front == 0)
+    {
+      Lane &lane = m_priority.head ? m_priority : m_normal;
+      m_front = lane.head;
+      lane.head = m_front->next;
+      if (lane.head == 0)
+        lane.tail = 0;
+      m_front->next = 0;
+    }
+  return m_front->item;
+}
+
+template <typename Item>
+Item&
+LoRaWANMacTxQueue<Item>::Peek (void)
+{
+  NS_ASSERT (m_size > 0);
+
+  if (m_front)
+    return m_front->item;
+  return m_priority.head ? m_priority.head->item : m_normal.head->item;
+}
+
+template <typename Item>
+void
+LoRaWANMacTxQueue<Item>::PopFront (void)
+{
+  Front ();
+  FreeNode (m_front);
+  m_front = 0;
+  m_size--;
+}
+
+template <typename Item>
+bool
+LoRaWANMacTxQueue<Item>::IsEmpty (void) const
+{
+  return m_size == 0;
+}
+
+template <typename Item>
+uint32_t
+LoRaWANMacTxQueue<Item>::GetSize (void) const
+{
+  return m_size;
+}
+
+template <typename Item>
+void
+LoRaWANMacTxQueue<Item>::Clear (void)
+{
+  while (m_size > 0)
+    {
+      PopFront ();
+    }
+}
+
+template <typename Item>
+typename LoRaWANMacTxQueue<Item>::Node*
+LoRaWANMacTxQueue<Item>::AllocateNode (void)
+{
+  if (m_free == 0)
+    {
+      Node *block = new Node [BLOCK_SIZE];
+      m_blocks.push_back (block);
+      for (uint32_t i = 0; i < BLOCK_SIZE; i++)
+        {
+          block[i].next = m_free;
+          m_free = &block[i];
+        }
+    }
+
+  Node *node = m_free;
+  m_free = node->next;
+  return node;
+}
+
+template <typename Item>
+void
+LoRaWANMacTxQueue<Item>::FreeNode (Node *node)
+{
+  node->item = Item ();
+  node->next = m_free;
+  m_free = node;
+}
+
+} // namespace ns3
+
+#endif /* LORAWAN_MAC_TX_QUEUE_H */
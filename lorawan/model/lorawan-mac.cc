@@ -22,11 +22,15 @@
 #include "lorawan-mac-header.h"
 #include "lorawan-net-device.h"
 #include "lorawan-frame-header-plain.h"
+#include "lorawan-spectrum-channel.h"
 #include <ns3/simulator.h>
 #include <ns3/log.h>
 #include <ns3/packet.h>
 #include <ns3/random-variable-stream.h>
 #include <ns3/double.h>
+#include <ns3/boolean.h>
+#include <ns3/uinteger.h>
+#include <ns3/enum.h>
 
 namespace ns3 {
 
@@ -36,6 +40,19 @@ NS_OBJECT_ENSURE_REGISTERED (LoRaWANMac);
 
 const uint8_t LoRaWANMac::maxMACPayloadSize[] = {59, 59, 59, 123, 230, 230, 230}; // we don't take the FSK row (for DR7) into account
 
+/**
+ * \return the time after the start of a receive window at which the Phy
+ * reports whether it detected a preamble, see OpenRW and CalculatePreambleTime
+ */
+static Time
+GetRWPreambleTime (uint8_t channelIndex, uint8_t dataRateIndex)
+{
+  const uint32_t bandwidth = LoRaWAN::m_supportedChannels [channelIndex].m_bw;
+  const LoRaSpreadingFactor sf = LoRaWAN::m_supportedDataRates [dataRateIndex].spreadingFactor;
+  const uint8_t preambleLength = 8; // as configured in OpenRW
+  return MicroSeconds ((preambleLength + 4.25) * LoRaWAN::GetSymbolPeriod (sf, bandwidth));
+}
+
 std::ostream&
 operator<< (std::ostream& os, const LoRaWANDataRequestParams& p)
 {
@@ -58,6 +75,31 @@ LoRaWANMac::GetTypeId (void)
     .SetParent<Object> ()
     .SetGroupName ("LoRaWAN")
     .AddConstructor<LoRaWANMac> ()
+    .AddAttribute ("MaxTxQueueSize",
+                   "The maximum number of frames in the transmission queue, "
+                   "0 for no limit. Beacons are always accepted.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&LoRaWANMac::m_maxTxQueueSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("RxWindowOracle",
+                   "Only open the receive windows of a class A end device when "
+                   "a downstream transmission starts on the channel and data "
+                   "rate of the window. The MAC still goes through the receive "
+                   "window states and the TrxState trace of the Phy shows "
+                   "skipped windows as RX_ON, but the Phy does not try to "
+                   "receive in them.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LoRaWANMac::m_rxWindowOracle),
+                   MakeBooleanChecker ())
+    .AddAttribute ("UplinkChannelSelection",
+                   "Let an end device choose the channel of every upstream "
+                   "transmission, retransmissions included: a random channel "
+                   "of which the sub band is available, or else the channel "
+                   "that becomes available first. The channel requested by "
+                   "the upper layer is ignored.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LoRaWANMac::m_uplinkChannelSelection),
+                   MakeBooleanChecker ())
     .AddTraceSource ("MacTxEnqueue",
                      "Trace source indicating a packet has been "
                      "enqueued in the transaction queue",
@@ -68,6 +110,11 @@ LoRaWANMac::GetTypeId (void)
                      "dequeued from the transaction queue",
                      MakeTraceSourceAccessor (&LoRaWANMac::m_macTxDequeueTrace),
                      "ns3::Packet::TracedCallback")
+    .AddTraceSource ("MacTxQueueOverflow",
+                     "Trace source indicating a packet has been "
+                     "dropped because the transaction queue is full",
+                     MakeTraceSourceAccessor (&LoRaWANMac::m_macTxQueueOverflowTrace),
+                     "ns3::Packet::TracedCallback")
     .AddTraceSource ("MacTx",
                      "Trace source indicating a packet has "
                      "arrived for transmission by this device",
@@ -122,6 +169,12 @@ LoRaWANMac::GetTypeId (void)
                      "the sent packet",
                      MakeTraceSourceAccessor (&LoRaWANMac::m_sentPktTrace),
                      "ns3::LoRaWANMac::SentTracedCallback")
+    .AddTraceSource ("RxWindow",
+                     "Trace source indicating the end of the preamble of a "
+                     "receive window, reporting the window and the time the "
+                     "receiver listened",
+                     MakeTraceSourceAccessor (&LoRaWANMac::m_rxWindowTrace),
+                     "ns3::LoRaWANMac::RxWindowTracedCallback")
   ;
   return tid;
 }
@@ -145,6 +198,7 @@ LoRaWANMac::LoRaWANMac (uint8_t index) : m_index (index)
   // m_macPromiscuousMode = false;
   m_retransmission = 0;
   m_txPkt = 0;
+  m_oracleListenerId = 0;
 
   m_failToTxBusy = 0;
   m_failToTxDutyCycle = 0;
@@ -152,6 +206,8 @@ LoRaWANMac::LoRaWANMac (uint8_t index) : m_index (index)
   m_failToRxDlBusy = 0;
 
   m_ackTimeOutRandomVariable = CreateObject<UniformRandomVariable> ();
+  // m_channelRandomVariable is only created when UplinkChannelSelection is used, so that
+  // the automatic stream numbers of other random variables do not change
 }
 
 LoRaWANMac::~LoRaWANMac ()
@@ -198,13 +254,11 @@ void
 LoRaWANMac::DoDispose ()
 {
   m_txPkt = 0;
-  for (uint32_t i = 0; i < m_txQueue.size (); i++)
-    {
-      m_txQueue[i]->txQPkt = 0;
-      delete m_txQueue[i];
-    }
-  m_txQueue.clear ();
+  m_txQueue.Clear ();
+  if (m_oracleListenerId && m_phy)
+    RemoveOracleListener ();
   m_phy = 0;
+  m_radioArbiter = 0;
   m_dataIndicationCallback = MakeNullCallback< void, LoRaWANDataIndicationParams, Ptr<Packet> > ();
   m_dataConfirmCallback = MakeNullCallback< void, LoRaWANDataConfirmParams > ();
 
@@ -280,11 +334,16 @@ LoRaWANMac::SetLoRaWANMacState (LoRaWANMacState macState)
       }
   } else if (macState == MAC_TX) {
       //An assert too strong here, as it is possible that a device will currently be in e.g. the MAC_BEACON state when a packet is attempted to be sent. If not currently in idle state, report err, keep current mac state, and continue
-      if(m_LoRaWANMacState == MAC_IDLE) {
-         // for gateways: switch off other PHY/MACs on this net-device
-        if (m_deviceType == LORAWAN_DT_GATEWAY) {
-          NS_ASSERT (!this->m_beginTxCallback.IsNull ());
-          this->m_beginTxCallback (this);
+      if (m_LoRaWANMacState == MAC_IDLE && m_radioArbiter && m_radioArbiter->IsTransmitting ()) {
+        // for gateways: another MAC on this net-device is transmitting, try again when the radio is available
+        m_failToTxBusy++;
+        m_txPkt = 0;
+        NS_LOG_LOGIC(this << " radio is busy; transmission postponed until the radio is available");
+        m_radioArbiter->WaitForRadio (this);
+      } else if(m_LoRaWANMacState == MAC_IDLE) {
+         // for gateways: abort the receptions of the other PHYs on this net-device
+        if (m_radioArbiter) {
+          m_radioArbiter->BeginTx (this);
         }
 
         ChangeMacState (macState);
@@ -306,14 +365,24 @@ LoRaWANMac::SetLoRaWANMacState (LoRaWANMacState macState)
       // Request to Put Phy into IDLE
       m_phy->SetTRXStateRequest (LORAWAN_PHY_IDLE);
 
+      // Calculate both receive windows now, RW1 uses the channel of the uplink and RW2 starts RECEIVE_DELAY2 after the end of the uplink modulation
+      m_rxTimeline.rw1ChannelIndex = m_phy->GetCurrentChannelIndex ();
+      m_rxTimeline.rw1DataRateIndex = LoRaWAN::GetRX1DataRateIndex (m_phy->GetCurrentDataRateIndex (), m_RX1DROffset);
+      m_rxTimeline.rw1Open = m_lastUplinkBitTime + MicroSeconds (RECEIVE_DELAY1);
+      m_rxTimeline.rw1Close = m_rxTimeline.rw1Open + GetRWPreambleTime (m_rxTimeline.rw1ChannelIndex, m_rxTimeline.rw1DataRateIndex);
+      m_rxTimeline.rw2Open = m_lastUplinkBitTime + MicroSeconds (RECEIVE_DELAY2);
+      m_rxTimeline.rw2Close = m_rxTimeline.rw2Open + GetRWPreambleTime (LoRaWAN::m_RW2ChannelIndex, LoRaWAN::m_RW2DataRateIndex);
+
       // schedule a MAC event to open RW1
-      Time receiveDelay = MicroSeconds (RECEIVE_DELAY1);
-      m_setMacState = Simulator::Schedule (receiveDelay, &LoRaWANMac::SetLoRaWANMacState, this, MAC_RW1);
+      m_setMacState = Simulator::Schedule (m_rxTimeline.rw1Open - Simulator::Now (), &LoRaWANMac::AdvanceRxTimeline, this);
   } else if (macState == MAC_RW1) {
       NS_ASSERT (m_LoRaWANMacState == MAC_WAITFORRW1);
 
       ChangeMacState (macState);
-      OpenRW ();
+      if (m_rxWindowOracle)
+        OpenOracleRW ();
+      else
+        OpenRW ();
   } else if (macState == MAC_WAITFORRW2) {
       NS_ASSERT (m_LoRaWANMacState == MAC_RW1);
 
@@ -323,16 +392,16 @@ LoRaWANMac::SetLoRaWANMacState (LoRaWANMacState macState)
       m_phy->SetTRXStateRequest (LORAWAN_PHY_IDLE);
 
       // schedule a MAC event to open RW2
-      // RW2 starts RECEIVE_DELAY2 after the end of the uplink modulation
-      Time receiveDelay = (m_lastUplinkBitTime + MicroSeconds (RECEIVE_DELAY2)) - Simulator::Now ();
+      Time receiveDelay = m_rxTimeline.rw2Open - Simulator::Now ();
       if (receiveDelay >= 0)
-        m_setMacState = Simulator::Schedule (receiveDelay, &LoRaWANMac::SetLoRaWANMacState, this, MAC_RW2);
+        m_setMacState = Simulator::Schedule (receiveDelay, &LoRaWANMac::AdvanceRxTimeline, this);
       else {
         // the node missed the start of RW2 (e.g. a long packet was received in RW1 but was dropped after or during reception)
         // TODO: what to do?
         // For now try to continue gracefully by switching mac state to RW2 and immediately calling OpenRW() and CloseRW()
         NS_LOG_WARN (this << " MAC missed the start of RW2");
         ChangeMacState (MAC_RW2);
+        StartRW2AckTimeoutTimer ();
         OpenRW ();
         CloseRW ();
       }
@@ -341,7 +410,11 @@ LoRaWANMac::SetLoRaWANMacState (LoRaWANMacState macState)
       NS_ASSERT (m_LoRaWANMacState == MAC_WAITFORRW2);
 
       ChangeMacState (macState);
-      OpenRW ();
+      StartRW2AckTimeoutTimer ();
+      if (m_rxWindowOracle)
+        OpenOracleRW ();
+      else
+        OpenRW ();
   } else if (macState == MAC_ACK_TIMEOUT) { // in this state the MAC is waiting for the Mac Ack timeout timer (m_ackTimeOut) to expire
       NS_ASSERT (m_LoRaWANMacState == MAC_TX || m_LoRaWANMacState == MAC_RW2); // MAC_TX for non Class devices
 
@@ -408,32 +481,18 @@ LoRaWANMac::SetDataConfirmCallback (DataConfirmCallback c)
 }
 
 void
-LoRaWANMac::SetBeginTxCallback (BeginTxCallback c)
-{
-  m_beginTxCallback = c;
-}
-
-void
-LoRaWANMac::SetEndTxCallback (EndTxCallback c)
-{
-  m_endTxCallback = c;
-}
-
-void
-LoRaWANMac::SwitchToUnavailableState ()
+LoRaWANMac::SetRadioArbiter (Ptr<LoRaWANRadioArbiter> arbiter)
 {
-  NS_ASSERT (m_deviceType == LORAWAN_DT_GATEWAY);
-
-  this->SetLoRaWANMacState (MAC_UNAVAILABLE);
+  m_radioArbiter = arbiter;
 }
 
 void
-LoRaWANMac::SwitchToIdleState ()
+LoRaWANMac::NotifyRadioAvailable (void)
 {
   NS_ASSERT (m_deviceType == LORAWAN_DT_GATEWAY);
-  NS_ASSERT (m_LoRaWANMacState == MAC_UNAVAILABLE); // this function should only be called to go from MAC_UNAVAILABLE to MAC_IDLE state
+  NS_LOG_FUNCTION (this);
 
-  this->SetLoRaWANMacState (MAC_IDLE);
+  CheckQueue ();
 }
 
 void
@@ -447,7 +506,7 @@ LoRaWANMac::PdDataDestroyed (void)
 }
 
 void
-LoRaWANMac::PdDataIndication (uint32_t phyPayloadLength, Ptr<Packet> p, uint8_t lqi, uint8_t channelIndex, uint8_t dataRateIndex, uint8_t codeRate)
+LoRaWANMac::PdDataIndication (uint32_t phyPayloadLength, Ptr<Packet> p, uint8_t lqi, uint8_t channelIndex, uint8_t dataRateIndex, uint8_t codeRate, LoRaWANRxMetadata rxMetadata)
 {
   // TODO: which state?
 
@@ -492,6 +551,7 @@ LoRaWANMac::PdDataIndication (uint32_t phyPayloadLength, Ptr<Packet> p, uint8_t
     params.m_channelIndex = channelIndex;
     params.m_dataRateIndex = dataRateIndex;
     params.m_codeRate = codeRate;
+    params.m_rxMetadata = rxMetadata;
     params.m_msgType = LORAWAN_BEACON;
      
     uint32_t bc_addr = 0;
@@ -558,7 +618,7 @@ LoRaWANMac::PdDataIndication (uint32_t phyPayloadLength, Ptr<Packet> p, uint8_t
             m_ackTimeOut.Cancel ();
             if (!m_dataConfirmCallback.IsNull ())
             { // Call callback, informing succesfull delivery of frame
-              TxQueueElement *txQElement = m_txQueue.front ();
+              TxQueueElement *txQElement = &m_txQueue.Front ();
               LoRaWANDataConfirmParams confirmParams;
               confirmParams.m_requestHandle = txQElement->lorawanDataRequestParams.m_requestHandle;
               confirmParams.m_status = LORAWAN_SUCCESS;
@@ -588,6 +648,7 @@ LoRaWANMac::PdDataIndication (uint32_t phyPayloadLength, Ptr<Packet> p, uint8_t
       params.m_channelIndex = channelIndex;
       params.m_dataRateIndex = dataRateIndex;
       params.m_codeRate = codeRate;
+      params.m_rxMetadata = rxMetadata;
       params.m_msgType = macHdr.getLoRaWANMsgType ();
       params.m_endDeviceAddress = frameHdr.getDevAddr (); // Note that a gateway can not access the Dev Addr due to encryption of the MACPayload
       params.m_MIC = MIC;
@@ -631,7 +692,7 @@ LoRaWANMac::SetTRXStateConfirm (LoRaWANPhyEnumeration status)
       Ptr<Packet> p = m_txPkt;
 
       // Get airtime for TX of PHY frame and update RDC
-      TxQueueElement *txQElement = m_txQueue.front ();
+      TxQueueElement *txQElement = &m_txQueue.Front ();
       Time airTime = m_phy->CalculateTxTime (p->GetSize ()); // which PHY does not matter here
       uint8_t subBandIndex = LoRaWAN::m_supportedChannels [txQElement->lorawanDataRequestParams.m_loraWANChannelIndex].m_subBandIndex;
       NS_LOG_DEBUG("airtime required is " << airTime);
@@ -685,7 +746,7 @@ LoRaWANMac::PdDataConfirm (LoRaWANPhyEnumeration status)
 {
   NS_ASSERT (m_LoRaWANMacState == MAC_TX);
 
-  NS_LOG_FUNCTION (this << status << m_txQueue.size ());
+  NS_LOG_FUNCTION (this << status << m_txQueue.GetSize ());
 
   NS_ASSERT (m_txPkt);
   LoRaWANMacHeader macHdr;
@@ -693,8 +754,8 @@ LoRaWANMac::PdDataConfirm (LoRaWANPhyEnumeration status)
 
   if (status == LORAWAN_PHY_SUCCESS)
     {
-      NS_ASSERT_MSG (m_txQueue.size () > 0, "TxQsize = 0");
-      TxQueueElement *txQElement = m_txQueue.front ();
+      NS_ASSERT_MSG (m_txQueue.GetSize () > 0, "TxQsize = 0");
+      TxQueueElement *txQElement = &m_txQueue.Front ();
 
       // As no Ack is comming, notify upper layer that packet was sent and check if packet can be removed from queue
       if (!macHdr.IsConfirmed ())
@@ -738,15 +799,16 @@ LoRaWANMac::PdDataConfirm (LoRaWANPhyEnumeration status)
       if (m_deviceType == LORAWAN_DT_END_DEVICE) { // always go to WAITFORRW1 for a Class A transmit
         // Note that the Ack timeout timer will only start running at the beginning of RW2
         m_lastUplinkBitTime = Simulator::Now ();
-        m_setMacState = Simulator::ScheduleNow (&LoRaWANMac::SetLoRaWANMacState, this, MAC_WAITFORRW1);
+        SetLoRaWANMacState (MAC_WAITFORRW1);
       } else if (m_deviceType == LORAWAN_DT_GATEWAY) { // Gateway
         // Always go to IDLE state for gateway, retransmissions are handled by the network server
         
         m_setMacState = Simulator::ScheduleNow (&LoRaWANMac::SetLoRaWANMacState, this, MAC_IDLE);
 
-        // Switch other PHY/MACs on this net-device to IDLE
-        NS_ASSERT (!this->m_endTxCallback.IsNull());
-        this->m_endTxCallback (this);
+        // Release the radio so that other MACs on this net-device can transmit
+        if (m_radioArbiter) {
+          m_radioArbiter->EndTx (this);
+        }
       } else {
         NS_FATAL_ERROR ( this << " Invalid device type " << m_deviceType);
         return;
@@ -836,23 +898,20 @@ LoRaWANMac::sendMACPayloadRequest (LoRaWANDataRequestParams params, Ptr<Packet>
   // Construct Phy Payload
   Ptr<Packet> phyPayload = constructPhyPayload (params, p);
 
+  //beacon has to be sent as soon as scheduled, if its a beacon put it in the priority lane of the queue
+  bool priority = params.m_msgType == LORAWAN_BEACON;
+  if (!priority && m_maxTxQueueSize > 0 && m_txQueue.GetSize () >= m_maxTxQueueSize) {
+    NS_LOG_WARN (this << " Transmission queue is full (" << m_txQueue.GetSize () << " frames), dropping packet");
+    m_macTxQueueOverflowTrace (phyPayload);
+    return;
+  }
+
   m_macTxEnqueueTrace (phyPayload);
 
   // All checks have been passed, add packet to the queue
-  TxQueueElement *txQElement = new TxQueueElement;
-  txQElement->lorawanDataRequestParams = params;
-  txQElement->txQPkt = phyPayload;
-
-  //beacon has to be sent as soon as scheduled, if its a beacon put it at the start of the queue
-  if(params.m_msgType == LORAWAN_BEACON)
-  {
-    m_txQueue.insert(m_txQueue.begin(), txQElement);
-  }
-  else
-  {
-    //otherwise push it to the end 
-    m_txQueue.push_back (txQElement);  
-  }
+  TxQueueElement &txQElement = m_txQueue.Enqueue (priority);
+  txQElement.lorawanDataRequestParams = params;
+  txQElement.txQPkt = phyPayload;
 
   CheckQueue ();
 }
@@ -893,20 +952,24 @@ LoRaWANMac::CheckQueue ()
 
   // Check if we can send a packet: MAC State, Phy state and RDC
 
-  NS_LOG_DEBUG (this << " INFO: tx queue size is equal to " << m_txQueue.size());
+  NS_LOG_DEBUG (this << " INFO: tx queue size is equal to " << m_txQueue.GetSize ());
 
-  if (m_LoRaWANMacState == MAC_IDLE && !m_txQueue.empty () && m_txPkt == 0 && !m_setMacState.IsRunning ())
+  if (m_LoRaWANMacState == MAC_IDLE && !m_txQueue.IsEmpty () && m_txPkt == 0 && !m_setMacState.IsRunning () && !(m_radioArbiter && m_radioArbiter->IsTransmitting ()))
   {
-    // Check RDC constraints for first packet in the queue
-    TxQueueElement *txQElement = m_txQueue.front ();
+    // Check RDC constraints for first packet in the queue, it only becomes
+    // the front of the queue once it is sent
+    TxQueueElement *txQElement = &m_txQueue.Peek ();
+    Time airTime = GetTxAirTime (*txQElement);
+    if (m_uplinkChannelSelection && m_deviceType == LORAWAN_DT_END_DEVICE)
+      txQElement->lorawanDataRequestParams.m_loraWANChannelIndex = SelectUplinkChannel (airTime);
     int8_t subBandIndex = m_lorawanMacRDC->GetSubBandIndexForChannelIndex (txQElement->lorawanDataRequestParams.m_loraWANChannelIndex);
     NS_ASSERT (subBandIndex >= 0);
-    if (m_lorawanMacRDC->IsSubBandAvailable (subBandIndex))
+    if (m_lorawanMacRDC->NextAvailableTime (subBandIndex, airTime) <= Simulator::Now ())
     {
       NS_LOG_DEBUG (this << " sub band #" << (uint16_t)subBandIndex << " is available");
 
       // we can sent the next frame
-      m_txPkt = txQElement->txQPkt;
+      m_txPkt = m_txQueue.Front ().txQPkt;
       m_setMacState = Simulator::ScheduleNow (&LoRaWANMac::SetLoRaWANMacState, this, MAC_TX);
 
       // in case of gateway, we should set the other MACs to BUSY and the other PHYs to BUSY, see SetLoRaWANMacState
@@ -916,7 +979,7 @@ LoRaWANMac::CheckQueue ()
       NS_LOG_DEBUG (this << " Cannot sent packet because sub band #" << static_cast<uint16_t>(subBandIndex) << " is not available");
       m_failToTxDutyCycle++; //if this is a ping slot then a fail-to-send is okay, the packet can be sent in a later one instead.
       if (m_deviceType != LORAWAN_DT_GATEWAY) {
-        m_lorawanMacRDC->ScheduleSubBandTimer (this, subBandIndex); // schedule RDC timer
+        m_lorawanMacRDC->ScheduleSubBandTimer (this, subBandIndex, airTime); // schedule RDC timer
       }
     }
   } else {
@@ -924,7 +987,7 @@ LoRaWANMac::CheckQueue ()
     if (m_LoRaWANMacState != MAC_IDLE) {
       NS_LOG_DEBUG (this << " Cannot sent packet because MAC is not idle, MAC state is equal to " << m_LoRaWANMacState);
     }
-    if (m_txQueue.empty ()) {
+    if (m_txQueue.IsEmpty ()) {
       NS_LOG_DEBUG (this << " tx queue is empty, so there is no packet to send.");
     }
     if (m_txPkt) {
@@ -933,18 +996,23 @@ LoRaWANMac::CheckQueue ()
     if (m_setMacState.IsRunning ()) {
       NS_LOG_DEBUG (this << " Cannot sent packet because set MAC state event is running");
     }
+    if (m_radioArbiter && m_radioArbiter->IsTransmitting ()) {
+      NS_LOG_DEBUG (this << " Cannot sent packet because the radio is transmitting");
+    }
   }
 
   // If a gateway can not send a packet immediately, then there is no use in trying to send it later as the RW of the end device will not be open later
   if (m_deviceType == LORAWAN_DT_GATEWAY) {
-    if (!m_txQueue.empty ()) {
+    if (!m_txQueue.IsEmpty ()) {
       // this is a dangereous state to be in, experience has shown that the gateway MACs gets stuck at this point
 
-      TxQueueElement *txQElement = m_txQueue.front ();
+      TxQueueElement *txQElement = &m_txQueue.Peek ();
       LoRaWANDataRequestParams params = txQElement->lorawanDataRequestParams;
 
       if (params.m_msgType == LORAWAN_BEACON) {
           NS_LOG_DEBUG(this << "Can't currently send the beacon frame.");
+          if (m_radioArbiter && m_radioArbiter->IsTransmitting ())
+            m_radioArbiter->WaitForRadio (this);
           // TODO: remove the beacon from the list?
       }
       else {
@@ -965,7 +1033,7 @@ LoRaWANMac::CheckRetransmission ()
   NS_LOG_FUNCTION (this);
 
   // The packet:
-  TxQueueElement *txQElement = m_txQueue.front ();
+  TxQueueElement *txQElement = &m_txQueue.Front ();
   NS_ASSERT (txQElement != 0);
   LoRaWANDataRequestParams params = txQElement->lorawanDataRequestParams;
 
@@ -1001,48 +1069,99 @@ LoRaWANMac::CheckRetransmission ()
 
   // We still have one or more transmissions left for m_txPkt
   if (!m_setMacState.IsRunning ()) {
-    // TODO: frequency hopping between retransmissions ?
     // Standard mentions "This resend must be done on another channel and must obey the duty cycle limitation as any other normal transmission."
-    // Note that enddevice-application may limit the number of channels via its random variable ...
-    // TODO: frequency hopping also applies to UNC US with NbRep > 1
+    // Without UplinkChannelSelection the frame is resent on the channel chosen by the upper layer
+    Time airTime = GetTxAirTime (*txQElement);
+    if (m_uplinkChannelSelection) {
+      txQElement->lorawanDataRequestParams.m_loraWANChannelIndex = SelectUplinkChannel (airTime);
+      params.m_loraWANChannelIndex = txQElement->lorawanDataRequestParams.m_loraWANChannelIndex;
+    }
     int8_t subBandIndex = m_lorawanMacRDC->GetSubBandIndexForChannelIndex (params.m_loraWANChannelIndex);
     NS_ASSERT (subBandIndex >= 0);
-    if (m_lorawanMacRDC->IsSubBandAvailable (subBandIndex)) { // we can sent the next frame
+    if (m_lorawanMacRDC->NextAvailableTime (subBandIndex, airTime) <= Simulator::Now ()) { // we can sent the next frame
       m_retransmission++;
       m_setMacState = Simulator::ScheduleNow (&LoRaWANMac::SetLoRaWANMacState, this, MAC_TX);
     } else {
-      m_lorawanMacRDC->ScheduleSubBandTimer (this, subBandIndex);
+      m_lorawanMacRDC->ScheduleSubBandTimer (this, subBandIndex, airTime);
     }
   } else {
       NS_LOG_ERROR ( this << "  called eventhough there is a mac state change scheduled.");
   }
 }
 
+uint8_t
+LoRaWANMac::SelectUplinkChannel (Time airTime)
+{
+  NS_LOG_FUNCTION (this << airTime);
+
+  // All channels but the RW2 channel can be used for upstream transmissions
+  const Time now = Simulator::Now ();
+  std::vector<uint8_t> available;
+  uint8_t earliestChannelIndex = 0;
+  Time earliest = Time::Max ();
+  for (uint8_t i = 0; i < LoRaWAN::m_supportedChannels.size (); i++)
+    {
+      if (i == LoRaWAN::m_RW2ChannelIndex)
+        continue;
+
+      const uint8_t subBandIndex = LoRaWAN::m_supportedChannels [i].m_subBandIndex;
+      const Time next = m_lorawanMacRDC->NextAvailableTime (subBandIndex, airTime);
+      if (next <= now)
+        available.push_back (i);
+      else if (next < earliest)
+        {
+          earliest = next;
+          earliestChannelIndex = i;
+        }
+    }
+
+  if (available.empty ())
+    {
+      NS_LOG_DEBUG (this << " no sub band is available, channel " << (uint16_t)earliestChannelIndex << " is available first at " << earliest);
+      return earliestChannelIndex;
+    }
+
+  if (m_channelRandomVariable == 0)
+    m_channelRandomVariable = CreateObject<UniformRandomVariable> ();
+  const uint8_t channelIndex = available [m_channelRandomVariable->GetInteger (0, available.size () - 1)];
+  NS_LOG_DEBUG (this << " selected channel " << (uint16_t)channelIndex << " out of " << available.size () << " available channels");
+  return channelIndex;
+}
+
 void
 LoRaWANMac::RemoveFirstTxQElement (bool sentPacket)
 {
   NS_LOG_FUNCTION (this);
 
-  TxQueueElement *txQElement = m_txQueue.front ();
+  TxQueueElement *txQElement = &m_txQueue.Front ();
   Ptr<const Packet> p = txQElement->txQPkt;
 
   if (sentPacket)
     m_sentPktTrace (p, m_retransmission + 1);
 
-  txQElement->txQPkt = 0;
-  delete txQElement;
-  m_txQueue.pop_front ();
+  m_txQueue.PopFront ();
   m_txPkt = 0;
   m_retransmission = 0;
   m_macTxDequeueTrace (p);
 }
 
+Time
+LoRaWANMac::GetTxAirTime (const TxQueueElement &txQElement) const
+{
+  const LoRaWANDataRequestParams &params = txQElement.lorawanDataRequestParams;
+  const uint32_t bandwidth = LoRaWAN::m_supportedChannels [params.m_loraWANChannelIndex].m_bw;
+  const LoRaSpreadingFactor sf = LoRaWAN::m_supportedDataRates [params.m_loraWANDataRateIndex].spreadingFactor;
+  bool implicitHeader = params.m_msgType == LORAWAN_BEACON; // see ConfigurePhyForTX
+  bool crcOn = params.m_msgType != LORAWAN_BEACON;
+  return LoRaWAN::GetTimeOnAir (sf, bandwidth, params.m_loraWANCodeRate, params.m_loraWANPreambleLength, crcOn, implicitHeader, txQElement.txQPkt->GetSize ());
+}
+
 bool
 LoRaWANMac::ConfigurePhyForTX () {
   NS_LOG_FUNCTION (this);
 
   if (m_txPkt != 0) {
-    TxQueueElement *txQElement = m_txQueue.front ();
+    TxQueueElement *txQElement = &m_txQueue.Front ();
     // Select and configure PHY
     uint8_t channelIndex = txQElement->lorawanDataRequestParams.m_loraWANChannelIndex;
     uint8_t dataRateIndex = txQElement->lorawanDataRequestParams.m_loraWANDataRateIndex;
@@ -1141,15 +1260,6 @@ LoRaWANMac::OpenRW ()
       NS_LOG_ERROR (this << " unable to configure Phy");
       return;
     }
-
-    // For confirmed frames, start the ACK_TIMEOUT timer at the beginning of RW2
-    if (m_txPkt) { // if the transmitted packet was unconfirmed, then it has been removed in RemoveFirstTxQElement which set m_txPkt to NULL
-      LoRaWANMacHeader macHdr;
-      m_txPkt->PeekHeader (macHdr);
-      if (macHdr.IsConfirmed ()) {
-        StartAckTimeoutTimer ();
-      }
-    }
   } 
   else if (m_LoRaWANMacState == MAC_BEACON) {
     // beacon uses a set channel and data rate defined in the spec
@@ -1187,6 +1297,10 @@ LoRaWANMac::OpenRW ()
   // Instruct Phy to listen for LoRa frame preamble
   m_phy->SetTRXStateRequest (LORAWAN_PHY_RX_ON);
 
+  // For RW1 and RW2, AdvanceRxTimeline checks the preamble at the end of the window
+  if (m_LoRaWANMacState == MAC_RW1 || m_LoRaWANMacState == MAC_RW2)
+    return;
+
   // Schedule timer to ask PHY layer whether it has detected a preamble
   // i) Preamble not detected -> Close RW, continue to RW2
   // ii) Preamble detected -> Continue receiving frame. PHY should contact MAC
@@ -1213,28 +1327,7 @@ LoRaWANMac::CloseRW ()
     return;
 
   } else if (m_LoRaWANMacState == MAC_RW2) { // no frame received, retransmissions or idle?
-    bool confirmed = false;
-    if (m_txPkt) { // if the transmitted packet was unconfirmed, then it has been removed in RemoveFirstTxQElement which set m_txPkt to NULL
-      LoRaWANMacHeader macHdr;
-      m_txPkt->PeekHeader (macHdr);
-      confirmed = macHdr.IsConfirmed ();
-    }
-
-    if (confirmed) {
-      // We didn't receive a frame in RW2, so assume that no Ack is comming: go to MAC_ACK_TIMEOUT state
-      // Note that the Ack Timeout timer was started at the beginning of RW2
-      // Also note that in some cases the RW might only be closed after the Ack timeout timer has already
-      // expired (e.g. due to a long packet reception and a short ack timeout time interval),
-      // in these cases just go immediatly to MAC_IDLE
-      if (m_ackTimeOut.IsRunning ()) {
-        m_setMacState = Simulator::ScheduleNow (&LoRaWANMac::SetLoRaWANMacState, this, MAC_ACK_TIMEOUT);
-      } else {
-        NS_LOG_WARN (this << " Closing RW2 after Ack Timeout timer has expired. Skipping MAC_ACK_TIMEOUT state and going directly to MAC_IDLE state.");
-        m_setMacState = Simulator::ScheduleNow (&LoRaWANMac::SetLoRaWANMacState, this, MAC_IDLE);
-      }
-    } else {
-      m_setMacState = Simulator::ScheduleNow (&LoRaWANMac::SetLoRaWANMacState, this, MAC_IDLE);
-    }
+    m_setMacState = Simulator::ScheduleNow (&LoRaWANMac::SetLoRaWANMacState, this, GetStateAfterRW2 ());
   } 
   else if (m_LoRaWANMacState == MAC_BEACON) {
     //no beacon received, log and go back to idle mode
@@ -1257,6 +1350,105 @@ LoRaWANMac::CloseRW ()
   // phy->SetTRXStateRequest(LORAWAN_PHY_IDLE);
 }
 
+void
+LoRaWANMac::OpenOracleRW ()
+{
+  NS_LOG_FUNCTION (this);
+
+  Ptr<LoRaWANSpectrumChannel> channel = DynamicCast<LoRaWANSpectrumChannel> (m_phy->GetChannel ());
+  if (channel == 0) { // we can not tell whether a downlink starts, so always listen
+    OpenRW ();
+    return;
+  }
+
+  uint8_t channelIndex = m_rxTimeline.rw1ChannelIndex;
+  uint8_t dataRateIndex = m_rxTimeline.rw1DataRateIndex;
+  if (m_LoRaWANMacState == MAC_RW2) {
+    channelIndex = LoRaWAN::m_RW2ChannelIndex;
+    dataRateIndex = LoRaWAN::m_RW2DataRateIndex;
+  }
+
+  // The Phy only shows RX_ON in its trace, the window is really opened when a downlink starts during the window
+  NS_ASSERT (m_oracleListenerId == 0);
+  m_oracleListenerId = channel->AddDownlinkListener (channelIndex, dataRateIndex, MakeCallback (&LoRaWANMac::OracleDownlinkStarted, this));
+  m_phy->StartSkippedRxWindow ();
+}
+
+void
+LoRaWANMac::OracleDownlinkStarted ()
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (m_LoRaWANMacState == MAC_RW1 || m_LoRaWANMacState == MAC_RW2);
+
+  RemoveOracleListener ();
+  OpenRW ();
+}
+
+void
+LoRaWANMac::RemoveOracleListener ()
+{
+  Ptr<LoRaWANSpectrumChannel> channel = DynamicCast<LoRaWANSpectrumChannel> (m_phy->GetChannel ());
+  if (channel)
+    channel->RemoveDownlinkListener (m_oracleListenerId);
+  m_oracleListenerId = 0;
+}
+
+LoRaWANMacState
+LoRaWANMac::GetStateAfterRW2 () const
+{
+  bool confirmed = false;
+  if (m_txPkt) { // if the transmitted packet was unconfirmed, then it has been removed in RemoveFirstTxQElement which set m_txPkt to NULL
+    LoRaWANMacHeader macHdr;
+    m_txPkt->PeekHeader (macHdr);
+    confirmed = macHdr.IsConfirmed ();
+  }
+
+  if (confirmed) {
+    // We didn't receive a frame in RW2, so assume that no Ack is comming: go to MAC_ACK_TIMEOUT state
+    // Note that the Ack Timeout timer was started at the beginning of RW2
+    // Also note that in some cases the RW might only be closed after the Ack timeout timer has already
+    // expired (e.g. due to a long packet reception and a short ack timeout time interval),
+    // in these cases just go immediatly to MAC_IDLE
+    if (m_ackTimeOut.IsRunning ()) {
+      return MAC_ACK_TIMEOUT;
+    } else {
+      NS_LOG_WARN (this << " Closing RW2 after Ack Timeout timer has expired. Skipping MAC_ACK_TIMEOUT state and going directly to MAC_IDLE state.");
+      return MAC_IDLE;
+    }
+  }
+  return MAC_IDLE;
+}
+
+void
+LoRaWANMac::AdvanceRxTimeline ()
+{
+  NS_LOG_FUNCTION (this << m_LoRaWANMacState);
+  NS_ASSERT (m_deviceType == LORAWAN_DT_END_DEVICE);
+
+  if (m_LoRaWANMacState == MAC_WAITFORRW1) {
+    SetLoRaWANMacState (MAC_RW1);
+    m_setMacState = Simulator::Schedule (m_rxTimeline.rw1Close - Simulator::Now (), &LoRaWANMac::AdvanceRxTimeline, this);
+  } else if (m_LoRaWANMacState == MAC_WAITFORRW2) {
+    SetLoRaWANMacState (MAC_RW2);
+    m_setMacState = Simulator::Schedule (m_rxTimeline.rw2Close - Simulator::Now (), &LoRaWANMac::AdvanceRxTimeline, this);
+  } else if (m_LoRaWANMacState == MAC_RW1 || m_LoRaWANMacState == MAC_RW2) {
+    const bool rw1 = m_LoRaWANMacState == MAC_RW1;
+    m_rxWindowTrace (rw1 ? 1 : 2, rw1 ? m_rxTimeline.rw1Close - m_rxTimeline.rw1Open : m_rxTimeline.rw2Close - m_rxTimeline.rw2Open);
+
+    if (m_oracleListenerId) {
+      // Oracle mode: no downlink started during the window, so nothing could have been received
+      RemoveOracleListener ();
+    } else if (m_phy->preambleDetected ()) {
+      // Keep on receiving the frame, the Phy calls PdDataIndication or PdDataDestroyed at the end of the frame
+      return;
+    }
+    // No frame in this RW: move on to the next step of the timeline right away
+    SetLoRaWANMacState (rw1 ? MAC_WAITFORRW2 : GetStateAfterRW2 ());
+  } else {
+    NS_LOG_ERROR (this << " MAC state incorrect " << m_LoRaWANMacState);
+  }
+}
+
 void
 LoRaWANMac::CheckPhyPreamble ()
 {
@@ -1276,6 +1468,19 @@ LoRaWANMac::CheckPhyPreamble ()
   }
 }
 
+void
+LoRaWANMac::StartRW2AckTimeoutTimer ()
+{
+  // For confirmed frames, start the ACK_TIMEOUT timer at the beginning of RW2
+  if (m_txPkt) { // if the transmitted packet was unconfirmed, then it has been removed in RemoveFirstTxQElement which set m_txPkt to NULL
+    LoRaWANMacHeader macHdr;
+    m_txPkt->PeekHeader (macHdr);
+    if (macHdr.IsConfirmed ()) {
+      StartAckTimeoutTimer ();
+    }
+  }
+}
+
 void
 LoRaWANMac::StartAckTimeoutTimer ()
 {
@@ -1315,7 +1520,43 @@ LoRaWANMac::AckTimeoutExpired ()
 }
 
 // LoRaWANMacRDC class implementation:
-LoRaWANMac::LoRaWANMacRDC::LoRaWANMacRDC (void) {
+
+// NS_OBJECT_ENSURE_REGISTERED does not accept a nested class
+static class LoRaWANMacRDCRegistrationClass
+{
+public:
+  LoRaWANMacRDCRegistrationClass ()
+  {
+    LoRaWANMac::LoRaWANMacRDC::GetTypeId ();
+  }
+} g_loRaWANMacRDCRegistrationVariable;
+
+TypeId
+LoRaWANMac::LoRaWANMacRDC::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LoRaWANMacRDC")
+    .SetParent<Object> ()
+    .SetGroupName ("LoRaWAN")
+    .AddConstructor<LoRaWANMacRDC> ()
+    .AddAttribute ("Policy",
+                   "How the duty cycle limits of the sub bands are enforced.",
+                   EnumValue (LORAWAN_DC_TIME_OFF),
+                   MakeEnumAccessor (&LoRaWANMacRDC::m_policy),
+                   MakeEnumChecker (LORAWAN_DC_TIME_OFF, "TimeOff",
+                                    LORAWAN_DC_SLIDING_WINDOW, "SlidingWindow"))
+    .AddAttribute ("Window",
+                   "The length of the window of the SlidingWindow policy.",
+                   TimeValue (Hours (1)),
+                   MakeTimeAccessor (&LoRaWANMacRDC::m_window),
+                   MakeTimeChecker (Seconds (1)))
+  ;
+  return tid;
+}
+
+LoRaWANMac::LoRaWANMacRDC::LoRaWANMacRDC (void)
+  : m_policy (LORAWAN_DC_TIME_OFF),
+    m_window (Hours (1))
+{
   // init sub bands, EU868
   LoRaWANSubBand g0 = {100, 14, Time (), Time ()}; // g(Note 7), 14dBm?
   LoRaWANSubBand g1 = {100, 14, Time (), Time ()}; // 1%
@@ -1335,6 +1576,8 @@ LoRaWANMac::LoRaWANMacRDC::LoRaWANMacRDC (void) {
   this->m_subBandTimers.push_back (EventId ());
   this->m_subBandTimers.push_back (EventId ());
   this->m_subBandTimers.push_back (EventId ());
+
+  this->m_ledgers.resize (m_subBands.size ());
 }
 
 int8_t
@@ -1358,6 +1601,9 @@ LoRaWANMac::LoRaWANMacRDC::IsSubBandAvailable (uint8_t subBandIndex) const
 {
   NS_LOG_FUNCTION (this << (uint16_t)subBandIndex);
 
+  if (m_policy == LORAWAN_DC_SLIDING_WINDOW)
+    return RemainingBudget (subBandIndex) > 0;
+
   if (m_subBands[subBandIndex].timeoff == 0) // when sending for the first time on this sub band timeoff will be zero, so then the sub band is always available
     return true;
 
@@ -1369,16 +1615,88 @@ LoRaWANMac::LoRaWANMacRDC::IsSubBandAvailable (uint8_t subBandIndex) const
   return result;
 }
 
+Time
+LoRaWANMac::LoRaWANMacRDC::NextAvailableTime (uint8_t subBandIndex, Time airTime) const
+{
+  NS_LOG_FUNCTION (this << (uint16_t)subBandIndex << airTime);
+
+  const Time now = Simulator::Now ();
+
+  if (m_policy == LORAWAN_DC_TIME_OFF) {
+    Time available = m_subBands[subBandIndex].LastTxFinishedTimestamp + m_subBands[subBandIndex].timeoff;
+    return available > now ? available : now;
+  }
+
+  // Sliding window: wait until enough of the oldest transmissions have left the window
+  ExpireLedger (subBandIndex);
+  const Ledger &ledger = m_ledgers[subBandIndex];
+  const Time budget = GetWindowBudget (subBandIndex);
+
+  if (airTime > budget) {
+    // The frame never fits in the budget, rather than blocking the sub band
+    // forever it may be sent once all other transmissions left the window
+    NS_LOG_WARN (this << " airtime " << airTime << " exceeds the budget " << budget << " of sub band #" << (uint16_t)subBandIndex);
+    return ledger.txs.empty () ? now : ledger.txs.back ().first + m_window;
+  }
+
+  Time used = ledger.used;
+  if (used + airTime <= budget)
+    return now;
+
+  // The frame fits once the ledger is empty, so the loop always returns
+  std::deque<std::pair<Time, Time> >::const_iterator it = ledger.txs.begin ();
+  for (; it != ledger.txs.end (); ++it) {
+    used -= it->second;
+    if (used + airTime <= budget)
+      break;
+  }
+  NS_ASSERT (it != ledger.txs.end ());
+  return it->first + m_window;
+}
+
+Time
+LoRaWANMac::LoRaWANMacRDC::RemainingBudget (uint8_t subBandIndex) const
+{
+  NS_LOG_FUNCTION (this << (uint16_t)subBandIndex);
+
+  const Time budget = GetWindowBudget (subBandIndex);
+
+  if (m_policy == LORAWAN_DC_TIME_OFF)
+    return NextAvailableTime (subBandIndex, Seconds (0)) <= Simulator::Now () ? budget : Seconds (0);
+
+  ExpireLedger (subBandIndex);
+  const Time used = m_ledgers[subBandIndex].used;
+  return used < budget ? budget - used : Seconds (0);
+}
+
+void
+LoRaWANMac::LoRaWANMacRDC::ExpireLedger (uint8_t subBandIndex) const
+{
+  Ledger &ledger = m_ledgers[subBandIndex];
+  const Time windowStart = Simulator::Now () - m_window;
+  while (!ledger.txs.empty () && ledger.txs.front ().first <= windowStart) {
+    ledger.used -= ledger.txs.front ().second;
+    ledger.txs.pop_front ();
+  }
+}
+
+Time
+LoRaWANMac::LoRaWANMacRDC::GetWindowBudget (uint8_t subBandIndex) const
+{
+  return NanoSeconds (m_window.GetNanoSeconds () / m_subBands[subBandIndex].dutyCycleLimit);
+}
+
 void
-LoRaWANMac::LoRaWANMacRDC::ScheduleSubBandTimer (Ptr<LoRaWANMac> macObj, uint8_t subBandIndex)
+LoRaWANMac::LoRaWANMacRDC::ScheduleSubBandTimer (Ptr<LoRaWANMac> macObj, uint8_t subBandIndex, Time airTime)
 {
-  NS_LOG_FUNCTION (this << static_cast<int> (subBandIndex));
+  NS_LOG_FUNCTION (this << static_cast<int> (subBandIndex) << airTime);
 
   if (!m_subBandTimers[subBandIndex].IsRunning ()) {
-    Time subBandAvailable = m_subBands[subBandIndex].LastTxFinishedTimestamp + m_subBands[subBandIndex].timeoff;
+    Time subBandAvailable = NextAvailableTime (subBandIndex, airTime);
     // As Simulator::Schedule expects a delay as its time argument we need to subtract Simulator::now() from SubBandAvailable
     Time delay = subBandAvailable  - Simulator::Now ();
-    NS_ASSERT (delay > 0); // if equal to zero, then ns3 will get stuck in a loop checking whether the band available ...
+    // if equal to zero, then ns3 will get stuck in a loop checking whether the band available ...
+    NS_ASSERT_MSG (delay > 0, "sub band #" << (uint16_t)subBandIndex << " is available for airtime " << airTime << ", the frame should have been sent");
 
     m_subBandTimers[subBandIndex] = Simulator::Schedule (delay, &LoRaWANMac::LoRaWANMacRDC::SubBandTimerExpired, this, macObj, subBandIndex);
     NS_LOG_LOGIC (this << " scheduled timer for subBand #" << (uint16_t)subBandIndex
@@ -1408,6 +1726,12 @@ LoRaWANMac::LoRaWANMacRDC::UpdateRDCTimerForSubBand (uint8_t subBandIndex, Time
   m_subBands[subBandIndex].LastTxFinishedTimestamp = LastTxFinishedTimestamp;
   m_subBands[subBandIndex].timeoff = timeoff;
 
+  if (m_policy == LORAWAN_DC_SLIDING_WINDOW) {
+    ExpireLedger (subBandIndex);
+    m_ledgers[subBandIndex].txs.push_back (std::make_pair (Simulator::Now (), airTime));
+    m_ledgers[subBandIndex].used += airTime;
+  }
+
   NS_LOG_LOGIC (this << " updated RDC for subBand " << (uint16_t)subBandIndex << ": time now is: " << Simulator::Now () << ", time finished sending is: "
                      << LastTxFinishedTimestamp << ", meaning a timeoff time of "
                      << timeoff << ", so next usable time is :" << LastTxFinishedTimestamp + timeoff);
@@ -1419,7 +1743,19 @@ LoRaWANMac::AssignStreams (int64_t stream)
   NS_LOG_FUNCTION (this);
   NS_ASSERT (m_ackTimeOutRandomVariable);
   m_ackTimeOutRandomVariable->SetStream (stream);
-  return 1;
+  if (!m_uplinkChannelSelection)
+    return 1;
+
+  if (m_channelRandomVariable == 0)
+    m_channelRandomVariable = CreateObject<UniformRandomVariable> ();
+  m_channelRandomVariable->SetStream (stream + 1);
+  return 2;
+}
+
+bool
+LoRaWANMac::GetUplinkChannelSelection (void) const
+{
+  return m_uplinkChannelSelection;
 }
 
 void 
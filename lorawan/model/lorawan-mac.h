@@ -22,6 +22,7 @@
 
 #include "lorawan.h"
 #include "lorawan-phy.h"
+#include "lorawan-mac-tx-queue.h"
 #include <ns3/object.h>
 #include <ns3/traced-callback.h>
 #include <ns3/traced-value.h>
@@ -29,6 +30,7 @@
 #include <ns3/nstime.h>
 #include <ns3/event-id.h>
 #include <ns3/timer.h>
+
 #include <deque>
 
 // Default settings for EU863-870
@@ -90,6 +92,17 @@ typedef struct LoRaWANSubBand {
   Time timeoff; // Simulator time for timeoff duration on this sub band
 } LoRaWANSubBand;
 
+/**
+ * \ingroup lorawan
+ *
+ * How the duty cycle limit of a sub band is enforced
+ */
+typedef enum
+{
+  LORAWAN_DC_TIME_OFF = 0,        //!< wait airtime*(limit - 1) after every transmission
+  LORAWAN_DC_SLIDING_WINDOW = 1,  //!< the airtime in any window (one hour by default) stays below window/limit
+} LoRaWANDutyCyclePolicy;
+
 typedef enum
 {
   LORAWAN_SUCCESS                = 0,
@@ -138,6 +151,7 @@ struct LoRaWANDataIndicationParams
   uint8_t m_dataRateIndex;		//!< Data rate index of received transmission
   uint8_t m_codeRate;			    //!< Code rate of received transmission
   uint8_t m_preambleLength;   //!< Preamble length of received transmission (usually 8 symbols, longer for beacons)
+  LoRaWANRxMetadata m_rxMetadata; //!< RSSI, SNR, receiving gateway and timestamp of received transmission
 
   LoRaWANMsgType m_msgType; 		//!< Message Type
   Ipv4Address m_endDeviceAddress; 	//!< End Device Address
@@ -145,22 +159,6 @@ struct LoRaWANDataIndicationParams
 };
 
 
-/**
- * \ingroup lorawan
- *
- * This callback is called immediately before when this MAC object changes its state to the TX state.
- * Note: only for gateways.
- */
-class LoRaWANMac;
-typedef Callback<void, Ptr<LoRaWANMac> > BeginTxCallback;
-/**
- * \ingroup lorawan
- *
- * This callback is called immediately after when a MAC object has finished a transmission.
- * Note: only for gateways.
- */
-typedef Callback<void, Ptr<LoRaWANMac> > EndTxCallback;
-
 /**
  * \ingroup lorawan
  *
@@ -201,23 +199,92 @@ public:
   class LoRaWANMacRDC : public Object
   {
   public:
+    /**
+     * Get the type ID.
+     *
+     * \return the object TypeId
+     */
+    static TypeId GetTypeId (void);
+
     LoRaWANMacRDC (void);
 
     int8_t GetSubBandIndexForChannelIndex (uint8_t channelIndex) const;
     int8_t GetMaxPowerForSubBand (uint8_t subBandIndex) const;
     bool IsSubBandAvailable (uint8_t subBandIndex) const;
 
+    /**
+     * Get the earliest time at which a frame can be sent on a sub band
+     * without violating its duty cycle limit. Under the sliding window
+     * policy a frame whose airtime exceeds the budget of a whole window can
+     * be sent once no other transmission is left in the window.
+     *
+     * \param subBandIndex the sub band
+     * \param airTime the airtime of the frame
+     * \return the absolute simulation time, not earlier than now
+     */
+    Time NextAvailableTime (uint8_t subBandIndex, Time airTime) const;
+
+    /**
+     * Get the airtime that can be used on a sub band right now. For the
+     * time-off policy this is either the airtime of a full window or zero.
+     *
+     * \param subBandIndex the sub band
+     * \return the remaining airtime
+     */
+    Time RemainingBudget (uint8_t subBandIndex) const;
+
     void UpdateRDCTimerForSubBand (uint8_t subBandIndex, Time airTime);
 
-    void ScheduleSubBandTimer (Ptr<LoRaWANMac> macObj, uint8_t subBandIndex);
+    /**
+     * Schedule a timer that notifies a MAC when a frame can be sent on a
+     * sub band. Only call this when NextAvailableTime is later than now.
+     *
+     * \param macObj the MAC to notify
+     * \param subBandIndex the sub band
+     * \param airTime the airtime of the frame
+     */
+    void ScheduleSubBandTimer (Ptr<LoRaWANMac> macObj, uint8_t subBandIndex, Time airTime);
     void SubBandTimerExpired (Ptr<LoRaWANMac> macObj, uint8_t subBandIndex);
   private:
+    /**
+     * The transmissions of a sub band in the last window, for the sliding
+     * window policy.
+     */
+    struct Ledger
+    {
+      std::deque<std::pair<Time, Time> > txs; //!< start time and airtime of the transmissions, oldest first
+      Time used;                              //!< sum of the airtime in txs
+    };
+
+    /**
+     * Remove the transmissions that left the window from the ledger of a
+     * sub band.
+     *
+     * \param subBandIndex the sub band
+     */
+    void ExpireLedger (uint8_t subBandIndex) const;
+
+    /**
+     * \param subBandIndex the sub band
+     * \return the airtime allowed in one window on the sub band
+     */
+    Time GetWindowBudget (uint8_t subBandIndex) const;
+
     /**
      * The RDC limitations per sub-band
      */
     std::vector<LoRaWANSubBand> m_subBands;
 
     std::vector<EventId> m_subBandTimers;
+
+    LoRaWANDutyCyclePolicy m_policy; //!< how the duty cycle limits are enforced
+    Time m_window;                   //!< the length of the sliding window
+
+    /**
+     * The sliding window ledger per sub band. Expired transmissions are
+     * removed lazily, also by the const queries.
+     */
+    mutable std::vector<Ledger> m_ledgers;
   };
 
   /**
@@ -265,14 +332,22 @@ public:
 
   void SetDataConfirmCallback (DataConfirmCallback c);
 
-  void SetBeginTxCallback (BeginTxCallback c);
-  void SetEndTxCallback (EndTxCallback c);
+  /**
+   * Set the radio arbiter shared by all MACs of a gateway. The MAC acquires
+   * the radio before transmitting and releases it afterwards.
+   *
+   * \param arbiter the radio arbiter
+   */
+  void SetRadioArbiter (Ptr<LoRaWANRadioArbiter> arbiter);
 
-  void SwitchToUnavailableState ();
-  void SwitchToIdleState ();
+  /**
+   * Called by the radio arbiter when the radio became available again after
+   * this MAC had to wait for it.
+   */
+  void NotifyRadioAvailable (void);
 
   void PdDataDestroyed (void);
-  void PdDataIndication (uint32_t phyPayloadLength, Ptr<Packet> p, uint8_t lqi, uint8_t channelIndex, uint8_t dataRateIndex, uint8_t codeRate);
+  void PdDataIndication (uint32_t phyPayloadLength, Ptr<Packet> p, uint8_t lqi, uint8_t channelIndex, uint8_t dataRateIndex, uint8_t codeRate, LoRaWANRxMetadata rxMetadata);
 
   /**
    *  Report status of Phy TRX state switch to MAC
@@ -314,15 +389,32 @@ public:
   typedef void (* SentTracedCallback)
     (Ptr<const Packet> packet, uint8_t retries);
 
+  /**
+   * TracedCallback signature for receive windows.
+   *
+   * \param [in] window The receive window (1 or 2).
+   * \param [in] duration The time the receiver listened for a preamble.
+   */
+  typedef void (* RxWindowTracedCallback)
+    (uint8_t window, Time duration);
+
   /**
    * Assign a fixed random variable stream number to the random variables
    * used by this model.  Return the number of streams that have been assigned.
+   * A stream for the uplink channel selection is only assigned when
+   * UplinkChannelSelection is set, so set it before assigning streams.
    *
    * \param stream first stream index to use
    * \return the number of stream indices assigned by this model
    */
   int64_t AssignStreams (int64_t stream);
 
+  /**
+   * \return true if the MAC chooses the channel of every upstream
+   *         transmission, see the UplinkChannelSelection attribute
+   */
+  bool GetUplinkChannelSelection (void) const;
+
   void setClassBChannelIndex(uint8_t  channelIndex);
   void setClassBDataRateIndex(uint8_t dataRateIndex);
   void setClassBCodeRateIndex(uint8_t codeRateIndex);
@@ -351,7 +443,44 @@ protected:
   void OpenRW ();
   void CloseRW ();
   void CheckPhyPreamble ();
+
+  /**
+   * Handler of the single event that walks a class A end device through
+   * its receive windows (see m_rxTimeline): it opens RW1 and RW2 and closes
+   * them at the end of their preamble when no preamble was detected.
+   */
+  void AdvanceRxTimeline ();
+
+  /**
+   * \return the state to go to after RW2 was closed without receiving a
+   * frame: MAC_ACK_TIMEOUT or MAC_IDLE
+   */
+  LoRaWANMacState GetStateAfterRW2 () const;
+
+  /**
+   * In oracle mode, open the receive window the MAC is in unless no downlink
+   * can arrive: only register with the channel for downstream transmissions
+   * on the channel and data rate of the window.
+   */
+  void OpenOracleRW ();
+
+  /**
+   * Called by the channel when a downstream transmission starts on the
+   * channel and data rate of the current receive window: open the window.
+   */
+  void OracleDownlinkStarted ();
+
+  /**
+   * Unregister from the channel.
+   */
+  void RemoveOracleListener ();
   void StartAckTimeoutTimer ();
+
+  /**
+   * Start the Ack timeout timer at the beginning of RW2 if the last uplink
+   * was confirmed.
+   */
+  void StartRW2AckTimeoutTimer ();
   void AckTimeoutExpired ();
 
   //void StartTransmission();
@@ -374,6 +503,15 @@ private:
    */
   TracedCallback<Ptr<const Packet>, uint8_t> m_sentPktTrace;
 
+  /**
+   * The trace source fired at the end of the preamble of every receive
+   * window of a class A end device, also for windows that were skipped in
+   * oracle mode.
+   *
+   * \see class CallBackTraceSource
+   */
+  TracedCallback<uint8_t, Time> m_rxWindowTrace;
+
   /**
    * The trace source fired when packets come into the "top" of the device
    * at the L3/L2 transition, when being queued for transmission.
@@ -390,6 +528,14 @@ private:
    */
   TracedCallback<Ptr<const Packet> > m_macTxDequeueTrace;
 
+  /**
+   * The trace source fired when packets are dropped because the
+   * transmission queue is full.
+   *
+   * \see class CallBackTraceSource
+   */
+  TracedCallback<Ptr<const Packet> > m_macTxQueueOverflowTrace;
+
   /**
    * The trace source fired when packets are being sent down to L1.
    *
@@ -472,16 +618,10 @@ private:
   TracedValue<LoRaWANMacState> m_LoRaWANMacState;
 
   /**
-   * This callback is used to switch off other MACs and PHYs objects, just prior to when this MAC object starts transmision
-   * Only for gateways
-   * */
-  BeginTxCallback m_beginTxCallback;
-
-  /**
-   * This callback is used to switch other MACs and PHYs objects back to IDLE, just after when this MAC object ends transmision
-   * Only for gateways
+   * The radio arbiter of the gateway, used to make sure only one MAC object
+   * transmits at a time. Only for gateways
    * */
-  EndTxCallback m_endTxCallback;
+  Ptr<LoRaWANRadioArbiter> m_radioArbiter;
 
   /**
    * This callback is used to notify incoming packets to the upper layers.
@@ -504,9 +644,34 @@ private:
   };
 
   /**
-   * The transmit queue used by the MAC.
+   * Calculate the airtime of a queued frame.
+   *
+   * \param txQElement the queued frame
+   * \return the airtime of the frame
    */
-  std::deque<TxQueueElement*> m_txQueue;
+  Time GetTxAirTime (const TxQueueElement &txQElement) const;
+
+  /**
+   * Choose the channel for an upstream transmission: a random channel out of
+   * the channels of which the sub band is available now, or else the channel
+   * of which the sub band becomes available first.
+   *
+   * \param airTime the airtime of the transmission
+   * \return the index of the channel
+   */
+  uint8_t SelectUplinkChannel (Time airTime);
+
+  /**
+   * The transmit queue used by the MAC. Beacons are queued in the priority
+   * lane, all other frames in the normal lane.
+   */
+  LoRaWANMacTxQueue<TxQueueElement> m_txQueue;
+
+  /**
+   * The maximum number of frames in the transmit queue, 0 for no limit.
+   * Frames for the priority lane are always accepted.
+   */
+  uint32_t m_maxTxQueueSize;
 
   /**
    * The packet which is currently being sent by the MAC layer.
@@ -547,6 +712,49 @@ private:
    */
   Time m_lastUplinkBitTime;
 
+  /**
+   * The receive windows following an uplink of a class A end device.
+   */
+  struct RxTimeline
+  {
+    Time rw1Open;  //!< start of RW1
+    Time rw1Close; //!< end of the preamble in RW1
+    Time rw2Open;  //!< start of RW2
+    Time rw2Close; //!< end of the preamble in RW2
+    uint8_t rw1ChannelIndex;  //!< channel of RW1
+    uint8_t rw1DataRateIndex; //!< data rate of RW1
+  };
+
+  /**
+   * The receive windows of the last uplink, calculated when the uplink ends.
+   * The windows are walked by a single pending AdvanceRxTimeline event
+   * (m_setMacState).
+   */
+  RxTimeline m_rxTimeline;
+
+  /**
+   * Skip the receive windows of a class A end device in which no downstream
+   * transmission starts on the channel and data rate of the window.
+   */
+  bool m_rxWindowOracle;
+
+  /**
+   * The id of the downlink listener registered with the channel for the
+   * current receive window in oracle mode, or 0.
+   */
+  uint32_t m_oracleListenerId;
+
+  /**
+   * Let the MAC choose the channel of upstream transmissions.
+   */
+  bool m_uplinkChannelSelection;
+
+  /**
+   * The random variable used to choose among the available upstream
+   * channels, only created when UplinkChannelSelection is used
+   */
+  Ptr<UniformRandomVariable> m_channelRandomVariable;
+
   /**
    * The random variable used to calculate the random fraction of the Ack
    * time-out timer
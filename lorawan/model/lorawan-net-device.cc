@@ -20,6 +20,8 @@
 #include "lorawan.h"
 #include "lorawan-net-device.h"
 #include "lorawan-error-model.h"
+#include "lorawan-gateway-phy.h"
+#include "lorawan-collision-phy.h"
 #include <ns3/abort.h>
 #include <ns3/assert.h>
 #include <ns3/node.h>
@@ -29,6 +31,7 @@
 #include <ns3/boolean.h>
 #include <ns3/mobility-model.h>
 #include <ns3/packet.h>
+#include <ns3/simulator.h>
 
 namespace ns3 {
 
@@ -69,21 +72,47 @@ LoRaWANNetDevice::LoRaWANNetDevice () : m_deviceType (LORAWAN_DT_END_DEVICE), m_
 {}
 
 LoRaWANNetDevice::LoRaWANNetDevice (LoRaWANDeviceType deviceType)
+  : LoRaWANNetDevice (deviceType, 0)
+{
+}
+
+LoRaWANNetDevice::LoRaWANNetDevice (LoRaWANDeviceType deviceType, uint32_t nDemodulators)
+  : LoRaWANNetDevice (deviceType, nDemodulators, false)
+{
+}
+
+LoRaWANNetDevice::LoRaWANNetDevice (LoRaWANDeviceType deviceType, uint32_t nDemodulators, bool collisionModel)
   : m_deviceType (deviceType), m_configComplete (false)
 {
-  NS_LOG_FUNCTION (this);
+  NS_LOG_FUNCTION (this << nDemodulators << collisionModel);
 
   if (deviceType == LORAWAN_DT_END_DEVICE) {
     uint8_t index = 0;
-    m_phy = CreateObject<LoRaWANPhy> (index);
+    if (collisionModel)
+      m_phy = CreateObject<LoRaWANCollisionPhy> (index);
+    else
+      m_phy = CreateObject<LoRaWANPhy> (index);
     m_mac = CreateObject<LoRaWANMac> (index);
     m_macRDC = CreateObject<LoRaWANMac::LoRaWANMacRDC> ();
+  } else if (deviceType == LORAWAN_DT_GATEWAY && nDemodulators > 0) {
+    // one front end that receives on all channels and data rates
+    Ptr<LoRaWANGatewayPhy> phy = CreateObject<LoRaWANGatewayPhy> ();
+    phy->SetAttribute ("Demodulators", UintegerValue (nDemodulators));
+    phy->SetAttribute ("InvertedIq", BooleanValue (true));
+    m_phys.push_back (phy);
+    m_macs.push_back (CreateObject<LoRaWANMac> (0));
+    m_macRDC = CreateObject<LoRaWANMac::LoRaWANMacRDC> ();
   } else if (deviceType == LORAWAN_DT_GATEWAY) {
     uint8_t index = 0;
     for (uint8_t i = 0; i < LoRaWAN::m_supportedChannels.size (); i++) {
       for (uint8_t j = 0; j < LoRaWAN::m_supportedDataRates.size (); j++) {
         index = i*LoRaWAN::m_supportedDataRates.size () + j;
-        Ptr<LoRaWANPhy> phy = CreateObject<LoRaWANPhy> (index);
+        Ptr<LoRaWANPhy> phy;
+        if (collisionModel)
+          phy = CreateObject<LoRaWANCollisionPhy> (index);
+        else
+          phy = CreateObject<LoRaWANPhy> (index);
+        phy->SetAttribute ("InvertedIq", BooleanValue (true));
         Ptr<LoRaWANMac> mac = CreateObject<LoRaWANMac> (index);
         // index in std::vector is i*LoRaWAN::m_supportedDataRates.size () + j
         // phy and mac belong together
@@ -123,6 +152,10 @@ LoRaWANNetDevice::DoDispose (void)
 
     m_phys.clear ();
     m_macs.clear ();
+    if (m_radioArbiter) {
+      m_radioArbiter->Clear ();
+      m_radioArbiter = 0;
+    }
   }
   m_macRDC = 0;
   m_node = 0;
@@ -194,6 +227,8 @@ LoRaWANNetDevice::CompleteConfig (void)
       {
         return;
       }
+    // All PHYs and MACs share the half-duplex radio of the gateway
+    m_radioArbiter = Create<LoRaWANRadioArbiter> ();
     for (uint8_t i = 0; i < m_macs.size (); i++) {
       Ptr<LoRaWANPhy> phy = m_phys[i];
       Ptr<LoRaWANMac> mac = m_macs[i];
@@ -212,9 +247,7 @@ LoRaWANNetDevice::CompleteConfig (void)
       mac->SetDeviceType (m_deviceType);
       mac->SetDataIndicationCallback (MakeCallback (&LoRaWANNetDevice::DataIndication, this));
 
-      // Set begin and end tx callbacks (only for gateway)
-      mac->SetBeginTxCallback (MakeCallback (&LoRaWANNetDevice::MacBeginsTx, this));
-      mac->SetEndTxCallback (MakeCallback (&LoRaWANNetDevice::MacEndsTx, this));
+      mac->SetRadioArbiter (m_radioArbiter);
 
       Ptr<MobilityModel> mobility = m_node->GetObject<MobilityModel> ();
       if (!mobility)
@@ -225,6 +258,7 @@ LoRaWANNetDevice::CompleteConfig (void)
       Ptr<LoRaWANErrorModel> model = CreateObject<LoRaWANErrorModel> ();
       phy->SetErrorModel (model);
       phy->SetDevice (this);
+      phy->SetRadioArbiter (m_radioArbiter);
 
       phy->SetPdDataIndicationCallback (MakeCallback (&LoRaWANMac::PdDataIndication, mac));
       phy->SetPdDataDestroyedCallback (MakeCallback (&LoRaWANMac::PdDataDestroyed,  mac));
@@ -325,6 +359,13 @@ LoRaWANNetDevice::GetPhys (void) const
     return m_phys;
   }
 }
+
+Ptr<LoRaWANMac::LoRaWANMacRDC>
+LoRaWANNetDevice::GetRDC (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return m_macRDC;
+}
 void
 LoRaWANNetDevice::SetIfIndex (const uint32_t index)
 {
@@ -597,62 +638,32 @@ LoRaWANNetDevice::getMACSIndexForChannelAndDataRate (uint8_t& macsIndex, uint8_t
   if (channelIndex >= LoRaWAN::m_supportedChannels.size() || dataRateIndex >= LoRaWAN::m_supportedDataRates.size())
     return false;
 
-  macsIndex = channelIndex*LoRaWAN::m_supportedDataRates.size() + dataRateIndex;
-  return true;
-}
-
-void
-LoRaWANNetDevice::MacBeginsTx (Ptr<LoRaWANMac> macPtr)
-{
-  NS_ASSERT (m_deviceType == LORAWAN_DT_GATEWAY);
-
-  NS_LOG_FUNCTION(this);
-
-  // Switch all MACs (including macPtr) to MAC_UNAVAILABLE state
-  for (uint8_t i = 0; i < m_macs.size (); i++) {
-    Ptr<LoRaWANMac> mac = m_macs[i];
-    NS_ASSERT(mac);
-
-    // include macPtr, as we need to switch the PHY corresponding to macPtr OFF first, before we can switch it to TX_ON
-    // if (mac == macPtr)
-    //   continue;
-
-    mac->SwitchToUnavailableState();
+  if (m_macs.size () == 1) { // single MAC on top of a LoRaWANGatewayPhy
+    macsIndex = 0;
+    return true;
   }
-}
 
-void
-LoRaWANNetDevice::MacEndsTx (Ptr<LoRaWANMac> macPtr)
-{
-  NS_ASSERT (m_deviceType == LORAWAN_DT_GATEWAY);
-
-  NS_LOG_FUNCTION(this);
-
-  // Switch all MACs and Phys except macPtr to MAC_IDLE state
-  for (uint8_t i = 0; i < m_macs.size (); i++) {
-    Ptr<LoRaWANMac> mac = m_macs[i];
-    NS_ASSERT(mac);
-
-    if (mac == macPtr)
-      continue;
-
-    mac->SwitchToIdleState ();
-  }
+  macsIndex = channelIndex*LoRaWAN::m_supportedDataRates.size() + dataRateIndex;
+  return true;
 }
 
 bool
-LoRaWANNetDevice::CanSendImmediatelyOnChannel (uint8_t channelIndex, uint8_t dataRateIndex)
+LoRaWANNetDevice::CanSendImmediatelyOnChannel (uint8_t channelIndex, uint8_t dataRateIndex, Time airTime)
 {
   if (this->m_macRDC) {
     int8_t subBandIndex = this->m_macRDC->GetSubBandIndexForChannelIndex (channelIndex);
     NS_ASSERT (subBandIndex >= 0);
-    // step 1: check RDC restrictions
-    if (this->m_macRDC->IsSubBandAvailable (subBandIndex)) {
+    // step 1: check RDC restrictions for the airtime of the frame, the MAC does the same check before sending
+    if (this->m_macRDC->NextAvailableTime (subBandIndex, airTime) <= Simulator::Now ()) {
+      // step 2: check whether the radio is transmitting (half-duplex)
+      if (m_radioArbiter && m_radioArbiter->IsTransmitting ())
+        return false;
+
       uint8_t macIndex = 0;
       if (getMACSIndexForChannelAndDataRate (macIndex, channelIndex, dataRateIndex)) {
-        // step2: check whether MAC object is in Idle state (could be in TX or unavailable)
+        // step 3: check whether MAC object is in Idle state
         if (this->m_macs[macIndex]->GetLoRaWANMacState () == MAC_IDLE) {
-          // step3: check whether a MAC event is scheduled (MAC state could be scheduled to go to TX state)
+          // step 4: check whether a MAC event is scheduled (MAC state could be scheduled to go to TX state)
           if (!this->m_macs[macIndex]->IsLoRaWANMacStateRunning ()) {
             return true;
           }
@@ -714,6 +725,8 @@ LoRaWANNetDevice::DataIndication (LoRaWANDataIndicationParams params, Ptr<Packet
   phyParamsTag.SetDataRateIndex (params.m_dataRateIndex);
   phyParamsTag.SetCodeRate (params.m_codeRate);
   phyParamsTag.SetPreambleLength (params.m_preambleLength);
+  params.m_rxMetadata.m_gatewayId = GetNode ()->GetId ();
+  phyParamsTag.SetRxMetadata (params.m_rxMetadata);
   pkt->AddPacketTag (phyParamsTag);
 
   // Add MsgTypeTag to packet
@@ -748,11 +761,13 @@ LoRaWANNetDevice::AssignStreams (int64_t stream)
   NS_LOG_FUNCTION (stream);
   int64_t streamIndex = stream;
   if (m_deviceType == LORAWAN_DT_END_DEVICE) {
-    streamIndex += m_phy->AssignStreams (stream);
+    streamIndex += m_phy->AssignStreams (streamIndex);
+    // The MAC only gets streams when it selects uplink channels, so that the streams of existing setups do not change
+    if (m_mac->GetUplinkChannelSelection ())
+      streamIndex += m_mac->AssignStreams (streamIndex);
   } else if (m_deviceType == LORAWAN_DT_GATEWAY) {
     for (uint8_t i = 0; i < m_phys.size (); i++) {
-      Ptr<LoRaWANPhy> phy = m_phys[i];
-      streamIndex += phy->AssignStreams (stream + i);
+      streamIndex += m_phys[i]->AssignStreams (streamIndex);
     }
   } else {
     NS_ASSERT_MSG (0, "Not implemented for non Class A end devices");
@@ -43,6 +43,25 @@ public:
 
   LoRaWANNetDevice ();
   LoRaWANNetDevice (LoRaWANDeviceType deviceType);
+  /**
+   * Create a net device. For gateways with nDemodulators > 0, a single
+   * LoRaWANGatewayPhy with nDemodulators demodulators and a single MAC are
+   * created instead of a PHY and MAC per channel and data rate.
+   *
+   * \param deviceType the type of the device
+   * \param nDemodulators the number of demodulators of a gateway
+   */
+  LoRaWANNetDevice (LoRaWANDeviceType deviceType, uint32_t nDemodulators);
+  /**
+   * Create a net device, with LoRaWANCollisionPhy objects instead of
+   * LoRaWANPhy objects if collisionModel is true. A gateway with
+   * nDemodulators > 0 always uses a LoRaWANGatewayPhy.
+   *
+   * \param deviceType the type of the device
+   * \param nDemodulators the number of demodulators of a gateway
+   * \param collisionModel whether to use the collision model PHY
+   */
+  LoRaWANNetDevice (LoRaWANDeviceType deviceType, uint32_t nDemodulators, bool collisionModel);
   virtual ~LoRaWANNetDevice ();
 
   /**
@@ -68,6 +87,11 @@ public:
   Ptr<LoRaWANPhy> GetPhy (void) const;
   std::vector<Ptr<LoRaWANPhy> > GetPhys (void) const;
 
+  /**
+   * \returns the duty cycle ledger of the device, shared by all its MACs.
+   */
+  Ptr<LoRaWANMac::LoRaWANMacRDC> GetRDC (void) const;
+
   //inherited from NetDevice base class.
   virtual void SetIfIndex (const uint32_t index);
   virtual uint32_t GetIfIndex (void) const;
@@ -95,10 +119,19 @@ public:
 
   bool getMACSIndexForChannelAndDataRate (uint8_t& macsIndex, uint8_t channelIndex, uint8_t dataRateIndex);
 
-  void MacBeginsTx (Ptr<LoRaWANMac> macPtr);
-  void MacEndsTx (Ptr<LoRaWANMac> macPtr);
-
-  bool CanSendImmediatelyOnChannel (uint8_t channelIndex, uint8_t dataRateIndex);
+  /**
+   * Check whether a frame can be sent right now: the duty cycle limit of
+   * the sub band allows the airtime of the frame (see
+   * LoRaWANMac::LoRaWANMacRDC::NextAvailableTime, the same check as in
+   * LoRaWANMac::CheckQueue), the radio is not transmitting and the MAC for
+   * the channel and data rate is idle.
+   *
+   * \param channelIndex the channel of the transmission
+   * \param dataRateIndex the data rate of the transmission
+   * \param airTime the airtime of the frame
+   * \return true if the frame can be sent right now
+   */
+  bool CanSendImmediatelyOnChannel (uint8_t channelIndex, uint8_t dataRateIndex, Time airTime);
 
   LoRaWANDeviceType GetDeviceType (void) const;
   // void SetDeviceType (LoRaWANDeviceType type);
@@ -118,6 +151,9 @@ public:
   /**
    * Assign a fixed random variable stream number to the random variables
    * used by this model.  Return the number of streams that have been assigned.
+   * The MAC of an end device is only assigned streams when its
+   * UplinkChannelSelection attribute is set, so set it before assigning
+   * streams.
    *
    * \param stream first stream index to use
    * \return the number of stream indices assigned by this model
@@ -174,6 +210,9 @@ private:
   std::vector<Ptr<LoRaWANMac> > m_macs;
 
   Ptr<LoRaWANMac::LoRaWANMacRDC> m_macRDC;
+
+  // For gateways: half-duplex state of the radio, shared by m_phys and m_macs
+  Ptr<LoRaWANRadioArbiter> m_radioArbiter;
   LoRaWANDeviceType m_deviceType;
 
   /**
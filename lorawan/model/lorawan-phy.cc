@@ -20,6 +20,7 @@
 #include "lorawan-phy.h"
 #include "lorawan-spectrum-signal-parameters.h"
 #include "lorawan-spectrum-value-helper.h"
+#include "lorawan-spectrum-channel.h"
 #include "lorawan-error-model.h"
 #include "lorawan-lqi-tag.h"
 #include <ns3/log.h>
@@ -33,6 +34,9 @@
 #include <ns3/net-device.h>
 #include <ns3/random-variable-stream.h>
 #include <ns3/double.h>
+#include <ns3/boolean.h>
+
+#include <algorithm>
 
 namespace ns3 {
 
@@ -49,6 +53,22 @@ LoRaWANPhy::GetTypeId (void)
     .SetParent<SpectrumPhy> ()
     .SetGroupName ("LoRaWAN")
     .AddConstructor<LoRaWANPhy> ()
+    .AddAttribute ("PerChunkRxOutcome",
+                   "If true, decide whether a reception failed every time the "
+                   "interference changes. If false, the success probability "
+                   "of all SINR segments of a reception is combined and the "
+                   "outcome is drawn once at the end of the reception.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LoRaWANPhy::m_perChunkRxOutcome),
+                   MakeBooleanChecker ())
+    .AddAttribute ("InvertedIq",
+                   "If true, the PHY transmits with inverted IQ and only locks "
+                   "onto transmissions without inverted IQ, as a gateway does. "
+                   "If false, the PHY behaves as an end device. Transmissions "
+                   "with the wrong IQ polarity only count as interference.",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&LoRaWANPhy::m_invertedIq),
+                   MakeBooleanChecker ())
     .AddTraceSource ("TrxState",
                      "The state of the transceiver",
                      MakeTraceSourceAccessor (&LoRaWANPhy::m_trxState),
@@ -112,17 +132,16 @@ LoRaWANPhy::LoRaWANPhy (uint8_t index)
   m_codeRate = 3;
   m_preambleLength = 8;
   m_crcOn = true;
+  m_implicitHeader = false;
+  m_invertedIq = false;
 
   // receiver sensitivity depends on LoRa modulation parameters according to Semtech
   // However, we don't use sensitivity in our PHY modelling as we don't do any
   // energy detection or carrier sensing
   //m_rxSensitivity = pow (10.0, -106.58 / 10.0) / 1000.0;
 
-  LoRaWANSpectrumValueHelper psdHelper;
-  const uint32_t freq = LoRaWAN::m_supportedChannels [m_currentChannelIndex].m_fc;
-  m_txPsd = psdHelper.CreateTxPowerSpectralDensity (m_txPower,
-                                                    freq);
-  m_noise = psdHelper.CreateNoisePowerSpectralDensity (freq);
+  m_txPsd = LoRaWANSpectrumValueHelper::GetTxPowerSpectralDensity (m_txPower, m_currentChannelIndex);
+  m_noise = LoRaWANSpectrumValueHelper::GetNoisePowerSpectralDensity (m_currentChannelIndex);
   m_signal = Create<LoRaWANInterferenceHelper> (m_noise->GetSpectrumModel ());
   m_rxLastUpdate = Seconds (0);
   Ptr<Packet> none_packet = 0;
@@ -136,6 +155,7 @@ LoRaWANPhy::LoRaWANPhy (uint8_t index)
   m_random->SetAttribute ("Max", DoubleValue (1.0));
 
 
+  m_skippedRxWindow = false;
   ChangeTrxState (LORAWAN_PHY_TRX_OFF);
 }
 
@@ -151,16 +171,20 @@ LoRaWANPhy::DoDispose (void)
   // Cancel pending transceiver state change, if one is in progress.
   m_setTRXState.Cancel ();
   m_trxState = LORAWAN_PHY_TRX_OFF;
+  m_skippedRxWindow = false;
   // m_trxStatePending = LORAWAN_PHY_IDLE;
 
   m_mobility = 0;
   m_device = 0;
+  m_radioArbiter = 0;
   m_channel = 0;
+  m_loRaWANChannel = 0;
   m_txPsd = 0;
   m_noise = 0;
   m_signal = 0;
   m_errorModel = 0;
-  m_pdDataIndicationCallback = MakeNullCallback< void, uint32_t, Ptr<Packet>, uint8_t, uint8_t, uint8_t, uint8_t > ();
+  m_rxSinrSegments.clear ();
+  m_pdDataIndicationCallback = MakeNullCallback< void, uint32_t, Ptr<Packet>, uint8_t, uint8_t, uint8_t, uint8_t, LoRaWANRxMetadata > ();
   m_pdDataConfirmCallback = MakeNullCallback< void, LoRaWANPhyEnumeration > ();
   m_setTRXStateConfirmCallback = MakeNullCallback< void, LoRaWANPhyEnumeration > ();
 
@@ -204,6 +228,7 @@ LoRaWANPhy::SetChannel (Ptr<SpectrumChannel> c)
 {
   NS_LOG_FUNCTION (this << c);
   m_channel = c;
+  m_loRaWANChannel = DynamicCast<LoRaWANSpectrumChannel> (c);
 }
 
 
@@ -265,6 +290,12 @@ LoRaWANPhy::GetIndex (void) const
   return m_index;
 }
 
+bool
+LoRaWANPhy::ReceivesOnAllChannels (void) const
+{
+  return false;
+}
+
 void
 LoRaWANPhy::PrintCurrentTxConf () const
 {
@@ -316,6 +347,8 @@ LoRaWANPhy::SetTxConf (int8_t power, uint8_t channelIndex, uint8_t dataRateIndex
 
   m_txPower = power;
   // TODO: changing the channel should corrupt any ongoing packet reception/transmission
+  if (m_currentChannelIndex != channelIndex && m_loRaWANChannel && !ReceivesOnAllChannels ())
+    m_loRaWANChannel->RetuneRx (this, channelIndex); // only deliver transmissions on the new channel to this PHY
   m_currentChannelIndex = channelIndex;
   m_currentDataRateIndex = dataRateIndex;
   m_codeRate = codeRate;
@@ -323,10 +356,8 @@ LoRaWANPhy::SetTxConf (int8_t power, uint8_t channelIndex, uint8_t dataRateIndex
   m_preambleLength = preambleLength;
   m_implicitHeader = implicitHeader; //implicit header is used in LoRaWAN Class B Beacon only
 
-  // update TX PSD
-  LoRaWANSpectrumValueHelper psdHelper;
-  m_txPsd = psdHelper.CreateTxPowerSpectralDensity (m_txPower,
-                                                    channel->m_fc);
+  // update TX PSD, the PSD is shared with other PHYs
+  m_txPsd = LoRaWANSpectrumValueHelper::GetTxPowerSpectralDensity (m_txPower, channelIndex);
 
   NS_LOG_DEBUG (this << ": updated TxConf");
 
@@ -340,6 +371,9 @@ LoRaWANPhy::SetTRXStateRequest (LoRaWANPhyEnumeration state)
 
   NS_LOG_LOGIC ("Trying to set m_trxState from " << m_trxState << " to " << state);
 
+  // Any request ends a skipped receive window; a request for RX_ON really opens it
+  m_skippedRxWindow = false;
+
   // Check valid states
   NS_ABORT_IF ( (state != LORAWAN_PHY_RX_ON)
                 && (state != LORAWAN_PHY_TRX_OFF)
@@ -461,10 +495,27 @@ LoRaWANPhy::SetTRXStateRequest (LoRaWANPhyEnumeration state)
   return;
 }
 
+void
+LoRaWANPhy::StartSkippedRxWindow (void)
+{
+  NS_LOG_FUNCTION (this);
+  NS_ASSERT (m_trxState == LORAWAN_PHY_IDLE || m_trxState == LORAWAN_PHY_TRX_OFF);
+
+  ChangeTrxState (LORAWAN_PHY_RX_ON);
+  m_skippedRxWindow = true;
+}
+
 void
 LoRaWANPhy::ChangeTrxState (LoRaWANPhyEnumeration newState)
 {
   NS_LOG_LOGIC (this << " state: " << m_trxState << " -> " << newState);
+  if (m_radioArbiter && (newState == LORAWAN_PHY_BUSY_RX) != (m_trxState == LORAWAN_PHY_BUSY_RX))
+    {
+      if (newState == LORAWAN_PHY_BUSY_RX)
+        m_radioArbiter->AddReceiver (this);
+      else
+        m_radioArbiter->RemoveReceiver (this);
+    }
   //m_trxStateLogger (Simulator::Now (), m_trxState, newState);
   m_trxState = newState;
 }
@@ -477,6 +528,31 @@ LoRaWANPhy::preambleDetected (void) const
   return (m_trxState == LORAWAN_PHY_BUSY_RX);
 }
 
+void
+LoRaWANPhy::SetRadioArbiter (Ptr<LoRaWANRadioArbiter> arbiter)
+{
+  NS_LOG_FUNCTION (this << arbiter);
+  m_radioArbiter = arbiter;
+}
+
+bool
+LoRaWANPhy::IsRadioTransmitting (void) const
+{
+  return m_radioArbiter && m_radioArbiter->IsTransmitting ();
+}
+
+void
+LoRaWANPhy::AbortRx (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_trxState == LORAWAN_PHY_BUSY_RX && m_currentRxPacket.first)
+    {
+      m_currentRxPacket.second.aborted = true;
+      FinishRx ();
+    }
+}
+
 void
 LoRaWANPhy::SetPdDataIndicationCallback (PdDataIndicationCallback c)
 {
@@ -510,18 +586,17 @@ LoRaWANPhy::StartRx (Ptr<SpectrumSignalParameters> spectrumRxParams)
 {
   NS_LOG_FUNCTION (this << spectrumRxParams);
 
-  LoRaWANSpectrumValueHelper psdHelper;
-
   Ptr<LoRaWANSpectrumSignalParameters> loraWanRxParams = DynamicCast<LoRaWANSpectrumSignalParameters> (spectrumRxParams);
   // If the channel of the transmission and the don't match, just return immediatly.
   // This is a workaround for a SpectrumPhy limitation where even in cases when the PSD of the incoming signalling has very very small power (-infinity in this case), we are still adding it as interference and calling EndRx (this clutters tracing output and wastes CPU time)
   // If the data rate of the transmission and the PHY don't match, do not attempt to receive the transmission; instead just count the transmission as noise
   // IRL the RX Phy would not lock onto a Preamble with different SF. In simulator we have to explicitly check the SF.
+  // Likewise, the Phy does not lock onto a preamble with the wrong IQ polarity (i.e. gateways ignore downstream and end devices ignore upstream transmissions).
   bool channelMismatch = false;
   bool dataRateMismatch = false;
   if (loraWanRxParams) {
     channelMismatch = loraWanRxParams->channelIndex != m_currentChannelIndex;
-    dataRateMismatch = loraWanRxParams->dataRateIndex != m_currentDataRateIndex;
+    dataRateMismatch = loraWanRxParams->dataRateIndex != m_currentDataRateIndex || !IsRxPolarity (loraWanRxParams);
   }
 
   if (channelMismatch) {
@@ -531,18 +606,22 @@ LoRaWANPhy::StartRx (Ptr<SpectrumSignalParameters> spectrumRxParams)
   if (loraWanRxParams == 0 || dataRateMismatch)
     { // reception is not a LoRaWAN packet or is a LoRaWAN transmission with a different data rate
       CheckInterference ();
-      m_signal->AddSignal (spectrumRxParams->psd);
+      if (loraWanRxParams)
+        m_signal->AddPower (loraWanRxParams->channelIndex, GetRxPower (loraWanRxParams));
+      else
+        m_signal->AddSignal (spectrumRxParams->psd);
 
       // Schedule EndRx to update m_signal when the transmission of the incoming signal has ended
-      Simulator::Schedule (spectrumRxParams->duration, &LoRaWANPhy::EndRx, this, spectrumRxParams);
+      ScheduleEndRx (spectrumRxParams);
       return;
     }
 
   Ptr<Packet> p = loraWanRxParams->packet;
   NS_ASSERT (p != 0);
 
-  // Prevent PHY from receiving another packet while switching the transceiver state.
-  if (m_trxState == LORAWAN_PHY_RX_ON && !m_setTRXState.IsRunning ())
+  // Prevent PHY from receiving another packet while switching the transceiver state
+  // or while another PHY of the gateway is transmitting.
+  if (m_trxState == LORAWAN_PHY_RX_ON && !m_skippedRxWindow && !m_setTRXState.IsRunning () && !IsRadioTransmitting ())
     {
       // The specification doesn't seem to refer to BUSY_RX, but vendor
       // data sheets suggest that this is a substate of the RX_ON state
@@ -560,21 +639,18 @@ LoRaWANPhy::StartRx (Ptr<SpectrumSignalParameters> spectrumRxParams)
 
       // Add any incoming packet to the current interference before checking the
       // SINR.
-      const uint32_t freq = LoRaWAN::m_supportedChannels [m_currentChannelIndex].m_fc;
       const uint32_t bw = LoRaWAN::m_supportedChannels [m_currentChannelIndex].m_bw;
       const uint8_t transmissionDataRateIndex = loraWanRxParams->dataRateIndex;
       const uint8_t transmissionCodeRate = loraWanRxParams->codeRate;
       const LoRaSpreadingFactor sf = LoRaWAN::m_supportedDataRates [transmissionDataRateIndex].spreadingFactor;
+      const double rxPower = GetRxPower (loraWanRxParams);
 
       NS_LOG_DEBUG (this << " channel index = " << static_cast<uint16_t>(m_currentChannelIndex));
-      NS_LOG_DEBUG (this << " receiving packet with power: " << 10 * log10 (LoRaWANSpectrumValueHelper::TotalAvgPower (loraWanRxParams->psd, freq)) + 30 << "dBm");
+      NS_LOG_DEBUG (this << " receiving packet with power: " << 10 * log10 (rxPower) + 30 << "dBm");
 
-      m_signal->AddSignal (loraWanRxParams->psd);
-      Ptr<SpectrumValue> interferenceAndNoise = m_signal->GetSignalPsd ();
-      *interferenceAndNoise -= *loraWanRxParams->psd;
-      *interferenceAndNoise += *m_noise;
+      m_signal->AddPower (loraWanRxParams->channelIndex, rxPower);
 
-      double sinr_db = 10.0 * log10 (LoRaWANSpectrumValueHelper::TotalAvgPower (loraWanRxParams->psd, freq) / LoRaWANSpectrumValueHelper::TotalAvgPower (interferenceAndNoise, freq));
+      double sinr_db = 10.0 * log10 (CalculateSinr (rxPower));
       double sinr_cutoff_db = m_errorModel->getSNRCutoffForRX (bw, sf, transmissionCodeRate);
 
       // When the BER is higher than 0.1 do not even try and decode the packet
@@ -583,6 +659,8 @@ LoRaWANPhy::StartRx (Ptr<SpectrumSignalParameters> spectrumRxParams)
         {
           ChangeTrxState (LORAWAN_PHY_BUSY_RX);
           m_currentRxPacket = std::make_pair (loraWanRxParams, LoRaWANPhyRxStatus (false, false));
+          m_rxSinrSegments.clear ();
+          InitRxRecord (m_rxRecord, rxPower, pow (10.0, sinr_db / 10.0));
           m_phyRxBeginTrace (p);
 
           m_rxLastUpdate = Simulator::Now ();
@@ -604,7 +682,7 @@ LoRaWANPhy::StartRx (Ptr<SpectrumSignalParameters> spectrumRxParams)
       // Add the incoming packet to the current interference after we have
       // checked for successfull reception of the current packet for the time
       // before the additional interference.
-      m_signal->AddSignal (loraWanRxParams->psd);
+      m_signal->AddPower (loraWanRxParams->channelIndex, GetRxPower (loraWanRxParams));
     }
   else
     {
@@ -613,20 +691,36 @@ LoRaWANPhy::StartRx (Ptr<SpectrumSignalParameters> spectrumRxParams)
       m_phyRxDropTrace (p, LORAWAN_RX_DROP_NOT_IN_RX_STATE);
 
       // Add the signal power to the interference, anyway.
-      m_signal->AddSignal (loraWanRxParams->psd);
+      m_signal->AddPower (loraWanRxParams->channelIndex, GetRxPower (loraWanRxParams));
     }
 
   // Always call EndRx to update the interference.
   // \todo: Do we need to keep track of these events to unschedule them when disposing off the PHY?
 
-  Simulator::Schedule (spectrumRxParams->duration, &LoRaWANPhy::EndRx, this, spectrumRxParams);
+  ScheduleEndRx (spectrumRxParams);
+}
+
+bool
+LoRaWANPhy::IsRxPolarity (Ptr<const LoRaWANSpectrumSignalParameters> params) const
+{
+  return params->invertedIq != m_invertedIq;
+}
+
+void
+LoRaWANPhy::ScheduleEndRx (Ptr<SpectrumSignalParameters> params)
+{
+  if (m_loRaWANChannel && m_loRaWANChannel->AddEndOfSignal (this, params))
+    {
+      return;
+    }
+
+  Simulator::Schedule (params->duration, &LoRaWANPhy::EndRx, this, params);
 }
 
 void
 LoRaWANPhy::CheckInterference (void)
 {
   // Calculate whether packet was lost.
-  LoRaWANSpectrumValueHelper psdHelper;
   Ptr<LoRaWANSpectrumSignalParameters> currentRxParams = m_currentRxPacket.first;
 
   // We are currently receiving a packet.
@@ -634,17 +728,33 @@ LoRaWANPhy::CheckInterference (void)
     {
       NS_ASSERT (currentRxParams); // && !m_currentRxPacket.second.destroyed);
 
-      Ptr<Packet> currentPacket = currentRxParams->packet;
       if (m_errorModel != 0)
         {
+          double sinr = CalculateSinr (GetRxPower (currentRxParams));
+          m_rxRecord.sinr = sinr;
+
+          if (!m_perChunkRxOutcome)
+            {
+              // Only record the SINR since the last update, the outcome is drawn in EndRx
+              const Time duration = Simulator::Now () - m_rxLastUpdate;
+              if (!m_rxSinrSegments.empty () && m_rxSinrSegments.back ().sinr == sinr)
+                {
+                  m_rxSinrSegments.back ().duration += duration;
+                }
+              else if (duration.IsStrictlyPositive ())
+                {
+                  SinrSegment segment;
+                  segment.sinr = sinr;
+                  segment.duration = duration;
+                  m_rxSinrSegments.push_back (segment);
+                }
+              m_rxLastUpdate = Simulator::Now ();
+              return;
+            }
+
           // How many bits did we receive since the last calculation?
           double t = (Simulator::Now () - m_rxLastUpdate).ToDouble (Time::MS);
           uint32_t chunkSize = ceil (t * (GetNominalDataRate () / 1000)); // divide by 1000, to get data rate per ms
-          Ptr<SpectrumValue> interferenceAndNoise = m_signal->GetSignalPsd ();
-          *interferenceAndNoise -= *currentRxParams->psd;
-          *interferenceAndNoise += *m_noise;
-
-          double sinr = LoRaWANSpectrumValueHelper::TotalAvgPower (currentRxParams->psd, LoRaWAN::m_supportedChannels [m_currentChannelIndex].m_fc) / LoRaWANSpectrumValueHelper::TotalAvgPower (interferenceAndNoise, LoRaWAN::m_supportedChannels [m_currentChannelIndex].m_fc);
           double sinr_db = 10.0*log10(sinr);
 
           const uint8_t transmissionDataRateIndex = currentRxParams->dataRateIndex;
@@ -653,12 +763,8 @@ LoRaWANPhy::CheckInterference (void)
           double per = 1.0 - m_errorModel->GetChunkSuccessRate (sinr_db, chunkSize, LoRaWAN::m_supportedDataRates [transmissionDataRateIndex].bandWith, sf, transmissionCodeRate);
 
           // The LQI is the total packet success rate scaled to 0-255.
-          // If not already set, initialize to 255.
-          LoRaWANLqiTag tag (std::numeric_limits<uint8_t>::max ());
-          currentPacket->PeekPacketTag (tag);
-          uint8_t lqi = tag.Get ();
-          tag.Set (lqi - (per * lqi));
-          currentPacket->ReplacePacketTag (tag);
+          m_rxRecord.successRate *= 1.0 - per;
+          m_rxRecord.lqi = m_rxRecord.lqi - (per * m_rxRecord.lqi);
 
           if (m_random->GetValue () < per)
             {
@@ -674,6 +780,80 @@ LoRaWANPhy::CheckInterference (void)
   m_rxLastUpdate = Simulator::Now ();
 }
 
+void
+LoRaWANPhy::EvaluateRxOutcome (void)
+{
+  Ptr<LoRaWANSpectrumSignalParameters> currentRxParams = m_currentRxPacket.first;
+  NS_ASSERT (currentRxParams);
+
+  if (m_perChunkRxOutcome || m_errorModel == 0 || m_rxSinrSegments.empty ())
+    {
+      return;
+    }
+
+  const double successRate = GetRxSuccessRate (m_rxSinrSegments, currentRxParams);
+  NS_LOG_LOGIC (this << " " << m_rxSinrSegments.size () << " SINR segments, success rate = " << successRate);
+  m_rxSinrSegments.clear ();
+
+  // The LQI is the total packet success rate scaled to 0-255.
+  m_rxRecord.successRate = successRate;
+  m_rxRecord.lqi = static_cast<uint8_t> (std::numeric_limits<uint8_t>::max () * successRate);
+
+  if (m_random->GetValue () < 1.0 - successRate)
+    {
+      // The packet was destroyed, drop the packet.
+      m_currentRxPacket.second.destroyed = true;
+    }
+}
+
+void
+LoRaWANPhy::InitRxRecord (RxRecord &record, double rxPower, double sinr)
+{
+  record.rssi = 10.0 * log10 (rxPower) + 30;
+  record.sinr = sinr;
+  record.successRate = 1.0;
+  record.lqi = std::numeric_limits<uint8_t>::max ();
+}
+
+Ptr<Packet>
+LoRaWANPhy::GetRxPacket (Ptr<const Packet> packet, const RxRecord &record)
+{
+  Ptr<Packet> rxPacket = packet->Copy ();
+  LoRaWANLqiTag tag (record.lqi);
+  rxPacket->ReplacePacketTag (tag);
+  return rxPacket;
+}
+
+LoRaWANRxMetadata
+LoRaWANPhy::GetRxMetadata (Ptr<const LoRaWANSpectrumSignalParameters> params, const RxRecord &record)
+{
+  LoRaWANRxMetadata metadata;
+  metadata.m_rssi = record.rssi;
+  metadata.m_snr = 10.0 * log10 (record.sinr);
+  metadata.m_timestamp = Simulator::Now () - params->duration;
+  return metadata;
+}
+
+double
+LoRaWANPhy::GetRxSuccessRate (const std::vector<SinrSegment> &segments, Ptr<const LoRaWANSpectrumSignalParameters> params) const
+{
+  NS_ASSERT (m_errorModel);
+
+  const LoRaWANDataRate &dataRate = LoRaWAN::m_supportedDataRates [params->dataRateIndex];
+  const LoRaSpreadingFactor sf = dataRate.spreadingFactor;
+  const uint32_t bw = dataRate.bandWith;
+  // nominal data rate is SF bits per symbol times the symbol rate, see GetNominalDataRate
+  const double bitsPerMs = sf * (bw / pow (2.0, sf)) / 1000;
+
+  double successRate = 1.0;
+  for (std::vector<SinrSegment>::const_iterator it = segments.begin (); it != segments.end (); ++it)
+    {
+      uint32_t chunkSize = ceil (it->duration.ToDouble (Time::MS) * bitsPerMs);
+      successRate *= m_errorModel->GetChunkSuccessRate (10.0 * log10 (it->sinr), chunkSize, bw, sf, params->codeRate);
+    }
+  return successRate;
+}
+
 void
 LoRaWANPhy::EndRx (Ptr<SpectrumSignalParameters> par)
 {
@@ -685,10 +865,14 @@ LoRaWANPhy::EndRx (Ptr<SpectrumSignalParameters> par)
   if (currentRxParams == params)
     {
       CheckInterference ();
+      EvaluateRxOutcome ();
     }
 
   // Update the interference.
-  m_signal->RemoveSignal (par->psd);
+  if (params)
+    m_signal->RemovePower (params->channelIndex, GetRxPower (params));
+  else
+    m_signal->RemoveSignal (par->psd);
 
   // Check whether EndRx is called for the end of LoRaWAN TX with different data rate:
   bool dataRateMismatch = false;
@@ -704,54 +888,84 @@ LoRaWANPhy::EndRx (Ptr<SpectrumSignalParameters> par)
   // If this is the end of the currently received packet, check if reception was successful.
   if (currentRxParams == params)
     {
-      Ptr<Packet> currentPacket = currentRxParams->packet;
-      NS_ASSERT (currentPacket != 0);
+      FinishRx ();
+    }
+}
+
+void
+LoRaWANPhy::FinishRx (void)
+{
+  Ptr<LoRaWANSpectrumSignalParameters> params = m_currentRxPacket.first;
+  NS_ASSERT (params);
 
-      // If there is no error model attached to the PHY, we always report the maximum LQI value.
-      LoRaWANLqiTag tag (std::numeric_limits<uint8_t>::max ());
-      currentPacket->PeekPacketTag (tag);
-      m_phyRxEndTrace (currentPacket, tag.Get ());
+  Ptr<Packet> currentPacket = params->packet;
+  NS_ASSERT (currentPacket != 0);
 
-      if (!m_currentRxPacket.second.destroyed && !m_currentRxPacket.second.aborted)
+  // If there is no error model attached to the PHY, we always report the maximum LQI value.
+  m_phyRxEndTrace (currentPacket, m_rxRecord.lqi);
+
+  if (!m_currentRxPacket.second.destroyed && !m_currentRxPacket.second.aborted)
+    {
+      // The packet was successfully received, push it up the stack.
+      if (!m_pdDataIndicationCallback.IsNull ())
         {
-          // The packet was successfully received, push it up the stack.
-          if (!m_pdDataIndicationCallback.IsNull ())
-            {
-              m_pdDataIndicationCallback (currentPacket->GetSize (), currentPacket, 0, m_currentChannelIndex, params->dataRateIndex, params->codeRate);
-            }
+          Ptr<Packet> rxPacket = GetRxPacket (currentPacket, m_rxRecord);
+          m_pdDataIndicationCallback (rxPacket->GetSize (), rxPacket, m_rxRecord.lqi, m_currentChannelIndex, params->dataRateIndex, params->codeRate, GetRxMetadata (params, m_rxRecord));
         }
+    }
+  else
+    {
+      // The packet was destroyed, drop it.
+      if (m_currentRxPacket.second.destroyed) {
+        m_phyRxDropTrace (currentPacket, LORAWAN_RX_DROP_PACKET_DESTOYED);
+        m_pdDataDestroyedCallback ();
+      } else if (m_currentRxPacket.second.aborted)
+        m_phyRxDropTrace (currentPacket, LORAWAN_RX_DROP_PACKET_ABORTED);
       else
-        {
-          // The packet was destroyed, drop it.
-          if (m_currentRxPacket.second.destroyed) {
-            m_phyRxDropTrace (currentPacket, LORAWAN_RX_DROP_PACKET_DESTOYED);
-            m_pdDataDestroyedCallback ();
-          } else if (m_currentRxPacket.second.aborted)
-            m_phyRxDropTrace (currentPacket, LORAWAN_RX_DROP_PACKET_ABORTED);
-          else
-            NS_ASSERT (false);
-        }
-      Ptr<LoRaWANSpectrumSignalParameters> none = 0;
-      m_currentRxPacket = std::make_pair (none, LoRaWANPhyRxStatus (true, false));
-
-      // In case the ongoing reception was aborted by a transmission on this PHY,
-      // then m_currentRxPacket.second will have been false but also the PHY state
-      // will be BUSY_TX.
-      // In case the ongoing reception was destroyed due to a BER, then
-      // m_currentRxPacket.second will have been false but the PHY state will
-      // be BUSY_RX
-      // Note that m_currentRxPacket.second can not tell us which case is true,
-      // so instead we need to look at the state of the PHY
-      //
-      // Only switch to RX_ON for cases where the Phy was receiving a
-      // transmission (i.e. the BUSY_RX state). When the PHY switched to a
-      // transmission during reception, don't change the state at all (this
-      // will be after EndTx is called)
-      // TODO: should we switch to IDLE here for end device PHYs?
-      // Normally not, as MAC will switch PHY state according to state machine
-      if (m_trxState == LORAWAN_PHY_BUSY_RX)
-          ChangeTrxState (LORAWAN_PHY_RX_ON);
+        NS_ASSERT (false);
     }
+  Ptr<LoRaWANSpectrumSignalParameters> none = 0;
+  m_currentRxPacket = std::make_pair (none, LoRaWANPhyRxStatus (true, false));
+
+  // In case the ongoing reception was aborted by a transmission on this PHY,
+  // then m_currentRxPacket.second will have been false but also the PHY state
+  // will be BUSY_TX.
+  // In case the ongoing reception was destroyed due to a BER, then
+  // m_currentRxPacket.second will have been false but the PHY state will
+  // be BUSY_RX
+  // Note that m_currentRxPacket.second can not tell us which case is true,
+  // so instead we need to look at the state of the PHY
+  //
+  // Only switch to RX_ON for cases where the Phy was receiving a
+  // transmission (i.e. the BUSY_RX state). When the PHY switched to a
+  // transmission during reception, don't change the state at all (this
+  // will be after EndTx is called)
+  // TODO: should we switch to IDLE here for end device PHYs?
+  // Normally not, as MAC will switch PHY state according to state machine
+  if (m_trxState == LORAWAN_PHY_BUSY_RX)
+      ChangeTrxState (LORAWAN_PHY_RX_ON);
+}
+
+double
+LoRaWANPhy::GetRxPower (Ptr<const LoRaWANSpectrumSignalParameters> params) const
+{
+  return LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (params->psd, params->channelIndex);
+}
+
+double
+LoRaWANPhy::CalculateSinr (double rxPower) const
+{
+  return CalculateSinr (rxPower, m_currentChannelIndex);
+}
+
+double
+LoRaWANPhy::CalculateSinr (double rxPower, uint8_t channelIndex) const
+{
+  // All signals on the channel, except for the signal itself, are interference
+  const double interference = std::max (m_signal->GetPower (channelIndex) - rxPower, 0.0);
+  const double noise = LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (m_noise, channelIndex);
+
+  return rxPower / (interference + noise);
 }
 
 void
@@ -792,12 +1006,13 @@ LoRaWANPhy::PdDataRequest (const uint32_t phyPayloadLength, Ptr<Packet> p)
       Ptr<LoRaWANSpectrumSignalParameters> txParams = Create<LoRaWANSpectrumSignalParameters> ();
       txParams->duration = CalculateTxTime (p->GetSize());
       txParams->txPhy = GetObject<SpectrumPhy> ();
-      txParams->psd = m_txPsd;
+      txParams->psd = ConstCast<SpectrumValue> (m_txPsd); // receivers get a copy of the PSD, see SpectrumSignalParameters
       txParams->txAntenna = m_antenna;
       txParams->packet = p;
       txParams->channelIndex = m_currentChannelIndex;
       txParams->dataRateIndex = m_currentDataRateIndex;
       txParams->codeRate = m_codeRate;
+      txParams->invertedIq = m_invertedIq;
 
       m_channel->StartTx (txParams);
       m_pdDataRequest = Simulator::Schedule (txParams->duration, &LoRaWANPhy::EndTx, this);
@@ -862,39 +1077,16 @@ Time
 LoRaWANPhy::CalculateTxTime (uint8_t payloadLength)
 {
   NS_LOG_FUNCTION(this);
-  
-  // calculations per $4.1.1.7 'Time on air' in sx1272 data sheet
+
+  // LoRaWAN Class A mandates no implicit header, implicit header is used in the beacon of Class B
   const uint32_t bandwidth = LoRaWAN::m_supportedChannels [m_currentChannelIndex].m_bw;
   const LoRaSpreadingFactor sf = LoRaWAN::m_supportedDataRates [m_currentDataRateIndex].spreadingFactor;
-
-  double symbolRate = ((double)bandwidth)/pow(2.0, sf);
-  double symbolPeriod = 1.0e6/symbolRate; // the symbol period in microseconds
-
-  double nSymbolsPreamble = m_preambleLength + 4.25;
-  uint16_t nSymbolsPayload = 8;
-  
-  uint32_t crc = 1;
-  if (!m_crcOn)
-    crc = 0;
-
-  // LoRaWAN Class A mandates no implicit header, we assume low data rate optimization (DE) is not used
-  uint32_t implicitHeader = 0;
-  if(m_implicitHeader) //implicit header is used in the beacon of Class B
-    implicitHeader = 1;
-
-  uint16_t nConditionalSymbolsPayload = ceil((8.0*payloadLength - 4.0*sf + 28 + 16*crc - 20*implicitHeader)/4.0/(double)sf)*(m_codeRate + 4);
-  if (nConditionalSymbolsPayload > 0.0)
-    nSymbolsPayload += nConditionalSymbolsPayload;
-
-  double txTime = (nSymbolsPreamble + nSymbolsPayload) * symbolPeriod;
+  Time txTime = LoRaWAN::GetTimeOnAir (sf, bandwidth, m_codeRate, m_preambleLength, m_crcOn, m_implicitHeader, payloadLength);
 
   NS_LOG_DEBUG(this << ": " << sf  << "|" << (uint16_t)m_codeRate  << "|" << (uint16_t)payloadLength
-      << "|" << (uint16_t) m_preambleLength  << "|" << nSymbolsPayload  << "|" << nConditionalSymbolsPayload
-      << "|" << txTime << "uS");
-
-  return MicroSeconds(txTime);
-
+      << "|" << (uint16_t) m_preambleLength  << "|" << txTime);
 
+  return txTime;
 }
 
 Time
@@ -903,8 +1095,7 @@ LoRaWANPhy::CalculatePreambleTime ()
   const uint32_t bandwidth = LoRaWAN::m_supportedChannels [m_currentChannelIndex].m_bw;
   const LoRaSpreadingFactor sf = LoRaWAN::m_supportedDataRates [m_currentDataRateIndex].spreadingFactor;
 
-  double symbolRate = ((double)bandwidth)/pow(2.0, sf);
-  double symbolPeriod = 1.0e6/symbolRate; // the symbol period in microseconds
+  double symbolPeriod = LoRaWAN::GetSymbolPeriod (sf, bandwidth); // the symbol period in microseconds
 
   double nSymbolsPreamble = m_preambleLength + 4.25;
   double timePreamble = nSymbolsPreamble * symbolPeriod;
@@ -22,10 +22,12 @@
 
 #include "lorawan.h"
 #include "lorawan-interference-helper.h"
+#include "lorawan-radio-arbiter.h"
 #include <ns3/spectrum-phy.h>
 #include <ns3/traced-callback.h>
 #include <ns3/traced-value.h>
 #include <ns3/event-id.h>
+#include <vector>
 
 namespace ns3 {
 /* ... */
@@ -36,6 +38,7 @@ class LoRaWANErrorModel;
 struct LoRaWANSpectrumSignalParameters;
 class MobilityModel;
 class SpectrumChannel;
+class LoRaWANSpectrumChannel;
 class SpectrumModel;
 class AntennaModel;
 class NetDevice;
@@ -66,6 +69,7 @@ typedef enum
   LORAWAN_RX_DROP_PACKET_DESTOYED = 0x03,
   LORAWAN_RX_DROP_ABORTED = 0x04,
   LORAWAN_RX_DROP_PACKET_ABORTED = 0x05,
+  LORAWAN_RX_DROP_NO_DEMODULATOR = 0x06,
 } LoRaWANPhyDropRxReason;
 
 typedef struct LoRaWANPhyRxStatus {
@@ -108,8 +112,9 @@ namespace TracedValueCallback {
  *  @param channelIndex index of the channel on which transmission was received
  *  @param dataRateIndex index of the data rate on which transmission was  received
  *  @param codeRate index of the code rate on which transmission was received
+ *  @param rxMetadata RSSI, SNR and timestamp of the reception
  */
-typedef Callback< void, uint32_t, Ptr<Packet>, uint8_t, uint8_t, uint8_t, uint8_t> PdDataIndicationCallback;
+typedef Callback< void, uint32_t, Ptr<Packet>, uint8_t, uint8_t, uint8_t, uint8_t, LoRaWANRxMetadata> PdDataIndicationCallback;
 
 /**
  * \ingroup lorawan
@@ -171,6 +176,7 @@ public:
 
   uint8_t GetCurrentChannelIndex () const { return m_currentChannelIndex; }
   uint8_t GetCurrentDataRateIndex () const { return m_currentDataRateIndex; }
+  bool GetInvertedIq () const { return m_invertedIq; }
 
   /**
    * Calculate the time for transmitting the given packet in microseconds
@@ -262,6 +268,13 @@ public:
    */
   void SetTRXStateRequest (LoRaWANPhyEnumeration state);
 
+  /**
+   * Switch to RX_ON for a receive window that the MAC skips, without locking
+   * onto any frame, so that the TrxState trace shows the window. The next
+   * call to SetTRXStateRequest ends the skipped window.
+   */
+  void StartSkippedRxWindow (void);
+
   /**
    * set the callback for the end of a RX, as part of the
    * interconnections between the PHY and the MAC. The callback
@@ -272,6 +285,21 @@ public:
 
   void SetPdDataDestroyedCallback (PdDataDestroyedCallback c);
 
+  /**
+   * Set the radio arbiter shared by all PHYs of a gateway. The PHY reports
+   * its receptions to the arbiter and does not lock onto new frames while the
+   * radio is transmitting.
+   *
+   * \param arbiter the radio arbiter, or 0
+   */
+  void SetRadioArbiter (Ptr<LoRaWANRadioArbiter> arbiter);
+
+  /**
+   * Abort the ongoing reception(s) because the radio starts transmitting. The
+   * PHY stays in the RX_ON state.
+   */
+  virtual void AbortRx (void);
+
   /**
    * set the callback for the end of a TX, as part of the
    * interconnections between the PHY and the MAC. The callback
@@ -334,14 +362,74 @@ public:
   void PdDataRequest (const uint32_t phyPayloadLength, Ptr<Packet> p);
 
   uint8_t GetIndex (void) const;
-protected:
 
-private:
+  /**
+   * Check whether this PHY receives on all channels at once. A
+   * LoRaWANSpectrumChannel delivers every transmission to such a PHY,
+   * regardless of the channel the PHY is configured for.
+   *
+   * \return true if the PHY is not tuned to a single channel
+   */
+  virtual bool ReceivesOnAllChannels (void) const;
+protected:
   /**
    * The second is true if the first is flagged as error/invalid.
    */
   typedef std::pair<Ptr<Packet>, bool>  PacketAndStatus;
 
+  /**
+   * A period during the reception of a frame in which the SINR was
+   * constant.
+   */
+  struct SinrSegment
+  {
+    double sinr;   //!< the SINR (linear)
+    Time duration; //!< the length of the period
+  };
+
+  /**
+   * Reception record of the frame a PHY is currently receiving. The packet of
+   * a transmission is shared by all receivers, so the outcome of a reception
+   * is kept here and the LoRaWANLqiTag is only added to the copy of the
+   * packet that is passed to the MAC.
+   */
+  struct RxRecord
+  {
+    double rssi;        //!< the received power of the frame in dBm
+    double sinr;        //!< the most recent SINR of the frame (linear)
+    double successRate; //!< the probability that the frame was received without errors
+    uint8_t lqi;        //!< the success rate scaled to 0-255
+  };
+
+  /**
+   * Start a new reception record.
+   *
+   * \param record the record to initialize
+   * \param rxPower the received power of the frame in W
+   * \param sinr the SINR at the start of the frame (linear)
+   */
+  static void InitRxRecord (RxRecord &record, double rxPower, double sinr);
+
+  /**
+   * Get the packet to pass to the MAC for a received frame: a copy of the
+   * shared packet, tagged with the LQI of the reception.
+   *
+   * \param packet the packet of the transmission
+   * \param record the reception record of the frame
+   * \return the packet for the MAC
+   */
+  static Ptr<Packet> GetRxPacket (Ptr<const Packet> packet, const RxRecord &record);
+
+  /**
+   * Get the metadata to pass to the MAC for a received frame. The gateway id
+   * is left to the LoRaWANNetDevice.
+   *
+   * \param params the signal parameters of the frame, the frame must end now
+   * \param record the reception record of the frame
+   * \return the metadata of the reception
+   */
+  static LoRaWANRxMetadata GetRxMetadata (Ptr<const LoRaWANSpectrumSignalParameters> params, const RxRecord &record);
+
   // Inherited from Object.
   virtual void DoDispose (void);
 
@@ -350,7 +438,7 @@ private:
    *
    * \param newState the new state
    */
-  void ChangeTrxState (LoRaWANPhyEnumeration newState);
+  virtual void ChangeTrxState (LoRaWANPhyEnumeration newState);
 
   /**
    * Finish the transmission of a frame. This is called at the end of a frame
@@ -361,10 +449,28 @@ private:
 
   /**
    * Check if the interference destroys a frame currently received. Called
-   * whenever a change in interference is detected.
+   * whenever a change in interference is detected. By default this only
+   * records the SINR of the frame since the last change, see
+   * m_perChunkRxOutcome.
    */
   void CheckInterference (void);
 
+  /**
+   * Decide whether the frame currently received was destroyed, based on the
+   * SINR segments recorded by CheckInterference. Updates the LQI in
+   * m_rxRecord and draws a single random number. Called from EndRx.
+   */
+  void EvaluateRxOutcome (void);
+
+  /**
+   * Combine the success probabilities of the SINR segments of a frame.
+   *
+   * \param segments the SINR timeline of the frame
+   * \param params signal parameters of the frame
+   * \return the probability that the frame was received without errors
+   */
+  double GetRxSuccessRate (const std::vector<SinrSegment> &segments, Ptr<const LoRaWANSpectrumSignalParameters> params) const;
+
   /**
    * Finish the reception of a frame. This is called at the end of a frame
    * reception, applying possibly pending PHY state changes and fireing the
@@ -375,7 +481,27 @@ private:
    *
    * \param params signal parameters of the packet
    */
-  void EndRx (Ptr<SpectrumSignalParameters> params);
+  virtual void EndRx (Ptr<SpectrumSignalParameters> params);
+
+  /**
+   * Report the outcome of the frame in m_currentRxPacket, using m_rxRecord,
+   * to the trace sources and the MAC, and get ready for the next frame.
+   */
+  void FinishRx (void);
+
+  /**
+   * Make sure EndRx is called at the end of the signal. The
+   * LoRaWANSpectrumChannel dispatches the end of a signal to all of its
+   * receivers at once, for other channels an EndRx event is scheduled.
+   *
+   * \param params signal parameters of the packet
+   */
+  void ScheduleEndRx (Ptr<SpectrumSignalParameters> params);
+
+  /**
+   * LoRaWANSpectrumChannel calls EndRx directly, see ScheduleEndRx.
+   */
+  friend class LoRaWANSpectrumChannel;
 
   /**
    * Called after applying a deferred transceiver state switch. The result of
@@ -391,6 +517,48 @@ private:
    */
   //bool PhyIsBusy (void) const;
 
+  /**
+   * Get the received power of a LoRaWAN signal on the channel it was
+   * transmitted on.
+   *
+   * \param params signal parameters of the signal
+   * \return the received power in W
+   */
+  double GetRxPower (Ptr<const LoRaWANSpectrumSignalParameters> params) const;
+
+  /**
+   * Check whether the PHY may lock onto a LoRaWAN signal, based on its IQ
+   * polarity.
+   *
+   * \param params signal parameters of the signal
+   * \return true if the IQ polarity of the signal is the opposite of the
+   *         polarity the PHY transmits with
+   */
+  bool IsRxPolarity (Ptr<const LoRaWANSpectrumSignalParameters> params) const;
+
+  /**
+   * \return true if another PHY on the same radio is transmitting
+   */
+  bool IsRadioTransmitting (void) const;
+
+  /**
+   * Calculate the SINR of a signal on the current channel. The power of the
+   * signal is expected to be part of the accumulated signals in m_signal.
+   *
+   * \param rxPower the received power of the signal in W
+   * \return the SINR (linear)
+   */
+  double CalculateSinr (double rxPower) const;
+
+  /**
+   * Calculate the SINR of a signal on the given channel.
+   *
+   * \param rxPower the received power of the signal in W
+   * \param channelIndex the channel of the signal
+   * \return the SINR (linear)
+   */
+  double CalculateSinr (double rxPower, uint8_t channelIndex) const;
+
   double GetNominalDataRate();
   // Trace sources
   /**
@@ -450,23 +618,34 @@ private:
    */
   Ptr<NetDevice> m_device;
 
+  /**
+   * The radio arbiter of the gateway, 0 for end devices.
+   */
+  Ptr<LoRaWANRadioArbiter> m_radioArbiter;
+
   /**
    * The channel attached to this transceiver.
    */
   Ptr<SpectrumChannel> m_channel;
 
+  /**
+   * The attached channel if it is a LoRaWANSpectrumChannel, which needs to be
+   * informed when this PHY changes channel. Null otherwise.
+   */
+  Ptr<LoRaWANSpectrumChannel> m_loRaWANChannel;
+
   /**
    * The antenna used by the transceiver.
    */
   Ptr<AntennaModel> m_antenna;
 
   /**
-   * The transmit power spectral density.
+   * The transmit power spectral density, shared with other PHYs.
    */
-  Ptr<SpectrumValue> m_txPsd;
+  Ptr<const SpectrumValue> m_txPsd;
 
   /**
-   * The spectral density for for the noise.
+   * The spectral density for for the noise, shared with other PHYs.
    */
   Ptr<const SpectrumValue> m_noise;
 
@@ -539,6 +718,36 @@ private:
    */
   std::pair<Ptr<LoRaWANSpectrumSignalParameters>, LoRaWANPhyRxStatus>  m_currentRxPacket;
 
+  /**
+   * The SINR timeline of the frame currently received. Consecutive segments
+   * with the same SINR are merged.
+   */
+  std::vector<SinrSegment> m_rxSinrSegments;
+
+  /**
+   * The reception record of the frame currently received.
+   */
+  RxRecord m_rxRecord;
+
+  /**
+   * If true, the outcome of a reception is drawn every time the interference
+   * changes (once per chunk). Otherwise, the outcome is drawn once at the end
+   * of the reception.
+   */
+  bool m_perChunkRxOutcome;
+
+  /**
+   * True if the PHY transmits with inverted IQ (gateway). The PHY only locks
+   * onto transmissions of the opposite polarity.
+   */
+  bool m_invertedIq;
+
+  /**
+   * True while the PHY is in RX_ON for a skipped receive window, see
+   * StartSkippedRxWindow.
+   */
+  bool m_skippedRxWindow;
+
   /**
    * Statusinformation of the currently transmitted packet. The first parameter
    * contains the frame. The second parameter is set to false, if the frame not
@@ -0,0 +1,114 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include "lorawan-radio-arbiter.h"
+#include "lorawan-mac.h"
+#include "lorawan-phy.h"
+#include <ns3/log.h>
+
+#include <algorithm>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LoRaWANRadioArbiter");
+
+LoRaWANRadioArbiter::LoRaWANRadioArbiter (void)
+  : m_transmitter (0)
+{
+}
+
+LoRaWANRadioArbiter::~LoRaWANRadioArbiter (void)
+{
+  Clear ();
+}
+
+bool
+LoRaWANRadioArbiter::IsTransmitting (void) const
+{
+  return m_transmitter != 0;
+}
+
+void
+LoRaWANRadioArbiter::BeginTx (Ptr<LoRaWANMac> mac)
+{
+  NS_LOG_FUNCTION (this << mac << m_receivers.size ());
+  NS_ASSERT_MSG (m_transmitter == 0, "Radio is already transmitting");
+
+  m_transmitter = PeekPointer (mac);
+
+  // Aborting a reception makes the Phy call RemoveReceiver
+  std::vector<LoRaWANPhy *> receivers;
+  receivers.swap (m_receivers);
+  for (std::vector<LoRaWANPhy *>::iterator it = receivers.begin (); it != receivers.end (); ++it)
+    {
+      (*it)->AbortRx ();
+    }
+}
+
+void
+LoRaWANRadioArbiter::EndTx (Ptr<LoRaWANMac> mac)
+{
+  NS_LOG_FUNCTION (this << mac << m_waiting.size ());
+  NS_ASSERT (m_transmitter == PeekPointer (mac));
+
+  m_transmitter = 0;
+
+  std::vector<LoRaWANMac *> waiting;
+  waiting.swap (m_waiting);
+  for (std::vector<LoRaWANMac *>::iterator it = waiting.begin (); it != waiting.end (); ++it)
+    {
+      (*it)->NotifyRadioAvailable ();
+    }
+}
+
+void
+LoRaWANRadioArbiter::WaitForRadio (Ptr<LoRaWANMac> mac)
+{
+  NS_LOG_FUNCTION (this << mac);
+
+  if (std::find (m_waiting.begin (), m_waiting.end (), PeekPointer (mac)) == m_waiting.end ())
+    m_waiting.push_back (PeekPointer (mac));
+}
+
+void
+LoRaWANRadioArbiter::AddReceiver (LoRaWANPhy *phy)
+{
+  m_receivers.push_back (phy);
+}
+
+void
+LoRaWANRadioArbiter::RemoveReceiver (LoRaWANPhy *phy)
+{
+  std::vector<LoRaWANPhy *>::iterator it = std::find (m_receivers.begin (), m_receivers.end (), phy);
+  if (it != m_receivers.end ())
+    {
+      *it = m_receivers.back ();
+      m_receivers.pop_back ();
+    }
+}
+
+void
+LoRaWANRadioArbiter::Clear (void)
+{
+  m_transmitter = 0;
+  m_receivers.clear ();
+  m_waiting.clear ();
+}
+
+} // namespace ns3
@@ -0,0 +1,120 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#ifndef LORAWAN_RADIO_ARBITER_H
+#define LORAWAN_RADIO_ARBITER_H
+
+#include <ns3/simple-ref-count.h>
+#include <ns3/ptr.h>
+#include <vector>
+
+namespace ns3 {
+
+class LoRaWANMac;
+class LoRaWANPhy;
+
+/**
+ * \ingroup lorawan
+ *
+ * \brief Half-duplex state of the radio of a gateway.
+ *
+ * All LoRaWANMac and LoRaWANPhy objects of a gateway LoRaWANNetDevice share a
+ * single radio arbiter. A MAC acquires the radio via BeginTx before it starts
+ * a transmission and releases it via EndTx. While the radio is transmitting,
+ * the Phy objects do not lock onto new frames and MACs can not start another
+ * transmission.
+ *
+ * The Phy objects report when they start and stop receiving a frame, so that
+ * BeginTx only has to abort the ongoing receptions instead of switching every
+ * Phy of the gateway off and on again. MACs that could not transmit because
+ * the radio was busy are notified when the radio becomes available.
+ */
+class LoRaWANRadioArbiter : public SimpleRefCount<LoRaWANRadioArbiter>
+{
+public:
+  LoRaWANRadioArbiter (void);
+  ~LoRaWANRadioArbiter (void);
+
+  /**
+   * \return true if one of the MACs is transmitting
+   */
+  bool IsTransmitting (void) const;
+
+  /**
+   * Acquire the radio for a transmission and abort all ongoing receptions.
+   *
+   * \param mac the MAC that starts transmitting
+   */
+  void BeginTx (Ptr<LoRaWANMac> mac);
+
+  /**
+   * Release the radio after a transmission and notify the MACs that have
+   * been waiting for it.
+   *
+   * \param mac the MAC that finished transmitting
+   */
+  void EndTx (Ptr<LoRaWANMac> mac);
+
+  /**
+   * Notify the MAC via LoRaWANMac::NotifyRadioAvailable when the ongoing
+   * transmission has ended.
+   *
+   * \param mac the MAC that is waiting for the radio
+   */
+  void WaitForRadio (Ptr<LoRaWANMac> mac);
+
+  /**
+   * Called by a Phy when it starts receiving a frame.
+   *
+   * \param phy the Phy
+   */
+  void AddReceiver (LoRaWANPhy *phy);
+
+  /**
+   * Called by a Phy when it stops receiving a frame.
+   *
+   * \param phy the Phy
+   */
+  void RemoveReceiver (LoRaWANPhy *phy);
+
+  /**
+   * Forget all MAC and Phy objects, called when the net device is disposed.
+   */
+  void Clear (void);
+
+private:
+  /**
+   * The MAC that is transmitting, or 0 when the radio is available.
+   */
+  LoRaWANMac *m_transmitter;
+
+  /**
+   * The Phy objects that are receiving a frame.
+   */
+  std::vector<LoRaWANPhy *> m_receivers;
+
+  /**
+   * The MACs that are waiting for the radio to become available.
+   */
+  std::vector<LoRaWANMac *> m_waiting;
+};
+
+} // namespace ns3
+
+#endif /* LORAWAN_RADIO_ARBITER_H */
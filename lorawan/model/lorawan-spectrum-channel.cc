@@ -0,0 +1,846 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include "lorawan.h"
+#include "lorawan-spectrum-channel.h"
+#include "lorawan-spectrum-signal-parameters.h"
+#include "lorawan-phy.h"
+#include "lorawan-spectrum-value-helper.h"
+#include <ns3/log.h>
+#include <ns3/double.h>
+#include <ns3/uinteger.h>
+#include <ns3/simulator.h>
+#include <ns3/node.h>
+#include <ns3/net-device.h>
+#include <ns3/mobility-model.h>
+#include <ns3/antenna-model.h>
+#include <ns3/angles.h>
+#include <ns3/spectrum-value.h>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("LoRaWANSpectrumChannel");
+
+NS_OBJECT_ENSURE_REGISTERED (LoRaWANSpectrumChannel);
+
+// The highest power level accepted by LoRaWANPhy::SetTxConf, determines the size of the grid cells
+#define LORAWAN_MAX_TX_POWER_DBM 27.0
+
+TypeId
+LoRaWANSpectrumChannel::GetTypeId (void)
+{
+  static TypeId tid = TypeId ("ns3::LoRaWANSpectrumChannel")
+    .SetParent<SpectrumChannel> ()
+    .SetGroupName ("LoRaWAN")
+    .AddConstructor<LoRaWANSpectrumChannel> ()
+    .AddAttribute ("MinRxPower",
+                   "LoRaWAN transmissions are not delivered to receivers that "
+                   "provably receive them below this power (in dBm). Minus "
+                   "infinity delivers every transmission to every receiver.",
+                   DoubleValue (-std::numeric_limits<double>::infinity ()),
+                   MakeDoubleAccessor (&LoRaWANSpectrumChannel::SetMinRxPower,
+                                       &LoRaWANSpectrumChannel::GetMinRxPower),
+                   MakeDoubleChecker<double> ())
+    .AddAttribute ("LinkCacheSize",
+                   "The maximum number of links of which the propagation loss "
+                   "is cached, 0 disables the cache. When the cache is full, "
+                   "the oldest link is evicted. Only use the cache with "
+                   "deterministic propagation loss models.",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&LoRaWANSpectrumChannel::m_linkCacheSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("LinkCacheMaxLoss",
+                   "Links with a propagation loss above this value (in dB) "
+                   "are cached as out of range, transmissions are not "
+                   "delivered over these links. Only used when LinkCacheSize "
+                   "is not 0.",
+                   DoubleValue (std::numeric_limits<double>::infinity ()),
+                   MakeDoubleAccessor (&LoRaWANSpectrumChannel::m_linkCacheMaxLoss),
+                   MakeDoubleChecker<double> ())
+  ;
+  return tid;
+}
+
+LoRaWANSpectrumChannel::LoRaWANSpectrumChannel (void)
+  : m_rxLists (LoRaWAN::m_supportedChannels.size () + 1),
+    m_widebandRxListIndex (LoRaWAN::m_supportedChannels.size ()),
+    m_minRxPowerDbm (-std::numeric_limits<double>::infinity ()),
+    m_nPropagationLossModels (0),
+    m_gridCellSize (0),
+    m_gridCellSizeDirty (true),
+    m_lossExponent (0),
+    m_lossReferenceDistance (0),
+    m_lossReferenceLoss (0),
+    m_linkCacheSize (0),
+    m_linkCacheMaxLoss (std::numeric_limits<double>::infinity ()),
+    m_linkCacheNextEviction (0),
+    m_startingReception (0),
+    m_nEndOfSignal (0),
+    m_nextDownlinkListenerId (1)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+LoRaWANSpectrumChannel::~LoRaWANSpectrumChannel (void)
+{
+}
+
+void
+LoRaWANSpectrumChannel::DoDispose (void)
+{
+  NS_LOG_FUNCTION (this);
+  m_rxLists.clear ();
+  m_rxListPositions.clear ();
+  m_spectrumModel = 0;
+  m_propagationLoss = 0;
+  m_spectrumPropagationLoss = 0;
+  m_propagationDelay = 0;
+  for (std::unordered_map<const MobilityModel*, TrackedMobility>::iterator it = m_trackedMobilities.begin (); it != m_trackedMobilities.end (); ++it)
+    {
+      it->second.mobility->TraceDisconnectWithoutContext ("CourseChange", MakeCallback (&LoRaWANSpectrumChannel::CourseChanged, this));
+    }
+  m_trackedMobilities.clear ();
+  m_linkCache.clear ();
+  m_linkCacheOrder.clear ();
+  m_gridEntries.clear ();
+  m_gridEntryIndex.clear ();
+  m_gridCells.clear ();
+  m_ungriddedRx.clear ();
+  m_batches.clear ();
+  m_batchIndex.clear ();
+  m_startingBatch = 0;
+  m_downlinkListeners.clear ();
+  m_downlinkListenerIndex.clear ();
+  SpectrumChannel::DoDispose ();
+}
+
+void
+LoRaWANSpectrumChannel::AddPropagationLossModel (Ptr<PropagationLossModel> loss)
+{
+  NS_LOG_FUNCTION (this << loss);
+  if (m_propagationLoss)
+    {
+      loss->SetNext (m_propagationLoss);
+    }
+  m_propagationLoss = loss;
+  m_nPropagationLossModels++;
+  m_gridCellSizeDirty = true;
+}
+
+void
+LoRaWANSpectrumChannel::AddSpectrumPropagationLossModel (Ptr<SpectrumPropagationLossModel> loss)
+{
+  NS_LOG_FUNCTION (this << loss);
+  if (m_spectrumPropagationLoss)
+    {
+      loss->SetNext (m_spectrumPropagationLoss);
+    }
+  m_spectrumPropagationLoss = loss;
+  m_gridCellSizeDirty = true;
+}
+
+void
+LoRaWANSpectrumChannel::SetPropagationDelayModel (Ptr<PropagationDelayModel> delay)
+{
+  NS_LOG_FUNCTION (this << delay);
+  NS_ASSERT (m_propagationDelay == 0);
+  m_propagationDelay = delay;
+}
+
+void
+LoRaWANSpectrumChannel::AddRx (Ptr<SpectrumPhy> phy)
+{
+  NS_LOG_FUNCTION (this << phy);
+
+  if (m_rxListPositions.find (PeekPointer (phy)) != m_rxListPositions.end ())
+    {
+      NS_LOG_WARN (this << " " << phy << " was already added to this channel");
+      return;
+    }
+
+  uint32_t listIndex = m_widebandRxListIndex;
+  Ptr<LoRaWANPhy> loRaWANPhy = DynamicCast<LoRaWANPhy> (phy);
+  if (loRaWANPhy && !loRaWANPhy->ReceivesOnAllChannels ())
+    {
+      listIndex = loRaWANPhy->GetCurrentChannelIndex ();
+      NS_ASSERT (listIndex < m_widebandRxListIndex);
+    }
+
+  AppendToRxList (phy, listIndex);
+  m_ungriddedRx.push_back (phy); // added to the grid once it has a MobilityModel, see UpdateGrid
+}
+
+void
+LoRaWANSpectrumChannel::RetuneRx (Ptr<SpectrumPhy> phy, uint8_t channelIndex)
+{
+  NS_LOG_FUNCTION (this << phy << static_cast<uint16_t> (channelIndex));
+  NS_ASSERT (channelIndex < m_widebandRxListIndex);
+
+  std::unordered_map<const SpectrumPhy*, RxListPosition>::const_iterator it = m_rxListPositions.find (PeekPointer (phy));
+  if (it == m_rxListPositions.end ())
+    {
+      NS_LOG_LOGIC (this << " " << phy << " is not attached to this channel, ignoring retune");
+      return;
+    }
+
+  if (it->second.listIndex == channelIndex)
+    {
+      return;
+    }
+
+  RemoveFromRxList (it->second);
+  AppendToRxList (phy, channelIndex);
+}
+
+uint32_t
+LoRaWANSpectrumChannel::GetNRxOnChannel (uint8_t channelIndex) const
+{
+  NS_ASSERT (channelIndex < m_widebandRxListIndex);
+  return m_rxLists[channelIndex].size ();
+}
+
+void
+LoRaWANSpectrumChannel::SetMinRxPower (double minRxPowerDbm)
+{
+  NS_LOG_FUNCTION (this << minRxPowerDbm);
+  m_minRxPowerDbm = minRxPowerDbm;
+  m_gridCellSizeDirty = true;
+}
+
+double
+LoRaWANSpectrumChannel::GetMinRxPower (void) const
+{
+  return m_minRxPowerDbm;
+}
+
+uint32_t
+LoRaWANSpectrumChannel::GetDownlinkListenerIndex (uint8_t channelIndex, uint8_t dataRateIndex)
+{
+  NS_ASSERT (dataRateIndex < LoRaWAN::m_supportedDataRates.size ());
+  return channelIndex * LoRaWAN::m_supportedDataRates.size () + dataRateIndex;
+}
+
+uint32_t
+LoRaWANSpectrumChannel::AddDownlinkListener (uint8_t channelIndex, uint8_t dataRateIndex, Callback<void> callback)
+{
+  NS_LOG_FUNCTION (this << static_cast<uint16_t> (channelIndex) << static_cast<uint16_t> (dataRateIndex));
+  const uint32_t index = GetDownlinkListenerIndex (channelIndex, dataRateIndex);
+  if (index >= m_downlinkListeners.size ())
+    {
+      m_downlinkListeners.resize (index + 1);
+    }
+  const uint32_t id = m_nextDownlinkListenerId++;
+  m_downlinkListeners[index][id] = callback;
+  m_downlinkListenerIndex[id] = index;
+  return id;
+}
+
+void
+LoRaWANSpectrumChannel::RemoveDownlinkListener (uint32_t id)
+{
+  NS_LOG_FUNCTION (this << id);
+  std::unordered_map<uint32_t, uint32_t>::iterator it = m_downlinkListenerIndex.find (id);
+  if (it == m_downlinkListenerIndex.end ())
+    {
+      return;
+    }
+  m_downlinkListeners[it->second].erase (id);
+  m_downlinkListenerIndex.erase (it);
+}
+
+void
+LoRaWANSpectrumChannel::NotifyDownlinkListeners (uint8_t channelIndex, uint8_t dataRateIndex)
+{
+  NS_LOG_FUNCTION (this << static_cast<uint16_t> (channelIndex) << static_cast<uint16_t> (dataRateIndex));
+  const uint32_t index = GetDownlinkListenerIndex (channelIndex, dataRateIndex);
+  if (index >= m_downlinkListeners.size () || m_downlinkListeners[index].empty ())
+    {
+      return;
+    }
+  std::vector<Callback<void> > callbacks;
+  callbacks.reserve (m_downlinkListeners[index].size ());
+  for (std::map<uint32_t, Callback<void> >::const_iterator it = m_downlinkListeners[index].begin (); it != m_downlinkListeners[index].end (); ++it)
+    {
+      callbacks.push_back (it->second);
+    }
+  for (std::vector<Callback<void> >::iterator it = callbacks.begin (); it != callbacks.end (); ++it)
+    {
+      (*it) ();
+    }
+}
+
+double
+LoRaWANSpectrumChannel::GetRange (double txPowerDbm)
+{
+  if (m_gridCellSizeDirty)
+    {
+      UpdateGrid ();
+    }
+
+  if (m_gridCellSize == 0)
+    {
+      return 0;
+    }
+
+  // Invert the LogDistancePropagationLossModel, no signal is received above
+  // txPowerDbm - m_lossReferenceLoss
+  const double maxLossDb = txPowerDbm - m_minRxPowerDbm;
+  const double range = m_lossReferenceDistance * std::pow (10.0, (maxLossDb - m_lossReferenceLoss) / (10.0 * m_lossExponent));
+  return std::max (range, m_lossReferenceDistance);
+}
+
+void
+LoRaWANSpectrumChannel::UpdateGrid (void)
+{
+  if (m_gridCellSizeDirty)
+    {
+      m_gridCellSizeDirty = false;
+      m_gridCellSize = 0;
+
+      // The received power can only be bounded for a single, deterministic loss model
+      Ptr<LogDistancePropagationLossModel> lossModel = DynamicCast<LogDistancePropagationLossModel> (m_propagationLoss);
+      if (!std::isinf (m_minRxPowerDbm) && m_nPropagationLossModels == 1 && lossModel && !m_spectrumPropagationLoss)
+        {
+          DoubleValue exponent, referenceDistance, referenceLoss;
+          lossModel->GetAttribute ("Exponent", exponent);
+          lossModel->GetAttribute ("ReferenceDistance", referenceDistance);
+          lossModel->GetAttribute ("ReferenceLoss", referenceLoss);
+          m_lossExponent = exponent.Get ();
+          m_lossReferenceDistance = referenceDistance.Get ();
+          m_lossReferenceLoss = referenceLoss.Get ();
+
+          if (m_lossExponent > 0)
+            {
+              m_gridCellSize = 1.0; // GetRange returns 0 otherwise
+              m_gridCellSize = GetRange (LORAWAN_MAX_TX_POWER_DBM);
+            }
+        }
+      NS_LOG_LOGIC (this << " grid cell size = " << m_gridCellSize << "m");
+
+      // Sort the receivers in the new cells
+      m_gridCells.clear ();
+      for (uint32_t i = 0; i < m_gridEntries.size (); i++)
+        {
+          m_gridEntries[i].cell = GetCell (m_gridEntries[i].mobility->GetPosition ());
+          m_gridCells[m_gridEntries[i].cell].push_back (i);
+        }
+    }
+
+  if (m_gridCellSize == 0)
+    {
+      return;
+    }
+
+  // Add receivers that got a MobilityModel since the last call to the grid
+  uint32_t nUngridded = 0;
+  for (uint32_t i = 0; i < m_ungriddedRx.size (); i++)
+    {
+      Ptr<SpectrumPhy> phy = m_ungriddedRx[i];
+      Ptr<MobilityModel> mobility = phy->GetMobility ();
+      if (!mobility || phy->GetRxAntenna ())
+        {
+          // Can not bound the received power without a position or with an antenna gain
+          m_ungriddedRx[nUngridded++] = phy;
+          continue;
+        }
+
+      std::unordered_map<const MobilityModel*, uint32_t>::const_iterator it = m_gridEntryIndex.find (PeekPointer (mobility));
+      if (it == m_gridEntryIndex.end ())
+        {
+          GridEntry entry;
+          entry.mobility = mobility;
+          entry.cell = GetCell (mobility->GetPosition ());
+          it = m_gridEntryIndex.insert (std::make_pair (PeekPointer (mobility), m_gridEntries.size ())).first;
+          m_gridCells[entry.cell].push_back (m_gridEntries.size ());
+          m_gridEntries.push_back (entry);
+          TrackMobility (mobility);
+        }
+      m_gridEntries[it->second].phys.push_back (phy);
+    }
+  m_ungriddedRx.resize (nUngridded);
+}
+
+int64_t
+LoRaWANSpectrumChannel::GetCell (const Vector &position) const
+{
+  if (m_gridCellSize == 0)
+    {
+      return 0;
+    }
+
+  const int32_t x = std::floor (position.x / m_gridCellSize);
+  const int32_t y = std::floor (position.y / m_gridCellSize);
+  return (static_cast<int64_t> (x) << 32) | static_cast<uint32_t> (y);
+}
+
+void
+LoRaWANSpectrumChannel::MoveGridEntry (uint32_t entryIndex)
+{
+  GridEntry &entry = m_gridEntries[entryIndex];
+  const int64_t cell = GetCell (entry.mobility->GetPosition ());
+  if (cell == entry.cell)
+    {
+      return;
+    }
+
+  std::vector<uint32_t> &oldCell = m_gridCells[entry.cell];
+  std::vector<uint32_t>::iterator it = std::find (oldCell.begin (), oldCell.end (), entryIndex);
+  NS_ASSERT (it != oldCell.end ());
+  *it = oldCell.back ();
+  oldCell.pop_back ();
+  if (oldCell.empty ())
+    {
+      m_gridCells.erase (entry.cell);
+    }
+
+  m_gridCells[cell].push_back (entryIndex);
+  entry.cell = cell;
+}
+
+void
+LoRaWANSpectrumChannel::CourseChanged (Ptr<const MobilityModel> mobility)
+{
+  // Invalidate the cached links of the mobility model
+  std::unordered_map<const MobilityModel*, TrackedMobility>::iterator trackedIt = m_trackedMobilities.find (PeekPointer (mobility));
+  if (trackedIt != m_trackedMobilities.end ())
+    {
+      trackedIt->second.version++;
+    }
+
+  std::unordered_map<const MobilityModel*, uint32_t>::const_iterator it = m_gridEntryIndex.find (PeekPointer (mobility));
+  if (it != m_gridEntryIndex.end () && m_gridCellSize > 0)
+    {
+      MoveGridEntry (it->second);
+    }
+}
+
+uint32_t
+LoRaWANSpectrumChannel::TrackMobility (Ptr<MobilityModel> mobility)
+{
+  std::pair<std::unordered_map<const MobilityModel*, TrackedMobility>::iterator, bool> inserted =
+    m_trackedMobilities.insert (std::make_pair (PeekPointer (mobility), TrackedMobility ()));
+  if (inserted.second)
+    {
+      inserted.first->second.mobility = mobility;
+      inserted.first->second.version = 0;
+      mobility->TraceConnectWithoutContext ("CourseChange", MakeCallback (&LoRaWANSpectrumChannel::CourseChanged, this));
+    }
+  return inserted.first->second.version;
+}
+
+double
+LoRaWANSpectrumChannel::GetPropagationGain (Ptr<MobilityModel> senderMobility, Ptr<MobilityModel> receiverMobility)
+{
+  if (m_linkCacheSize == 0)
+    {
+      return m_propagationLoss->CalcRxPower (0, senderMobility, receiverMobility);
+    }
+
+  const uint32_t senderVersion = TrackMobility (senderMobility);
+  const uint32_t receiverVersion = TrackMobility (receiverMobility);
+  const LinkKey key (PeekPointer (senderMobility), PeekPointer (receiverMobility));
+
+  std::unordered_map<LinkKey, Link, LinkKeyHash>::iterator it = m_linkCache.find (key);
+  if (it != m_linkCache.end ()
+      && it->second.senderVersion == senderVersion && it->second.receiverVersion == receiverVersion)
+    {
+      return it->second.gainDb;
+    }
+
+  double gainDb = m_propagationLoss->CalcRxPower (0, senderMobility, receiverMobility);
+  if (-gainDb > m_linkCacheMaxLoss)
+    {
+      // Remember that the link is out of range instead of evaluating the loss model again
+      gainDb = -std::numeric_limits<double>::infinity ();
+    }
+
+  if (it == m_linkCache.end ())
+    {
+      if (m_linkCacheOrder.size () < m_linkCacheSize)
+        {
+          m_linkCacheOrder.push_back (key);
+        }
+      else
+        {
+          // Evict the oldest link and reuse its slot in m_linkCacheOrder
+          NS_LOG_LOGIC (this << " link cache is full, evicting a link");
+          m_linkCache.erase (m_linkCacheOrder[m_linkCacheNextEviction]);
+          m_linkCacheOrder[m_linkCacheNextEviction] = key;
+          m_linkCacheNextEviction = (m_linkCacheNextEviction + 1) % m_linkCacheOrder.size ();
+        }
+      it = m_linkCache.insert (std::make_pair (key, Link ())).first;
+    }
+
+  // Either a new link or a link that was invalidated by a course change
+  it->second.gainDb = gainDb;
+  it->second.senderVersion = senderVersion;
+  it->second.receiverVersion = receiverVersion;
+  return gainDb;
+}
+
+bool
+LoRaWANSpectrumChannel::IsListening (Ptr<SpectrumPhy> phy, uint8_t channelIndex) const
+{
+  std::unordered_map<const SpectrumPhy*, RxListPosition>::const_iterator it = m_rxListPositions.find (PeekPointer (phy));
+  return it != m_rxListPositions.end ()
+         && (it->second.listIndex == channelIndex || it->second.listIndex == m_widebandRxListIndex);
+}
+
+void
+LoRaWANSpectrumChannel::AppendToRxList (Ptr<SpectrumPhy> phy, uint32_t listIndex)
+{
+  RxListPosition position;
+  position.listIndex = listIndex;
+  position.position = m_rxLists[listIndex].size ();
+
+  m_rxLists[listIndex].push_back (phy);
+  m_rxListPositions[PeekPointer (phy)] = position;
+}
+
+void
+LoRaWANSpectrumChannel::RemoveFromRxList (const RxListPosition &position)
+{
+  RxList &rxList = m_rxLists[position.listIndex];
+  NS_ASSERT (position.position < rxList.size ());
+
+  // Move the last receiver of the list into the freed slot
+  const uint32_t last = rxList.size () - 1;
+  if (position.position != last)
+    {
+      rxList[position.position] = rxList[last];
+      m_rxListPositions[PeekPointer (rxList[position.position])].position = position.position;
+    }
+  rxList.pop_back ();
+}
+
+void
+LoRaWANSpectrumChannel::StartTx (Ptr<SpectrumSignalParameters> txParams)
+{
+  NS_LOG_FUNCTION (this << txParams->psd << txParams->duration << txParams->txPhy);
+  NS_ASSERT_MSG (txParams->psd, "NULL txPsd");
+  NS_ASSERT_MSG (txParams->txPhy, "NULL txPhy");
+
+  // all attached SpectrumPhy instances must use the same SpectrumModel
+  if (m_spectrumModel == 0)
+    {
+      m_spectrumModel = txParams->psd->GetSpectrumModel ();
+    }
+  else
+    {
+      NS_ASSERT (*(txParams->psd->GetSpectrumModel ()) == *m_spectrumModel);
+    }
+
+  Ptr<LoRaWANSpectrumSignalParameters> loRaWANTxParams = DynamicCast<LoRaWANSpectrumSignalParameters> (txParams);
+  if (loRaWANTxParams)
+    {
+      const uint8_t channelIndex = loRaWANTxParams->channelIndex;
+      NS_ASSERT (channelIndex < m_widebandRxListIndex);
+
+      if (loRaWANTxParams->invertedIq && !m_downlinkListenerIndex.empty ())
+        {
+          NotifyDownlinkListeners (channelIndex, loRaWANTxParams->dataRateIndex);
+        }
+
+      UpdateGrid ();
+      double range = 0;
+      if (m_gridCellSize > 0 && txParams->txAntenna == 0 && txParams->txPhy->GetMobility ())
+        {
+          const double txPower = LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (txParams->psd, channelIndex);
+          range = GetRange (10.0 * std::log10 (txPower) + 30);
+        }
+
+      if (range > 0 && range <= m_gridCellSize)
+        {
+          DeliverInRange (txParams, channelIndex, range);
+        }
+      else
+        {
+          DeliverToRxList (txParams, m_rxLists[channelIndex]);
+          DeliverToRxList (txParams, m_rxLists[m_widebandRxListIndex]);
+        }
+    }
+  else
+    {
+      // Not a LoRaWAN transmission, we can not tell which channels it overlaps with
+      for (std::vector<RxList>::const_iterator it = m_rxLists.begin (); it != m_rxLists.end (); ++it)
+        {
+          DeliverToRxList (txParams, *it);
+        }
+    }
+
+  // Schedule a single StartRx event per batch
+  for (std::vector<Ptr<ReceptionBatch> >::const_iterator it = m_batches.begin (); it != m_batches.end (); ++it)
+    {
+      if ((*it)->context != Simulator::NO_CONTEXT)
+        {
+          Simulator::ScheduleWithContext ((*it)->context, (*it)->delay, &LoRaWANSpectrumChannel::StartRx, this, *it);
+        }
+      else
+        {
+          // the receivers are not attached to a NetDevice, so we cannot assume that they are attached to a node
+          Simulator::Schedule ((*it)->delay, &LoRaWANSpectrumChannel::StartRx, this, *it);
+        }
+    }
+  NS_LOG_LOGIC (this << " scheduled " << m_batches.size () << " batches of receptions");
+  m_batches.clear ();
+  m_batchIndex.clear ();
+}
+
+void
+LoRaWANSpectrumChannel::DeliverToRxList (Ptr<SpectrumSignalParameters> txParams, const RxList &rxList)
+{
+  Ptr<MobilityModel> senderMobility = txParams->txPhy->GetMobility ();
+
+  for (RxList::const_iterator rxPhyIterator = rxList.begin ();
+       rxPhyIterator != rxList.end ();
+       ++rxPhyIterator)
+    {
+      DeliverToRx (txParams, senderMobility, *rxPhyIterator);
+    }
+}
+
+void
+LoRaWANSpectrumChannel::DeliverInRange (Ptr<SpectrumSignalParameters> txParams, uint8_t channelIndex, double range)
+{
+  Ptr<MobilityModel> senderMobility = txParams->txPhy->GetMobility ();
+  const Vector senderPosition = senderMobility->GetPosition ();
+  const int32_t x = std::floor (senderPosition.x / m_gridCellSize);
+  const int32_t y = std::floor (senderPosition.y / m_gridCellSize);
+
+  // The range is at most the cell size, so only the surrounding cells can contain receivers in range
+  uint32_t nSkipped = 0;
+  for (int32_t i = x - 1; i <= x + 1; i++)
+    {
+      for (int32_t j = y - 1; j <= y + 1; j++)
+        {
+          const int64_t cell = (static_cast<int64_t> (i) << 32) | static_cast<uint32_t> (j);
+          std::unordered_map<int64_t, std::vector<uint32_t> >::const_iterator it = m_gridCells.find (cell);
+          if (it == m_gridCells.end ())
+            {
+              continue;
+            }
+
+          for (std::vector<uint32_t>::const_iterator entryIt = it->second.begin (); entryIt != it->second.end (); ++entryIt)
+            {
+              const GridEntry &entry = m_gridEntries[*entryIt];
+              if (CalculateDistance (entry.mobility->GetPosition (), senderPosition) > range)
+                {
+                  nSkipped += entry.phys.size ();
+                  continue;
+                }
+
+              for (std::vector<Ptr<SpectrumPhy> >::const_iterator phyIt = entry.phys.begin (); phyIt != entry.phys.end (); ++phyIt)
+                {
+                  if (IsListening (*phyIt, channelIndex))
+                    {
+                      DeliverToRx (txParams, senderMobility, *phyIt);
+                    }
+                }
+            }
+        }
+    }
+
+  for (std::vector<Ptr<SpectrumPhy> >::const_iterator it = m_ungriddedRx.begin (); it != m_ungriddedRx.end (); ++it)
+    {
+      if (IsListening (*it, channelIndex))
+        {
+          DeliverToRx (txParams, senderMobility, *it);
+        }
+    }
+
+  NS_LOG_LOGIC (this << " range " << range << "m, skipped at least " << nSkipped << " receivers");
+}
+
+void
+LoRaWANSpectrumChannel::DeliverToRx (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility, Ptr<SpectrumPhy> receiver)
+{
+  if (receiver == txParams->txPhy)
+    {
+      return;
+    }
+
+  Time delay = MicroSeconds (0);
+
+  Ptr<MobilityModel> receiverMobility = receiver->GetMobility ();
+  NS_LOG_LOGIC ("copying signal parameters " << txParams);
+  Ptr<SpectrumSignalParameters> rxParams = txParams->Copy ();
+
+  if (senderMobility && receiverMobility)
+    {
+      double pathLossDb = 0;
+      if (rxParams->txAntenna != 0)
+        {
+          Angles txAngles (receiverMobility->GetPosition (), senderMobility->GetPosition ());
+          double txAntennaGain = rxParams->txAntenna->GetGainDb (txAngles);
+          NS_LOG_LOGIC ("txAntennaGain = " << txAntennaGain << " dB");
+          pathLossDb -= txAntennaGain;
+        }
+      Ptr<AntennaModel> rxAntenna = receiver->GetRxAntenna ();
+      if (rxAntenna != 0)
+        {
+          Angles rxAngles (senderMobility->GetPosition (), receiverMobility->GetPosition ());
+          double rxAntennaGain = rxAntenna->GetGainDb (rxAngles);
+          NS_LOG_LOGIC ("rxAntennaGain = " << rxAntennaGain << " dB");
+          pathLossDb -= rxAntennaGain;
+        }
+      if (m_propagationLoss)
+        {
+          double propagationGainDb = GetPropagationGain (senderMobility, receiverMobility);
+          NS_LOG_LOGIC ("propagationGainDb = " << propagationGainDb << " dB");
+          if (std::isinf (propagationGainDb))
+            {
+              return; // out of range, see LinkCacheMaxLoss
+            }
+          pathLossDb -= propagationGainDb;
+        }
+      NS_LOG_LOGIC ("total pathLoss = " << pathLossDb << " dB");
+
+      double pathGainLinear = std::pow (10.0, (-pathLossDb) / 10.0);
+      *(rxParams->psd) *= pathGainLinear;
+
+      if (m_spectrumPropagationLoss)
+        {
+          rxParams->psd = m_spectrumPropagationLoss->CalcRxPowerSpectralDensity (rxParams->psd, senderMobility, receiverMobility);
+        }
+
+      if (m_propagationDelay)
+        {
+          delay = m_propagationDelay->GetDelay (senderMobility, receiverMobility);
+        }
+    }
+
+  AddReception (receiver, rxParams, delay, -1);
+}
+
+void
+LoRaWANSpectrumChannel::AddReception (Ptr<SpectrumPhy> receiver, Ptr<SpectrumSignalParameters> rxParams, Time delay, double rxPower)
+{
+  uint32_t context = Simulator::NO_CONTEXT;
+  Ptr<NetDevice> netDev = receiver->GetDevice ();
+  if (netDev)
+    {
+      // the receiver has a NetDevice, so we expect that it is attached to a Node
+      context = netDev->GetNode ()->GetId ();
+    }
+
+  // Receivers of the same node usually share the delay, e.g. all PHYs of a gateway
+  ReceptionBatchKey key (context, delay.GetTimeStep ());
+  std::pair<std::unordered_map<ReceptionBatchKey, uint32_t, ReceptionBatchKeyHash>::iterator, bool> inserted =
+    m_batchIndex.insert (std::make_pair (key, m_batches.size ()));
+  if (inserted.second)
+    {
+      Ptr<ReceptionBatch> batch = Create<ReceptionBatch> ();
+      batch->delay = delay;
+      batch->context = context;
+      m_batches.push_back (batch);
+    }
+
+  Reception reception;
+  reception.receiver = receiver;
+  reception.rxParams = rxParams;
+  reception.rxPower = rxPower;
+  m_batches[inserted.first->second]->receptions.push_back (reception);
+}
+
+void
+LoRaWANSpectrumChannel::StartRx (Ptr<ReceptionBatch> batch)
+{
+  NS_LOG_FUNCTION (this << batch->receptions.size ());
+  NS_ASSERT (m_startingBatch == 0);
+
+  // Receivers that call AddEndOfSignal are moved to the front of the batch,
+  // the batch is reused for EndOfSignal
+  m_startingBatch = batch;
+  m_nEndOfSignal = 0;
+  for (m_startingReception = 0; m_startingReception < batch->receptions.size (); m_startingReception++)
+    {
+      StartReception (batch->receptions[m_startingReception]);
+    }
+  m_startingBatch = 0;
+
+  batch->receptions.resize (m_nEndOfSignal);
+  if (!batch->receptions.empty ())
+    {
+      // all receptions of a batch are copies of the same transmission
+      Simulator::Schedule (batch->receptions.front ().rxParams->duration, &LoRaWANSpectrumChannel::EndOfSignal, this, batch);
+    }
+}
+
+void
+LoRaWANSpectrumChannel::StartReception (const Reception &reception)
+{
+  reception.receiver->StartRx (reception.rxParams);
+}
+
+bool
+LoRaWANSpectrumChannel::AddEndOfSignal (Ptr<SpectrumPhy> phy, Ptr<SpectrumSignalParameters> params)
+{
+  if (m_startingBatch == 0)
+    {
+      return false;
+    }
+
+  const Reception &reception = m_startingBatch->receptions[m_startingReception];
+  if (reception.receiver != phy || reception.rxParams != params)
+    {
+      return false;
+    }
+
+  NS_ASSERT (m_nEndOfSignal <= m_startingReception);
+  m_startingBatch->receptions[m_nEndOfSignal++] = reception;
+  return true;
+}
+
+void
+LoRaWANSpectrumChannel::EndOfSignal (Ptr<ReceptionBatch> batch)
+{
+  NS_LOG_FUNCTION (this << batch->receptions.size ());
+  for (std::vector<Reception>::const_iterator it = batch->receptions.begin (); it != batch->receptions.end (); ++it)
+    {
+      StaticCast<LoRaWANPhy> (it->receiver)->EndRx (it->rxParams);
+    }
+}
+
+uint32_t
+LoRaWANSpectrumChannel::GetNDevices (void) const
+{
+  NS_LOG_FUNCTION (this);
+  return m_rxListPositions.size ();
+}
+
+Ptr<NetDevice>
+LoRaWANSpectrumChannel::GetDevice (uint32_t i) const
+{
+  NS_LOG_FUNCTION (this << i);
+  for (std::vector<RxList>::const_iterator it = m_rxLists.begin (); it != m_rxLists.end (); ++it)
+    {
+      if (i < it->size ())
+        {
+          return (*it)[i]->GetDevice ();
+        }
+      i -= it->size ();
+    }
+  NS_FATAL_ERROR ("Device index " << i << " out of range");
+  return 0;
+}
+
+} // namespace ns3
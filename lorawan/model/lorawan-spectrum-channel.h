@@ -0,0 +1,590 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#ifndef LORAWAN_SPECTRUM_CHANNEL_H
+#define LORAWAN_SPECTRUM_CHANNEL_H
+
+#include <ns3/spectrum-channel.h>
+#include <ns3/spectrum-phy.h>
+#include <ns3/propagation-loss-model.h>
+#include <ns3/propagation-delay-model.h>
+#include <ns3/spectrum-propagation-loss-model.h>
+#include <ns3/simple-ref-count.h>
+#include <ns3/nstime.h>
+#include <ns3/vector.h>
+#include <ns3/callback.h>
+#include <vector>
+#include <map>
+#include <unordered_map>
+
+namespace ns3 {
+
+class MobilityModel;
+
+/**
+ * \ingroup lorawan
+ *
+ * A SpectrumChannel that is aware of the LoRaWAN channel plan.
+ *
+ * Receivers are kept in one list per LoRaWAN channel index. A
+ * LoRaWANSpectrumSignalParameters transmission is only delivered to the
+ * LoRaWANPhy objects that are tuned to the channel of the transmission, which
+ * avoids evaluating the propagation loss models and calling StartRx for
+ * receivers that would discard the signal anyway. Receivers that are not a
+ * LoRaWANPhy, LoRaWANPhy objects that receive on all channels (see
+ * LoRaWANPhy::ReceivesOnAllChannels), and transmissions that are not LoRaWAN
+ * transmissions, are treated as wideband: they are delivered to (and receive from) every
+ * attached receiver, just like in the SingleModelSpectrumChannel.
+ *
+ * A LoRaWANPhy has to call RetuneRx whenever it changes channel, this is done
+ * by LoRaWANPhy::SetTxConf.
+ *
+ * Receivers with the same propagation delay and node (e.g. all PHYs of a
+ * gateway) share a single StartRx event per transmission. LoRaWANPhy objects
+ * that need to be notified of the end of the signal register via
+ * AddEndOfSignal during their StartRx, after which the channel calls
+ * LoRaWANPhy::EndRx for all of them from a single event.
+ *
+ * Optionally, receivers that can not receive a transmission above the
+ * MinRxPower attribute are skipped altogether. This is only done when the
+ * received power can be bounded from the distance, i.e. when a single
+ * LogDistancePropagationLossModel is attached, no frequency dependent loss
+ * model is attached and the transmitter and receiver have no antenna model.
+ * The receivers are kept in a uniform grid over their positions, with cells
+ * as large as the range of a transmission at the highest LoRaWAN power
+ * level, so only the receivers in the 3x3 cells around the transmitter are
+ * considered. The grid is kept up to date via the CourseChange trace of the
+ * MobilityModel of the receivers. Receivers without a MobilityModel are
+ * never skipped.
+ *
+ * For static topologies with a deterministic PropagationLossModel, the
+ * channel can also cache the propagation loss per pair of MobilityModel
+ * objects, see the LinkCacheSize attribute. A cached link is invalidated when
+ * either MobilityModel changes course. Links with a loss above
+ * LinkCacheMaxLoss are cached as out of range and are skipped.
+ */
+class LoRaWANSpectrumChannel : public SpectrumChannel
+{
+public:
+  /**
+   * Get the type ID.
+   *
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+
+  LoRaWANSpectrumChannel (void);
+  virtual ~LoRaWANSpectrumChannel (void);
+
+  // inherited from SpectrumChannel
+  virtual void AddPropagationLossModel (Ptr<PropagationLossModel> loss);
+  virtual void AddSpectrumPropagationLossModel (Ptr<SpectrumPropagationLossModel> loss);
+  virtual void SetPropagationDelayModel (Ptr<PropagationDelayModel> delay);
+  virtual void AddRx (Ptr<SpectrumPhy> phy);
+  virtual void StartTx (Ptr<SpectrumSignalParameters> params);
+
+  // inherited from Channel
+  virtual uint32_t GetNDevices (void) const;
+  virtual Ptr<NetDevice> GetDevice (uint32_t i) const;
+
+  /**
+   * Move a receiver to the receiver list of the given LoRaWAN channel index.
+   * Receivers that were not added via AddRx before are ignored.
+   *
+   * \param phy the receiver that changed channel
+   * \param channelIndex the index of the channel the receiver is now tuned to
+   */
+  void RetuneRx (Ptr<SpectrumPhy> phy, uint8_t channelIndex);
+
+  /**
+   * Get the number of receivers tuned to the given LoRaWAN channel index, not
+   * counting the wideband receivers.
+   *
+   * \param channelIndex the LoRaWAN channel index
+   * \return the number of receivers in the receiver list of the channel
+   */
+  uint32_t GetNRxOnChannel (uint8_t channelIndex) const;
+
+  /**
+   * Ask the channel to call LoRaWANPhy::EndRx at the end of the signal that
+   * the PHY is currently receiving. Only possible from within the StartRx of
+   * a receiver that was called by this channel.
+   *
+   * \param phy the receiver
+   * \param params the signal parameters passed to StartRx of the receiver
+   * \return true if the channel will call EndRx, false if the receiver has to
+   *         schedule EndRx itself
+   */
+  bool AddEndOfSignal (Ptr<SpectrumPhy> phy, Ptr<SpectrumSignalParameters> params);
+
+  /**
+   * Set the minimum received power in dBm below which a receiver is skipped.
+   *
+   * \param minRxPowerDbm the minimum received power in dBm
+   */
+  void SetMinRxPower (double minRxPowerDbm);
+
+  /**
+   * \return the minimum received power in dBm below which a receiver is skipped
+   */
+  double GetMinRxPower (void) const;
+
+  /**
+   * Get the distance beyond which a transmission at txPowerDbm is received
+   * below MinRxPower, based on the attached LogDistancePropagationLossModel.
+   *
+   * \param txPowerDbm the transmission power in dBm
+   * \return the range in m, or 0 if receivers can not be skipped
+   */
+  double GetRange (double txPowerDbm);
+
+  /**
+   * Register a callback that is called when a downstream LoRaWAN transmission
+   * (i.e. with inverted IQ) starts on the given channel and data rate. The
+   * callback is called from StartTx, before the transmission is delivered to
+   * any receiver.
+   *
+   * \param channelIndex the LoRaWAN channel index
+   * \param dataRateIndex the LoRaWAN data rate index
+   * \param callback the callback
+   * \return the id of the listener, to be passed to RemoveDownlinkListener
+   */
+  uint32_t AddDownlinkListener (uint8_t channelIndex, uint8_t dataRateIndex, Callback<void> callback);
+
+  /**
+   * Remove a callback that was registered with AddDownlinkListener.
+   *
+   * \param id the id of the listener
+   */
+  void RemoveDownlinkListener (uint32_t id);
+
+protected:
+  // Inherited from Object.
+  virtual void DoDispose (void);
+
+  /**
+   * The signal parameters of a transmission as seen by one receiver.
+   */
+  struct Reception
+  {
+    Ptr<SpectrumPhy> receiver;              //!< the receiver
+    Ptr<SpectrumSignalParameters> rxParams; //!< the signal as received
+    double rxPower;                         //!< the received power in W if it is not part of rxParams, negative otherwise
+  };
+
+  /**
+   * Calculate the signal at the receiver and add it to the batch of the
+   * receiver in m_batches.
+   *
+   * \param txParams the parameters of the transmitted signal
+   * \param senderMobility the mobility model of the transmitter, can be 0
+   * \param receiver the receiver
+   */
+  virtual void DeliverToRx (Ptr<SpectrumSignalParameters> txParams, Ptr<MobilityModel> senderMobility, Ptr<SpectrumPhy> receiver);
+
+  /**
+   * Add a reception to the batch of the receiver in m_batches.
+   *
+   * \param receiver the receiver
+   * \param rxParams the signal as received
+   * \param delay the propagation delay
+   * \param rxPower the received power in W, or a negative value if the power
+   *        is part of rxParams
+   */
+  void AddReception (Ptr<SpectrumPhy> receiver, Ptr<SpectrumSignalParameters> rxParams, Time delay, double rxPower);
+
+  /**
+   * Pass a reception to its receiver, called by StartRx after the
+   * propagation delay. Calls SpectrumPhy::StartRx by default.
+   *
+   * \param reception the reception
+   */
+  virtual void StartReception (const Reception &reception);
+
+  /**
+   * Get the gain of m_propagationLoss between two nodes, from the link cache
+   * if possible.
+   *
+   * \param senderMobility the mobility model of the transmitter
+   * \param receiverMobility the mobility model of the receiver
+   * \return the propagation gain in dB, minus infinity if the link is cached
+   *         as out of range
+   */
+  double GetPropagationGain (Ptr<MobilityModel> senderMobility, Ptr<MobilityModel> receiverMobility);
+
+  /**
+   * Single-frequency propagation loss model to be used with this channel.
+   */
+  Ptr<PropagationLossModel> m_propagationLoss;
+
+  /**
+   * Frequency-dependent propagation loss model to be used with this channel.
+   */
+  Ptr<SpectrumPropagationLossModel> m_spectrumPropagationLoss;
+
+  /**
+   * Propagation delay model to be used with this channel.
+   */
+  Ptr<PropagationDelayModel> m_propagationDelay;
+
+private:
+  /**
+   * A list of receivers.
+   */
+  typedef std::vector<Ptr<SpectrumPhy> > RxList;
+
+  /**
+   * Location of a receiver in m_rxLists.
+   */
+  struct RxListPosition
+  {
+    uint32_t listIndex; //!< index of the RxList in m_rxLists
+    uint32_t position;  //!< index of the receiver in the RxList
+  };
+
+  /**
+   * Receptions of the same transmission that start (and end) at the same time
+   * in the same context.
+   */
+  class ReceptionBatch : public SimpleRefCount<ReceptionBatch>
+  {
+  public:
+    Time delay;                         //!< the propagation delay
+    uint32_t context;                   //!< the node id of the receivers, or Simulator::NO_CONTEXT
+    std::vector<Reception> receptions;  //!< the receptions
+  };
+
+  /**
+   * Key of a ReceptionBatch in m_batchIndex: the context and the delay in
+   * time steps.
+   */
+  typedef std::pair<uint32_t, int64_t> ReceptionBatchKey;
+
+  /**
+   * Hash function for ReceptionBatchKey.
+   */
+  struct ReceptionBatchKeyHash
+  {
+    size_t operator() (const ReceptionBatchKey &key) const
+    {
+      return std::hash<int64_t> () (key.second) ^ (std::hash<uint32_t> () (key.first) * 31);
+    }
+  };
+
+  /**
+   * A MobilityModel of one or more receivers in the grid.
+   */
+  struct GridEntry
+  {
+    Ptr<MobilityModel> mobility;          //!< the mobility model
+    int64_t cell;                         //!< the key of the grid cell
+    std::vector<Ptr<SpectrumPhy> > phys;  //!< the receivers with this mobility model
+  };
+
+  /**
+   * Calculate the signal at every receiver in the list and add it to the
+   * batch of the receiver in m_batches.
+   *
+   * \param txParams the parameters of the transmitted signal
+   * \param rxList the receivers to deliver the signal to
+   */
+  void DeliverToRxList (Ptr<SpectrumSignalParameters> txParams, const RxList &rxList);
+
+  /**
+   * Deliver a LoRaWAN transmission to the receivers that are within range
+   * according to the grid, and to all receivers that are not in the grid.
+   *
+   * \param txParams the parameters of the transmitted signal
+   * \param channelIndex the channel of the transmission
+   * \param range the range of the transmission in m
+   */
+  void DeliverInRange (Ptr<SpectrumSignalParameters> txParams, uint8_t channelIndex, double range);
+
+  /**
+   * Whether a receiver is on a receiver list that gets transmissions on the
+   * given channel.
+   *
+   * \param phy the receiver
+   * \param channelIndex the channel of the transmission
+   * \return true if the receiver is tuned to the channel or is wideband
+   */
+  bool IsListening (Ptr<SpectrumPhy> phy, uint8_t channelIndex) const;
+
+  /**
+   * Call the downlink listeners of a channel and data rate. The callbacks are
+   * copied first, so a callback may remove listeners.
+   *
+   * \param channelIndex the channel of the downstream transmission
+   * \param dataRateIndex the data rate of the downstream transmission
+   */
+  void NotifyDownlinkListeners (uint8_t channelIndex, uint8_t dataRateIndex);
+
+  /**
+   * Recalculate the grid cell size when the loss model or MinRxPower changed
+   * and add receivers that got a MobilityModel to the grid.
+   */
+  void UpdateGrid (void);
+
+  /**
+   * \param position a position
+   * \return the key of the grid cell of the position
+   */
+  int64_t GetCell (const Vector &position) const;
+
+  /**
+   * Move a grid entry to the cell of its current position.
+   *
+   * \param entryIndex the index of the entry in m_gridEntries
+   */
+  void MoveGridEntry (uint32_t entryIndex);
+
+  /**
+   * Called when a MobilityModel that is in the grid or in the link cache
+   * changes course.
+   *
+   * \param mobility the mobility model
+   */
+  void CourseChanged (Ptr<const MobilityModel> mobility);
+
+  /**
+   * Connect to the CourseChange trace of a MobilityModel, if not done before.
+   *
+   * \param mobility the mobility model
+   * \return the number of times the mobility model changed course since it
+   *         is tracked
+   */
+  uint32_t TrackMobility (Ptr<MobilityModel> mobility);
+
+  /**
+   * A MobilityModel of which the CourseChange trace is connected.
+   */
+  struct TrackedMobility
+  {
+    Ptr<MobilityModel> mobility;  //!< the mobility model
+    uint32_t version;             //!< the number of course changes since it is tracked
+  };
+
+  /**
+   * The key of a link in the link cache, the sender and receiver mobility.
+   */
+  typedef std::pair<const MobilityModel*, const MobilityModel*> LinkKey;
+
+  /**
+   * Hash function for LinkKey.
+   */
+  struct LinkKeyHash
+  {
+    size_t operator() (const LinkKey &key) const
+    {
+      return std::hash<const MobilityModel*> () (key.first) ^ (std::hash<const MobilityModel*> () (key.second) * 31);
+    }
+  };
+
+  /**
+   * A cached link, only valid while the versions of both mobility models
+   * did not change.
+   */
+  struct Link
+  {
+    double gainDb;            //!< the propagation gain in dB, minus infinity if out of range
+    uint32_t senderVersion;   //!< the version of the sender mobility model
+    uint32_t receiverVersion; //!< the version of the receiver mobility model
+  };
+
+  /**
+   * Call StartRx of all receivers in the batch, after the propagation delay.
+   * Schedules EndOfSignal for the receivers that called AddEndOfSignal.
+   *
+   * \param batch the receptions
+   */
+  void StartRx (Ptr<ReceptionBatch> batch);
+
+  /**
+   * Call LoRaWANPhy::EndRx of all receivers in the batch.
+   *
+   * \param batch the receptions
+   */
+  void EndOfSignal (Ptr<ReceptionBatch> batch);
+
+  /**
+   * Add a receiver at the end of a receiver list.
+   *
+   * \param phy the receiver
+   * \param listIndex the index of the receiver list in m_rxLists
+   */
+  void AppendToRxList (Ptr<SpectrumPhy> phy, uint32_t listIndex);
+
+  /**
+   * Remove a receiver from the list it currently is in. The last receiver of
+   * that list takes the position of the removed receiver.
+   *
+   * \param position the current location of the receiver
+   */
+  void RemoveFromRxList (const RxListPosition &position);
+
+  /**
+   * One receiver list per LoRaWAN channel index, the last list holds the
+   * wideband receivers.
+   */
+  std::vector<RxList> m_rxLists;
+
+  /**
+   * The index of the list of wideband receivers in m_rxLists.
+   */
+  uint32_t m_widebandRxListIndex;
+
+  /**
+   * Current location of every receiver, allows for constant time retuning.
+   */
+  std::unordered_map<const SpectrumPhy*, RxListPosition> m_rxListPositions;
+
+  /**
+   * SpectrumModel that all attached SpectrumPhy instances have to use.
+   */
+  Ptr<const SpectrumModel> m_spectrumModel;
+
+  /**
+   * The minimum received power in dBm, see SetMinRxPower.
+   */
+  double m_minRxPowerDbm;
+
+  /**
+   * The number of PropagationLossModel objects chained in m_propagationLoss.
+   */
+  uint32_t m_nPropagationLossModels;
+
+  /**
+   * The size of the grid cells in m, 0 if receivers can not be skipped.
+   */
+  double m_gridCellSize;
+
+  /**
+   * Whether m_gridCellSize has to be recalculated.
+   */
+  bool m_gridCellSizeDirty;
+
+  // The attributes of the LogDistancePropagationLossModel, copied by UpdateGrid
+  double m_lossExponent;          //!< path loss exponent
+  double m_lossReferenceDistance; //!< reference distance in m
+  double m_lossReferenceLoss;     //!< path loss at the reference distance in dB
+
+  /**
+   * The receivers in the grid, grouped per MobilityModel.
+   */
+  std::vector<GridEntry> m_gridEntries;
+
+  /**
+   * Index of every MobilityModel in m_gridEntries.
+   */
+  std::unordered_map<const MobilityModel*, uint32_t> m_gridEntryIndex;
+
+  /**
+   * The indices in m_gridEntries of the entries in every non-empty cell.
+   */
+  std::unordered_map<int64_t, std::vector<uint32_t> > m_gridCells;
+
+  /**
+   * The receivers that are not in the grid (yet).
+   */
+  std::vector<Ptr<SpectrumPhy> > m_ungriddedRx;
+
+  /**
+   * The mobility models of which the CourseChange trace is connected.
+   */
+  std::unordered_map<const MobilityModel*, TrackedMobility> m_trackedMobilities;
+
+  /**
+   * The maximum number of links in m_linkCache, 0 disables the cache.
+   */
+  uint32_t m_linkCacheSize;
+
+  /**
+   * Links with a higher loss (in dB) are cached as out of range.
+   */
+  double m_linkCacheMaxLoss;
+
+  /**
+   * The propagation gain of links.
+   */
+  std::unordered_map<LinkKey, Link, LinkKeyHash> m_linkCache;
+
+  /**
+   * The keys of m_linkCache in insertion order, used as a ring to evict the
+   * oldest link when the cache is full.
+   */
+  std::vector<LinkKey> m_linkCacheOrder;
+
+  /**
+   * The index in m_linkCacheOrder of the next link to evict.
+   */
+  uint32_t m_linkCacheNextEviction;
+
+  /**
+   * The batches of the transmission that is being delivered by StartTx.
+   */
+  std::vector<Ptr<ReceptionBatch> > m_batches;
+
+  /**
+   * Index of every batch of the transmission in m_batches.
+   */
+  std::unordered_map<ReceptionBatchKey, uint32_t, ReceptionBatchKeyHash> m_batchIndex;
+
+  /**
+   * The batch of which StartRx is calling the receivers, or 0.
+   */
+  Ptr<ReceptionBatch> m_startingBatch;
+
+  /**
+   * The index of the reception that StartRx is calling in m_startingBatch.
+   */
+  uint32_t m_startingReception;
+
+  /**
+   * The number of receptions in m_startingBatch that called AddEndOfSignal.
+   */
+  uint32_t m_nEndOfSignal;
+
+  /**
+   * \param channelIndex the LoRaWAN channel index
+   * \param dataRateIndex the LoRaWAN data rate index
+   * \return the index of the channel and data rate in m_downlinkListeners
+   */
+  static uint32_t GetDownlinkListenerIndex (uint8_t channelIndex, uint8_t dataRateIndex);
+
+  /**
+   * The callbacks registered with AddDownlinkListener, by id, for every
+   * channel and data rate (see GetDownlinkListenerIndex), so a downstream
+   * transmission only visits the listeners of its own channel and data rate.
+   */
+  std::vector<std::map<uint32_t, Callback<void> > > m_downlinkListeners;
+
+  /**
+   * The index in m_downlinkListeners of every registered listener, by id.
+   */
+  std::unordered_map<uint32_t, uint32_t> m_downlinkListenerIndex;
+
+  /**
+   * The id of the next downlink listener, 0 is never used.
+   */
+  uint32_t m_nextDownlinkListenerId;
+};
+
+} // namespace ns3
+
+#endif /* LORAWAN_SPECTRUM_CHANNEL_H */
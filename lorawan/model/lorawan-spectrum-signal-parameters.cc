@@ -25,6 +25,7 @@ namespace ns3 {
 NS_LOG_COMPONENT_DEFINE ("LoRaWANSpectrumSignalParameters");
 
 LoRaWANSpectrumSignalParameters::LoRaWANSpectrumSignalParameters (void)
+  : invertedIq (false)
 {
   NS_LOG_FUNCTION (this);
 }
@@ -37,6 +38,7 @@ LoRaWANSpectrumSignalParameters::LoRaWANSpectrumSignalParameters (const LoRaWANS
   channelIndex = p.channelIndex;
   dataRateIndex = p.dataRateIndex;
   codeRate = p.codeRate;
+  invertedIq = p.invertedIq;
 }
 
 Ptr<SpectrumSignalParameters>
@@ -66,6 +66,11 @@ struct LoRaWANSpectrumSignalParameters : public SpectrumSignalParameters
    * The code rate of the transmission
    */
   uint8_t codeRate;
+
+  /**
+   * True if the transmission uses inverted IQ (i.e. a downstream transmission)
+   */
+  bool invertedIq;
 };
 
 }  // namespace ns3
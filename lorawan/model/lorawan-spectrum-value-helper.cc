@@ -77,6 +77,56 @@ public:
 
 } g_LoRaWANSpectrumModelInitializerInstance; //!< Global object used to initialize the LoRaWAN Spectrum Model
 
+/**
+ * The legal transmit power levels in dBm, as per LoRaWAN $7.1.3
+ */
+static const int8_t g_LoRaWANTxPowerLevels[] = { 2, 5, 8, 11, 14, 20, 27 };
+
+#define LORAWAN_NR_TX_POWER_LEVELS (sizeof (g_LoRaWANTxPowerLevels) / sizeof (g_LoRaWANTxPowerLevels[0]))
+
+/**
+ * \ingroup lorawan
+ * \brief Helper class that creates the shared transmit and noise PSDs
+ */
+class LoRaWANPsdCache
+{
+public:
+  LoRaWANPsdCache (void)
+  {
+    LoRaWANSpectrumValueHelper psdHelper;
+    for (std::vector<LoRaWANChannel>::const_iterator it = LoRaWAN::m_supportedChannels.begin (); it != LoRaWAN::m_supportedChannels.end (); ++it)
+      {
+        for (uint8_t i = 0; i < LORAWAN_NR_TX_POWER_LEVELS; i++)
+          m_txPsds[i].push_back (psdHelper.CreateTxPowerSpectralDensity (g_LoRaWANTxPowerLevels[i], it->m_fc));
+
+        m_noisePsds.push_back (psdHelper.CreateNoisePowerSpectralDensity (it->m_fc));
+      }
+  }
+
+  /**
+   * Transmit PSDs indexed by [power level index][channel index]
+   */
+  std::vector<Ptr<const SpectrumValue> > m_txPsds[LORAWAN_NR_TX_POWER_LEVELS];
+
+  /**
+   * Noise PSDs indexed by channel index
+   */
+  std::vector<Ptr<const SpectrumValue> > m_noisePsds;
+};
+
+/**
+ * The cache is created on first use rather than during static
+ * initialization, as it depends on LoRaWAN::m_supportedChannels.
+ *
+ * \return the object that stores the shared PSDs
+ */
+static const LoRaWANPsdCache &
+GetLoRaWANPsdCache (void)
+{
+  static const LoRaWANPsdCache cache;
+  return cache;
+}
+
 /* ... */
 LoRaWANSpectrumValueHelper::LoRaWANSpectrumValueHelper(void)
 {
@@ -132,6 +182,29 @@ LoRaWANSpectrumValueHelper::CreateNoisePowerSpectralDensity (uint32_t freq)
   return noisePsd;
 }
 
+Ptr<const SpectrumValue>
+LoRaWANSpectrumValueHelper::GetTxPowerSpectralDensity (double txPower, uint8_t channelIndex)
+{
+  NS_ASSERT (channelIndex < LoRaWAN::m_supportedChannels.size ());
+
+  for (uint8_t i = 0; i < LORAWAN_NR_TX_POWER_LEVELS; i++)
+    {
+      if (txPower == g_LoRaWANTxPowerLevels[i])
+        return GetLoRaWANPsdCache ().m_txPsds[i][channelIndex];
+    }
+
+  NS_LOG_LOGIC ("LoRaWANSpectrumValueHelper::GetTxPowerSpectralDensity: creating PSD for power level " << txPower << " dBm");
+  LoRaWANSpectrumValueHelper psdHelper;
+  return psdHelper.CreateTxPowerSpectralDensity (txPower, LoRaWAN::m_supportedChannels[channelIndex].m_fc);
+}
+
+Ptr<const SpectrumValue>
+LoRaWANSpectrumValueHelper::GetNoisePowerSpectralDensity (uint8_t channelIndex)
+{
+  NS_ASSERT (channelIndex < LoRaWAN::m_supportedChannels.size ());
+  return GetLoRaWANPsdCache ().m_noisePsds[channelIndex];
+}
+
 uint32_t
 LoRaWANSpectrumValueHelper::GetPsdIndexForCenterFrequency(uint32_t freq)
 {
@@ -165,4 +238,14 @@ LoRaWANSpectrumValueHelper::TotalAvgPower (Ptr<const SpectrumValue> psd, uint32_
   return totalAvgPower;
 }
 
+double
+LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (Ptr<const SpectrumValue> psd, uint8_t channelIndex)
+{
+  NS_ASSERT (psd->GetSpectrumModel () == g_LoRaWANSpectrumModel);
+  NS_ASSERT (channelIndex < LoRaWAN::m_supportedChannels.size ());
+
+  // the bands of g_LoRaWANSpectrumModel follow the order of LoRaWAN::m_supportedChannels
+  return (*psd)[channelIndex] * 125e3;
+}
+
 } // namespace ns3
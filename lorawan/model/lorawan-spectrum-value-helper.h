@@ -63,6 +63,35 @@ public:
    */
   static double TotalAvgPower (Ptr<const SpectrumValue> psd, uint32_t channel);
 
+  /**
+   * \brief total average power of the signal in the band of a LoRaWAN channel,
+   * same as TotalAvgPower but without looking up the band of the channel
+   * \param psd spectral density
+   * \param channelIndex the index of the channel in LoRaWAN::m_supportedChannels
+   * \return total power
+   */
+  static double TotalAvgPowerForChannelIndex (Ptr<const SpectrumValue> psd, uint8_t channelIndex);
+
+  /**
+   * \brief get the shared transmit PSD for one of the LoRaWAN power levels
+   *
+   * The PSDs for all legal power levels (see LoRaWANPhy::SetTxConf) on all
+   * channels are created once and shared by all PHYs, so they must not be
+   * modified. Other power levels result in a newly created SpectrumValue.
+   *
+   * \param txPower the power transmission in dBm
+   * \param channelIndex the index of the channel in LoRaWAN::m_supportedChannels
+   * \return the PSD of a transmission at txPower on the channel
+   */
+  static Ptr<const SpectrumValue> GetTxPowerSpectralDensity (double txPower, uint8_t channelIndex);
+
+  /**
+   * \brief get the shared noise PSD, i.e. the noise in the band of a channel
+   * \param channelIndex the index of the channel in LoRaWAN::m_supportedChannels
+   * \return the noise PSD for the channel, which must not be modified
+   */
+  static Ptr<const SpectrumValue> GetNoisePowerSpectralDensity (uint8_t channelIndex);
+
 private:
   static uint32_t GetPsdIndexForCenterFrequency(uint32_t freq);
   /**
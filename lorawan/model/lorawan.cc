@@ -20,6 +20,10 @@
 #include "lorawan.h"
 #include <ns3/log.h>
 
+#include <cmath>
+#include <algorithm>
+#include <limits>
+
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("LoRaWAN");
@@ -64,6 +68,100 @@ LoRaWAN::GetRX1DataRateIndex (uint8_t upstreamDRIndex, uint8_t rx1DROffset)
     return upstreamDRIndex;
   }
 }
+
+#define LORAWAN_TOA_NR_SF 7 // SF6 up to SF12
+#define LORAWAN_TOA_NR_BW 3
+#define LORAWAN_TOA_NR_CR 4
+#define LORAWAN_TOA_NR_PAYLOAD_LENGTHS 256
+
+static const uint32_t g_LoRaWANTimeOnAirBandwidths[LORAWAN_TOA_NR_BW] = { 125000, 250000, 500000 };
+
+/**
+ * The symbol period in microseconds, indexed by [SF-6][bandwidth index]
+ */
+static double g_LoRaWANSymbolPeriods[LORAWAN_TOA_NR_SF][LORAWAN_TOA_NR_BW];
+
+/**
+ * The number of symbols after the preamble (i.e. header, payload and CRC),
+ * indexed by [SF-6][CR-1][CRC on][implicit header][low data rate optimization][payload length]
+ */
+static uint16_t g_LoRaWANPayloadSymbols[LORAWAN_TOA_NR_SF][LORAWAN_TOA_NR_CR][2][2][2][LORAWAN_TOA_NR_PAYLOAD_LENGTHS];
+
+/**
+ * \ingroup lorawan
+ * \brief Helper class used to automatically fill the time on air tables
+ */
+class LoRaWANTimeOnAirTableInitializer
+{
+public:
+  LoRaWANTimeOnAirTableInitializer (void)
+  {
+    for (uint8_t i = 0; i < LORAWAN_TOA_NR_SF; i++)
+      {
+        const uint32_t sf = i + LORAWAN_SF6;
+        for (uint8_t j = 0; j < LORAWAN_TOA_NR_BW; j++)
+          {
+            double symbolRate = ((double)g_LoRaWANTimeOnAirBandwidths[j])/pow(2.0, sf);
+            g_LoRaWANSymbolPeriods[i][j] = 1.0e6/symbolRate;
+          }
+
+        for (uint8_t cr = 1; cr <= LORAWAN_TOA_NR_CR; cr++)
+          for (uint32_t crc = 0; crc <= 1; crc++)
+            for (uint32_t implicitHeader = 0; implicitHeader <= 1; implicitHeader++)
+              for (uint32_t de = 0; de <= 1; de++)
+                for (uint32_t payloadLength = 0; payloadLength < LORAWAN_TOA_NR_PAYLOAD_LENGTHS; payloadLength++)
+                  {
+                    uint16_t nSymbolsPayload = 8;
+                    double nConditionalSymbolsPayload = ceil((8.0*payloadLength - 4.0*sf + 28 + 16*crc - 20*implicitHeader)/4.0/((double)sf - 2*de))*(cr + 4);
+                    if (nConditionalSymbolsPayload > 0.0)
+                      nSymbolsPayload += nConditionalSymbolsPayload;
+                    g_LoRaWANPayloadSymbols[i][cr - 1][crc][implicitHeader][de][payloadLength] = nSymbolsPayload;
+                  }
+      }
+  }
+} g_LoRaWANTimeOnAirTableInitializerInstance; //!< Global object used to initialize the time on air tables
+
+/**
+ * \return the index of a bandwidth in g_LoRaWANTimeOnAirBandwidths
+ */
+static uint8_t
+GetTimeOnAirBandwidthIndex (uint32_t bandwidth)
+{
+  switch (bandwidth)
+    {
+    case 125000:
+      return 0;
+    case 250000:
+      return 1;
+    case 500000:
+      return 2;
+    default:
+      NS_FATAL_ERROR ("Unsupported bandwidth " << bandwidth);
+      return 0;
+    }
+}
+
+double
+LoRaWAN::GetSymbolPeriod (LoRaSpreadingFactor spreadingFactor, uint32_t bandwidth)
+{
+  NS_ASSERT (spreadingFactor >= LORAWAN_SF6 && spreadingFactor <= LORAWAN_SF12);
+  return g_LoRaWANSymbolPeriods[spreadingFactor - LORAWAN_SF6][GetTimeOnAirBandwidthIndex (bandwidth)];
+}
+
+Time
+LoRaWAN::GetTimeOnAir (LoRaSpreadingFactor spreadingFactor, uint32_t bandwidth, uint8_t codeRate, uint8_t preambleLength, bool crcOn, bool implicitHeader, uint8_t payloadLength, bool lowDataRateOptimization)
+{
+  NS_ASSERT (spreadingFactor >= LORAWAN_SF6 && spreadingFactor <= LORAWAN_SF12);
+  NS_ASSERT (codeRate >= 1 && codeRate <= LORAWAN_TOA_NR_CR);
+
+  const uint8_t sfIndex = spreadingFactor - LORAWAN_SF6;
+  const double symbolPeriod = g_LoRaWANSymbolPeriods[sfIndex][GetTimeOnAirBandwidthIndex (bandwidth)];
+  const double nSymbolsPreamble = preambleLength + 4.25;
+  const uint16_t nSymbolsPayload = g_LoRaWANPayloadSymbols[sfIndex][codeRate - 1][crcOn][implicitHeader][lowDataRateOptimization][payloadLength];
+
+  return MicroSeconds ((nSymbolsPreamble + nSymbolsPayload) * symbolPeriod);
+}
+
 /****************************************************************************
  ************************ LoRaWANMsgTypeTag *********************************
  ****************************************************************************/
@@ -127,7 +225,8 @@ LoRaWANMsgTypeTag::Print (std::ostream &os) const
  *********************** LoRaWANPhyParamsTag ************************************
  ****************************************************************************/
 
-LoRaWANPhyParamsTag::LoRaWANPhyParamsTag () {}
+LoRaWANPhyParamsTag::LoRaWANPhyParamsTag ()
+  : m_rssi (0), m_snr (0), m_gatewayId (0), m_timestamp (0) {}
 
 void
 LoRaWANPhyParamsTag::SetChannelIndex (uint8_t index)
@@ -177,6 +276,27 @@ LoRaWANPhyParamsTag::GetPreambleLength (void) const
   return m_preambleLength;
 }
 
+void
+LoRaWANPhyParamsTag::SetRxMetadata (const LoRaWANRxMetadata &metadata)
+{
+  const double limit = std::numeric_limits<int16_t>::max () / 100.0;
+  m_rssi = static_cast<int16_t> (std::round (std::max (-limit, std::min (limit, metadata.m_rssi)) * 100));
+  m_snr = static_cast<int16_t> (std::round (std::max (-limit, std::min (limit, metadata.m_snr)) * 100));
+  m_gatewayId = metadata.m_gatewayId;
+  m_timestamp = metadata.m_timestamp.GetNanoSeconds ();
+}
+
+LoRaWANRxMetadata
+LoRaWANPhyParamsTag::GetRxMetadata (void) const
+{
+  LoRaWANRxMetadata metadata;
+  metadata.m_rssi = m_rssi / 100.0;
+  metadata.m_snr = m_snr / 100.0;
+  metadata.m_gatewayId = m_gatewayId;
+  metadata.m_timestamp = NanoSeconds (m_timestamp);
+  return metadata;
+}
+
 TypeId
 LoRaWANPhyParamsTag::GetTypeId (void)
 {
@@ -197,7 +317,7 @@ LoRaWANPhyParamsTag::GetInstanceTypeId (void) const
 uint32_t
 LoRaWANPhyParamsTag::GetSerializedSize (void) const
 {
-  return 4 * sizeof (uint8_t);
+  return 4 * sizeof (uint8_t) + 2 * sizeof (int16_t) + sizeof (uint32_t) + sizeof (int64_t);
 }
 
 void
@@ -207,6 +327,10 @@ LoRaWANPhyParamsTag::Serialize (TagBuffer i) const
   i.WriteU8 (m_dataRateIndex);
   i.WriteU8 (m_codeRate);
   i.WriteU8 (m_preambleLength);
+  i.WriteU16 (static_cast<uint16_t> (m_rssi));
+  i.WriteU16 (static_cast<uint16_t> (m_snr));
+  i.WriteU32 (m_gatewayId);
+  i.WriteU64 (static_cast<uint64_t> (m_timestamp));
 }
 
 void
@@ -216,6 +340,10 @@ LoRaWANPhyParamsTag::Deserialize (TagBuffer i)
   m_dataRateIndex = i.ReadU8();
   m_codeRate = i.ReadU8();
   m_preambleLength = i.ReadU8();
+  m_rssi = static_cast<int16_t> (i.ReadU16 ());
+  m_snr = static_cast<int16_t> (i.ReadU16 ());
+  m_gatewayId = i.ReadU32 ();
+  m_timestamp = static_cast<int64_t> (i.ReadU64 ());
 }
 
 void
@@ -23,6 +23,7 @@
 #include <ns3/uinteger.h>
 #include <ns3/packet.h>
 #include <ns3/flow-id-tag.h>
+#include <ns3/nstime.h>
 
 #include <vector>
 
@@ -112,6 +113,22 @@ namespace ns3 {
    LORAWAN_BEACON,
   } LoRaWANMsgType;
 
+  /**
+   * \ingroup lorawan
+   *
+   * Metadata of a received frame, passed up from the PHY to the network
+   * server
+   */
+  struct LoRaWANRxMetadata
+  {
+    LoRaWANRxMetadata () : m_rssi (0), m_snr (0), m_gatewayId (0), m_timestamp (0) {}
+
+    double m_rssi;        //!< Received signal strength in dBm
+    double m_snr;         //!< SINR of the reception in dB
+    uint32_t m_gatewayId; //!< Id of the node that received the frame
+    Time m_timestamp;     //!< Time at which the reception of the frame started
+  };
+
   class LoRaWAN {
 
   public:
@@ -137,6 +154,32 @@ namespace ns3 {
     static uint8_t m_RW2ChannelIndex;
     static uint8_t m_RW2DataRateIndex;
 
+    /**
+     * Get the time on air of a LoRa frame, calculated per $4.1.1.7 'Time on
+     * air' in the sx1272 data sheet. The LoRaWAN PHY and MAC do not use low
+     * data rate optimization (DE). The number of symbols of every possible
+     * frame is looked up in a table that is built at startup, so this can be
+     * called from planning tools without a LoRaWANPhy instance.
+     *
+     * \param spreadingFactor SF6 up to SF12
+     * \param bandwidth 125kHz, 250kHz or 500kHz
+     * \param codeRate 1 up to 4 (i.e. 4/5 up to 4/8)
+     * \param preambleLength the number of programmed preamble symbols
+     * \param crcOn whether the payload CRC is present
+     * \param implicitHeader whether the frame has no explicit header
+     * \param payloadLength the length of the PHY payload in bytes
+     * \param lowDataRateOptimization whether low data rate optimization (DE) is enabled
+     * \return the time on air of the frame
+     */
+    static Time GetTimeOnAir (LoRaSpreadingFactor spreadingFactor, uint32_t bandwidth, uint8_t codeRate, uint8_t preambleLength, bool crcOn, bool implicitHeader, uint8_t payloadLength, bool lowDataRateOptimization = false);
+
+    /**
+     * \param spreadingFactor SF6 up to SF12
+     * \param bandwidth 125kHz, 250kHz or 500kHz
+     * \return the duration of a single LoRa symbol in microseconds
+     */
+    static double GetSymbolPeriod (LoRaSpreadingFactor spreadingFactor, uint32_t bandwidth);
+
   }; // class LoRaWAN
 
   class LoRaWANMsgTypeTag : public Tag {
@@ -186,6 +229,12 @@ namespace ns3 {
     void SetPreambleLength (uint8_t);
     uint8_t GetPreambleLength (void) const;
 
+    /**
+     * The RSSI and SNR are carried with a resolution of 0.01 dB
+     */
+    void SetRxMetadata (const LoRaWANRxMetadata &);
+    LoRaWANRxMetadata GetRxMetadata (void) const;
+
     /**
      * \brief Get the type ID.
      * \return the object TypeId
@@ -212,6 +261,11 @@ namespace ns3 {
     uint8_t m_codeRate;
 
     uint8_t m_preambleLength;
+
+    int16_t m_rssi; //!< in 0.01 dBm
+    int16_t m_snr;  //!< in 0.01 dB
+    uint32_t m_gatewayId;
+    int64_t m_timestamp; //!< in ns
   }; // class LoRaWANPhyParamsTag
 
   typedef FlowIdTag LoRaWANPhyTraceIdTag;
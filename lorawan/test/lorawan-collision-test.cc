@@ -0,0 +1,232 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include <ns3/test.h>
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/boolean.h>
+#include <ns3/packet.h>
+#include <ns3/propagation-loss-model.h>
+#include <ns3/propagation-delay-model.h>
+#include <ns3/constant-position-mobility-model.h>
+#include <ns3/lorawan-module.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("lorawan-collision-test");
+
+static void
+IgnoreDestroyed (void)
+{
+}
+
+// Create a collision model PHY that is attached to the channel and tuned to channel 0 at SF7
+static Ptr<LoRaWANCollisionPhy>
+CreatePhy (Ptr<LoRaWANCollisionChannel> channel, Vector position, bool invertedIq)
+{
+  Ptr<LoRaWANCollisionPhy> phy = CreateObject<LoRaWANCollisionPhy> ();
+  phy->SetAttribute ("InvertedIq", BooleanValue (invertedIq));
+  Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+  mobility->SetPosition (position);
+  phy->SetMobility (mobility);
+  phy->SetErrorModel (CreateObject<LoRaWANErrorModel> ());
+  phy->SetPdDataDestroyedCallback (MakeCallback (&IgnoreDestroyed));
+  phy->SetTxConf (14, 0, 5, 3, 8, false, true);
+  phy->SetChannel (channel);
+  channel->AddRx (phy);
+  return phy;
+}
+
+static void
+Transmit (Ptr<LoRaWANPhy> phy, uint32_t size)
+{
+  Ptr<Packet> p = Create<Packet> (size);
+  phy->SetTRXStateRequest (LORAWAN_PHY_TX_ON);
+  phy->PdDataRequest (p->GetSize (), p);
+}
+
+static void
+RecordLqi (std::vector<double> *lqis, Ptr<const Packet> p, double lqi)
+{
+  lqis->push_back (lqi);
+}
+
+static void
+RecordDropReason (std::vector<LoRaWANPhyDropRxReason> *reasons, Ptr<const Packet> p, LoRaWANPhyDropRxReason reason)
+{
+  reasons->push_back (reason);
+}
+
+// ==============================================================================
+class LoRaWANCollisionCaptureTestCase : public TestCase
+{
+public:
+  LoRaWANCollisionCaptureTestCase ();
+  virtual ~LoRaWANCollisionCaptureTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * Let two end devices transmit at the same time with the same spreading
+   * factor and record the outcome at a receiver at the origin. The device at
+   * distance is the nearest and is received first.
+   */
+  void Collide (double distance, double interfererDistance);
+
+  std::vector<double> m_lqis;                         //!< the LQI of every frame at the end of its reception
+  std::vector<LoRaWANPhyDropRxReason> m_dropReasons;  //!< the reason of every dropped frame
+};
+
+LoRaWANCollisionCaptureTestCase::LoRaWANCollisionCaptureTestCase ()
+  : TestCase ("Test that overlapping frames with the same spreading factor are only received above the capture threshold")
+{
+}
+
+LoRaWANCollisionCaptureTestCase::~LoRaWANCollisionCaptureTestCase ()
+{
+}
+
+void
+LoRaWANCollisionCaptureTestCase::Collide (double distance, double interfererDistance)
+{
+  m_lqis.clear ();
+  m_dropReasons.clear ();
+
+  Ptr<LoRaWANCollisionChannel> channel = CreateObject<LoRaWANCollisionChannel> ();
+  channel->AddPropagationLossModel (CreateObject<LogDistancePropagationLossModel> ());
+  channel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+
+  Ptr<LoRaWANCollisionPhy> receiver = CreatePhy (channel, Vector (0, 0, 0), true);
+  Ptr<LoRaWANCollisionPhy> sender = CreatePhy (channel, Vector (distance, 0, 0), false);
+  Ptr<LoRaWANCollisionPhy> interferer = CreatePhy (channel, Vector (0, interfererDistance, 0), false);
+  receiver->TraceConnectWithoutContext ("PhyRxEnd", MakeBoundCallback (&RecordLqi, &m_lqis));
+  receiver->TraceConnectWithoutContext ("PhyRxDrop", MakeBoundCallback (&RecordDropReason, &m_dropReasons));
+  receiver->SetTRXStateRequest (LORAWAN_PHY_RX_ON);
+
+  Simulator::Schedule (Seconds (1.0), &Transmit, sender, 20);
+  Simulator::Schedule (Seconds (1.0), &Transmit, interferer, 20);
+  Simulator::Run ();
+  Simulator::Destroy ();
+}
+
+void
+LoRaWANCollisionCaptureTestCase::DoRun (void)
+{
+  // With the default log distance exponent of 3, ten times the distance is 30 dB weaker
+  Collide (10, 100);
+  NS_TEST_ASSERT_MSG_EQ (m_lqis.size (), 1, "The receiver should lock onto the nearest frame");
+  NS_TEST_ASSERT_MSG_EQ (m_lqis.front (), 255, "A frame 30 dB stronger than the interferer should be captured");
+  NS_TEST_ASSERT_MSG_EQ (m_dropReasons.size (), 1, "Only the interfering frame should be dropped");
+  NS_TEST_ASSERT_MSG_EQ (m_dropReasons.front (), LORAWAN_RX_DROP_PHY_BUSY_RX, "The interfering frame should arrive while the receiver is busy");
+
+  // 10% further away is only about 1.2 dB weaker, below the 6 dB capture threshold
+  Collide (100, 110);
+  NS_TEST_ASSERT_MSG_EQ (m_lqis.size (), 1, "The receiver should lock onto the nearest frame");
+  NS_TEST_ASSERT_MSG_EQ (m_lqis.front (), 0, "A frame less than 6 dB stronger than the interferer should be destroyed");
+  NS_TEST_ASSERT_MSG_EQ (m_dropReasons.size (), 2, "Both frames should be dropped");
+  NS_TEST_ASSERT_MSG_EQ (m_dropReasons.back (), LORAWAN_RX_DROP_PACKET_DESTOYED, "The frame should be destroyed by the collision");
+}
+
+// ==============================================================================
+class LoRaWANCollisionTrxOffTestCase : public TestCase
+{
+public:
+  LoRaWANCollisionTrxOffTestCase ();
+  virtual ~LoRaWANCollisionTrxOffTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * Let a nearby interferer transmit while the receiver is switched off, switch
+   * the receiver on and let a distant end device transmit before the
+   * interfering frame ends.
+   */
+  void ReceiveAfterSwitchOn (bool skipTrxOffReceivers);
+
+  std::vector<double> m_lqis;                         //!< the LQI of every frame at the end of its reception
+  std::vector<LoRaWANPhyDropRxReason> m_dropReasons;  //!< the reason of every dropped frame
+};
+
+LoRaWANCollisionTrxOffTestCase::LoRaWANCollisionTrxOffTestCase ()
+  : TestCase ("Test the delivery of transmissions to switched off receivers")
+{
+}
+
+LoRaWANCollisionTrxOffTestCase::~LoRaWANCollisionTrxOffTestCase ()
+{
+}
+
+void
+LoRaWANCollisionTrxOffTestCase::ReceiveAfterSwitchOn (bool skipTrxOffReceivers)
+{
+  m_lqis.clear ();
+  m_dropReasons.clear ();
+
+  Ptr<LoRaWANCollisionChannel> channel = CreateObject<LoRaWANCollisionChannel> ();
+  channel->SetAttribute ("SkipTrxOffReceivers", BooleanValue (skipTrxOffReceivers));
+  channel->AddPropagationLossModel (CreateObject<LogDistancePropagationLossModel> ());
+  channel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+
+  Ptr<LoRaWANCollisionPhy> receiver = CreatePhy (channel, Vector (0, 0, 0), true);
+  Ptr<LoRaWANCollisionPhy> sender = CreatePhy (channel, Vector (100, 0, 0), false);
+  Ptr<LoRaWANCollisionPhy> interferer = CreatePhy (channel, Vector (0, 10, 0), false);
+  receiver->TraceConnectWithoutContext ("PhyRxEnd", MakeBoundCallback (&RecordLqi, &m_lqis));
+  receiver->TraceConnectWithoutContext ("PhyRxDrop", MakeBoundCallback (&RecordDropReason, &m_dropReasons));
+
+  // A 20 byte frame at SF7 is on air for more than 50 ms
+  Simulator::Schedule (Seconds (1.0), &Transmit, interferer, 20);
+  Simulator::Schedule (Seconds (1.01), &LoRaWANPhy::SetTRXStateRequest, receiver, LORAWAN_PHY_RX_ON);
+  Simulator::Schedule (Seconds (1.03), &Transmit, sender, 20);
+  Simulator::Run ();
+  Simulator::Destroy ();
+}
+
+void
+LoRaWANCollisionTrxOffTestCase::DoRun (void)
+{
+  ReceiveAfterSwitchOn (true);
+  NS_TEST_ASSERT_MSG_EQ (m_dropReasons.size (), 0, "A skipped transmission should not be traced");
+  NS_TEST_ASSERT_MSG_EQ (m_lqis.size (), 1, "The receiver should lock onto the distant frame");
+  NS_TEST_ASSERT_MSG_EQ (m_lqis.front (), 255, "A skipped transmission should not interfere");
+
+  // Without the skip the traces match those of LoRaWANPhy
+  ReceiveAfterSwitchOn (false);
+  NS_TEST_ASSERT_MSG_EQ (m_dropReasons.size (), 2, "Both frames should be dropped");
+  NS_TEST_ASSERT_MSG_EQ (m_dropReasons.front (), LORAWAN_RX_DROP_NOT_IN_RX_STATE, "The interfering frame should arrive while the receiver is off");
+  NS_TEST_ASSERT_MSG_EQ (m_lqis.size (), 1, "The receiver should lock onto the distant frame");
+  NS_TEST_ASSERT_MSG_EQ (m_lqis.front (), 0, "The frame should be destroyed by the interferer that started while the receiver was off");
+}
+
+// ==============================================================================
+class LoRaWANCollisionTestSuite : public TestSuite
+{
+public:
+  LoRaWANCollisionTestSuite ();
+};
+
+LoRaWANCollisionTestSuite::LoRaWANCollisionTestSuite ()
+  : TestSuite ("lorawan-collision", UNIT)
+{
+  AddTestCase (new LoRaWANCollisionCaptureTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANCollisionTrxOffTestCase, TestCase::QUICK);
+}
+
+static LoRaWANCollisionTestSuite lorawanCollisionTestSuite;
@@ -0,0 +1,128 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include <ns3/test.h>
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/boolean.h>
+#include <ns3/string.h>
+#include <ns3/nstime.h>
+#include <ns3/node-container.h>
+#include <ns3/packet-socket-helper.h>
+#include <ns3/mobility-helper.h>
+#include <ns3/lorawan-module.h>
+#include <map>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("lorawan-enddevice-application-test");
+
+static void
+RecordPingSlot (std::vector<Time> *pingSlots, LoRaWANMacState oldState, LoRaWANMacState newState)
+{
+  if (newState == MAC_CLASS_B_PACKET)
+    pingSlots->push_back (Simulator::Now ());
+}
+
+// ==============================================================================
+class LoRaWANEndDeviceClassBPingSlotTestCase : public TestCase
+{
+public:
+  LoRaWANEndDeviceClassBPingSlotTestCase ();
+  virtual ~LoRaWANEndDeviceClassBPingSlotTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANEndDeviceClassBPingSlotTestCase::LoRaWANEndDeviceClassBPingSlotTestCase ()
+  : TestCase ("Test the chaining of the ping slots of a Class B end device and their end after 57 missed beacons")
+{
+}
+
+LoRaWANEndDeviceClassBPingSlotTestCase::~LoRaWANEndDeviceClassBPingSlotTestCase ()
+{
+}
+
+void
+LoRaWANEndDeviceClassBPingSlotTestCase::DoRun (void)
+{
+  // A single Class B end device without gateway: every beacon is missed, the
+  // device keeps its ping slots going on its own clock for 56 beacon periods
+  NodeContainer nodes;
+  nodes.Create (1);
+  MobilityHelper mobility;
+  mobility.Install (nodes);
+
+  LoRaWANHelper lorawanHelper;
+  NetDeviceContainer devices = lorawanHelper.Install (nodes);
+  PacketSocketHelper packetSocket;
+  packetSocket.Install (nodes);
+
+  // Periodicity 6 (the default) gives 2 ping slots per beacon period; no uplinks are sent
+  LoRaWANEndDeviceHelper endDeviceHelper;
+  endDeviceHelper.SetAttribute ("IsClassB", BooleanValue (true));
+  endDeviceHelper.SetAttribute ("UpstreamIAT", StringValue ("ns3::ConstantRandomVariable[Constant=1000000.0]"));
+  endDeviceHelper.SetAttribute ("UpstreamSend", StringValue ("ns3::ConstantRandomVariable[Constant=1000000.0]"));
+  ApplicationContainer apps = endDeviceHelper.Install (nodes);
+
+  std::vector<Time> pingSlots;
+  Ptr<LoRaWANNetDevice> device = DynamicCast<LoRaWANNetDevice> (devices.Get (0));
+  device->GetMac ()->TraceConnectWithoutContext ("MacState", MakeBoundCallback (&RecordPingSlot, &pingSlots));
+
+  const Time beaconPeriod = Seconds (128);
+  Simulator::Stop (beaconPeriod * 60);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (pingSlots.size (), 56 * 2, "Expected 2 ping slots in each of the 56 beacon periods before Class B is lost");
+
+  std::map<int64_t, std::vector<Time> > perBeaconPeriod;
+  for (auto &t : pingSlots)
+    perBeaconPeriod[t.GetTimeStep () / beaconPeriod.GetTimeStep ()].push_back (t);
+  NS_TEST_ASSERT_MSG_EQ (perBeaconPeriod.size (), 56, "Every beacon period with Class B should have ping slots");
+  for (auto &period : perBeaconPeriod)
+    {
+      NS_TEST_ASSERT_MSG_EQ (((period.first >= 1) && (period.first <= 56)), true, "Ping slots should only follow beacons 1 to 56");
+      NS_TEST_ASSERT_MSG_EQ (period.second.size (), 2, "Each ping slot should chain to the next one of its beacon period");
+      if (period.second.size () == 2)
+        NS_TEST_ASSERT_MSG_EQ (period.second[1] - period.second[0], MilliSeconds (2048 * 30), "The ping slots should be one ping period apart");
+    }
+
+  // After the 57th missed beacon the device drops back to Class A
+  BooleanValue isClassB;
+  apps.Get (0)->GetAttribute ("IsClassB", isClassB);
+  NS_TEST_ASSERT_MSG_EQ (isClassB.Get (), false, "The device should have turned to Class A");
+
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANEndDeviceApplicationTestSuite : public TestSuite
+{
+public:
+  LoRaWANEndDeviceApplicationTestSuite ();
+};
+
+LoRaWANEndDeviceApplicationTestSuite::LoRaWANEndDeviceApplicationTestSuite ()
+  : TestSuite ("lorawan-enddevice-application", UNIT)
+{
+  AddTestCase (new LoRaWANEndDeviceClassBPingSlotTestCase, TestCase::QUICK);
+}
+
+static LoRaWANEndDeviceApplicationTestSuite lorawanEndDeviceApplicationTestSuite;
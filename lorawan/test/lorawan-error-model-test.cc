@@ -196,6 +196,67 @@ LoRaWANErrorModelTestCase::DoRun (void)
 
 }
 
+// ==============================================================================
+class LoRaWANErrorModelTableTestCase : public TestCase
+{
+public:
+  LoRaWANErrorModelTableTestCase ();
+  virtual ~LoRaWANErrorModelTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANErrorModelTableTestCase::LoRaWANErrorModelTableTestCase ()
+  : TestCase ("Test the tabulated chunk success rate against the BER curves")
+{
+}
+
+LoRaWANErrorModelTableTestCase::~LoRaWANErrorModelTableTestCase ()
+{
+}
+
+void
+LoRaWANErrorModelTableTestCase::DoRun (void)
+{
+  Ptr<LoRaWANErrorModel> model = CreateObject<LoRaWANErrorModel> ();
+  uint32_t bandwidth = 125e3;
+  const uint32_t nbits[] = { 1, 8, 160, 2000, 20000 };
+
+  for (uint8_t sf = LORAWAN_SF7; sf <= LORAWAN_SF12; sf++)
+    {
+      LoRaSpreadingFactor spreadingFactor = static_cast <LoRaSpreadingFactor> (sf);
+      for (uint8_t codeRate = 1; codeRate <= 3; codeRate += 2)
+        {
+          // step through the SNR off the table grid, and beyond the curves
+          for (double snr = -30.0; snr <= 3.0; snr += 0.0173)
+            {
+              double ber = model->getBER (snr, bandwidth, spreadingFactor, codeRate);
+              for (uint32_t i = 0; i < sizeof (nbits) / sizeof (nbits[0]); i++)
+                {
+                  double expected = pow (1.0 - ber, nbits[i]);
+                  double csr = model->GetChunkSuccessRate (snr, nbits[i], bandwidth, spreadingFactor, codeRate);
+                  NS_TEST_ASSERT_MSG_EQ_TOL (csr, expected, 5.0e-4, "Chunk success rate fails for SF" << static_cast<uint32_t> (sf) << " CR" << static_cast<uint32_t> (codeRate) << " SNR = " << snr << " nbits = " << nbits[i]);
+                }
+            }
+        }
+    }
+
+  // The batch interface has to return the same values as the scalar one
+  const uint32_t n = 4;
+  double snrs[n] = { -25.0, -12.3, -7.5, 2.0 };
+  uint32_t chunkBits[n] = { 400, 20, 160, 8 };
+  LoRaSpreadingFactor spreadingFactors[n] = { LORAWAN_SF12, LORAWAN_SF9, LORAWAN_SF7, LORAWAN_SF10 };
+  uint8_t codeRates[n] = { 3, 1, 3, 1 };
+  double successRates[n];
+  model->GetChunkSuccessRates (n, snrs, chunkBits, spreadingFactors, codeRates, successRates);
+  for (uint32_t i = 0; i < n; i++)
+    {
+      double csr = model->GetChunkSuccessRate (snrs[i], chunkBits[i], bandwidth, spreadingFactors[i], codeRates[i]);
+      NS_TEST_ASSERT_MSG_EQ (successRates[i], csr, "Batch chunk success rate differs for element " << i);
+    }
+}
+
 // ==============================================================================
 class LoRaWANErrorModelTestSuite : public TestSuite
 {
@@ -207,6 +268,7 @@ LoRaWANErrorModelTestSuite::LoRaWANErrorModelTestSuite ()
   : TestSuite ("lorawan-error-model", UNIT)
 {
   AddTestCase (new LoRaWANErrorModelTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANErrorModelTableTestCase, TestCase::QUICK);
   AddTestCase (new LoRaWANErrorDistanceTestCase, TestCase::QUICK);
 }
 
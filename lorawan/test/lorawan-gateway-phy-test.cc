@@ -0,0 +1,298 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include <ns3/test.h>
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/boolean.h>
+#include <ns3/uinteger.h>
+#include <ns3/packet.h>
+#include <ns3/propagation-loss-model.h>
+#include <ns3/propagation-delay-model.h>
+#include <ns3/constant-position-mobility-model.h>
+#include <ns3/single-model-spectrum-channel.h>
+#include <ns3/node.h>
+#include <ns3/lorawan-module.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("lorawan-gateway-phy-test");
+
+static void
+IgnoreDestroyed (void)
+{
+}
+
+// Attach a PHY to the channel at the given position
+static void
+AttachPhy (Ptr<LoRaWANPhy> phy, Ptr<LoRaWANSpectrumChannel> channel, Vector position)
+{
+  Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+  mobility->SetPosition (position);
+  phy->SetMobility (mobility);
+  phy->SetErrorModel (CreateObject<LoRaWANErrorModel> ());
+  phy->SetPdDataDestroyedCallback (MakeCallback (&IgnoreDestroyed));
+  phy->SetChannel (channel);
+  channel->AddRx (phy);
+}
+
+// Create an end device PHY that transmits upstream on channelIndex at SF7
+static Ptr<LoRaWANPhy>
+CreateEndDevicePhy (Ptr<LoRaWANSpectrumChannel> channel, Vector position, uint8_t channelIndex)
+{
+  Ptr<LoRaWANPhy> phy = CreateObject<LoRaWANPhy> (0);
+  AttachPhy (phy, channel, position);
+  phy->SetTxConf (14, channelIndex, 5, 3, 8, false, true);
+  return phy;
+}
+
+static Ptr<LoRaWANSpectrumChannel>
+CreateChannel (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateObject<LoRaWANSpectrumChannel> ();
+  channel->AddPropagationLossModel (CreateObject<LogDistancePropagationLossModel> ());
+  channel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+  return channel;
+}
+
+static void
+Transmit (Ptr<LoRaWANPhy> phy, uint32_t size)
+{
+  Ptr<Packet> p = Create<Packet> (size);
+  phy->SetTRXStateRequest (LORAWAN_PHY_TX_ON);
+  phy->PdDataRequest (p->GetSize (), p);
+}
+
+static void
+CountRxBegin (uint32_t *count, Ptr<const Packet> p)
+{
+  (*count)++;
+}
+
+static void
+RecordDropReason (std::vector<LoRaWANPhyDropRxReason> *reasons, Ptr<const Packet> p, LoRaWANPhyDropRxReason reason)
+{
+  reasons->push_back (reason);
+}
+
+static void
+RecordTime (Time *time, Ptr<const Packet> p)
+{
+  *time = Simulator::Now ();
+}
+
+static void
+IgnoreDataConfirm (LoRaWANDataConfirmParams params)
+{
+}
+
+static void
+IgnoreDataIndication (LoRaWANDataIndicationParams params, Ptr<Packet> p)
+{
+}
+
+static void
+RecordBusyDemodulators (uint32_t *nBusy, Ptr<LoRaWANGatewayPhy> phy)
+{
+  *nBusy = phy->GetNBusyDemodulators ();
+}
+
+// ==============================================================================
+class LoRaWANGatewayPhyDemodulatorTestCase : public TestCase
+{
+public:
+  LoRaWANGatewayPhyDemodulatorTestCase ();
+  virtual ~LoRaWANGatewayPhyDemodulatorTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANGatewayPhyDemodulatorTestCase::LoRaWANGatewayPhyDemodulatorTestCase ()
+  : TestCase ("Test that the gateway PHY drops frames when all demodulators are busy")
+{
+}
+
+LoRaWANGatewayPhyDemodulatorTestCase::~LoRaWANGatewayPhyDemodulatorTestCase ()
+{
+}
+
+void
+LoRaWANGatewayPhyDemodulatorTestCase::DoRun (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateChannel ();
+  Ptr<LoRaWANGatewayPhy> gateway = CreateObject<LoRaWANGatewayPhy> ();
+  gateway->SetAttribute ("Demodulators", UintegerValue (2));
+  gateway->SetAttribute ("InvertedIq", BooleanValue (true));
+  AttachPhy (gateway, channel, Vector (0, 0, 0));
+
+  // Three end devices at the same distance, each on its own channel
+  Ptr<LoRaWANPhy> endDevices[3];
+  endDevices[0] = CreateEndDevicePhy (channel, Vector (100, 0, 0), 0);
+  endDevices[1] = CreateEndDevicePhy (channel, Vector (0, 100, 0), 1);
+  endDevices[2] = CreateEndDevicePhy (channel, Vector (-100, 0, 0), 2);
+
+  uint32_t rxBeginCount = 0;
+  std::vector<LoRaWANPhyDropRxReason> dropReasons;
+  gateway->TraceConnectWithoutContext ("PhyRxBegin", MakeBoundCallback (&CountRxBegin, &rxBeginCount));
+  gateway->TraceConnectWithoutContext ("PhyRxDrop", MakeBoundCallback (&RecordDropReason, &dropReasons));
+  gateway->SetTRXStateRequest (LORAWAN_PHY_RX_ON);
+
+  uint32_t nBusyDuringRx = 0;
+  const Time start = Seconds (1.0);
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      Simulator::Schedule (start, &Transmit, endDevices[i], 20);
+    }
+  Simulator::Schedule (start + endDevices[0]->CalculateTxTime (20) / 2, &RecordBusyDemodulators, &nBusyDuringRx, gateway);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (nBusyDuringRx, 2, "Both demodulators should be locked onto a frame");
+  NS_TEST_ASSERT_MSG_EQ (rxBeginCount, 2, "Only two of the three frames should be received");
+  NS_TEST_ASSERT_MSG_EQ (dropReasons.size (), 1, "The third frame should be dropped");
+  NS_TEST_ASSERT_MSG_EQ (dropReasons.front (), LORAWAN_RX_DROP_NO_DEMODULATOR, "The third frame should be dropped for lack of a demodulator");
+  NS_TEST_ASSERT_MSG_EQ (gateway->GetNBusyDemodulators (), 0, "The demodulators should be released at the end of the frames");
+
+  // The released demodulators can receive the next frame
+  endDevices[2]->SetTRXStateRequest (LORAWAN_PHY_IDLE); // the PHY stays in BUSY_TX after a transmission
+  Simulator::Schedule (Seconds (2.0), &Transmit, endDevices[2], 20);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (rxBeginCount, 3, "A frame after the release of the demodulators should be received");
+  NS_TEST_ASSERT_MSG_EQ (dropReasons.size (), 1, "No other frames should be dropped");
+
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANRadioArbiterTestCase : public TestCase
+{
+public:
+  LoRaWANRadioArbiterTestCase ();
+  virtual ~LoRaWANRadioArbiterTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANRadioArbiterTestCase::LoRaWANRadioArbiterTestCase ()
+  : TestCase ("Test that a gateway transmission aborts receptions on the other PHYs and that waiting MACs transmit afterwards")
+{
+}
+
+LoRaWANRadioArbiterTestCase::~LoRaWANRadioArbiterTestCase ()
+{
+}
+
+void
+LoRaWANRadioArbiterTestCase::DoRun (void)
+{
+  Ptr<SingleModelSpectrumChannel> channel = CreateObject<SingleModelSpectrumChannel> ();
+  channel->AddPropagationLossModel (CreateObject<LogDistancePropagationLossModel> ());
+  channel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+
+  // A gateway with a PHY and MAC per channel and data rate
+  Ptr<Node> gatewayNode = CreateObject<Node> ();
+  Ptr<ConstantPositionMobilityModel> gatewayMobility = CreateObject<ConstantPositionMobilityModel> ();
+  gatewayMobility->SetPosition (Vector (0, 0, 0));
+  gatewayNode->AggregateObject (gatewayMobility);
+  Ptr<LoRaWANNetDevice> gateway = CreateObject<LoRaWANNetDevice> (LORAWAN_DT_GATEWAY);
+  gateway->SetChannel (channel);
+  gatewayNode->AddDevice (gateway);
+  for (auto &mac : gateway->GetMacs ())
+    {
+      mac->SetDataConfirmCallback (MakeCallback (&IgnoreDataConfirm));
+      mac->SetDataIndicationCallback (MakeCallback (&IgnoreDataIndication));
+    }
+
+  // An end device transmits upstream on channel 2 while the gateway starts transmitting
+  Ptr<LoRaWANPhy> endDevice = CreateObject<LoRaWANPhy> (0);
+  Ptr<ConstantPositionMobilityModel> endDeviceMobility = CreateObject<ConstantPositionMobilityModel> ();
+  endDeviceMobility->SetPosition (Vector (100, 0, 0));
+  endDevice->SetMobility (endDeviceMobility);
+  endDevice->SetErrorModel (CreateObject<LoRaWANErrorModel> ());
+  endDevice->SetPdDataDestroyedCallback (MakeCallback (&IgnoreDestroyed));
+  endDevice->SetTxConf (14, 2, 5, 3, 8, false, true);
+  endDevice->SetChannel (channel);
+  channel->AddRx (endDevice);
+
+  uint8_t rxIndex = 0;
+  NS_TEST_ASSERT_MSG_EQ (gateway->getMACSIndexForChannelAndDataRate (rxIndex, 2, 5), true, "No gateway MAC for channel 2 and DR5");
+  Ptr<LoRaWANPhy> rxPhy = gateway->GetPhys ()[rxIndex];
+  uint32_t rxBeginCount = 0;
+  std::vector<LoRaWANPhyDropRxReason> dropReasons;
+  rxPhy->TraceConnectWithoutContext ("PhyRxBegin", MakeBoundCallback (&CountRxBegin, &rxBeginCount));
+  rxPhy->TraceConnectWithoutContext ("PhyRxDrop", MakeBoundCallback (&RecordDropReason, &dropReasons));
+
+  // Two gateway MACs get a downstream frame at the same time. Channel 0 and
+  // the RW2 channel are in different sub bands, so only the radio is shared.
+  uint8_t txIndex[2];
+  const uint8_t txChannelIndex[2] = { 0, LoRaWAN::m_RW2ChannelIndex };
+  Time txBegin[2];
+  Time txEnd[2];
+  const Time start = Seconds (1.0);
+  for (uint32_t i = 0; i < 2; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (gateway->getMACSIndexForChannelAndDataRate (txIndex[i], txChannelIndex[i], 5), true, "No gateway MAC for channel " << (uint16_t)txChannelIndex[i]);
+      Ptr<LoRaWANPhy> txPhy = gateway->GetPhys ()[txIndex[i]];
+      txPhy->TraceConnectWithoutContext ("PhyTxBegin", MakeBoundCallback (&RecordTime, &txBegin[i]));
+      txPhy->TraceConnectWithoutContext ("PhyTxEnd", MakeBoundCallback (&RecordTime, &txEnd[i]));
+
+      LoRaWANDataRequestParams params;
+      params.m_loraWANChannelIndex = txChannelIndex[i];
+      params.m_loraWANDataRateIndex = 5;
+      params.m_loraWANPreambleLength = 8;
+      params.m_loraWANCodeRate = 3;
+      params.m_msgType = LORAWAN_UNCONFIRMED_DATA_DOWN;
+      params.m_requestHandle = i;
+      params.m_numberOfTransmissions = 1;
+      Simulator::Schedule (start, &LoRaWANMac::sendMACPayloadRequest, gateway->GetMacs ()[txIndex[i]], params, Create<Packet> (20));
+    }
+  Simulator::Schedule (start - MilliSeconds (20), &Transmit, endDevice, 20);
+
+  Simulator::Stop (Seconds (5.0));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (rxBeginCount, 1, "The gateway should have started receiving the upstream frame");
+  NS_TEST_ASSERT_MSG_EQ (dropReasons.size (), 1, "The upstream frame should be dropped");
+  NS_TEST_ASSERT_MSG_EQ (dropReasons.front (), LORAWAN_RX_DROP_PACKET_ABORTED, "The gateway transmission should abort the reception on the other PHY");
+
+  NS_TEST_ASSERT_MSG_EQ (txBegin[0], start, "The first MAC should acquire the radio");
+  NS_TEST_ASSERT_MSG_EQ (txEnd[0].IsStrictlyPositive (), true, "The first MAC should finish its transmission");
+  NS_TEST_ASSERT_MSG_EQ (txBegin[1].IsStrictlyPositive (), true, "The waiting MAC should transmit once the radio is available");
+  NS_TEST_ASSERT_MSG_EQ (txBegin[1] >= txEnd[0], true, "The waiting MAC should not transmit before the end of the first transmission");
+
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANGatewayPhyTestSuite : public TestSuite
+{
+public:
+  LoRaWANGatewayPhyTestSuite ();
+};
+
+LoRaWANGatewayPhyTestSuite::LoRaWANGatewayPhyTestSuite ()
+  : TestSuite ("lorawan-gateway-phy", UNIT)
+{
+  AddTestCase (new LoRaWANGatewayPhyDemodulatorTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANRadioArbiterTestCase, TestCase::QUICK);
+}
+
+static LoRaWANGatewayPhyTestSuite lorawanGatewayPhyTestSuite;
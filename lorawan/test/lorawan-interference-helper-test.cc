@@ -0,0 +1,105 @@
+/* -*-  Mode: C++; c-file-style: "gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include <ns3/test.h>
+#include <ns3/log.h>
+#include <ns3/spectrum-value.h>
+#include <ns3/lorawan-module.h>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("lorawan-interference-helper-test");
+
+class LoRaWANInterferenceHelperTestCase : public TestCase
+{
+public:
+  LoRaWANInterferenceHelperTestCase ();
+  virtual ~LoRaWANInterferenceHelperTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANInterferenceHelperTestCase::LoRaWANInterferenceHelperTestCase ()
+  : TestCase ("Test the per channel power accounting of the LoRaWAN interference helper")
+{
+}
+
+LoRaWANInterferenceHelperTestCase::~LoRaWANInterferenceHelperTestCase ()
+{
+}
+
+void
+LoRaWANInterferenceHelperTestCase::DoRun (void)
+{
+  LoRaWANSpectrumValueHelper psdHelper;
+  Ptr<SpectrumValue> psd0 = psdHelper.CreateTxPowerSpectralDensity (14, LoRaWAN::m_supportedChannels[0].m_fc);
+  Ptr<SpectrumValue> psd3 = psdHelper.CreateTxPowerSpectralDensity (2, LoRaWAN::m_supportedChannels[3].m_fc);
+  const double power0 = LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (psd0, 0);
+  const double power3 = LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (psd3, 3);
+  NS_TEST_ASSERT_MSG_EQ_TOL (power0, 0.025118864, 1.0e-9, "14 dBm should be about 25 mW");
+  NS_TEST_ASSERT_MSG_EQ_TOL (power0, LoRaWANSpectrumValueHelper::TotalAvgPower (psd0, LoRaWAN::m_supportedChannels[0].m_fc), 1.0e-15,
+                             "Power for channel index and frequency should be the same");
+
+  Ptr<LoRaWANInterferenceHelper> helper = Create<LoRaWANInterferenceHelper> (psd0->GetSpectrumModel ());
+
+  // Scalar interface
+  helper->AddPower (0, power0);
+  helper->AddPower (0, power0);
+  helper->AddPower (3, power3);
+  NS_TEST_ASSERT_MSG_EQ_TOL (helper->GetPower (0), 2 * power0, 1.0e-15, "Power on channel 0 not accumulated");
+  NS_TEST_ASSERT_MSG_EQ_TOL (helper->GetPower (3), power3, 1.0e-15, "Power on channel 3 not accumulated");
+  NS_TEST_ASSERT_MSG_EQ (helper->GetPower (1), 0.0, "Power leaked into channel 1");
+
+  helper->RemovePower (0, power0);
+  NS_TEST_ASSERT_MSG_EQ_TOL (helper->GetPower (0), power0, 1.0e-15, "Power on channel 0 not removed");
+  helper->RemovePower (0, power0);
+  NS_TEST_ASSERT_MSG_EQ (helper->GetPower (0), 0.0, "Channel 0 should be exactly zero without signals");
+
+  // SpectrumValue interface, mixed with the scalar interface
+  NS_TEST_ASSERT_MSG_EQ (helper->AddSignal (psd0), true, "Signal not added");
+  NS_TEST_ASSERT_MSG_EQ (helper->AddSignal (psd0), false, "Same signal added twice");
+  NS_TEST_ASSERT_MSG_EQ_TOL (helper->GetPower (0), power0, 1.0e-15, "Power of signal not accounted");
+
+  Ptr<SpectrumValue> sum = helper->GetSignalPsd ();
+  NS_TEST_ASSERT_MSG_EQ_TOL (LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (sum, 0), power0, 1.0e-15, "Wrong PSD on channel 0");
+  NS_TEST_ASSERT_MSG_EQ_TOL (LoRaWANSpectrumValueHelper::TotalAvgPowerForChannelIndex (sum, 3), power3, 1.0e-15, "Wrong PSD on channel 3");
+
+  NS_TEST_ASSERT_MSG_EQ (helper->RemoveSignal (psd0), true, "Signal not removed");
+  NS_TEST_ASSERT_MSG_EQ (helper->RemoveSignal (psd0), false, "Signal removed twice");
+  NS_TEST_ASSERT_MSG_EQ (helper->GetPower (0), 0.0, "Channel 0 should be exactly zero without signals");
+
+  helper->ClearSignals ();
+  NS_TEST_ASSERT_MSG_EQ (helper->GetPower (3), 0.0, "Signals not cleared");
+}
+
+// ==============================================================================
+class LoRaWANInterferenceHelperTestSuite : public TestSuite
+{
+public:
+  LoRaWANInterferenceHelperTestSuite ();
+};
+
+LoRaWANInterferenceHelperTestSuite::LoRaWANInterferenceHelperTestSuite ()
+  : TestSuite ("lorawan-interference-helper", UNIT)
+{
+  AddTestCase (new LoRaWANInterferenceHelperTestCase, TestCase::QUICK);
+}
+
+static LoRaWANInterferenceHelperTestSuite lorawanInterferenceHelperTestSuite;
@@ -0,0 +1,652 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include <ns3/test.h>
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/uinteger.h>
+#include <ns3/boolean.h>
+#include <ns3/enum.h>
+#include <ns3/nstime.h>
+#include <ns3/packet.h>
+#include <ns3/node.h>
+#include <ns3/propagation-loss-model.h>
+#include <ns3/propagation-delay-model.h>
+#include <ns3/constant-position-mobility-model.h>
+#include <ns3/lorawan-module.h>
+#include <algorithm>
+#include <set>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("lorawan-mac-test");
+
+static void
+IgnoreDataConfirm (LoRaWANDataConfirmParams params)
+{
+}
+
+static void
+IgnoreDataIndication (LoRaWANDataIndicationParams params, Ptr<Packet> p)
+{
+}
+
+static Ptr<LoRaWANSpectrumChannel>
+CreateChannel (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateObject<LoRaWANSpectrumChannel> ();
+  channel->AddPropagationLossModel (CreateObject<LogDistancePropagationLossModel> ());
+  channel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+  return channel;
+}
+
+// Create a LoRaWANNetDevice on a new node at the given position
+static Ptr<LoRaWANNetDevice>
+CreateDevice (Ptr<SpectrumChannel> channel, LoRaWANDeviceType deviceType, Vector position)
+{
+  Ptr<Node> node = CreateObject<Node> ();
+  Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+  mobility->SetPosition (position);
+  node->AggregateObject (mobility);
+
+  Ptr<LoRaWANNetDevice> device = CreateObject<LoRaWANNetDevice> (deviceType);
+  device->SetChannel (channel);
+  node->AddDevice (device);
+  std::vector<Ptr<LoRaWANMac> > macs;
+  if (deviceType == LORAWAN_DT_GATEWAY)
+    macs = device->GetMacs ();
+  else
+    macs.push_back (device->GetMac ());
+  for (auto &mac : macs)
+    {
+      mac->SetDataConfirmCallback (MakeCallback (&IgnoreDataConfirm));
+      mac->SetDataIndicationCallback (MakeCallback (&IgnoreDataIndication));
+    }
+  return device;
+}
+
+static LoRaWANDataRequestParams
+CreateDataRequestParams (LoRaWANMsgType msgType, uint8_t channelIndex, uint8_t dataRateIndex)
+{
+  LoRaWANDataRequestParams params;
+  params.m_loraWANChannelIndex = channelIndex;
+  params.m_loraWANDataRateIndex = dataRateIndex;
+  params.m_loraWANPreambleLength = 8;
+  params.m_loraWANCodeRate = 3;
+  params.m_msgType = msgType;
+  params.m_requestHandle = 1;
+  params.m_numberOfTransmissions = 1;
+  return params;
+}
+
+static void
+CountPackets (uint32_t *count, Ptr<const Packet> p)
+{
+  (*count)++;
+}
+
+static void
+RecordMacState (std::vector<LoRaWANMacState> *states, LoRaWANMacState oldState, LoRaWANMacState newState)
+{
+  states->push_back (newState);
+}
+
+// Let the gateway MAC send a downstream frame to devAddr just after RW1 of the end device opened
+static void
+SendDownlinkInRW1 (Ptr<LoRaWANMac> gatewayMac, Ipv4Address devAddr, LoRaWANMacState oldState, LoRaWANMacState newState)
+{
+  if (newState != MAC_WAITFORRW1)
+    return;
+
+  LoRaWANFrameHeaderDownlink fhdr;
+  fhdr.setDevAddr (devAddr);
+  Ptr<Packet> p = Create<Packet> (10);
+  p->AddHeader (fhdr);
+  LoRaWANDataRequestParams params = CreateDataRequestParams (LORAWAN_UNCONFIRMED_DATA_DOWN, 0, 5);
+  Simulator::Schedule (MicroSeconds (RECEIVE_DELAY1) + MilliSeconds (1), &LoRaWANMac::sendMACPayloadRequest, gatewayMac, params, p);
+}
+
+// Count how often the receiver is switched on, the Phy also returns to RX_ON at the end of a reception
+static void
+CountRxOn (uint32_t *count, LoRaWANPhyEnumeration oldState, LoRaWANPhyEnumeration newState)
+{
+  if (newState == LORAWAN_PHY_RX_ON && oldState != LORAWAN_PHY_BUSY_RX)
+    (*count)++;
+}
+
+static void
+RecordTrxState (std::vector<std::pair<Time, LoRaWANPhyEnumeration> > *states, LoRaWANPhyEnumeration oldState, LoRaWANPhyEnumeration newState)
+{
+  states->push_back (std::make_pair (Simulator::Now (), newState));
+}
+
+static void
+RecordRxWindow (std::vector<uint8_t> *windows, uint8_t window, Time duration)
+{
+  windows->push_back (window);
+}
+
+static void
+CountCalls (uint32_t *count)
+{
+  (*count)++;
+}
+
+static void
+RecordTxChannel (Ptr<LoRaWANPhy> phy, std::vector<std::pair<Time, uint8_t> > *txs, Ptr<const Packet> p)
+{
+  txs->push_back (std::make_pair (Simulator::Now (), phy->GetCurrentChannelIndex ()));
+}
+
+// Run the simulator until the given delay has passed
+static void
+AdvanceTime (Time delay)
+{
+  Simulator::Stop (delay);
+  Simulator::Run ();
+}
+
+// ==============================================================================
+class LoRaWANMacTxQueueTestCase : public TestCase
+{
+public:
+  LoRaWANMacTxQueueTestCase ();
+  virtual ~LoRaWANMacTxQueueTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANMacTxQueueTestCase::LoRaWANMacTxQueueTestCase ()
+  : TestCase ("Test the order of the priority and normal lanes of the MAC transmit queue")
+{
+}
+
+LoRaWANMacTxQueueTestCase::~LoRaWANMacTxQueueTestCase ()
+{
+}
+
+void
+LoRaWANMacTxQueueTestCase::DoRun (void)
+{
+  LoRaWANMacTxQueue<uint32_t> queue;
+  NS_TEST_ASSERT_MSG_EQ (queue.IsEmpty (), true, "A new queue should be empty");
+
+  queue.Enqueue (false) = 1;
+  queue.Enqueue (false) = 2;
+  queue.Enqueue (true) = 10;
+  NS_TEST_ASSERT_MSG_EQ (queue.GetSize (), 3, "Both lanes should be counted");
+  NS_TEST_ASSERT_MSG_EQ (queue.Peek (), 10, "The priority lane should go first");
+
+  // Peek does not fix the item at the front, a newer priority item is still in the same lane
+  queue.Enqueue (true) = 11;
+  NS_TEST_ASSERT_MSG_EQ (queue.Peek (), 10, "The priority lane should be FIFO");
+  NS_TEST_ASSERT_MSG_EQ (queue.Front (), 10, "Front should return the peeked item");
+  queue.PopFront ();
+  NS_TEST_ASSERT_MSG_EQ (queue.Front (), 11, "The priority lane should be FIFO");
+  queue.PopFront ();
+
+  // A priority item overtakes a peeked item of the normal lane ...
+  NS_TEST_ASSERT_MSG_EQ (queue.Peek (), 1, "The normal lane should go after the priority lane");
+  queue.Enqueue (true) = 20;
+  NS_TEST_ASSERT_MSG_EQ (queue.Peek (), 20, "A priority item should overtake a peeked item");
+  queue.PopFront ();
+
+  // ... but not the item returned by Front
+  NS_TEST_ASSERT_MSG_EQ (queue.Front (), 1, "The normal lane should be FIFO");
+  queue.Enqueue (true) = 21;
+  NS_TEST_ASSERT_MSG_EQ (queue.Front (), 1, "A priority item should not overtake the front item");
+  NS_TEST_ASSERT_MSG_EQ (queue.Peek (), 1, "Peek should return the front item");
+  queue.PopFront ();
+  NS_TEST_ASSERT_MSG_EQ (queue.Front (), 21, "The priority item should be next");
+  queue.PopFront ();
+  NS_TEST_ASSERT_MSG_EQ (queue.Front (), 2, "The normal lane should be FIFO");
+  queue.PopFront ();
+  NS_TEST_ASSERT_MSG_EQ (queue.IsEmpty (), true, "All items should be removed");
+
+  // Nodes are recycled, also beyond a single block
+  for (uint32_t round = 0; round < 2; round++)
+    {
+      for (uint32_t i = 0; i < 20; i++)
+        queue.Enqueue (i % 3 == 0) = i;
+      NS_TEST_ASSERT_MSG_EQ (queue.GetSize (), 20, "All items should be queued");
+      for (uint32_t i = 0; i < 20; i += 3)
+        {
+          NS_TEST_ASSERT_MSG_EQ (queue.Front (), i, "Priority items should be dequeued in order");
+          queue.PopFront ();
+        }
+      for (uint32_t i = 0; i < 20; i++)
+        {
+          if (i % 3 == 0)
+            continue;
+          NS_TEST_ASSERT_MSG_EQ (queue.Front (), i, "Normal items should be dequeued in order");
+          queue.PopFront ();
+        }
+      NS_TEST_ASSERT_MSG_EQ (queue.IsEmpty (), true, "All items should be removed");
+    }
+
+  queue.Enqueue (false) = 1;
+  queue.Enqueue (true) = 2;
+  queue.Front ();
+  queue.Clear ();
+  NS_TEST_ASSERT_MSG_EQ (queue.GetSize (), 0, "Clear should remove all items");
+}
+
+// ==============================================================================
+class LoRaWANMacTxQueueOverflowTestCase : public TestCase
+{
+public:
+  LoRaWANMacTxQueueOverflowTestCase ();
+  virtual ~LoRaWANMacTxQueueOverflowTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANMacTxQueueOverflowTestCase::LoRaWANMacTxQueueOverflowTestCase ()
+  : TestCase ("Test that the MAC drops frames when the transmit queue is full")
+{
+}
+
+LoRaWANMacTxQueueOverflowTestCase::~LoRaWANMacTxQueueOverflowTestCase ()
+{
+}
+
+void
+LoRaWANMacTxQueueOverflowTestCase::DoRun (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateChannel ();
+  Ptr<LoRaWANNetDevice> endDevice = CreateDevice (channel, LORAWAN_DT_END_DEVICE, Vector (0, 0, 0));
+  Ptr<LoRaWANMac> mac = endDevice->GetMac ();
+  mac->SetAttribute ("MaxTxQueueSize", UintegerValue (2));
+
+  uint32_t enqueued = 0;
+  uint32_t overflowed = 0;
+  mac->TraceConnectWithoutContext ("MacTxEnqueue", MakeBoundCallback (&CountPackets, &enqueued));
+  mac->TraceConnectWithoutContext ("MacTxQueueOverflow", MakeBoundCallback (&CountPackets, &overflowed));
+
+  // The first frame is being sent and stays in the queue until its transmission is done
+  LoRaWANDataRequestParams params = CreateDataRequestParams (LORAWAN_UNCONFIRMED_DATA_UP, 0, 5);
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      Simulator::Schedule (Seconds (1.0), &LoRaWANMac::sendMACPayloadRequest, mac, params, Create<Packet> (20));
+    }
+  Simulator::Stop (Seconds (1.5));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (enqueued, 2, "Only two frames fit in the transmit queue");
+  NS_TEST_ASSERT_MSG_EQ (overflowed, 2, "The other frames should be traced as overflow");
+
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANMacRDCTestCase : public TestCase
+{
+public:
+  LoRaWANMacRDCTestCase ();
+  virtual ~LoRaWANMacRDCTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANMacRDCTestCase::LoRaWANMacRDCTestCase ()
+  : TestCase ("Test the duty cycle bookkeeping of the time-off and sliding window policies")
+{
+}
+
+LoRaWANMacRDCTestCase::~LoRaWANMacRDCTestCase ()
+{
+}
+
+void
+LoRaWANMacRDCTestCase::DoRun (void)
+{
+  // Time-off: a transmission of 100 ms blocks a 1% sub band until 9.9 s after its end
+  Ptr<LoRaWANMac::LoRaWANMacRDC> rdc = CreateObject<LoRaWANMac::LoRaWANMacRDC> ();
+  const uint8_t subBand = rdc->GetSubBandIndexForChannelIndex (0);
+  rdc->UpdateRDCTimerForSubBand (subBand, MilliSeconds (100));
+  NS_TEST_ASSERT_MSG_EQ (rdc->NextAvailableTime (subBand, MilliSeconds (100)), Seconds (10), "Wrong end of the time-off");
+  NS_TEST_ASSERT_MSG_EQ (rdc->NextAvailableTime (subBand, Seconds (100)), Seconds (10), "The time-off does not depend on the next frame");
+  NS_TEST_ASSERT_MSG_EQ (rdc->RemainingBudget (subBand), Seconds (0), "No airtime left during the time-off");
+  NS_TEST_ASSERT_MSG_EQ (rdc->IsSubBandAvailable (subBand), false, "Sub band should be unavailable during the time-off");
+  AdvanceTime (Seconds (10));
+  NS_TEST_ASSERT_MSG_EQ (rdc->NextAvailableTime (subBand, MilliSeconds (100)), Seconds (10), "Sub band should be available after the time-off");
+  NS_TEST_ASSERT_MSG_EQ (rdc->RemainingBudget (subBand), Seconds (36), "The budget of a full hour should be left");
+  NS_TEST_ASSERT_MSG_EQ (rdc->IsSubBandAvailable (subBand), true, "Sub band should be available after the time-off");
+  Simulator::Destroy ();
+
+  // Sliding window of 100 s: a 1% sub band allows 1 s of airtime in every window
+  rdc = CreateObject<LoRaWANMac::LoRaWANMacRDC> ();
+  rdc->SetAttribute ("Policy", EnumValue (LORAWAN_DC_SLIDING_WINDOW));
+  rdc->SetAttribute ("Window", TimeValue (Seconds (100)));
+  rdc->UpdateRDCTimerForSubBand (subBand, MilliSeconds (400));
+  AdvanceTime (Seconds (10));
+  rdc->UpdateRDCTimerForSubBand (subBand, MilliSeconds (400));
+  AdvanceTime (Seconds (10));
+
+  NS_TEST_ASSERT_MSG_EQ (rdc->RemainingBudget (subBand), MilliSeconds (200), "Wrong remaining budget");
+  NS_TEST_ASSERT_MSG_EQ (rdc->IsSubBandAvailable (subBand), true, "Sub band should have budget left");
+  NS_TEST_ASSERT_MSG_EQ (rdc->NextAvailableTime (subBand, MilliSeconds (200)), Seconds (20), "A frame that fits should be sent now");
+  NS_TEST_ASSERT_MSG_EQ (rdc->NextAvailableTime (subBand, MilliSeconds (300)), Seconds (100), "The frame fits once the first transmission left the window");
+  NS_TEST_ASSERT_MSG_EQ (rdc->NextAvailableTime (subBand, MilliSeconds (900)), Seconds (110), "The frame fits once both transmissions left the window");
+  NS_TEST_ASSERT_MSG_EQ (rdc->NextAvailableTime (subBand, MilliSeconds (1500)), Seconds (110), "A frame longer than the budget waits for an empty window");
+
+  AdvanceTime (Seconds (80));
+  NS_TEST_ASSERT_MSG_EQ (rdc->RemainingBudget (subBand), MilliSeconds (600), "The first transmission should have left the window");
+  NS_TEST_ASSERT_MSG_EQ (rdc->NextAvailableTime (subBand, MilliSeconds (300)), Seconds (100), "A frame that fits should be sent now");
+
+  AdvanceTime (Seconds (11));
+  NS_TEST_ASSERT_MSG_EQ (rdc->RemainingBudget (subBand), Seconds (1), "The window should be empty");
+  NS_TEST_ASSERT_MSG_EQ (rdc->NextAvailableTime (subBand, MilliSeconds (1500)), Seconds (111), "A frame longer than the budget is sent in an empty window");
+  Simulator::Destroy ();
+
+  // A gateway checks the airtime of the downstream frame, like its MAC does before sending
+  Ptr<LoRaWANNetDevice> gateway = CreateDevice (CreateChannel (), LORAWAN_DT_GATEWAY, Vector (0, 0, 0));
+  rdc = gateway->GetRDC ();
+  rdc->SetAttribute ("Policy", EnumValue (LORAWAN_DC_SLIDING_WINDOW));
+  rdc->SetAttribute ("Window", TimeValue (Seconds (100)));
+  rdc->UpdateRDCTimerForSubBand (subBand, MilliSeconds (800));
+  NS_TEST_ASSERT_MSG_EQ (gateway->CanSendImmediatelyOnChannel (0, 5, MilliSeconds (100)), true, "The frame fits in the remaining budget");
+  NS_TEST_ASSERT_MSG_EQ (gateway->CanSendImmediatelyOnChannel (0, 5, MilliSeconds (300)), false, "The frame does not fit in the remaining budget");
+  NS_TEST_ASSERT_MSG_EQ (gateway->CanSendImmediatelyOnChannel (LoRaWAN::m_RW2ChannelIndex, LoRaWAN::m_RW2DataRateIndex, MilliSeconds (300)), true, "The RW2 channel is on another sub band");
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANMacRxTimelineTestCase : public TestCase
+{
+public:
+  LoRaWANMacRxTimelineTestCase ();
+  virtual ~LoRaWANMacRxTimelineTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANMacRxTimelineTestCase::LoRaWANMacRxTimelineTestCase ()
+  : TestCase ("Test that an end device skips RW2 after receiving a frame in RW1")
+{
+}
+
+LoRaWANMacRxTimelineTestCase::~LoRaWANMacRxTimelineTestCase ()
+{
+}
+
+void
+LoRaWANMacRxTimelineTestCase::DoRun (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateChannel ();
+  Ptr<LoRaWANNetDevice> gateway = CreateDevice (channel, LORAWAN_DT_GATEWAY, Vector (0, 0, 0));
+  Ptr<LoRaWANNetDevice> endDevice = CreateDevice (channel, LORAWAN_DT_END_DEVICE, Vector (100, 0, 0));
+  const Ipv4Address devAddr (0x00000001);
+  endDevice->SetAddress (devAddr);
+
+  // RW1 uses the channel and, without RX1DROffset, the data rate of the uplink
+  uint8_t macIndex = 0;
+  NS_TEST_ASSERT_MSG_EQ (gateway->getMACSIndexForChannelAndDataRate (macIndex, 0, 5), true, "No gateway MAC for channel 0 and DR5");
+  Ptr<LoRaWANMac> gatewayMac = gateway->GetMacs ()[macIndex];
+
+  Ptr<LoRaWANMac> mac = endDevice->GetMac ();
+  std::vector<LoRaWANMacState> states;
+  uint32_t received = 0;
+  mac->TraceConnectWithoutContext ("MacState", MakeBoundCallback (&RecordMacState, &states));
+  mac->TraceConnectWithoutContext ("MacState", MakeBoundCallback (&SendDownlinkInRW1, gatewayMac, devAddr));
+  mac->TraceConnectWithoutContext ("MacRx", MakeBoundCallback (&CountPackets, &received));
+
+  LoRaWANDataRequestParams params = CreateDataRequestParams (LORAWAN_UNCONFIRMED_DATA_UP, 0, 5);
+  Simulator::Schedule (Seconds (1.0), &LoRaWANMac::sendMACPayloadRequest, mac, params, Create<Packet> (20));
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (received, 1, "The end device should receive the downstream frame in RW1");
+  NS_TEST_ASSERT_MSG_EQ (states.size (), 4, "Expected the states TX, WAITFORRW1, RW1 and IDLE");
+  if (states.size () == 4)
+    {
+      NS_TEST_ASSERT_MSG_EQ (states[0], MAC_TX, "The end device should send the uplink");
+      NS_TEST_ASSERT_MSG_EQ (states[1], MAC_WAITFORRW1, "The end device should wait for RW1");
+      NS_TEST_ASSERT_MSG_EQ (states[2], MAC_RW1, "The end device should open RW1");
+      NS_TEST_ASSERT_MSG_EQ (states[3], MAC_IDLE, "The end device should skip RW2");
+    }
+  for (std::vector<LoRaWANMacState>::const_iterator it = states.begin (); it != states.end (); ++it)
+    {
+      NS_TEST_ASSERT_MSG_EQ ((*it == MAC_WAITFORRW2 || *it == MAC_RW2), false, "RW2 should not be opened");
+    }
+
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANMacRxWindowOracleTestCase : public TestCase
+{
+public:
+  LoRaWANMacRxWindowOracleTestCase ();
+  virtual ~LoRaWANMacRxWindowOracleTestCase ();
+
+private:
+  virtual void DoRun (void);
+  void RunUplink (bool oracle, bool sendDownlink);
+
+  std::vector<std::pair<Time, LoRaWANPhyEnumeration> > m_trxStates; //!< the TrxState changes of the end device in the last run
+};
+
+LoRaWANMacRxWindowOracleTestCase::LoRaWANMacRxWindowOracleTestCase ()
+  : TestCase ("Test that the RxWindowOracle mode only opens receive windows in which a downlink starts")
+{
+}
+
+LoRaWANMacRxWindowOracleTestCase::~LoRaWANMacRxWindowOracleTestCase ()
+{
+}
+
+void
+LoRaWANMacRxWindowOracleTestCase::RunUplink (bool oracle, bool sendDownlink)
+{
+  m_trxStates.clear ();
+
+  Ptr<LoRaWANSpectrumChannel> channel = CreateChannel ();
+  Ptr<LoRaWANNetDevice> gateway = CreateDevice (channel, LORAWAN_DT_GATEWAY, Vector (0, 0, 0));
+  Ptr<LoRaWANNetDevice> endDevice = CreateDevice (channel, LORAWAN_DT_END_DEVICE, Vector (100, 0, 0));
+  const Ipv4Address devAddr (0x00000001);
+  endDevice->SetAddress (devAddr);
+
+  Ptr<LoRaWANMac> mac = endDevice->GetMac ();
+  mac->SetAttribute ("RxWindowOracle", BooleanValue (oracle));
+  std::vector<LoRaWANMacState> states;
+  std::vector<uint8_t> windows;
+  uint32_t received = 0;
+  uint32_t rxOn = 0;
+  mac->TraceConnectWithoutContext ("MacState", MakeBoundCallback (&RecordMacState, &states));
+  mac->TraceConnectWithoutContext ("RxWindow", MakeBoundCallback (&RecordRxWindow, &windows));
+  mac->TraceConnectWithoutContext ("MacRx", MakeBoundCallback (&CountPackets, &received));
+  endDevice->GetPhy ()->TraceConnectWithoutContext ("TrxState", MakeBoundCallback (&CountRxOn, &rxOn));
+  endDevice->GetPhy ()->TraceConnectWithoutContext ("TrxState", MakeBoundCallback (&RecordTrxState, &m_trxStates));
+
+  // Listeners of other data rates and channels are not called for the downlink on channel 0 and DR5
+  uint32_t otherListenerCalls = 0;
+  uint32_t otherDataRateId = channel->AddDownlinkListener (0, 4, MakeBoundCallback (&CountCalls, &otherListenerCalls));
+  uint32_t otherChannelId = channel->AddDownlinkListener (1, 5, MakeBoundCallback (&CountCalls, &otherListenerCalls));
+
+  if (sendDownlink)
+    {
+      uint8_t macIndex = 0;
+      NS_TEST_ASSERT_MSG_EQ (gateway->getMACSIndexForChannelAndDataRate (macIndex, 0, 5), true, "No gateway MAC for channel 0 and DR5");
+      mac->TraceConnectWithoutContext ("MacState", MakeBoundCallback (&SendDownlinkInRW1, gateway->GetMacs ()[macIndex], devAddr));
+    }
+
+  LoRaWANDataRequestParams params = CreateDataRequestParams (LORAWAN_UNCONFIRMED_DATA_UP, 0, 5);
+  Simulator::Schedule (Seconds (1.0), &LoRaWANMac::sendMACPayloadRequest, mac, params, Create<Packet> (20));
+  Simulator::Stop (Seconds (10));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (otherListenerCalls, 0, "Only the listeners of the channel and data rate of a downlink should be called");
+  channel->RemoveDownlinkListener (otherDataRateId);
+  channel->RemoveDownlinkListener (otherChannelId);
+
+  if (sendDownlink)
+    {
+      NS_TEST_ASSERT_MSG_EQ (received, 1, "The end device should receive the downstream frame in RW1");
+      NS_TEST_ASSERT_MSG_EQ (rxOn, 1, "The Phy should only be switched on once for RW1");
+      NS_TEST_ASSERT_MSG_EQ (windows.size (), 1, "Only RW1 should be reported");
+      NS_TEST_ASSERT_MSG_EQ (states.back (), MAC_IDLE, "The end device should go idle after RW1");
+      for (std::vector<LoRaWANMacState>::const_iterator it = states.begin (); it != states.end (); ++it)
+        {
+          NS_TEST_ASSERT_MSG_EQ ((*it == MAC_WAITFORRW2 || *it == MAC_RW2), false, "RW2 should not be opened");
+        }
+    }
+  else
+    {
+      NS_TEST_ASSERT_MSG_EQ (received, 0, "No frame was sent to the end device");
+      NS_TEST_ASSERT_MSG_EQ (rxOn, 2, "The TrxState trace should show both windows");
+      NS_TEST_ASSERT_MSG_EQ (windows.size (), 2, "Both skipped windows should be reported");
+      if (windows.size () == 2)
+        {
+          NS_TEST_ASSERT_MSG_EQ ((uint16_t)windows[0], 1, "RW1 should be reported first");
+          NS_TEST_ASSERT_MSG_EQ ((uint16_t)windows[1], 2, "RW2 should be reported second");
+        }
+      NS_TEST_ASSERT_MSG_EQ (states.size (), 6, "Expected the states TX, WAITFORRW1, RW1, WAITFORRW2, RW2 and IDLE");
+      if (states.size () == 6)
+        {
+          NS_TEST_ASSERT_MSG_EQ (states[2], MAC_RW1, "The MAC should still enter RW1");
+          NS_TEST_ASSERT_MSG_EQ (states[4], MAC_RW2, "The MAC should still enter RW2");
+          NS_TEST_ASSERT_MSG_EQ (states[5], MAC_IDLE, "The end device should go idle after RW2");
+        }
+    }
+
+  Simulator::Destroy ();
+}
+
+void
+LoRaWANMacRxWindowOracleTestCase::DoRun (void)
+{
+  // The TrxState trace of the end device is the same with and without the oracle
+  for (uint32_t sendDownlink = 0; sendDownlink < 2; sendDownlink++)
+    {
+      RunUplink (false, sendDownlink);
+      std::vector<std::pair<Time, LoRaWANPhyEnumeration> > expected = m_trxStates;
+      RunUplink (true, sendDownlink);
+      NS_TEST_ASSERT_MSG_EQ (m_trxStates.size (), expected.size (), "The oracle should not change the number of TrxState changes");
+      for (uint32_t i = 0; i < std::min (m_trxStates.size (), expected.size ()); i++)
+        {
+          NS_TEST_ASSERT_MSG_EQ (m_trxStates[i].first, expected[i].first, "TrxState change " << i << " is at a different time with the oracle");
+          NS_TEST_ASSERT_MSG_EQ (m_trxStates[i].second, expected[i].second, "TrxState change " << i << " differs with the oracle");
+        }
+    }
+}
+
+// ==============================================================================
+class LoRaWANMacUplinkChannelSelectionTestCase : public TestCase
+{
+public:
+  LoRaWANMacUplinkChannelSelectionTestCase ();
+  virtual ~LoRaWANMacUplinkChannelSelectionTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANMacUplinkChannelSelectionTestCase::LoRaWANMacUplinkChannelSelectionTestCase ()
+  : TestCase ("Test that uplink channel selection skips the RW2 channel and waits for a blocked sub band")
+{
+}
+
+LoRaWANMacUplinkChannelSelectionTestCase::~LoRaWANMacUplinkChannelSelectionTestCase ()
+{
+}
+
+void
+LoRaWANMacUplinkChannelSelectionTestCase::DoRun (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateChannel ();
+  Ptr<LoRaWANNetDevice> endDevice = CreateDevice (channel, LORAWAN_DT_END_DEVICE, Vector (0, 0, 0));
+  Ptr<LoRaWANMac> mac = endDevice->GetMac ();
+
+  // The MAC only gets streams when the selection is used, so existing stream numbers do not change
+  NS_TEST_ASSERT_MSG_EQ (endDevice->AssignStreams (1), 1, "Expected only a stream for the Phy");
+  mac->SetAttribute ("UplinkChannelSelection", BooleanValue (true));
+  NS_TEST_ASSERT_MSG_EQ (endDevice->AssignStreams (1), 3, "Expected streams for the Ack time-out and the channel selection");
+
+  std::vector<std::pair<Time, uint8_t> > txs;
+  endDevice->GetPhy ()->TraceConnectWithoutContext ("PhyTxBegin", MakeBoundCallback (&RecordTxChannel, endDevice->GetPhy (), &txs));
+
+  // The upper layer asks for the RW2 channel, of which the sub band is always free here
+  LoRaWANDataRequestParams params = CreateDataRequestParams (LORAWAN_UNCONFIRMED_DATA_UP, LoRaWAN::m_RW2ChannelIndex, 5);
+  const uint32_t nUplinks = 20;
+  for (uint32_t i = 0; i < nUplinks; i++)
+    {
+      Simulator::Schedule (Seconds (10 * (i + 1)), &LoRaWANMac::sendMACPayloadRequest, mac, params, Create<Packet> (20));
+    }
+  Simulator::Stop (Seconds (10 * (nUplinks + 1)));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (txs.size (), nUplinks, "Every uplink should be sent");
+  std::set<uint8_t> usedChannels;
+  for (uint32_t i = 0; i < txs.size (); i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (txs[i].first, Seconds (10 * (i + 1)), "The uplink should be sent right away");
+      NS_TEST_ASSERT_MSG_EQ ((uint16_t)txs[i].second == LoRaWAN::m_RW2ChannelIndex, false, "The RW2 channel should never be selected");
+      usedChannels.insert (txs[i].second);
+    }
+  NS_TEST_ASSERT_MSG_EQ (usedChannels.size () > 1, true, "The uplinks should be spread over the channels");
+  Simulator::Destroy ();
+
+  // Block the sub band of the upstream channels: the uplink waits for it instead of taking the free RW2 channel
+  endDevice = CreateDevice (CreateChannel (), LORAWAN_DT_END_DEVICE, Vector (0, 0, 0));
+  mac = endDevice->GetMac ();
+  mac->SetAttribute ("UplinkChannelSelection", BooleanValue (true));
+  txs.clear ();
+  endDevice->GetPhy ()->TraceConnectWithoutContext ("PhyTxBegin", MakeBoundCallback (&RecordTxChannel, endDevice->GetPhy (), &txs));
+
+  Ptr<LoRaWANMac::LoRaWANMacRDC> rdc = endDevice->GetRDC ();
+  const uint8_t subBand = rdc->GetSubBandIndexForChannelIndex (0);
+  NS_TEST_ASSERT_MSG_EQ ((uint16_t)subBand == rdc->GetSubBandIndexForChannelIndex (LoRaWAN::m_RW2ChannelIndex), false, "The RW2 channel should be on another sub band");
+  rdc->UpdateRDCTimerForSubBand (subBand, Seconds (1)); // available again at 100 s
+  Simulator::Schedule (Seconds (10), &LoRaWANMac::sendMACPayloadRequest, mac, params, Create<Packet> (20));
+  Simulator::Stop (Seconds (110));
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (txs.size (), 1, "The uplink should be sent once the sub band is available");
+  if (txs.size () == 1)
+    {
+      NS_TEST_ASSERT_MSG_EQ (txs[0].first, Seconds (100), "The uplink should wait for the blocked sub band");
+      NS_TEST_ASSERT_MSG_EQ ((uint16_t)rdc->GetSubBandIndexForChannelIndex (txs[0].second), (uint16_t)subBand, "The uplink should use a channel of the upstream sub band");
+    }
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANMacTestSuite : public TestSuite
+{
+public:
+  LoRaWANMacTestSuite ();
+};
+
+LoRaWANMacTestSuite::LoRaWANMacTestSuite ()
+  : TestSuite ("lorawan-mac", UNIT)
+{
+  AddTestCase (new LoRaWANMacTxQueueTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANMacTxQueueOverflowTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANMacRDCTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANMacRxTimelineTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANMacRxWindowOracleTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANMacUplinkChannelSelectionTestCase, TestCase::QUICK);
+}
+
+static LoRaWANMacTestSuite lorawanMacTestSuite;
@@ -0,0 +1,383 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include <ns3/test.h>
+#include <ns3/log.h>
+#include <ns3/packet.h>
+#include <ns3/ipv4-address.h>
+#include <ns3/simulator.h>
+#include <ns3/lorawan-module.h>
+#include <algorithm>
+#include <cstring>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("lorawan-network-server-test");
+
+// ==============================================================================
+class LoRaWANEndDeviceRegistryTestCase : public TestCase
+{
+public:
+  LoRaWANEndDeviceRegistryTestCase ();
+  virtual ~LoRaWANEndDeviceRegistryTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANEndDeviceRegistryTestCase::LoRaWANEndDeviceRegistryTestCase ()
+  : TestCase ("Test the device indices and the Class B list of the end device registry")
+{
+}
+
+LoRaWANEndDeviceRegistryTestCase::~LoRaWANEndDeviceRegistryTestCase ()
+{
+}
+
+void
+LoRaWANEndDeviceRegistryTestCase::DoRun (void)
+{
+  LoRaWANEndDeviceRegistryNS registry;
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      NS_TEST_ASSERT_MSG_EQ (registry.Add (Ipv4Address (0x100 + i)), i, "Devices should get dense indices");
+    }
+  NS_TEST_ASSERT_MSG_EQ (registry.GetSize (), 3, "Three devices were added");
+  NS_TEST_ASSERT_MSG_EQ (registry.Find (0x101), 1, "Wrong index for a known device");
+  NS_TEST_ASSERT_MSG_EQ (registry.Find (0x200), LoRaWANEndDeviceRegistryNS::INVALID_INDEX, "Unknown devices should not be found");
+
+  // Removing a Class B device moves the last device of the list into its position
+  registry.SetClassB (0, true);
+  registry.SetClassB (1, true);
+  registry.SetClassB (2, true);
+  registry.SetClassB (1, true); // no duplicates
+  NS_TEST_ASSERT_MSG_EQ (registry.GetClassBDevices ().size (), 3, "All devices should be Class B");
+  registry.SetClassB (0, false);
+  std::vector<uint32_t> classB = registry.GetClassBDevices ();
+  NS_TEST_ASSERT_MSG_EQ (classB.size (), 2, "Device 0 should be removed");
+  if (classB.size () == 2)
+    {
+      NS_TEST_ASSERT_MSG_EQ (classB[0], 2, "The last device should take the position of the removed device");
+      NS_TEST_ASSERT_MSG_EQ (classB[1], 1, "Device 1 should keep its position");
+    }
+  registry.SetClassB (0, false); // not Class B, nothing happens
+  NS_TEST_ASSERT_MSG_EQ (registry.GetClassBDevices ().size (), 2, "Clearing the flag twice should have no effect");
+  registry.SetClassB (2, false);
+  registry.SetClassB (0, true);
+  classB = registry.GetClassBDevices ();
+  NS_TEST_ASSERT_MSG_EQ (classB.size (), 2, "Expected devices 1 and 0");
+  if (classB.size () == 2)
+    {
+      NS_TEST_ASSERT_MSG_EQ (classB[0], 1, "Device 1 should have moved to the front");
+      NS_TEST_ASSERT_MSG_EQ (classB[1], 0, "Device 0 should be appended");
+    }
+
+  // Adding a known device keeps its index but resets its fields and drops its pending frames
+  registry.m_fCntUp[0] = 10;
+  registry.m_fCntUp[1] = 20;
+  registry.m_setAck[0] = 1;
+  registry.m_ClassBPingSlots[0] = 8;
+  registry.m_ClassBPingOffset[0] = 100;
+  LoRaWANNSDSQueueElement* element = new LoRaWANNSDSQueueElement ();
+  element->m_downstreamPacket = Create<Packet> (10);
+  registry.m_downstreamQueue[0].PushBack (element);
+  element = new LoRaWANNSDSQueueElement ();
+  element->m_downstreamPacket = Create<Packet> (10);
+  registry.m_ClassBdownstreamQueue[0].PushBack (element);
+
+  NS_TEST_ASSERT_MSG_EQ (registry.Add (Ipv4Address (0x100)), 0, "A known device should keep its index");
+  NS_TEST_ASSERT_MSG_EQ (registry.GetSize (), 3, "No device should be added");
+  NS_TEST_ASSERT_MSG_EQ (registry.m_fCntUp[0], 0, "The frame counter should be reset");
+  NS_TEST_ASSERT_MSG_EQ (registry.m_setAck[0], 0, "The Ack flag should be reset");
+  NS_TEST_ASSERT_MSG_EQ (registry.m_ClassBPingSlots[0], 0, "The ping slots should be reset");
+  NS_TEST_ASSERT_MSG_EQ (registry.m_ClassBPingOffset[0], LoRaWANEndDeviceRegistryNS::NO_PING_OFFSET, "The ping offset should be reset");
+  NS_TEST_ASSERT_MSG_EQ (registry.m_downstreamQueue[0].IsEmpty (), true, "Pending frames should be deleted");
+  NS_TEST_ASSERT_MSG_EQ (registry.m_ClassBdownstreamQueue[0].IsEmpty (), true, "Pending Class B frames should be deleted");
+  NS_TEST_ASSERT_MSG_EQ (registry.m_isClassB[0], false, "The device should no longer be Class B");
+  classB = registry.GetClassBDevices ();
+  NS_TEST_ASSERT_MSG_EQ (classB.size (), 1, "Only device 1 should be Class B");
+  NS_TEST_ASSERT_MSG_EQ (std::find (classB.begin (), classB.end (), 0) == classB.end (), true, "Device 0 should be removed from the Class B list");
+  NS_TEST_ASSERT_MSG_EQ (registry.m_fCntUp[1], 20, "Other devices should not change");
+
+  registry.Clear ();
+  NS_TEST_ASSERT_MSG_EQ (registry.GetSize (), 0, "All devices should be removed");
+  NS_TEST_ASSERT_MSG_EQ (registry.Find (0x101), LoRaWANEndDeviceRegistryNS::INVALID_INDEX, "Removed devices should not be found");
+  NS_TEST_ASSERT_MSG_EQ (registry.GetClassBDevices ().size (), 0, "The Class B list should be empty");
+  NS_TEST_ASSERT_MSG_EQ (registry.Add (Ipv4Address (0x101)), 0, "Indices should start over after Clear");
+}
+
+// ==============================================================================
+class LoRaWANNetworkServerPingSlotTestCase : public TestCase
+{
+public:
+  LoRaWANNetworkServerPingSlotTestCase ();
+  virtual ~LoRaWANNetworkServerPingSlotTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANNetworkServerPingSlotTestCase::LoRaWANNetworkServerPingSlotTestCase ()
+  : TestCase ("Test that the network server only schedules ping slots for pending Class B traffic")
+{
+}
+
+LoRaWANNetworkServerPingSlotTestCase::~LoRaWANNetworkServerPingSlotTestCase ()
+{
+}
+
+void
+LoRaWANNetworkServerPingSlotTestCase::DoRun (void)
+{
+  // The gateway is not installed on a node: the test stops before a ping slot is used
+  Ptr<LoRaWANNetworkServer> ns = CreateObject<LoRaWANNetworkServer> ();
+  Ptr<LoRaWANGatewayApplication> gw = CreateObject<LoRaWANGatewayApplication> ();
+
+  const uint32_t index = ns->m_endDevices.Add (Ipv4Address (0x01020304));
+  ns->m_endDevices.SetClassB (index, true);
+  ns->m_endDevices.m_ClassBPingPeriodicity[index] = 3;
+  ns->m_endDevices.m_ClassBPingSlots[index] = 16;
+  ns->m_endDevices.m_lastGWs[index].push_back (gw);
+
+  // Beacon at t = 0: the ping slots are reserved, but nothing is queued so no ping slot is scheduled
+  ns->ClassBSendBeacon ();
+  const uint16_t offset = ns->m_endDevices.m_ClassBPingOffset[index];
+  NS_TEST_ASSERT_MSG_EQ ((offset != LoRaWANEndDeviceRegistryNS::NO_PING_OFFSET), true, "The beacon should set the ping offset");
+  NS_TEST_ASSERT_MSG_EQ (gw->m_pingSlots.Get (offset).m_allocated, 1, "The first ping slot should be reserved at the gateway");
+  NS_TEST_ASSERT_MSG_EQ (ns->m_endDevices.m_ClassBPingSlotTimer[index].IsRunning (), false, "No ping slot should be scheduled without pending traffic");
+
+  // A downlink queued mid-period schedules the next ping slot of the device
+  Simulator::Stop (Seconds (60));
+  Simulator::Run ();
+  ns->ClassBDSTimerExpired (index);
+  NS_TEST_ASSERT_MSG_EQ (ns->m_endDevices.m_ClassBPingSlotTimer[index].IsRunning (), true, "Queuing a downlink should schedule a ping slot");
+
+  const uint64_t period = 4096 / 16;
+  Time expected;
+  for (uint32_t i = 0; i < 16; i++)
+    {
+      expected = MilliSeconds (2120 + (offset + period * i) * 30);
+      if (expected > Seconds (60))
+        break;
+    }
+  NS_TEST_ASSERT_MSG_EQ (ns->m_endDevices.m_ClassBPingSlotTimer[index].GetTs (), (uint64_t) expected.GetTimeStep (), "Expected the first ping slot after the downlink was queued");
+
+  // A second downlink does not schedule another ping slot
+  const EventId pingSlot = ns->m_endDevices.m_ClassBPingSlotTimer[index];
+  ns->ClassBDSTimerExpired (index);
+  NS_TEST_ASSERT_MSG_EQ ((ns->m_endDevices.m_ClassBPingSlotTimer[index] == pingSlot), true, "The scheduled ping slot should be kept");
+  NS_TEST_ASSERT_MSG_EQ (ns->m_endDevices.m_ClassBdownstreamQueue[index].GetSize (), 2, "Both downlinks should be queued");
+
+  // Dropping Class B cancels the ping slot, and new traffic does not schedule one
+  ns->ClassBStop (index);
+  NS_TEST_ASSERT_MSG_EQ (pingSlot.IsRunning (), false, "The ping slot should be cancelled");
+  NS_TEST_ASSERT_MSG_EQ (ns->m_endDevices.m_ClassBPingOffset[index], LoRaWANEndDeviceRegistryNS::NO_PING_OFFSET, "The ping offset should be cleared");
+  NS_TEST_ASSERT_MSG_EQ (ns->m_endDevices.GetClassBDevices ().size (), 0, "The device should no longer be Class B");
+  ns->ClassBDSTimerExpired (index);
+  NS_TEST_ASSERT_MSG_EQ (ns->m_endDevices.m_ClassBPingSlotTimer[index].IsRunning (), false, "No ping slot should be scheduled for a Class A device");
+
+  // Run to just before the next beacon: no ping slot may fire
+  Simulator::Stop (Seconds (127) - Simulator::Now ());
+  Simulator::Run ();
+  NS_TEST_ASSERT_MSG_EQ (ns->m_endDevices.m_stats[index].m_nClassBPacketsSent, 0, "No Class B downlink should be sent");
+
+  ns->Dispose ();
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANPingOffsetCalculatorTestCase : public TestCase
+{
+public:
+  LoRaWANPingOffsetCalculatorTestCase ();
+  virtual ~LoRaWANPingOffsetCalculatorTestCase ();
+
+private:
+  virtual void DoRun (void);
+  // Calculate the ping offset with a fresh AES instance: R = AES_128_enc(key, Time | DevAddr | pad16)
+  static uint16_t GetPingOffsetDirect (uint32_t beaconSecs, Ipv4Address devAddr, uint8_t pingSlots, const uint8_t key[16]);
+};
+
+LoRaWANPingOffsetCalculatorTestCase::LoRaWANPingOffsetCalculatorTestCase ()
+  : TestCase ("Test the ping offset calculator against a direct AES encryption")
+{
+}
+
+LoRaWANPingOffsetCalculatorTestCase::~LoRaWANPingOffsetCalculatorTestCase ()
+{
+}
+
+uint16_t
+LoRaWANPingOffsetCalculatorTestCase::GetPingOffsetDirect (uint32_t beaconSecs, Ipv4Address devAddr, uint8_t pingSlots, const uint8_t key[16])
+{
+  uint8_t k[16];
+  std::memcpy (k, key, 16);
+  uint8_t block[16];
+  std::memcpy (block, &beaconSecs, 4); // host byte order, like the beacon timestamp
+  devAddr.Serialize (block + 4);
+  std::memset (block + 8, 0, 8);
+
+  AES aes;
+  aes.SetKey (k, 16);
+  aes.Encrypt (block, 16);
+  return (block[0] + block[1]*256) % (4096 / pingSlots);
+}
+
+void
+LoRaWANPingOffsetCalculatorTestCase::DoRun (void)
+{
+  const uint8_t zeroKey[16] = { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 };
+  const uint8_t otherKey[16] = { 0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6, 0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c };
+  const uint8_t* keys[2] = { zeroKey, otherKey };
+  const Time beaconTimes[3] = { Seconds (128), MilliSeconds (256700), Seconds (1000064) }; // only whole seconds are used
+  const uint32_t beaconSecs[3] = { 128, 256, 1000064 };
+
+  std::vector<Ipv4Address> devAddrs;
+  devAddrs.push_back (Ipv4Address (0x00000001));
+  devAddrs.push_back (Ipv4Address (0x01020304));
+  devAddrs.push_back (Ipv4Address (0xfffffffe));
+  devAddrs.push_back (Ipv4Address (0x00000001)); // listed twice
+  std::vector<uint8_t> pingSlots;
+  pingSlots.push_back (1);
+  pingSlots.push_back (16);
+  pingSlots.push_back (128);
+  pingSlots.push_back (2);
+
+  LoRaWANClassBPingOffsetCalculator* calculator = LoRaWANClassBPingOffsetCalculator::Get ();
+  // First fill the remembered offsets with the batched call, then with single calls
+  for (uint32_t batchFirst = 0; batchFirst < 2; batchFirst++)
+    {
+      calculator->Clear ();
+      for (uint32_t k = 0; k < 2; k++)
+        {
+          for (uint32_t t = 0; t < 3; t++)
+            {
+              std::vector<uint16_t> offsets;
+              if (batchFirst)
+                calculator->GetPingOffsets (beaconTimes[t], devAddrs, pingSlots, keys[k], offsets);
+              for (uint32_t d = 0; d < devAddrs.size (); d++)
+                {
+                  const uint16_t expected = GetPingOffsetDirect (beaconSecs[t], devAddrs[d], pingSlots[d], keys[k]);
+                  NS_TEST_ASSERT_MSG_EQ (calculator->GetPingOffset (beaconTimes[t], devAddrs[d], pingSlots[d], keys[k]), expected,
+                                         "GetPingOffset differs from AES for device " << devAddrs[d] << " at " << beaconSecs[t] << " s");
+                }
+              if (!batchFirst)
+                calculator->GetPingOffsets (beaconTimes[t], devAddrs, pingSlots, keys[k], offsets);
+              NS_TEST_ASSERT_MSG_EQ (offsets.size (), devAddrs.size (), "Expected an offset per device");
+              for (uint32_t d = 0; d < offsets.size (); d++)
+                {
+                  const uint16_t expected = GetPingOffsetDirect (beaconSecs[t], devAddrs[d], pingSlots[d], keys[k]);
+                  NS_TEST_ASSERT_MSG_EQ (offsets[d], expected,
+                                         "GetPingOffsets differs from AES for device " << devAddrs[d] << " at " << beaconSecs[t] << " s");
+                }
+            }
+        }
+    }
+  calculator->Clear ();
+}
+
+// ==============================================================================
+class LoRaWANPingSlotTableTestCase : public TestCase
+{
+public:
+  LoRaWANPingSlotTableTestCase ();
+  virtual ~LoRaWANPingSlotTableTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANPingSlotTableTestCase::LoRaWANPingSlotTableTestCase ()
+  : TestCase ("Test growth, probing and clearing of stale reservations in the ping slot table")
+{
+}
+
+LoRaWANPingSlotTableTestCase::~LoRaWANPingSlotTableTestCase ()
+{
+}
+
+void
+LoRaWANPingSlotTableTestCase::DoRun (void)
+{
+  LoRaWANPingSlotTable table;
+
+  // Slots of one device are a ping period apart: add slots with equal low bits first, then all others
+  std::vector<uint64_t> slots;
+  for (uint64_t slot = 0; slot < LoRaWANPingSlotTable::NUM_SLOTS; slot += 256)
+    slots.push_back (slot);
+  for (uint64_t slot = 0; slot < LoRaWANPingSlotTable::NUM_SLOTS; slot++)
+    {
+      if (slot % 256 != 0)
+        slots.push_back (slot);
+    }
+
+  // The table grows several times; entries and their statistics are kept
+  for (uint32_t i = 0; i < slots.size (); i++)
+    {
+      LoRaWANPingSlotTable::Entry &entry = table.Get (slots[i]);
+      NS_TEST_ASSERT_MSG_EQ (entry.m_slot, slots[i], "Get should return the entry of the slot");
+      NS_TEST_ASSERT_MSG_EQ (entry.m_allocated, 0, "A new entry should have no statistics");
+      entry.m_allocated = slots[i] + 1;
+      entry.m_reservations.push_back (slots[i]);
+    }
+  NS_TEST_ASSERT_MSG_EQ (table.GetEntries ().size (), LoRaWANPingSlotTable::NUM_SLOTS, "Every slot should have one entry");
+  for (uint64_t slot = 0; slot < LoRaWANPingSlotTable::NUM_SLOTS; slot++)
+    {
+      LoRaWANPingSlotTable::Entry &entry = table.Get (slot);
+      NS_TEST_ASSERT_MSG_EQ (entry.m_slot, slot, "Probing should find the entry of the slot");
+      NS_TEST_ASSERT_MSG_EQ (entry.m_allocated, slot + 1, "The statistics should survive the growth of the table");
+      NS_TEST_ASSERT_MSG_EQ (entry.m_reservations.size (), 1, "Reservations of the current epoch should be kept");
+    }
+  NS_TEST_ASSERT_MSG_EQ (table.GetEntries ().size (), LoRaWANPingSlotTable::NUM_SLOTS, "Finding an entry should not add one");
+
+  // A new epoch drops the reservations of an entry the next time it is accessed, the statistics stay
+  table.NewEpoch ();
+  NS_TEST_ASSERT_MSG_EQ (table.GetEntries ()[0].m_reservations.size (), 1, "Reservations are only dropped when an entry is accessed");
+  LoRaWANPingSlotTable::Entry &entry = table.Get (1000);
+  NS_TEST_ASSERT_MSG_EQ (entry.m_reservations.size (), 0, "Reservations of an earlier epoch should be dropped");
+  NS_TEST_ASSERT_MSG_EQ (entry.m_allocated, 1001, "The statistics should be kept across epochs");
+  entry.m_reservations.push_back (7);
+  NS_TEST_ASSERT_MSG_EQ (table.Get (1000).m_reservations.size (), 1, "New reservations should be kept within the epoch");
+  table.NewEpoch ();
+  table.NewEpoch ();
+  NS_TEST_ASSERT_MSG_EQ (table.Get (1000).m_reservations.size (), 0, "Reservations should be dropped after several epochs");
+
+  table.Clear ();
+  NS_TEST_ASSERT_MSG_EQ (table.GetEntries ().size (), 0, "Clear should remove all entries");
+  NS_TEST_ASSERT_MSG_EQ (table.Get (1000).m_allocated, 0, "An entry added after Clear should have no statistics");
+  NS_TEST_ASSERT_MSG_EQ (table.GetEntries ().size (), 1, "Only the new entry should be present");
+}
+
+// ==============================================================================
+class LoRaWANNetworkServerTestSuite : public TestSuite
+{
+public:
+  LoRaWANNetworkServerTestSuite ();
+};
+
+LoRaWANNetworkServerTestSuite::LoRaWANNetworkServerTestSuite ()
+  : TestSuite ("lorawan-network-server", UNIT)
+{
+  AddTestCase (new LoRaWANEndDeviceRegistryTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANNetworkServerPingSlotTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANPingOffsetCalculatorTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANPingSlotTableTestCase, TestCase::QUICK);
+}
+
+static LoRaWANNetworkServerTestSuite lorawanNetworkServerTestSuite;
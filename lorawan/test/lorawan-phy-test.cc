@@ -20,11 +20,21 @@
 // Include a header file from your module to test.
 #include "ns3/lorawan.h"
 #include "ns3/lorawan-phy.h"
+#include "ns3/lorawan-error-model.h"
+#include "ns3/lorawan-spectrum-channel.h"
 
 // An essential include is test.h
 #include "ns3/test.h"
 #include "ns3/nstime.h"
 #include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/boolean.h>
+#include <ns3/packet.h>
+#include <ns3/propagation-loss-model.h>
+#include <ns3/constant-position-mobility-model.h>
+
+#include <algorithm>
+#include <cmath>
 
 // Do not put your test classes in namespace ns3.  You may find it useful
 // to use the using directive to access the ns3 namespace directly
@@ -296,6 +306,195 @@ LoRaWANPhyTxTimeTestCase::DoRun (void)
   NS_TEST_ASSERT_MSG_EQ_TOL (0.01, 0.01, 0.001, "Numbers are not equal within tolerance");
 }
 
+/**
+ * Time on air in microseconds per the formula of Semtech AN1200.13 'LoRa
+ * Modem Designer's Guide', computed independently of the lookup table
+ */
+static double
+SemtechTimeOnAir (uint32_t sf, uint32_t bandwidth, uint32_t codeRate, uint32_t preambleLength, bool crcOn, bool implicitHeader, uint32_t payloadLength, bool lowDataRateOptimization)
+{
+  double tSym = pow (2.0, sf) / bandwidth * 1.0e6;
+  double tPreamble = (preambleLength + 4.25) * tSym;
+  double numerator = 8.0 * payloadLength - 4.0 * sf + 28 + 16 * crcOn - 20 * implicitHeader;
+  double denominator = 4.0 * (sf - 2 * lowDataRateOptimization);
+  double payloadSymbNb = 8 + std::max (ceil (numerator / denominator) * (codeRate + 4), 0.0);
+  return tPreamble + payloadSymbNb * tSym;
+}
+
+class LoRaWANTimeOnAirTestCase : public TestCase
+{
+public:
+  LoRaWANTimeOnAirTestCase ();
+  virtual ~LoRaWANTimeOnAirTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANTimeOnAirTestCase::LoRaWANTimeOnAirTestCase ()
+  : TestCase ("Test the time on air table of LoRaWAN against the Semtech formula")
+{
+}
+
+LoRaWANTimeOnAirTestCase::~LoRaWANTimeOnAirTestCase ()
+{
+}
+
+void
+LoRaWANTimeOnAirTestCase::DoRun (void)
+{
+  // Reference values of the LoRa Modem Calculator Tool
+  Time timeOnAir = LoRaWAN::GetTimeOnAir (LORAWAN_SF7, 125000, 1, 8, true, false, 8);
+  Time expected = MicroSeconds(36.1e3);
+  NS_TEST_ASSERT_MSG_EQ_TOL (timeOnAir, expected, expected/100, "LoRaWAN::GetTimeOnAir() returned " << timeOnAir << ". Expected " << expected);
+
+  // SF12 with low data rate optimization, 8 instead of 7 payload blocks
+  timeOnAir = LoRaWAN::GetTimeOnAir (LORAWAN_SF12, 125000, 3, 8, true, false, 40, true);
+  expected = MicroSeconds(2498.56e3);
+  NS_TEST_ASSERT_MSG_EQ_TOL (timeOnAir, expected, expected/100, "LoRaWAN::GetTimeOnAir() returned " << timeOnAir << ". Expected " << expected);
+
+  // Class B beacon: SF9, 10 preamble symbols, implicit header, no CRC, 17 bytes
+  timeOnAir = LoRaWAN::GetTimeOnAir (LORAWAN_SF9, 125000, 1, 10, false, true, 17);
+  expected = MicroSeconds(152.58e3);
+  NS_TEST_ASSERT_MSG_EQ_TOL (timeOnAir, expected, expected/1000, "LoRaWAN::GetTimeOnAir() returned " << timeOnAir << ". Expected " << expected);
+
+  // An empty implicit header frame has no conditional payload symbols
+  timeOnAir = LoRaWAN::GetTimeOnAir (LORAWAN_SF12, 125000, 1, 8, false, true, 0);
+  expected = MicroSeconds(663.552e3);
+  NS_TEST_ASSERT_MSG_EQ_TOL (timeOnAir, expected, expected/1000, "LoRaWAN::GetTimeOnAir() returned " << timeOnAir << ". Expected " << expected);
+
+  // Every entry of the table and the PHY frame duration should match the formula
+  Ptr<LoRaWANPhy> phy = CreateObject<LoRaWANPhy> (0);
+  for (uint32_t dataRateIndex = 0; dataRateIndex < LoRaWAN::m_supportedDataRates.size (); dataRateIndex++)
+    {
+      LoRaSpreadingFactor spreadingFactor = LoRaWAN::m_supportedDataRates [dataRateIndex].spreadingFactor;
+      uint32_t bandwidth = LoRaWAN::m_supportedChannels [0].m_bw;
+      for (uint8_t codeRate = 1; codeRate <= 4; codeRate++)
+        for (uint8_t crcOn = 0; crcOn <= 1; crcOn++)
+          for (uint8_t implicitHeader = 0; implicitHeader <= 1; implicitHeader++)
+            {
+              bool txConfSucces = phy->SetTxConf (2, 0, dataRateIndex, codeRate, 8, implicitHeader, crcOn);
+              NS_TEST_ASSERT_MSG_EQ (txConfSucces, true, "Failed to configure LoRa PHY");
+              for (uint32_t payloadLength = 0; payloadLength <= 255; payloadLength++)
+                {
+                  for (uint8_t de = 0; de <= 1; de++)
+                    {
+                      timeOnAir = LoRaWAN::GetTimeOnAir (spreadingFactor, bandwidth, codeRate, 8, crcOn, implicitHeader, payloadLength, de);
+                      double reference = SemtechTimeOnAir (spreadingFactor, bandwidth, codeRate, 8, crcOn, implicitHeader, payloadLength, de);
+                      NS_TEST_ASSERT_MSG_EQ_TOL (timeOnAir.GetMicroSeconds (), reference, 1.0, "Time on air differs for " << spreadingFactor << "/" << (uint16_t)codeRate
+                                                 << "/" << (uint16_t)crcOn << "/" << (uint16_t)implicitHeader << "/" << (uint16_t)de << "/" << payloadLength);
+                    }
+
+                  // The PHY does not use low data rate optimization
+                  double reference = SemtechTimeOnAir (spreadingFactor, bandwidth, codeRate, 8, crcOn, implicitHeader, payloadLength, false);
+                  NS_TEST_ASSERT_MSG_EQ_TOL (phy->CalculateTxTime (payloadLength).GetMicroSeconds (), reference, 1.0, "PHY time on air differs for payload length " << payloadLength);
+                }
+            }
+    }
+}
+
+static void
+IgnoreDestroyed (void)
+{
+}
+
+static void
+CountPackets (uint32_t *count, Ptr<const Packet> p)
+{
+  (*count)++;
+}
+
+static void
+CountDroppedPackets (uint32_t *count, Ptr<const Packet> p, LoRaWANPhyDropRxReason reason)
+{
+  (*count)++;
+}
+
+class LoRaWANPhyIqPolarityTestCase : public TestCase
+{
+public:
+  LoRaWANPhyIqPolarityTestCase ();
+  virtual ~LoRaWANPhyIqPolarityTestCase ();
+
+private:
+  virtual void DoRun (void);
+
+  /**
+   * Create a PHY on channel 0 at SF7 that is attached to the channel.
+   */
+  Ptr<LoRaWANPhy> CreatePhy (Ptr<LoRaWANSpectrumChannel> channel, Vector position, bool invertedIq);
+};
+
+LoRaWANPhyIqPolarityTestCase::LoRaWANPhyIqPolarityTestCase ()
+  : TestCase ("Test that the PHY ignores transmissions with the IQ polarity it transmits with")
+{
+}
+
+LoRaWANPhyIqPolarityTestCase::~LoRaWANPhyIqPolarityTestCase ()
+{
+}
+
+Ptr<LoRaWANPhy>
+LoRaWANPhyIqPolarityTestCase::CreatePhy (Ptr<LoRaWANSpectrumChannel> channel, Vector position, bool invertedIq)
+{
+  Ptr<LoRaWANPhy> phy = CreateObject<LoRaWANPhy> (0);
+  phy->SetAttribute ("InvertedIq", BooleanValue (invertedIq));
+  Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+  mobility->SetPosition (position);
+  phy->SetMobility (mobility);
+  phy->SetErrorModel (CreateObject<LoRaWANErrorModel> ());
+  phy->SetPdDataDestroyedCallback (MakeCallback (&IgnoreDestroyed));
+  phy->SetTxConf (14, 0, 5, 3, 8, false, true);
+  phy->SetChannel (channel);
+  channel->AddRx (phy);
+  return phy;
+}
+
+void
+LoRaWANPhyIqPolarityTestCase::DoRun (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateObject<LoRaWANSpectrumChannel> ();
+  channel->AddPropagationLossModel (CreateObject<LogDistancePropagationLossModel> ());
+
+  // An end device transmits upstream, i.e. without inverted IQ
+  Ptr<LoRaWANPhy> endDevice = CreatePhy (channel, Vector (0, 0, 0), false);
+  Ptr<LoRaWANPhy> gatewayRx = CreatePhy (channel, Vector (100, 0, 0), true);
+  Ptr<LoRaWANPhy> endDeviceRx = CreatePhy (channel, Vector (0, 100, 0), false);
+
+  uint32_t gatewayRxBegin = 0;
+  uint32_t gatewayRxDrop = 0;
+  uint32_t endDeviceRxBegin = 0;
+  uint32_t endDeviceRxDrop = 0;
+  gatewayRx->TraceConnectWithoutContext ("PhyRxBegin", MakeBoundCallback (&CountPackets, &gatewayRxBegin));
+  gatewayRx->TraceConnectWithoutContext ("PhyRxDrop", MakeBoundCallback (&CountDroppedPackets, &gatewayRxDrop));
+  endDeviceRx->TraceConnectWithoutContext ("PhyRxBegin", MakeBoundCallback (&CountPackets, &endDeviceRxBegin));
+  endDeviceRx->TraceConnectWithoutContext ("PhyRxDrop", MakeBoundCallback (&CountDroppedPackets, &endDeviceRxDrop));
+  gatewayRx->SetTRXStateRequest (LORAWAN_PHY_RX_ON);
+  endDeviceRx->SetTRXStateRequest (LORAWAN_PHY_RX_ON);
+
+  Ptr<Packet> p = Create<Packet> (20);
+  endDevice->SetTRXStateRequest (LORAWAN_PHY_TX_ON);
+  endDevice->PdDataRequest (p->GetSize (), p);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (gatewayRxBegin, 1, "A PHY with inverted IQ should receive the upstream transmission");
+  NS_TEST_ASSERT_MSG_EQ (endDeviceRxBegin, 0, "A PHY without inverted IQ should not lock onto the upstream transmission");
+  NS_TEST_ASSERT_MSG_EQ (endDeviceRxDrop, 0, "A transmission with the wrong IQ polarity is noise, not a dropped frame");
+
+  // A downstream transmission with inverted IQ is only received by the end device
+  Ptr<LoRaWANPhy> gateway = CreatePhy (channel, Vector (0, 0, 10), true);
+  p = Create<Packet> (20);
+  gateway->SetTRXStateRequest (LORAWAN_PHY_TX_ON);
+  gateway->PdDataRequest (p->GetSize (), p);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (endDeviceRxBegin, 1, "A PHY without inverted IQ should receive the downstream transmission");
+  NS_TEST_ASSERT_MSG_EQ (gatewayRxBegin, 1, "A PHY with inverted IQ should not lock onto the downstream transmission");
+  NS_TEST_ASSERT_MSG_EQ (gatewayRxDrop, 0, "A transmission with the wrong IQ polarity is noise, not a dropped frame");
+
+  Simulator::Destroy ();
+}
+
 // The TestSuite class names the TestSuite, identifies what type of TestSuite,
 // and enables the TestCases to be run.  Typically, only the constructor for
 // this class must be defined
@@ -311,6 +510,8 @@ LoRaWANPhyTestSuite::LoRaWANPhyTestSuite()
 {
   // TestDuration for TestCase can be QUICK, EXTENSIVE or TAKES_FOREVER
   AddTestCase (new LoRaWANPhyTxTimeTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANTimeOnAirTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANPhyIqPolarityTestCase, TestCase::QUICK);
 }
 
 // Do not forget to allocate an instance of this TestSuite
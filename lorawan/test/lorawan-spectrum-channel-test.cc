@@ -0,0 +1,305 @@
+/* -*- Mode:C++; c-file-style:"gnu"; indent-tabs-mode:nil; -*- */
+/*
+ * Copyright (c) 2017 IDLab-imec
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License version 2 as
+ * published by the Free Software Foundation;
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ * Author: Floris Van den Abeele <floris.vandenabeele@ugent.be>
+ */
+#include <ns3/test.h>
+#include <ns3/log.h>
+#include <ns3/simulator.h>
+#include <ns3/boolean.h>
+#include <ns3/double.h>
+#include <ns3/uinteger.h>
+#include <ns3/packet.h>
+#include <ns3/propagation-loss-model.h>
+#include <ns3/propagation-delay-model.h>
+#include <ns3/constant-position-mobility-model.h>
+#include <ns3/lorawan-module.h>
+#include <cmath>
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("lorawan-spectrum-channel-test");
+
+static void
+IgnoreDestroyed (void)
+{
+}
+
+// Create a bare PHY that is attached to the channel and tuned to channelIndex at SF7
+static Ptr<LoRaWANPhy>
+CreatePhy (Ptr<LoRaWANSpectrumChannel> channel, Vector position, uint8_t channelIndex, bool invertedIq)
+{
+  Ptr<LoRaWANPhy> phy = CreateObject<LoRaWANPhy> (0);
+  phy->SetAttribute ("InvertedIq", BooleanValue (invertedIq));
+  Ptr<ConstantPositionMobilityModel> mobility = CreateObject<ConstantPositionMobilityModel> ();
+  mobility->SetPosition (position);
+  phy->SetMobility (mobility);
+  phy->SetErrorModel (CreateObject<LoRaWANErrorModel> ());
+  phy->SetPdDataDestroyedCallback (MakeCallback (&IgnoreDestroyed));
+  phy->SetTxConf (14, channelIndex, 5, 3, 8, false, true);
+  phy->SetChannel (channel);
+  channel->AddRx (phy);
+  return phy;
+}
+
+static Ptr<LoRaWANSpectrumChannel>
+CreateChannel (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateObject<LoRaWANSpectrumChannel> ();
+  channel->AddPropagationLossModel (CreateObject<LogDistancePropagationLossModel> ());
+  channel->SetPropagationDelayModel (CreateObject<ConstantSpeedPropagationDelayModel> ());
+  return channel;
+}
+
+static void
+Transmit (Ptr<LoRaWANPhy> phy, uint32_t size)
+{
+  Ptr<Packet> p = Create<Packet> (size);
+  phy->SetTRXStateRequest (LORAWAN_PHY_TX_ON);
+  phy->PdDataRequest (p->GetSize (), p);
+}
+
+static void
+CountRxBegin (uint32_t *count, Ptr<const Packet> p)
+{
+  (*count)++;
+}
+
+static void
+RecordTime (Time *time, Ptr<const Packet> p)
+{
+  *time = Simulator::Now ();
+}
+
+static void
+RecordRxEndTime (Time *time, Ptr<const Packet> p, double lqi)
+{
+  *time = Simulator::Now ();
+}
+
+// ==============================================================================
+class LoRaWANSpectrumChannelDispatchTestCase : public TestCase
+{
+public:
+  LoRaWANSpectrumChannelDispatchTestCase ();
+  virtual ~LoRaWANSpectrumChannelDispatchTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANSpectrumChannelDispatchTestCase::LoRaWANSpectrumChannelDispatchTestCase ()
+  : TestCase ("Test that transmissions are only delivered to receivers tuned to their channel, also after a retune")
+{
+}
+
+LoRaWANSpectrumChannelDispatchTestCase::~LoRaWANSpectrumChannelDispatchTestCase ()
+{
+}
+
+void
+LoRaWANSpectrumChannelDispatchTestCase::DoRun (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateChannel ();
+  Ptr<LoRaWANPhy> tx = CreatePhy (channel, Vector (0, 0, 0), 0, false);
+  Ptr<LoRaWANPhy> rx0 = CreatePhy (channel, Vector (10, 0, 0), 0, true);
+  Ptr<LoRaWANPhy> rx1 = CreatePhy (channel, Vector (0, 10, 0), 1, true);
+
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNRxOnChannel (0), 2, "Transmitter and rx0 should be listed on channel 0");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNRxOnChannel (1), 1, "rx1 should be listed on channel 1");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNDevices (), 3, "All receivers should be attached");
+
+  uint32_t rx0Count = 0;
+  uint32_t rx1Count = 0;
+  rx0->TraceConnectWithoutContext ("PhyRxBegin", MakeBoundCallback (&CountRxBegin, &rx0Count));
+  rx1->TraceConnectWithoutContext ("PhyRxBegin", MakeBoundCallback (&CountRxBegin, &rx1Count));
+  rx0->SetTRXStateRequest (LORAWAN_PHY_RX_ON);
+  rx1->SetTRXStateRequest (LORAWAN_PHY_RX_ON);
+
+  Simulator::Schedule (Seconds (0.0), &Transmit, tx, 20);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (rx0Count, 1, "rx0 is tuned to the channel of the transmission and should receive it");
+  NS_TEST_ASSERT_MSG_EQ (rx1Count, 0, "rx1 is tuned to another channel and should not see the transmission");
+
+  // Retuning moves rx1 to the receiver list of channel 0, so it receives the next transmission
+  NS_TEST_ASSERT_MSG_EQ (rx1->SetTxConf (14, 0, 5, 3, 8, false, true), true, "Failed to retune rx1");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNRxOnChannel (0), 3, "rx1 should be moved to channel 0");
+  NS_TEST_ASSERT_MSG_EQ (channel->GetNRxOnChannel (1), 0, "rx1 should be removed from channel 1");
+
+  tx->SetTRXStateRequest (LORAWAN_PHY_IDLE); // the PHY stays in BUSY_TX after a transmission
+  Simulator::Schedule (Seconds (1.0), &Transmit, tx, 20);
+  Simulator::Run ();
+
+  NS_TEST_ASSERT_MSG_EQ (rx0Count, 2, "rx0 should receive the second transmission");
+  NS_TEST_ASSERT_MSG_EQ (rx1Count, 1, "rx1 should receive the transmission after the retune");
+
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANSpectrumChannelBatchTestCase : public TestCase
+{
+public:
+  LoRaWANSpectrumChannelBatchTestCase ();
+  virtual ~LoRaWANSpectrumChannelBatchTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANSpectrumChannelBatchTestCase::LoRaWANSpectrumChannelBatchTestCase ()
+  : TestCase ("Test that batched receptions start and end after the propagation delay of every receiver")
+{
+}
+
+LoRaWANSpectrumChannelBatchTestCase::~LoRaWANSpectrumChannelBatchTestCase ()
+{
+}
+
+void
+LoRaWANSpectrumChannelBatchTestCase::DoRun (void)
+{
+  Ptr<LoRaWANSpectrumChannel> channel = CreateChannel ();
+  Ptr<LoRaWANPhy> tx = CreatePhy (channel, Vector (0, 0, 0), 0, false);
+  // rx0 and rx1 have the same propagation delay and share a batch, rx2 is ten times as far
+  Ptr<LoRaWANPhy> rx[3];
+  rx[0] = CreatePhy (channel, Vector (30, 0, 0), 0, true);
+  rx[1] = CreatePhy (channel, Vector (0, 30, 0), 0, true);
+  rx[2] = CreatePhy (channel, Vector (300, 0, 0), 0, true);
+
+  Time rxBegin[3];
+  Time rxEnd[3];
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      rx[i]->TraceConnectWithoutContext ("PhyRxBegin", MakeBoundCallback (&RecordTime, &rxBegin[i]));
+      rx[i]->TraceConnectWithoutContext ("PhyRxEnd", MakeBoundCallback (&RecordRxEndTime, &rxEnd[i]));
+      rx[i]->SetTRXStateRequest (LORAWAN_PHY_RX_ON);
+    }
+
+  const Time start = Seconds (1.0);
+  const Time duration = tx->CalculateTxTime (20);
+  Simulator::Schedule (start, &Transmit, tx, 20);
+  Simulator::Run ();
+
+  Ptr<ConstantSpeedPropagationDelayModel> delayModel = CreateObject<ConstantSpeedPropagationDelayModel> ();
+  NS_TEST_ASSERT_MSG_EQ (rxBegin[0], rxBegin[1], "Receivers at the same distance should start receiving at the same time");
+  NS_TEST_ASSERT_MSG_GT (rxBegin[2], rxBegin[0], "The farthest receiver should start receiving last");
+  for (uint32_t i = 0; i < 3; i++)
+    {
+      Time delay = delayModel->GetDelay (tx->GetMobility (), rx[i]->GetMobility ());
+      NS_TEST_ASSERT_MSG_EQ (rxBegin[i], start + delay, "Reception of rx" << i << " should start after its propagation delay");
+      NS_TEST_ASSERT_MSG_EQ (rxEnd[i], start + delay + duration, "Reception of rx" << i << " should end after the duration of the frame");
+    }
+
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+// Exposes the propagation gain of the link cache to the test
+class LinkCacheTestChannel : public LoRaWANSpectrumChannel
+{
+public:
+  using LoRaWANSpectrumChannel::GetPropagationGain;
+};
+
+class LoRaWANSpectrumChannelLinkCacheTestCase : public TestCase
+{
+public:
+  LoRaWANSpectrumChannelLinkCacheTestCase ();
+  virtual ~LoRaWANSpectrumChannelLinkCacheTestCase ();
+
+private:
+  virtual void DoRun (void);
+};
+
+LoRaWANSpectrumChannelLinkCacheTestCase::LoRaWANSpectrumChannelLinkCacheTestCase ()
+  : TestCase ("Test that the link cache returns the gain of the loss model, also after evictions and course changes")
+{
+}
+
+LoRaWANSpectrumChannelLinkCacheTestCase::~LoRaWANSpectrumChannelLinkCacheTestCase ()
+{
+}
+
+void
+LoRaWANSpectrumChannelLinkCacheTestCase::DoRun (void)
+{
+  Ptr<LogDistancePropagationLossModel> loss = CreateObject<LogDistancePropagationLossModel> ();
+  Ptr<LinkCacheTestChannel> uncached = CreateObject<LinkCacheTestChannel> ();
+  uncached->AddPropagationLossModel (loss);
+  // Four links do not fit in the cache, so every round evicts links
+  Ptr<LinkCacheTestChannel> cached = CreateObject<LinkCacheTestChannel> ();
+  cached->SetAttribute ("LinkCacheSize", UintegerValue (3));
+  cached->AddPropagationLossModel (loss);
+
+  Ptr<ConstantPositionMobilityModel> sender = CreateObject<ConstantPositionMobilityModel> ();
+  sender->SetPosition (Vector (0, 0, 0));
+  const double distances[4] = { 10, 100, 1000, 5000 };
+  Ptr<ConstantPositionMobilityModel> receivers[4];
+  for (uint32_t i = 0; i < 4; i++)
+    {
+      receivers[i] = CreateObject<ConstantPositionMobilityModel> ();
+      receivers[i]->SetPosition (Vector (distances[i], 0, 0));
+    }
+
+  for (uint32_t round = 0; round < 3; round++)
+    {
+      for (uint32_t i = 0; i < 4; i++)
+        {
+          double expected = uncached->GetPropagationGain (sender, receivers[i]);
+          double gain = cached->GetPropagationGain (sender, receivers[i]);
+          NS_TEST_ASSERT_MSG_EQ_TOL (gain, expected, 1e-9, "Cached gain differs at " << distances[i] << "m in round " << round);
+        }
+      // A course change invalidates the cached links of the receiver
+      receivers[round]->SetPosition (Vector (0, 2 * distances[round], 0));
+    }
+
+  // Links above LinkCacheMaxLoss are cached as out of range
+  Ptr<LinkCacheTestChannel> limited = CreateObject<LinkCacheTestChannel> ();
+  limited->SetAttribute ("LinkCacheSize", UintegerValue (10));
+  limited->SetAttribute ("LinkCacheMaxLoss", DoubleValue (120));
+  limited->AddPropagationLossModel (loss);
+  for (uint32_t round = 0; round < 2; round++)
+    {
+      double gain = limited->GetPropagationGain (sender, receivers[0]);
+      NS_TEST_ASSERT_MSG_EQ_TOL (gain, uncached->GetPropagationGain (sender, receivers[0]), 1e-9, "A link below the maximum loss should be cached with its gain");
+      gain = limited->GetPropagationGain (sender, receivers[3]);
+      NS_TEST_ASSERT_MSG_EQ (std::isinf (gain) && gain < 0, true, "A link above the maximum loss should be cached as out of range");
+    }
+
+  cached->Dispose ();
+  limited->Dispose ();
+  Simulator::Destroy ();
+}
+
+// ==============================================================================
+class LoRaWANSpectrumChannelTestSuite : public TestSuite
+{
+public:
+  LoRaWANSpectrumChannelTestSuite ();
+};
+
+LoRaWANSpectrumChannelTestSuite::LoRaWANSpectrumChannelTestSuite ()
+  : TestSuite ("lorawan-spectrum-channel", UNIT)
+{
+  AddTestCase (new LoRaWANSpectrumChannelDispatchTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANSpectrumChannelBatchTestCase, TestCase::QUICK);
+  AddTestCase (new LoRaWANSpectrumChannelLinkCacheTestCase, TestCase::QUICK);
+}
+
+static LoRaWANSpectrumChannelTestSuite lorawanSpectrumChannelTestSuite;